@@ -0,0 +1,125 @@
+/**
+ * Imaging Core Benchmark
+ * Pushes synthetic requests through ImagingCore in process, without gRPC, and
+ * reports throughput, latency and the mean time per pipeline stage. Needs the
+ * models the service loads (under /app/models).
+ *
+ * Usage: imaging_core_benchmark [requests=200] [threads=4] [rpc=analyze|dicom] [size=1024]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "imaging_core.h"
+#include "pipeline_stage.h"
+#include "synthetic_dicom.h"
+#include "synthetic_images.h"
+
+namespace {
+
+constexpr int kPayloads = 8;
+
+std::vector<std::string> buildPayloads(bool dicom, int size) {
+    std::vector<std::string> payloads;
+    for (int i = 0; i < kPayloads; ++i) {
+        if (dicom) {
+            synthetic::CtSeriesOptions ct;
+            ct.size = size;
+            ct.slices = kPayloads;
+            payloads.push_back(synthetic::ctSliceDicom(ct, i));
+            continue;
+        }
+        std::vector<uint16_t> pixels = synthetic::xrayImage(i + 1, size, size);
+        cv::Mat image(size, size, CV_16UC1, pixels.data());
+        std::vector<uchar> png;
+        cv::imencode(".png", image, png);
+        payloads.emplace_back(png.begin(), png.end());
+    }
+    return payloads;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int requests = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200;
+    const int threads = argc > 2 ? std::max(1, std::atoi(argv[2])) : 4;
+    const bool dicom = argc > 3 && std::string(argv[3]) == "dicom";
+    const int size = argc > 4 ? std::atoi(argv[4]) : 1024;
+
+    ImagingCore::initializeProcess();
+    ImagingCore core;
+    const std::vector<std::string> payloads = buildPayloads(dicom, size);
+
+    std::atomic<int> next{0};
+    std::atomic<int> failures{0};
+    std::mutex mutex;
+    std::vector<double> latencies;
+    std::map<PipelineStage, double> stage_ms;
+
+    auto worker = [&] {
+        for (int i = next++; i < requests; i = next++) {
+            const std::string& payload = payloads[i % payloads.size()];
+            StageRecorder recorder;
+            auto start = std::chrono::steady_clock::now();
+            try {
+                if (dicom) {
+                    ProcessDicomRequest request;
+                    request.patient_id = "BENCH";
+                    request.dicom_data = payload;
+                    core.processDicom(request);
+                } else {
+                    AnalyzeImageRequest request;
+                    request.patient_id = "BENCH";
+                    request.image_type = "xray";
+                    request.image_data = payload;
+                    core.analyzeImage(request);
+                }
+            } catch (const std::exception& e) {
+                if (failures++ == 0) {
+                    std::cerr << "request failed: " << e.what() << std::endl;
+                }
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            latencies.push_back(ms);
+            for (const auto& stage : recorder.stages()) {
+                stage_ms[stage.stage] += stage.wall_time_ms;
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << (dicom ? "ProcessDicom" : "AnalyzeImage") << " " << size << "x" << size << ", "
+              << requests << " requests on " << threads << " threads, " << failures.load() << " failed\n"
+              << "throughput: " << requests / elapsed_s << " req/s\n"
+              << "latency: p50 " << latencies[latencies.size() / 2] << " ms, p99 "
+              << latencies[static_cast<size_t>(0.99 * (latencies.size() - 1))] << " ms\n"
+              << "mean per stage:";
+    for (const auto& [stage, ms] : stage_ms) {
+        std::cout << " " << pipelineStageName(stage) << " " << ms / requests << " ms";
+    }
+    std::cout << std::endl;
+    return failures.load() > 0 ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * Embedding Index Benchmark
+ * Builds an embedding index from clustered synthetic embeddings, then times
+ * queries from several threads and checks recall@k against exact search.
+ * The index file is reopened before querying, so queries run on the mapped
+ * file as the service would after a restart.
+ *
+ * Usage: imaging_index_benchmark [entries=1000000] [dim=512] [queries=2000]
+ *                                [threads=4] [ef=64] [path=/tmp/imaging_index_bench.bin]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "embedding_index.h"
+#include "image_kernels.h"
+
+namespace {
+
+constexpr int kClusters = 1000;
+constexpr size_t kRecallK = 10;
+
+// Unit vectors scattered around random cluster centres, closer to real
+// embeddings than uniform noise, where every neighbour is equally far
+class EmbeddingSource {
+public:
+    EmbeddingSource(size_t dim, uint32_t seed) : dim_(dim), rng_(seed), centres_(kClusters * dim) {
+        for (float& v : centres_) {
+            v = gauss_(rng_);
+        }
+    }
+
+    void next(float* out) {
+        const size_t cluster = rng_() % kClusters;
+        double norm = 0.0;
+        for (size_t d = 0; d < dim_; ++d) {
+            out[d] = centres_[cluster * dim_ + d] + 0.6f * gauss_(rng_);
+            norm += static_cast<double>(out[d]) * out[d];
+        }
+        const float scale = static_cast<float>(1.0 / std::sqrt(norm));
+        for (size_t d = 0; d < dim_; ++d) {
+            out[d] *= scale;
+        }
+    }
+
+private:
+    size_t dim_;
+    std::mt19937 rng_;
+    std::normal_distribution<float> gauss_;
+    std::vector<float> centres_;
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t entries = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const size_t dim = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 512;
+    const int queries = argc > 3 ? std::max(1, std::atoi(argv[3])) : 2000;
+    const int threads = argc > 4 ? std::max(1, std::atoi(argv[4])) : 4;
+    const size_t ef = argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 64;
+    const std::string path = argc > 6 ? argv[6] : "/tmp/imaging_index_bench.bin";
+
+    std::remove(path.c_str());
+    EmbeddingIndexConfig config = EmbeddingIndexConfig::fromEnvironment();
+    std::vector<float> embeddings(entries * dim);
+    EmbeddingSource source(dim, 7);
+    for (size_t i = 0; i < entries; ++i) {
+        source.next(&embeddings[i * dim]);
+    }
+
+    {
+        EmbeddingIndex index(path, dim, config);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < entries; ++i) {
+            index.insert(ContentHash{0, i}, &embeddings[i * dim]);
+            if ((i + 1) % 100000 == 0) {
+                std::cout << "  " << (i + 1) << " inserted" << std::endl;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Build: " << entries << " x " << dim << " in " << seconds << "s ("
+                  << entries / seconds << " inserts/s)" << std::endl;
+    }
+
+    EmbeddingIndex index(path, dim, config);
+    std::vector<float> query_vectors(static_cast<size_t>(queries) * dim);
+    for (int q = 0; q < queries; ++q) {
+        source.next(&query_vectors[q * dim]);
+    }
+
+    std::vector<std::vector<IndexMatch>> results(queries);
+    std::vector<double> latencies;
+    std::mutex mutex;
+    std::atomic<int> next{0};
+    auto worker = [&] {
+        std::vector<double> local;
+        for (int q; (q = next.fetch_add(1)) < queries;) {
+            auto start = std::chrono::steady_clock::now();
+            results[q] = index.search(&query_vectors[q * dim], kRecallK, ef);
+            local.push_back(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies.insert(latencies.end(), local.begin(), local.end());
+    };
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    // Exact neighbours for a sample of the queries
+    const int checked = std::min(queries, 200);
+    std::vector<const float*> rows(entries);
+    for (size_t i = 0; i < entries; ++i) {
+        rows[i] = &embeddings[i * dim];
+    }
+    std::vector<float> scores(entries);
+    std::vector<uint32_t> order(entries);
+    size_t found = 0;
+    for (int q = 0; q < checked; ++q) {
+        kernels::dotProducts(&query_vectors[q * dim], rows.data(), entries, dim, scores.data());
+        std::iota(order.begin(), order.end(), 0);
+        const size_t k = std::min(kRecallK, entries);
+        std::partial_sort(order.begin(), order.begin() + k, order.end(),
+                          [&](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+        for (const auto& match : results[q]) {
+            found += std::count(order.begin(), order.begin() + k, match.hash.low);
+        }
+    }
+
+    std::cout << "Query (" << threads << " threads, ef=" << ef << "): p50=" << percentile(latencies, 0.5)
+              << "ms p99=" << percentile(latencies, 0.99) << "ms max="
+              << *std::max_element(latencies.begin(), latencies.end()) << "ms" << std::endl;
+    std::cout << "Recall@" << kRecallK << ": "
+              << static_cast<double>(found) / (checked * std::min(kRecallK, entries)) << std::endl;
+    return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * Single-Request Latency Benchmark
+ * Times the per-pixel preprocessing kernels on one large synthetic CT slice,
+ * serial versus the OpenMP pipeline budget.
+ *
+ * Usage: imaging_latency_benchmark [size=4096] [iterations=20]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "image_kernels.h"
+#include "parallel.h"
+#include "synthetic_images.h"
+
+namespace {
+
+struct StageTimes {
+    double window_level_ms = 0.0;
+    double resize_ms = 0.0;
+    double normalize_ms = 0.0;
+
+    double total() const { return window_level_ms + resize_ms + normalize_ms; }
+};
+
+template <typename Fn>
+double timeMs(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+StageTimes runPipeline(const std::vector<uint16_t>& pixels, int size, int iterations) {
+    const int model_size = 1024;
+    std::vector<float> windowed(pixels.size());
+    std::vector<float> resized(static_cast<size_t>(model_size) * model_size);
+    std::vector<float> tensor(resized.size());
+    WindowLevelParams window{40.0, 400.0, 1.0, -1024.0};
+
+    StageTimes best;
+    best.window_level_ms = best.resize_ms = best.normalize_ms = 1e30;
+    for (int i = 0; i < iterations; ++i) {
+        best.window_level_ms = std::min(best.window_level_ms, timeMs([&] {
+            kernels::windowLevel(pixels.data(), windowed.data(), pixels.size(), window);
+        }));
+        best.resize_ms = std::min(best.resize_ms, timeMs([&] {
+            kernels::resizeBilinear(windowed.data(), size, size, resized.data(), model_size, model_size);
+        }));
+        best.normalize_ms = std::min(best.normalize_ms, timeMs([&] {
+            kernels::normalize(resized.data(), tensor.data(), tensor.size(), 0.485f, 0.229f);
+        }));
+    }
+    return best;
+}
+
+void report(const char* label, const StageTimes& times) {
+    std::cout << label
+              << "  window/level " << times.window_level_ms << " ms"
+              << "  resize " << times.resize_ms << " ms"
+              << "  normalize " << times.normalize_ms << " ms"
+              << "  total " << times.total() << " ms" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int size = argc > 1 ? std::atoi(argv[1]) : 4096;
+    const int iterations = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    parallel::configure();
+    const int threads = parallel::maxThreads();
+
+    std::vector<int16_t> hu = synthetic::ctSlice(42, size, 0, 1);
+    std::vector<uint16_t> pixels(hu.size());
+    for (size_t i = 0; i < hu.size(); ++i) {
+        pixels[i] = static_cast<uint16_t>(hu[i] + 1024);
+    }
+
+    const char* isa = cpuIsaName(kernels::activeIsa());
+    std::cout << "Image " << size << "x" << size << " (16-bit), kernels: "
+              << isa << ", best of " << iterations << std::endl;
+
+    parallel::setMaxThreads(1);
+    StageTimes serial = runPipeline(pixels, size, iterations);
+    report("serial     ", serial);
+
+    parallel::setMaxThreads(threads);
+    StageTimes parallel_times = runPipeline(pixels, size, iterations);
+    report("parallel   ", parallel_times);
+
+    std::cout << "speedup: " << serial.total() / parallel_times.total() << "x with "
+              << threads << " threads" << std::endl;
+    return 0;
+}
@@ -0,0 +1,576 @@
+/**
+ * Performance Regression Gate
+ * Runs the stage micro-benchmarks and a short end-to-end load on synthetic
+ * CT slices (synthetic_images.h), then compares each metric with the
+ * checked-in baseline and exits non-zero when one regressed beyond its
+ * tolerance. Inference uses the tiny in-code model (tiny_model.h), so the
+ * gate needs no model files or network.
+ *
+ * The baseline holds one profile per kernel ISA ("avx2"), since that is what
+ * the single-threaded micro-benchmarks depend on. The end-to-end load uses
+ * the full OpenMP budget with several concurrent requests, so each profile
+ * also records the thread count it was measured with, and the e2e metrics
+ * are only gated on a host with the same count. Without a profile for this
+ * ISA the gate warns, compares against the nearest ISA for information and
+ * passes, since numbers from another class of machine say nothing about a
+ * regression. --write-baseline records or replaces only this ISA's profile.
+ *
+ * Micro-benchmarks report the median of their repetitions, which keeps them
+ * stable on shared CI runners.
+ *
+ * Usage: imaging_perf_gate [--baseline FILE] [--tolerance FRACTION]
+ *                          [--write-baseline FILE] [--quick]
+ *
+ * Exit status: 0 within tolerance or no profile for this ISA, 1 regression,
+ * 2 usage or runtime error.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "cpu_features.h"
+#include "image_kernels.h"
+#include "parallel.h"
+#include "pipeline_stage.h"
+#include "synthetic_images.h"
+#include "tiny_model.h"
+
+namespace {
+
+enum class Better { Lower, Higher };
+
+struct Metric {
+    std::string name;
+    double value;
+    Better better;
+};
+
+using MetricValues = std::map<std::string, double>;
+
+struct Baseline {
+    double tolerance = 0.25;
+    MetricValues tolerances;                       // per-metric overrides
+    std::map<std::string, MetricValues> profiles;  // ISA name -> metrics and "threads"
+};
+
+constexpr const char* kThreadsKey = "threads";
+
+// Minimal reader for the baseline file: nested objects of numbers plus a few
+// scalar fields; unknown keys are skipped
+class BaselineReader {
+public:
+    explicit BaselineReader(std::string text) : text_(std::move(text)) {}
+
+    Baseline read() {
+        Baseline baseline;
+        expect('{');
+        if (!consume('}')) {
+            do {
+                std::string key = readString();
+                expect(':');
+                if (key == "profiles") {
+                    readProfiles(baseline.profiles);
+                } else if (key == "tolerances") {
+                    readNumbers(baseline.tolerances);
+                } else if (key == "tolerance") {
+                    baseline.tolerance = readNumber();
+                } else {
+                    skipValue();
+                }
+            } while (consume(','));
+            expect('}');
+        }
+        return baseline;
+    }
+
+private:
+    void readProfiles(std::map<std::string, MetricValues>& out) {
+        expect('{');
+        if (consume('}')) {
+            return;
+        }
+        do {
+            std::string reference = readString();
+            expect(':');
+            readNumbers(out[reference]);
+        } while (consume(','));
+        expect('}');
+    }
+
+    void readNumbers(MetricValues& out) {
+        expect('{');
+        if (consume('}')) {
+            return;
+        }
+        do {
+            std::string key = readString();
+            expect(':');
+            out[key] = readNumber();
+        } while (consume(','));
+        expect('}');
+    }
+
+    void skipValue() {
+        skipSpace();
+        if (peek() == '"') {
+            readString();
+        } else if (peek() == '{') {
+            MetricValues ignored;
+            readNumbers(ignored);
+        } else {
+            readNumber();
+        }
+    }
+
+    std::string readString() {
+        expect('"');
+        std::string value;
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            if (text_[pos_] == '\\' && pos_ + 1 < text_.size()) {
+                ++pos_;
+            }
+            value += text_[pos_++];
+        }
+        expect('"');
+        return value;
+    }
+
+    double readNumber() {
+        skipSpace();
+        const char* start = text_.c_str() + pos_;
+        char* end = nullptr;
+        double value = std::strtod(start, &end);
+        if (end == start) {
+            fail("number expected");
+        }
+        pos_ += static_cast<size_t>(end - start);
+        return value;
+    }
+
+    void skipSpace() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            ++pos_;
+        }
+    }
+
+    char peek() {
+        skipSpace();
+        return pos_ < text_.size() ? text_[pos_] : '\0';
+    }
+
+    bool consume(char c) {
+        if (peek() == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c) {
+        if (!consume(c)) {
+            fail(std::string("'") + c + "' expected");
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& what) {
+        throw std::runtime_error("baseline: " + what + " at offset " + std::to_string(pos_));
+    }
+
+    std::string text_;
+    size_t pos_ = 0;
+};
+
+Baseline loadBaseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("cannot open baseline " + path);
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    return BaselineReader(buffer.str()).read();
+}
+
+void writeNumbers(std::ostream& out, const MetricValues& values, const std::string& indent) {
+    for (auto it = values.begin(); it != values.end(); ++it) {
+        out << indent << "\"" << it->first << "\": " << it->second
+            << (std::next(it) != values.end() ? ",\n" : "\n");
+    }
+}
+
+// Replaces the profile of `reference` in the baseline at `path`, keeping its
+// tolerances and the profiles of other ISAs
+void writeBaseline(const std::string& path, const std::string& reference, int threads,
+                   const std::vector<Metric>& metrics, double tolerance) {
+    Baseline baseline;
+    if (std::ifstream(path)) {
+        baseline = loadBaseline(path);
+    }
+    if (tolerance >= 0.0) {
+        baseline.tolerance = tolerance;
+    }
+    MetricValues& profile = baseline.profiles[reference];
+    profile.clear();
+    profile[kThreadsKey] = threads;
+    for (const auto& metric : metrics) {
+        profile[metric.name] = metric.value;
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("cannot write baseline " + path);
+    }
+    out << std::setprecision(6);
+    out << "{\n  \"tolerance\": " << baseline.tolerance << ",\n";
+    if (!baseline.tolerances.empty()) {
+        out << "  \"tolerances\": {\n";
+        writeNumbers(out, baseline.tolerances, "    ");
+        out << "  },\n";
+    }
+    out << "  \"profiles\": {\n";
+    for (auto it = baseline.profiles.begin(); it != baseline.profiles.end(); ++it) {
+        out << "    \"" << it->first << "\": {\n";
+        writeNumbers(out, it->second, "      ");
+        out << "    }" << (std::next(it) != baseline.profiles.end() ? ",\n" : "\n");
+    }
+    out << "  }\n}\n";
+}
+
+template <typename Fn>
+double medianMs(int repetitions, Fn&& fn) {
+    std::vector<double> samples;
+    samples.reserve(repetitions);
+    fn();  // warm-up
+    for (int i = 0; i < repetitions; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Stored pixels of a synthetic CT slice (12-bit, rescale intercept -1024)
+std::vector<uint16_t> syntheticImage(int size, uint64_t seed) {
+    std::vector<int16_t> hu = synthetic::ctSlice(seed, size, 0, 1);
+    std::vector<uint16_t> pixels(hu.size());
+    for (size_t i = 0; i < hu.size(); ++i) {
+        pixels[i] = static_cast<uint16_t>(hu[i] + 1024);
+    }
+    return pixels;
+}
+
+std::vector<DetectionBox> syntheticBoxes(int count, uint64_t seed) {
+    synthetic::Rng rng(seed);
+    std::vector<DetectionBox> boxes(count);
+    for (auto& b : boxes) {
+        b.x1 = static_cast<float>(rng.uniform() * 480.0);
+        b.y1 = static_cast<float>(rng.uniform() * 480.0);
+        b.x2 = b.x1 + static_cast<float>(8.0 + rng.uniform() * 56.0);
+        b.y2 = b.y1 + static_cast<float>(8.0 + rng.uniform() * 56.0);
+        b.score = static_cast<float>(rng.uniform());
+    }
+    return boxes;
+}
+
+const WindowLevelParams kSoftTissue{40.0, 400.0, 1.0, -1024.0};
+
+void microBenchmarks(bool quick, std::vector<Metric>& metrics) {
+    const int size = 2048;
+    const int model_size = 512;
+    const int repetitions = quick ? 5 : 21;
+
+    const int threads = parallel::maxThreads();
+    parallel::setMaxThreads(1);
+
+    auto pixels = syntheticImage(size, 1);
+    std::vector<float> windowed(pixels.size());
+    std::vector<float> resized(static_cast<size_t>(model_size) * model_size);
+    std::vector<float> tensor(resized.size());
+    auto boxes = syntheticBoxes(2000, 2);
+
+    metrics.push_back({"kernel.window_level_ms", medianMs(repetitions, [&] {
+        kernels::windowLevel(pixels.data(), windowed.data(), pixels.size(), kSoftTissue);
+    }), Better::Lower});
+    metrics.push_back({"kernel.resize_ms", medianMs(repetitions, [&] {
+        kernels::resizeBilinear(windowed.data(), size, size, resized.data(), model_size, model_size);
+    }), Better::Lower});
+    metrics.push_back({"kernel.normalize_ms", medianMs(repetitions, [&] {
+        kernels::normalize(resized.data(), tensor.data(), tensor.size(), 0.485f, 0.229f);
+    }), Better::Lower});
+    // The three above fused, as the services run them
+    const PixelPlane plane{pixels.data(), PixelDepth::U16, size, size, static_cast<size_t>(size)};
+    TensorMapping mapping;
+    mapping.window = &kSoftTissue;
+    mapping.mean = 0.485f;
+    mapping.stddev = 0.229f;
+    metrics.push_back({"kernel.resample_tensor_ms", medianMs(repetitions, [&] {
+        kernels::resampleToTensor(plane, mapping, tensor.data(), model_size, model_size);
+    }), Better::Lower});
+    metrics.push_back({"kernel.nms_ms", medianMs(repetitions, [&] {
+        kernels::nonMaxSuppression(boxes, 0.5f);
+    }), Better::Lower});
+
+    // Stage bookkeeping of one request (recorder plus scopes, tracing off)
+    const int requests = 10000;
+    double ms = medianMs(repetitions, [&] {
+        for (int i = 0; i < requests; ++i) {
+            StageRecorder recorder;
+            StageScope analysis(PipelineStage::Analysis);
+            { StageScope stage(PipelineStage::Preprocess); }
+            { StageScope stage(PipelineStage::Inference); }
+            { StageScope stage(PipelineStage::Postprocess); }
+        }
+    });
+    metrics.push_back({"stage.overhead_ns", ms * 1e6 / requests, Better::Lower});
+
+    parallel::setMaxThreads(threads);
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// Decode-free analysis path: fused window/level, resize and normalize,
+// inference on the tiny model, NMS over candidates weighted by the model
+// scores
+void endToEnd(bool quick, std::vector<Metric>& metrics) {
+    const int size = 1024;
+    const int model_size = 256;
+    const int workers = 4;
+    const auto duration = std::chrono::milliseconds(quick ? 500 : 2000);
+
+    Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "perf_gate");
+    Ort::SessionOptions options;
+    options.SetIntraOpNumThreads(1);
+    options.SetInterOpNumThreads(1);
+    options.SetExecutionMode(ORT_SEQUENTIAL);
+    const std::string model = bench::tinyModelBytes();
+    Ort::Session session(env, model.data(), model.size(), options);
+    auto memory = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+    const auto pixels = syntheticImage(size, 3);
+    const auto candidates = syntheticBoxes(500, 4);
+
+    std::mutex mutex;
+    std::vector<double> latencies;
+    std::atomic<bool> stop{false};
+    std::atomic<int> failures{0};
+
+    const PixelPlane plane{pixels.data(), PixelDepth::U16, size, size, static_cast<size_t>(size)};
+    TensorMapping mapping;
+    mapping.window = &kSoftTissue;
+    mapping.mean = 0.485f;
+    mapping.stddev = 0.229f;
+
+    auto worker = [&] {
+        std::vector<float> tensor(static_cast<size_t>(model_size) * model_size);
+        std::vector<DetectionBox> boxes = candidates;
+        const int64_t shape[4] = {1, 1, model_size, model_size};
+        const char* inputs[] = {bench::kTinyModelInput};
+        const char* outputs[] = {bench::kTinyModelOutput};
+        std::vector<double> local;
+
+        while (!stop.load(std::memory_order_relaxed)) {
+            auto start = std::chrono::steady_clock::now();
+            try {
+                kernels::resampleToTensor(plane, mapping, tensor.data(), model_size, model_size);
+
+                Ort::Value input = Ort::Value::CreateTensor<float>(memory, tensor.data(), tensor.size(), shape, 4);
+                auto result = session.Run(Ort::RunOptions{}, inputs, &input, 1, outputs, 1);
+                const float* scores = result[0].GetTensorData<float>();
+
+                for (size_t i = 0; i < boxes.size(); ++i) {
+                    boxes[i].score = candidates[i].score * scores[i % bench::kTinyModelOutputs];
+                }
+                kernels::nonMaxSuppression(boxes, 0.5f);
+            } catch (const std::exception& e) {
+                if (failures.fetch_add(1) == 0) {
+                    std::cerr << "end-to-end request failed: " << e.what() << std::endl;
+                }
+                continue;
+            }
+            local.push_back(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count());
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies.insert(latencies.end(), local.begin(), local.end());
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; ++i) {
+        threads.emplace_back(worker);
+    }
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto& t : threads) {
+        t.join();
+    }
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (failures.load() > 0 || latencies.empty()) {
+        throw std::runtime_error("end-to-end load failed (" + std::to_string(failures.load()) + " errors)");
+    }
+    metrics.push_back({"e2e.latency_p50_ms", percentile(latencies, 0.50), Better::Lower});
+    metrics.push_back({"e2e.latency_p99_ms", percentile(latencies, 0.99), Better::Lower});
+    metrics.push_back({"e2e.throughput_rps", latencies.size() / elapsed_s, Better::Higher});
+}
+
+// The profile for `isa`, or else the one nearest to it (a lower level first
+// on a tie); null when the baseline has none
+const MetricValues* nearestProfile(const Baseline& baseline, CpuIsa isa, std::string& name) {
+    const MetricValues* nearest = nullptr;
+    int best_distance = 0;
+    for (int level = static_cast<int>(CpuIsa::Baseline); level <= static_cast<int>(CpuIsa::AVX512); ++level) {
+        auto it = baseline.profiles.find(cpuIsaName(static_cast<CpuIsa>(level)));
+        const int distance = std::abs(level - static_cast<int>(isa));
+        if (it != baseline.profiles.end() && (!nearest || distance < best_distance)) {
+            nearest = &it->second;
+            best_distance = distance;
+            name = it->first;
+        }
+    }
+    return nearest;
+}
+
+// Prints one line per metric; returns the number of regressions. End-to-end
+// metrics measured with another thread count are shown but not gated.
+int compare(const std::vector<Metric>& metrics, const MetricValues& profile, int threads,
+            const Baseline& baseline, double tolerance_override) {
+    auto recorded = profile.find(kThreadsKey);
+    const bool same_threads = recorded != profile.end() && static_cast<int>(recorded->second) == threads;
+    int regressions = 0;
+    std::cout << std::left << std::setw(26) << "metric" << std::right
+              << std::setw(12) << "baseline" << std::setw(12) << "current"
+              << std::setw(10) << "change" << "  status" << std::endl;
+    for (const auto& metric : metrics) {
+        std::cout << std::left << std::setw(26) << metric.name << std::right << std::fixed
+                  << std::setprecision(3);
+        auto it = profile.find(metric.name);
+        if (it == profile.end() || it->second <= 0.0) {
+            std::cout << std::setw(12) << "-" << std::setw(12) << metric.value
+                      << std::setw(10) << "-" << "  no baseline" << std::endl;
+            continue;
+        }
+        double tolerance = tolerance_override >= 0.0 ? tolerance_override : baseline.tolerance;
+        auto per_metric = baseline.tolerances.find(metric.name);
+        if (tolerance_override < 0.0 && per_metric != baseline.tolerances.end()) {
+            tolerance = per_metric->second;
+        }
+
+        double change = (metric.value - it->second) / it->second;
+        const bool gated = same_threads || metric.name.rfind("e2e.", 0) != 0;
+        bool regressed = gated && (metric.better == Better::Lower ? change > tolerance : change < -tolerance);
+        regressions += regressed ? 1 : 0;
+
+        std::ostringstream pct;
+        pct << std::showpos << std::fixed << std::setprecision(1) << change * 100.0 << "%";
+        std::cout << std::setw(12) << it->second << std::setw(12) << metric.value
+                  << std::setw(10) << pct.str() << "  "
+                  << (regressed ? "REGRESSED" : gated ? "ok" : "not gated (threads differ)") << std::endl;
+    }
+    return regressions;
+}
+
+void usage() {
+    std::cerr << "usage: imaging_perf_gate [--baseline FILE] [--tolerance FRACTION] "
+                 "[--write-baseline FILE] [--quick]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string baseline_path;
+    std::string write_path;
+    double tolerance_override = -1.0;
+    bool quick = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg == "--write-baseline" && i + 1 < argc) {
+            write_path = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance_override = std::atof(argv[++i]);
+        } else if (arg == "--quick") {
+            quick = true;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (baseline_path.empty() && write_path.empty()) {
+        usage();
+        return 2;
+    }
+
+    try {
+        parallel::configure();
+        const CpuIsa isa = kernels::activeIsa();
+        const std::string reference = cpuIsaName(isa);
+        const int threads = parallel::maxThreads();
+        std::cout << "kernels: " << reference << ", " << threads << " threads" << (quick ? ", quick run" : "")
+                  << std::endl;
+
+        std::vector<Metric> metrics;
+        microBenchmarks(quick, metrics);
+        endToEnd(quick, metrics);
+
+        if (!write_path.empty()) {
+            writeBaseline(write_path, reference, threads, metrics, tolerance_override);
+            std::cout << "wrote baseline " << write_path << std::endl;
+        }
+        if (baseline_path.empty()) {
+            return 0;
+        }
+
+        const Baseline baseline = loadBaseline(baseline_path);
+        std::string nearest;
+        const MetricValues* profile = nearestProfile(baseline, isa, nearest);
+        if (nearest != reference) {
+            std::cerr << "warning: " << baseline_path << " has no profile for " << reference
+                      << "; record one with --write-baseline on this host" << std::endl;
+            if (profile) {
+                std::cout << "for information only, against the " << nearest << " profile:" << std::endl;
+                compare(metrics, *profile, threads, baseline, tolerance_override);
+            }
+            std::cout << "performance not gated" << std::endl;
+            return 0;
+        }
+        int regressions = compare(metrics, *profile, threads, baseline, tolerance_override);
+        if (regressions > 0) {
+            std::cout << regressions << " metric(s) regressed beyond tolerance" << std::endl;
+            return 1;
+        }
+        std::cout << "performance within tolerance" << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "perf gate failed: " << e.what() << std::endl;
+        return 2;
+    }
+}
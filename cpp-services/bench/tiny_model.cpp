@@ -0,0 +1,172 @@
+/**
+ * Tiny Benchmark Model Implementation
+ * Writes the protobuf wire format directly; field numbers follow onnx.proto.
+ */
+
+#include "tiny_model.h"
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+namespace bench {
+
+namespace {
+
+enum WireType { Varint = 0, LengthDelimited = 2 };
+
+class ProtoWriter {
+public:
+    ProtoWriter& varint(int field, uint64_t value) {
+        tag(field, Varint);
+        raw(value);
+        return *this;
+    }
+
+    ProtoWriter& bytes(int field, const std::string& value) {
+        tag(field, LengthDelimited);
+        raw(value.size());
+        out_ += value;
+        return *this;
+    }
+
+    ProtoWriter& message(int field, const ProtoWriter& value) {
+        return bytes(field, value.out_);
+    }
+
+    const std::string& str() const { return out_; }
+
+private:
+    void tag(int field, WireType type) {
+        raw((static_cast<uint64_t>(field) << 3) | type);
+    }
+
+    void raw(uint64_t value) {
+        while (value >= 0x80) {
+            out_ += static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out_ += static_cast<char>(value);
+    }
+
+    std::string out_;
+};
+
+// onnx.proto field numbers
+namespace model { constexpr int kIrVersion = 1, kGraph = 7, kOpsetImport = 8, kProducerName = 2; }
+namespace opset { constexpr int kVersion = 2; }
+namespace graph { constexpr int kNode = 1, kName = 2, kInitializer = 5, kInput = 11, kOutput = 12; }
+namespace node { constexpr int kInput = 1, kOutput = 2, kName = 3, kOpType = 4, kAttribute = 5; }
+namespace attribute { constexpr int kName = 1, kInts = 8, kType = 20; constexpr uint64_t kTypeInts = 7; }
+namespace tensor { constexpr int kDims = 1, kDataType = 2, kName = 8, kRawData = 9; constexpr uint64_t kFloat = 1; }
+namespace value_info { constexpr int kName = 1, kType = 2; }
+namespace type_proto { constexpr int kTensorType = 1, kElemType = 1, kShape = 2; }
+namespace shape { constexpr int kDim = 1, kDimValue = 1, kDimParam = 2; }
+
+ProtoWriter intsAttribute(const char* name, std::initializer_list<int64_t> values) {
+    ProtoWriter attr;
+    attr.bytes(attribute::kName, name);
+    for (int64_t v : values) {
+        attr.varint(attribute::kInts, static_cast<uint64_t>(v));
+    }
+    attr.varint(attribute::kType, attribute::kTypeInts);
+    return attr;
+}
+
+ProtoWriter makeNode(const char* op_type, std::initializer_list<const char*> inputs, const char* output) {
+    ProtoWriter n;
+    for (const char* input : inputs) {
+        n.bytes(node::kInput, input);
+    }
+    n.bytes(node::kOutput, output);
+    n.bytes(node::kName, std::string(op_type) + "_" + output);
+    n.bytes(node::kOpType, op_type);
+    return n;
+}
+
+ProtoWriter floatTensor(const char* name, std::initializer_list<int64_t> dims, const std::vector<float>& values) {
+    ProtoWriter t;
+    for (int64_t d : dims) {
+        t.varint(tensor::kDims, static_cast<uint64_t>(d));
+    }
+    t.varint(tensor::kDataType, tensor::kFloat);
+    t.bytes(tensor::kName, name);
+    // raw_data is little-endian, as is every platform the service targets
+    std::string raw(values.size() * sizeof(float), '\0');
+    std::memcpy(&raw[0], values.data(), raw.size());
+    t.bytes(tensor::kRawData, raw);
+    return t;
+}
+
+// Each dimension is either a fixed size or a symbolic name
+struct Dim {
+    int64_t value;
+    const char* param;
+};
+
+ProtoWriter floatValueInfo(const char* name, std::initializer_list<Dim> dims) {
+    ProtoWriter tensor_shape;
+    for (const Dim& d : dims) {
+        ProtoWriter dim;
+        if (d.param) {
+            dim.bytes(shape::kDimParam, d.param);
+        } else {
+            dim.varint(shape::kDimValue, static_cast<uint64_t>(d.value));
+        }
+        tensor_shape.message(shape::kDim, dim);
+    }
+    ProtoWriter tensor_type;
+    tensor_type.varint(type_proto::kElemType, tensor::kFloat);
+    tensor_type.message(type_proto::kShape, tensor_shape);
+    ProtoWriter type;
+    type.message(type_proto::kTensorType, tensor_type);
+
+    ProtoWriter info;
+    info.bytes(value_info::kName, name);
+    info.message(value_info::kType, type);
+    return info;
+}
+
+} // namespace
+
+std::string tinyModelBytes() {
+    // Four fixed 3x3 filters: smoothing, horizontal and vertical edges, and a
+    // Laplacian, roughly what a first detector layer learns
+    const std::vector<float> weights = {
+         1 / 9.f,  1 / 9.f,  1 / 9.f,   1 / 9.f,  1 / 9.f,  1 / 9.f,   1 / 9.f,  1 / 9.f,  1 / 9.f,
+        -1.f,     -2.f,     -1.f,       0.f,      0.f,      0.f,       1.f,      2.f,      1.f,
+        -1.f,      0.f,      1.f,      -2.f,      0.f,      2.f,      -1.f,      0.f,      1.f,
+         0.f,      1.f,      0.f,       1.f,     -4.f,      1.f,       0.f,      1.f,      0.f,
+    };
+    const std::vector<float> bias = {0.0f, 0.1f, 0.1f, 0.05f};
+
+    ProtoWriter conv = makeNode("Conv", {kTinyModelInput, "conv_w", "conv_b"}, "conv");
+    conv.message(node::kAttribute, intsAttribute("kernel_shape", {3, 3}));
+    conv.message(node::kAttribute, intsAttribute("pads", {1, 1, 1, 1}));
+
+    ProtoWriter g;
+    g.message(graph::kNode, conv);
+    g.message(graph::kNode, makeNode("Relu", {"conv"}, "relu"));
+    g.message(graph::kNode, makeNode("GlobalAveragePool", {"relu"}, "pooled"));
+    g.message(graph::kNode, makeNode("Flatten", {"pooled"}, kTinyModelOutput));
+    g.bytes(graph::kName, "tiny_detector");
+    g.message(graph::kInitializer, floatTensor("conv_w", {kTinyModelOutputs, 1, 3, 3}, weights));
+    g.message(graph::kInitializer, floatTensor("conv_b", {kTinyModelOutputs}, bias));
+    g.message(graph::kInput, floatValueInfo(kTinyModelInput,
+                                            {{0, "N"}, {1, nullptr}, {0, "H"}, {0, "W"}}));
+    g.message(graph::kOutput, floatValueInfo(kTinyModelOutput,
+                                             {{0, "N"}, {kTinyModelOutputs, nullptr}}));
+
+    ProtoWriter opset_import;
+    opset_import.varint(opset::kVersion, 13);
+
+    ProtoWriter m;
+    m.varint(model::kIrVersion, 8);
+    m.bytes(model::kProducerName, "medical_imaging_bench");
+    m.message(model::kGraph, g);
+    m.message(model::kOpsetImport, opset_import);
+    return m.str();
+}
+
+} // namespace bench
@@ -0,0 +1,26 @@
+/**
+ * Tiny Benchmark Model
+ * A serialized ONNX model small enough to build in code, so the perf gate and
+ * benchmarks exercise ONNX Runtime without model files or network access.
+ *
+ * Graph: image[N,1,H,W] -> Conv(4 filters, 3x3, same padding) -> Relu
+ *        -> GlobalAveragePool -> Flatten -> scores[N,4]
+ * Batch, height and width are symbolic, so any input size runs. Weights are
+ * fixed, making outputs reproducible across runs.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace bench {
+
+constexpr const char* kTinyModelInput = "image";
+constexpr const char* kTinyModelOutput = "scores";
+constexpr int kTinyModelOutputs = 4;
+
+// ONNX ModelProto bytes (IR version 8, opset 13), for Ort::Session's
+// in-memory constructor
+std::string tinyModelBytes();
+
+} // namespace bench
@@ -0,0 +1,39 @@
+/**
+ * DICOM De-identifier Fuzzer
+ * Plans and renders arbitrary bytes with the basic profile. Malformed input
+ * must end in std::invalid_argument; anything else (crash, other exception,
+ * an output that disagrees with the plan) is a finding.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "dicom_deidentifier.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static const DicomDeidentifier deidentifier(*DeidentificationProfile::byName("basic"), "fuzz-salt");
+    const std::string_view dicom(reinterpret_cast<const char*>(data), size);
+
+    DeidentificationPlan plan;
+    try {
+        plan = deidentifier.plan(dicom);
+    } catch (const std::invalid_argument&) {
+        return 0;
+    }
+
+    size_t end = 0;
+    for (const auto& edit : plan.edits) {
+        if (edit.offset < end || edit.offset + edit.length > size) {
+            std::abort();
+        }
+        end = edit.offset + edit.length;
+    }
+    if (DicomDeidentifier::render(dicom, plan).size() != plan.output_bytes) {
+        std::abort();
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+/**
+ * Image Quality Fuzzer
+ * Feeds arbitrary bytes to the quality gate both as an encoded stream (end
+ * marker scan) and as an 8- or 16-bit plane whose width comes from the first
+ * input byte, so the histogram, Laplacian and tail-row passes see odd sizes.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "image_quality.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static const ImageQualityConfig config;
+    const std::string_view encoded(reinterpret_cast<const char*>(data), size);
+    if (size < 2) {
+        assessImageQuality(encoded, nullptr, config);
+        return 0;
+    }
+
+    const bool sixteen_bit = data[0] & 0x80;
+    const int width = (data[0] & 0x7f) + 1;
+    const size_t sample_bytes = sixteen_bit ? 2 : 1;
+    const int height = static_cast<int>((size - 1) / (width * sample_bytes));
+    if (height == 0) {
+        assessImageQuality(encoded, nullptr, config);
+        return 0;
+    }
+
+    // Copied so 16-bit samples are aligned
+    std::vector<uint16_t> pixels((static_cast<size_t>(width) * height * sample_bytes + 1) / 2);
+    std::memcpy(pixels.data(), data + 1, static_cast<size_t>(width) * height * sample_bytes);
+    const PixelPlane plane{pixels.data(), sixteen_bit ? PixelDepth::U16 : PixelDepth::U8, width, height,
+                           static_cast<size_t>(width)};
+    assessImageQuality(encoded, &plane, config);
+    return 0;
+}
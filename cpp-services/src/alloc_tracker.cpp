@@ -0,0 +1,238 @@
+/**
+ * Allocation Tracker Implementation
+ *
+ * Everything reachable from the hooks below must not allocate: no iostreams,
+ * no std::string, and thread-locals use the initial-exec TLS model so that
+ * first access never calls into the allocator.
+ */
+
+#include "alloc_tracker.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <malloc.h>
+#include <unistd.h>
+
+namespace alloc_tracker {
+
+namespace {
+
+constexpr int kStages = static_cast<int>(PipelineStage::Count);
+
+struct StageCounters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> bytes_allocated{0};
+    std::atomic<uint64_t> bytes_freed{0};
+};
+
+std::atomic<bool> g_enabled{false};
+StageCounters g_stages[kStages];
+std::atomic<int64_t> g_live{0};
+std::atomic<int64_t> g_peak{0};
+
+__attribute__((tls_model("initial-exec")))
+thread_local ThreadAllocations t_counters = {0, 0, 0, 0};
+
+} // namespace
+
+#ifdef IMAGING_ALLOC_HOOKS
+
+namespace {
+
+inline void recordAllocation(void* ptr) {
+    const size_t size = malloc_usable_size(ptr);
+    StageCounters& stage = g_stages[static_cast<int>(currentPipelineStage())];
+    stage.allocations.fetch_add(1, std::memory_order_relaxed);
+    stage.bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+
+    ThreadAllocations& thread = t_counters;
+    thread.allocations++;
+    thread.bytes_allocated += size;
+    thread.live_bytes += static_cast<int64_t>(size);
+    if (thread.live_bytes > thread.peak_live_bytes) {
+        thread.peak_live_bytes = thread.live_bytes;
+    }
+
+    int64_t live = g_live.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) + static_cast<int64_t>(size);
+    int64_t peak = g_peak.load(std::memory_order_relaxed);
+    while (live > peak && !g_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+inline void recordFree(void* ptr) {
+    const size_t size = malloc_usable_size(ptr);
+    StageCounters& stage = g_stages[static_cast<int>(currentPipelineStage())];
+    stage.frees.fetch_add(1, std::memory_order_relaxed);
+    stage.bytes_freed.fetch_add(size, std::memory_order_relaxed);
+
+    t_counters.live_bytes -= static_cast<int64_t>(size);
+    g_live.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+inline bool tracking() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+bool available() {
+    return true;
+}
+
+#else
+
+bool available() {
+    return false;
+}
+
+#endif
+
+bool enabled() {
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool enabled) {
+    g_enabled.store(enabled && available(), std::memory_order_relaxed);
+}
+
+void initializeFromEnvironment() {
+    const char* value = std::getenv("IMAGING_ALLOC_TRACKING");
+    setEnabled(value && (std::strcmp(value, "1") == 0 || std::strcmp(value, "on") == 0));
+}
+
+StageAllocations stageTotals(PipelineStage stage) {
+    const StageCounters& counters = g_stages[static_cast<int>(stage)];
+    return {counters.allocations.load(std::memory_order_relaxed),
+            counters.frees.load(std::memory_order_relaxed),
+            counters.bytes_allocated.load(std::memory_order_relaxed),
+            counters.bytes_freed.load(std::memory_order_relaxed)};
+}
+
+int64_t liveBytes() {
+    return g_live.load(std::memory_order_relaxed);
+}
+
+int64_t peakLiveBytes() {
+    return g_peak.load(std::memory_order_relaxed);
+}
+
+ThreadAllocations& threadCounters() {
+    return t_counters;
+}
+
+} // namespace alloc_tracker
+
+#ifdef IMAGING_ALLOC_HOOKS
+
+// glibc's own entry points, exported for exactly this kind of interposition
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+using alloc_tracker::recordAllocation;
+using alloc_tracker::recordFree;
+using alloc_tracker::tracking;
+
+extern "C" {
+
+void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    if (ptr && tracking()) {
+        recordAllocation(ptr);
+    }
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size) {
+    void* ptr = __libc_calloc(count, size);
+    if (ptr && tracking()) {
+        recordAllocation(ptr);
+    }
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (!tracking()) {
+        return __libc_realloc(ptr, size);
+    }
+    // Counted as free + allocation; the old block's size must be read first
+    if (ptr) {
+        recordFree(ptr);
+    }
+    void* result = __libc_realloc(ptr, size);
+    if (result) {
+        recordAllocation(result);
+    } else if (ptr && size != 0) {
+        recordAllocation(ptr);  // failed realloc leaves the old block in place
+    }
+    return result;
+}
+
+void free(void* ptr) {
+    if (ptr && tracking()) {
+        recordFree(ptr);
+    }
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    if (ptr && tracking()) {
+        recordAllocation(ptr);
+    }
+    return ptr;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void* ptr = memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *out = ptr;
+    return 0;
+}
+
+// glibc serves these without going through the functions above, so they
+// are routed through them here; otherwise their blocks would be counted
+// when freed but never when allocated
+void* valloc(size_t size) {
+    return memalign(static_cast<size_t>(getpagesize()), size);
+}
+
+void* pvalloc(size_t size) {
+    const size_t page = static_cast<size_t>(getpagesize());
+    if (size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    const size_t rounded = size == 0 ? page : (size + page - 1) & ~(page - 1);
+    return memalign(page, rounded);
+}
+
+void* reallocarray(void* ptr, size_t count, size_t size) {
+    size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(ptr, bytes);
+}
+
+} // extern "C"
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * Allocation Tracker
+ * Interposes the malloc family (which also backs operator new, OpenCV and
+ * protobuf) and counts allocations per pipeline stage, process-wide and per
+ * thread. Counting is off until enabled; while off each call pays one relaxed
+ * atomic load. Blocks allocated before tracking was enabled are still
+ * subtracted when freed, so live byte counts are approximate right after a
+ * toggle.
+ *
+ * Built only with MEDICAL_IMAGING_ALLOC_HOOKS (default ON). Turn it off for
+ * sanitizer builds, which bring their own allocator.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "pipeline_stage.h"
+
+namespace alloc_tracker {
+
+struct StageAllocations {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+};
+
+// Running totals of the calling thread; frees count against the thread that
+// frees, so live bytes are the thread's net allocation
+struct ThreadAllocations {
+    uint64_t allocations;
+    uint64_t bytes_allocated;
+    int64_t live_bytes;
+    int64_t peak_live_bytes;
+};
+
+bool available();
+bool enabled();
+// Also honours IMAGING_ALLOC_TRACKING=1 at startup (see initializeFromEnvironment)
+void setEnabled(bool enabled);
+void initializeFromEnvironment();
+
+StageAllocations stageTotals(PipelineStage stage);
+int64_t liveBytes();
+int64_t peakLiveBytes();
+
+ThreadAllocations& threadCounters();
+
+} // namespace alloc_tracker
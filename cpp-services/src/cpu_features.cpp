@@ -0,0 +1,58 @@
+/**
+ * CPU Feature Detection Implementation
+ */
+
+#include "cpu_features.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+CpuIsa detectHardwareIsa() {
+#if defined(__x86_64__) || defined(__i386__)
+    // libgcc also verifies via XGETBV that the OS saves the extended register state
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")) {
+        return CpuIsa::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return CpuIsa::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+        return CpuIsa::SSE42;
+    }
+#endif
+    return CpuIsa::Baseline;
+}
+
+bool parseIsa(const char* name, CpuIsa& isa) {
+    if (std::strcmp(name, "baseline") == 0) { isa = CpuIsa::Baseline; return true; }
+    if (std::strcmp(name, "sse4.2") == 0)   { isa = CpuIsa::SSE42; return true; }
+    if (std::strcmp(name, "avx2") == 0)     { isa = CpuIsa::AVX2; return true; }
+    if (std::strcmp(name, "avx512") == 0)   { isa = CpuIsa::AVX512; return true; }
+    return false;
+}
+
+} // namespace
+
+CpuIsa detectCpuIsa() {
+    CpuIsa isa = detectHardwareIsa();
+
+    const char* override_name = std::getenv("MEDICAL_IMAGING_CPU_ISA");
+    CpuIsa requested;
+    if (override_name && parseIsa(override_name, requested) && requested < isa) {
+        isa = requested;
+    }
+    return isa;
+}
+
+const char* cpuIsaName(CpuIsa isa) {
+    switch (isa) {
+        case CpuIsa::SSE42:  return "sse4.2";
+        case CpuIsa::AVX2:   return "avx2";
+        case CpuIsa::AVX512: return "avx512";
+        default:             return "baseline";
+    }
+}
@@ -0,0 +1,19 @@
+/**
+ * CPU Feature Detection
+ * Runtime instruction-set detection used to dispatch the hot image kernels
+ */
+
+#pragma once
+
+enum class CpuIsa {
+    Baseline = 0,   // x86-64 (SSE2) or non-x86 fallback
+    SSE42 = 1,
+    AVX2 = 2,       // AVX2 + FMA
+    AVX512 = 3      // AVX-512 F/BW/DQ/VL
+};
+
+// Best instruction set supported by both the CPU and the OS. The result can be
+// capped (never raised) with MEDICAL_IMAGING_CPU_ISA=baseline|sse4.2|avx2|avx512.
+CpuIsa detectCpuIsa();
+
+const char* cpuIsaName(CpuIsa isa);
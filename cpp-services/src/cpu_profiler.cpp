@@ -0,0 +1,266 @@
+/**
+ * CPU Profiler Implementation
+ */
+
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include "pipeline_stage.h"
+
+namespace {
+
+constexpr int kMaxDepth = 64;
+constexpr size_t kMaxSamples = 32 * 1024;
+// A frame pointer further than this above the previous frame is taken to be
+// garbage (code built without frame pointers) and ends the walk
+constexpr uintptr_t kMaxFrameBytes = 1024 * 1024;
+
+struct Sample {
+    PipelineStage stage;
+    int depth;
+    void* pcs[kMaxDepth];
+};
+
+// Shared with the signal handler, which must stay async-signal-safe: it only
+// touches these atomics and the preallocated sample buffer. capture()
+// clears g_samples and then waits on g_in_handler; the handler raises
+// g_in_handler and then reads g_samples. Both pairs are sequentially
+// consistent, since under acquire/release each side may miss the other's
+// write and the buffer be freed under a running handler.
+std::atomic<Sample*> g_samples{nullptr};
+std::atomic<size_t> g_capacity{0};
+std::atomic<size_t> g_next{0};
+std::atomic<int> g_in_handler{0};
+
+std::mutex g_capture_mutex;
+
+bool interruptedRegisters(const ucontext_t* context, uintptr_t& pc, uintptr_t& sp, uintptr_t& fp) {
+#if defined(__x86_64__)
+    pc = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+    sp = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RSP]);
+    fp = static_cast<uintptr_t>(context->uc_mcontext.gregs[REG_RBP]);
+    return true;
+#elif defined(__aarch64__)
+    pc = context->uc_mcontext.pc;
+    sp = context->uc_mcontext.sp;
+    fp = context->uc_mcontext.regs[29];
+    return true;
+#else
+    (void)context; (void)pc; (void)sp; (void)fp;
+    return false;
+#endif
+}
+
+// backtrace() is not async-signal-safe (it may lock and allocate inside the
+// unwinder), so the handler walks the frame-pointer chain of the interrupted
+// context itself. Every frame must lie above the previous one and within
+// kMaxFrameBytes of it; that keeps the reads on the interrupted stack and
+// stops at the first frame built without frame pointers.
+int walkFramePointers(const ucontext_t* context, void** pcs, int max_depth) {
+    uintptr_t pc = 0;
+    uintptr_t sp = 0;
+    uintptr_t fp = 0;
+    if (!interruptedRegisters(context, pc, sp, fp)) {
+        return 0;
+    }
+
+    int depth = 0;
+    pcs[depth++] = reinterpret_cast<void*>(pc);
+    uintptr_t lower = sp;
+    while (depth < max_depth) {
+        if (fp < lower || fp - lower > kMaxFrameBytes || fp % sizeof(uintptr_t) != 0) {
+            break;
+        }
+        const auto* frame = reinterpret_cast<const uintptr_t*>(fp);
+        uintptr_t return_address = frame[1];
+        if (return_address == 0) {
+            break;
+        }
+        pcs[depth++] = reinterpret_cast<void*>(return_address);
+        lower = fp + 2 * sizeof(uintptr_t);
+        fp = frame[0];
+    }
+    return depth;
+}
+
+void onProfileSignal(int, siginfo_t*, void* context) {
+    int saved_errno = errno;
+    g_in_handler.fetch_add(1, std::memory_order_seq_cst);
+
+    Sample* samples = g_samples.load(std::memory_order_seq_cst);
+    if (samples) {
+        size_t index = g_next.fetch_add(1, std::memory_order_relaxed);
+        if (index < g_capacity.load(std::memory_order_relaxed)) {
+            Sample& sample = samples[index];
+            sample.stage = currentPipelineStage();
+            sample.depth = walkFramePointers(static_cast<const ucontext_t*>(context), sample.pcs, kMaxDepth);
+        }
+    }
+
+    g_in_handler.fetch_sub(1, std::memory_order_release);
+    errno = saved_errno;
+}
+
+std::string symbolize(void* pc, bool return_address) {
+    // Return addresses point past the call; step back into it
+    auto lookup = reinterpret_cast<char*>(pc) - (return_address ? 1 : 0);
+
+    Dl_info info;
+    if (dladdr(lookup, &info) && info.dli_sname) {
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+        std::free(demangled);
+        // ';' separates frames in the folded format
+        std::replace(name.begin(), name.end(), ';', ':');
+        return name;
+    }
+
+    std::ostringstream fallback;
+    if (dladdr(lookup, &info) && info.dli_fname) {
+        fallback << "[" << std::filesystem::path(info.dli_fname).filename().string() << "+0x"
+                 << std::hex << (lookup - static_cast<char*>(info.dli_fbase)) << "]";
+    } else {
+        fallback << "[0x" << std::hex << reinterpret_cast<uintptr_t>(lookup) << "]";
+    }
+    return fallback.str();
+}
+
+std::string timestampForFilename() {
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+    localtime_r(&now, &local);
+    std::ostringstream out;
+    out << std::put_time(&local, "%Y%m%d-%H%M%S");
+    return out.str();
+}
+
+void setTimer(int frequency_hz) {
+    itimerval timer{};
+    if (frequency_hz > 0) {
+        timer.it_interval.tv_usec = 1000000 / frequency_hz;
+        timer.it_value = timer.it_interval;
+    }
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+} // namespace
+
+CpuProfiler& CpuProfiler::instance() {
+    static CpuProfiler profiler;
+    return profiler;
+}
+
+std::string CpuProfiler::defaultOutputDir() {
+    const char* dir = std::getenv("IMAGING_PROFILE_DIR");
+    return dir ? dir : "/app/logs";
+}
+
+CpuProfileResult CpuProfiler::capture(std::chrono::milliseconds duration, int frequency_hz,
+                                      const std::string& output_dir) {
+    std::unique_lock<std::mutex> lock(g_capture_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        throw std::runtime_error("A CPU profile capture is already running");
+    }
+
+    duration = std::clamp<std::chrono::milliseconds>(duration, std::chrono::milliseconds(10), kMaxDuration);
+    frequency_hz = std::clamp(frequency_hz > 0 ? frequency_hz : kDefaultFrequencyHz, 1, kMaxFrequencyHz);
+
+    auto buffer = std::make_unique<Sample[]>(kMaxSamples);
+    g_next.store(0, std::memory_order_relaxed);
+    g_capacity.store(kMaxSamples, std::memory_order_relaxed);
+    g_samples.store(buffer.get(), std::memory_order_seq_cst);
+
+    struct sigaction action{};
+    struct sigaction previous{};
+    action.sa_sigaction = onProfileSignal;
+    action.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &previous) != 0) {
+        g_samples.store(nullptr, std::memory_order_seq_cst);
+        throw std::runtime_error("Failed to install SIGPROF handler");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    setTimer(frequency_hz);
+    std::this_thread::sleep_for(duration);
+    setTimer(0);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    // The handler records nothing from here on but stays installed until no
+    // SIGPROF is pending, since one delivered under the default disposition
+    // would kill the process; the previous disposition is then restored as
+    // it was
+    g_samples.store(nullptr, std::memory_order_seq_cst);
+    const auto drain_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    sigset_t pending;
+    while (sigpending(&pending) == 0 && sigismember(&pending, SIGPROF) &&
+           std::chrono::steady_clock::now() < drain_deadline) {
+        std::this_thread::yield();
+    }
+    sigaction(SIGPROF, &previous, nullptr);
+    while (g_in_handler.load(std::memory_order_seq_cst) > 0) {
+        std::this_thread::yield();
+    }
+
+    const size_t taken = g_next.load(std::memory_order_relaxed);
+    const size_t recorded = std::min(taken, kMaxSamples);
+
+    CpuProfileResult result;
+    result.samples = recorded;
+    result.dropped_samples = taken - recorded;
+    result.duration = elapsed;
+
+    // Fold identical stacks: "stage;outermost;...;innermost count"
+    std::unordered_map<void*, std::string> symbols;
+    std::map<std::string, size_t> folded;
+    for (size_t i = 0; i < recorded; ++i) {
+        const Sample& sample = buffer[i];
+        std::string stack = pipelineStageName(sample.stage);
+        // Frame 0 is the interrupted pc itself, the rest are return addresses
+        for (int frame = sample.depth - 1; frame >= 0; --frame) {
+            void* pc = sample.pcs[frame];
+            auto it = symbols.find(pc);
+            if (it == symbols.end()) {
+                it = symbols.emplace(pc, symbolize(pc, frame > 0)).first;
+            }
+            stack += ';';
+            stack += it->second;
+        }
+        folded[stack]++;
+        result.samples_by_stage[pipelineStageName(sample.stage)]++;
+    }
+
+    std::filesystem::create_directories(output_dir);
+    result.output_path = (std::filesystem::path(output_dir) /
+                          ("cpu-profile-" + timestampForFilename() + ".folded")).string();
+    std::ofstream out(result.output_path);
+    if (!out) {
+        throw std::runtime_error("Cannot write profile to " + result.output_path);
+    }
+    for (const auto& [stack, count] : folded) {
+        out << stack << ' ' << count << '\n';
+    }
+    return result;
+}
@@ -0,0 +1,44 @@
+/**
+ * CPU Profiler
+ * On-demand sampling profiler for production incidents. A capture arms
+ * ITIMER_PROF for a bounded time, records a stack and the pipeline stage per
+ * SIGPROF into a preallocated buffer, then writes symbolized stacks in folded
+ * format (input for flamegraph.pl / speedscope). With no capture running
+ * nothing is installed, so the only steady-state cost is the stage markers.
+ * Stacks are walked through frame pointers, which the build keeps; a walk
+ * ends early at the first library frame compiled without them.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+
+struct CpuProfileResult {
+    std::string output_path;
+    size_t samples = 0;
+    size_t dropped_samples = 0;
+    std::chrono::milliseconds duration{0};
+    std::map<std::string, size_t> samples_by_stage;
+};
+
+class CpuProfiler {
+public:
+    static constexpr int kDefaultFrequencyHz = 99;
+    static constexpr int kMaxFrequencyHz = 1000;
+    static constexpr std::chrono::seconds kMaxDuration{60};
+
+    static CpuProfiler& instance();
+
+    // Blocks for `duration` while sampling. Throws std::runtime_error when a
+    // capture is already running or the timer cannot be installed.
+    CpuProfileResult capture(std::chrono::milliseconds duration, int frequency_hz,
+                             const std::string& output_dir);
+
+    // IMAGING_PROFILE_DIR, default /app/logs
+    static std::string defaultOutputDir();
+
+private:
+    CpuProfiler() = default;
+};
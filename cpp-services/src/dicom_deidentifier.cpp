@@ -0,0 +1,771 @@
+/**
+ * DICOM De-identifier Implementation
+ */
+
+#include "dicom_deidentifier.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "hmac_sha256.h"
+
+namespace {
+
+constexpr uint32_t kItem = 0xFFFEE000;
+constexpr uint32_t kItemDelimiter = 0xFFFEE00D;
+constexpr uint32_t kSequenceDelimiter = 0xFFFEE0DD;
+constexpr uint32_t kUndefinedLength = 0xFFFFFFFF;
+constexpr uint32_t kMetaGroupLength = 0x00020000;
+constexpr uint32_t kMediaStorageSopInstanceUid = 0x00020003;
+constexpr uint32_t kTransferSyntaxUid = 0x00020010;
+constexpr uint32_t kSopInstanceUid = 0x00080018;
+constexpr uint32_t kPatientIdentityRemoved = 0x00120062;
+constexpr uint32_t kDeidentificationMethod = 0x00120063;
+constexpr uint32_t kPixelData = 0x7FE00010;
+
+constexpr const char* kImplicitLittleEndian = "1.2.840.10008.1.2";
+constexpr const char* kDeflatedLittleEndian = "1.2.840.10008.1.2.1.99";
+constexpr const char* kExplicitBigEndian = "1.2.840.10008.1.2.2";
+constexpr const char* kMethod = "Basic Application Confidentiality Profile";
+
+uint16_t read16(std::string_view data, size_t pos) {
+    return static_cast<uint16_t>(static_cast<uint8_t>(data[pos]) | (static_cast<uint8_t>(data[pos + 1]) << 8));
+}
+
+uint32_t read32(std::string_view data, size_t pos) {
+    return static_cast<uint32_t>(read16(data, pos)) | (static_cast<uint32_t>(read16(data, pos + 2)) << 16);
+}
+
+void append16(std::string& out, uint16_t value) {
+    out += static_cast<char>(value & 0xff);
+    out += static_cast<char>(value >> 8);
+}
+
+void append32(std::string& out, uint32_t value) {
+    append16(out, static_cast<uint16_t>(value & 0xffff));
+    append16(out, static_cast<uint16_t>(value >> 16));
+}
+
+// VRs with a reserved field and a 4-byte length in explicit VR (PS3.5 7.1.2)
+bool longFormVr(const char* vr) {
+    static const char* const kLong[] = {"OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV"};
+    for (const char* candidate : kLong) {
+        if (vr[0] == candidate[0] && vr[1] == candidate[1]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string elementHeader(uint32_t tag, const char* vr, bool explicit_vr, uint32_t length) {
+    std::string out;
+    append16(out, static_cast<uint16_t>(tag >> 16));
+    append16(out, static_cast<uint16_t>(tag & 0xffff));
+    if (!explicit_vr) {
+        append32(out, length);
+    } else if (longFormVr(vr)) {
+        out.append(vr, 2);
+        append16(out, 0);
+        append32(out, length);
+    } else {
+        out.append(vr, 2);
+        append16(out, static_cast<uint16_t>(length));
+    }
+    return out;
+}
+
+// Values are padded to even length: UIDs and binary VRs with NUL, text with a space
+std::string padded(std::string value, const char* vr) {
+    if (value.size() % 2 != 0) {
+        const bool nul = std::strncmp(vr, "UI", 2) == 0 || vr[0] == 'O';
+        value += nul ? '\0' : ' ';
+    }
+    return value;
+}
+
+std::string trimmed(std::string_view value) {
+    size_t end = value.size();
+    while (end > 0 && (value[end - 1] == ' ' || value[end - 1] == '\0')) {
+        --end;
+    }
+    size_t begin = 0;
+    while (begin < end && value[begin] == ' ') {
+        ++begin;
+    }
+    return std::string(value.substr(begin, end - begin));
+}
+
+std::string dummyValue(const char* vr) {
+    const std::string v(vr, 2);
+    if (v == "PN") return "ANONYMOUS";
+    if (v == "DA") return "19000101";
+    if (v == "TM") return "000000";
+    if (v == "DT") return "19000101000000";
+    if (v == "AS") return "000Y";
+    if (v == "LO" || v == "SH" || v == "CS" || v == "LT" || v == "ST" || v == "UT" || v == "UC") return "ANONYMIZED";
+    return "";
+}
+
+DeidentificationProfile makeBasicProfile() {
+    using A = DeidAction;
+    DeidentificationProfile profile;
+    profile.name = "basic";
+    // PS3.15 Table E.1-1, Basic Profile column, for attributes seen in
+    // radiology objects; anything not listed is kept
+    const std::pair<uint32_t, DeidRule> rules[] = {
+        {0x00020003, {A::Uid, "UI"}},        // Media Storage SOP Instance UID
+        {0x00080012, {A::Remove, "DA"}},     // Instance Creation Date
+        {0x00080013, {A::Remove, "TM"}},     // Instance Creation Time
+        {0x00080014, {A::Uid, "UI"}},        // Instance Creator UID
+        {0x00080015, {A::Remove, "DT"}},     // Instance Coercion DateTime
+        {0x00080018, {A::Uid, "UI"}},        // SOP Instance UID
+        {0x00080020, {A::Empty, "DA"}},      // Study Date
+        {0x00080021, {A::Remove, "DA"}},     // Series Date
+        {0x00080022, {A::Remove, "DA"}},     // Acquisition Date
+        {0x00080023, {A::Empty, "DA"}},      // Content Date
+        {0x00080024, {A::Remove, "DA"}},     // Overlay Date
+        {0x00080025, {A::Remove, "DA"}},     // Curve Date
+        {0x0008002A, {A::Remove, "DT"}},     // Acquisition DateTime
+        {0x00080030, {A::Empty, "TM"}},      // Study Time
+        {0x00080031, {A::Remove, "TM"}},     // Series Time
+        {0x00080032, {A::Remove, "TM"}},     // Acquisition Time
+        {0x00080033, {A::Empty, "TM"}},      // Content Time
+        {0x00080034, {A::Remove, "TM"}},     // Overlay Time
+        {0x00080035, {A::Remove, "TM"}},     // Curve Time
+        {0x00080050, {A::Empty, "SH"}},      // Accession Number
+        {0x00080058, {A::Uid, "UI"}},        // Failed SOP Instance UID List
+        {0x00080080, {A::Remove, "LO"}},     // Institution Name
+        {0x00080081, {A::Remove, "ST"}},     // Institution Address
+        {0x00080082, {A::Remove, "SQ"}},     // Institution Code Sequence
+        {0x00080090, {A::Empty, "PN"}},      // Referring Physician's Name
+        {0x00080092, {A::Remove, "ST"}},     // Referring Physician's Address
+        {0x00080094, {A::Remove, "SH"}},     // Referring Physician's Telephone Numbers
+        {0x00080096, {A::Remove, "SQ"}},     // Referring Physician Identification Sequence
+        {0x0008009C, {A::Empty, "PN"}},      // Consulting Physician's Name
+        {0x0008009D, {A::Remove, "SQ"}},     // Consulting Physician Identification Sequence
+        {0x00080201, {A::Remove, "SH"}},     // Timezone Offset From UTC
+        {0x00081010, {A::Remove, "SH"}},     // Station Name
+        {0x00081030, {A::Remove, "LO"}},     // Study Description
+        {0x0008103E, {A::Remove, "LO"}},     // Series Description
+        {0x00081040, {A::Remove, "LO"}},     // Institutional Department Name
+        {0x00081048, {A::Remove, "PN"}},     // Physician(s) of Record
+        {0x00081049, {A::Remove, "SQ"}},     // Physician(s) of Record Identification Sequence
+        {0x00081050, {A::Remove, "PN"}},     // Performing Physician's Name
+        {0x00081052, {A::Remove, "SQ"}},     // Performing Physician Identification Sequence
+        {0x00081060, {A::Remove, "PN"}},     // Name of Physician(s) Reading Study
+        {0x00081062, {A::Remove, "SQ"}},     // Physician(s) Reading Study Identification Sequence
+        {0x00081070, {A::Remove, "PN"}},     // Operators' Name
+        {0x00081072, {A::Remove, "SQ"}},     // Operator Identification Sequence
+        {0x00081080, {A::Remove, "LO"}},     // Admitting Diagnoses Description
+        {0x00081084, {A::Remove, "SQ"}},     // Admitting Diagnoses Code Sequence
+        {0x00081120, {A::Remove, "SQ"}},     // Referenced Patient Sequence
+        {0x00081155, {A::Uid, "UI"}},        // Referenced SOP Instance UID
+        {0x00081195, {A::Uid, "UI"}},        // Transaction UID
+        {0x00082111, {A::Remove, "ST"}},     // Derivation Description
+        {0x00083010, {A::Uid, "UI"}},        // Irradiation Event UID
+        {0x00084000, {A::Remove, "LT"}},     // Identifying Comments
+        {0x00100010, {A::Dummy, "PN"}},      // Patient's Name
+        {0x00100020, {A::Pseudonym, "LO"}},  // Patient ID
+        {0x00100021, {A::Remove, "LO"}},     // Issuer of Patient ID
+        {0x00100030, {A::Empty, "DA"}},      // Patient's Birth Date
+        {0x00100032, {A::Remove, "TM"}},     // Patient's Birth Time
+        {0x00100040, {A::Empty, "CS"}},      // Patient's Sex
+        {0x00100050, {A::Remove, "SQ"}},     // Patient's Insurance Plan Code Sequence
+        {0x00100101, {A::Remove, "SQ"}},     // Patient's Primary Language Code Sequence
+        {0x00100102, {A::Remove, "SQ"}},     // Patient's Primary Language Modifier Code Sequence
+        {0x00101000, {A::Remove, "LO"}},     // Other Patient IDs
+        {0x00101001, {A::Remove, "PN"}},     // Other Patient Names
+        {0x00101002, {A::Remove, "SQ"}},     // Other Patient IDs Sequence
+        {0x00101005, {A::Remove, "PN"}},     // Patient's Birth Name
+        {0x00101010, {A::Remove, "AS"}},     // Patient's Age
+        {0x00101020, {A::Remove, "DS"}},     // Patient's Size
+        {0x00101030, {A::Remove, "DS"}},     // Patient's Weight
+        {0x00101040, {A::Remove, "LO"}},     // Patient's Address
+        {0x00101060, {A::Remove, "PN"}},     // Patient's Mother's Birth Name
+        {0x00101080, {A::Remove, "LO"}},     // Military Rank
+        {0x00101081, {A::Remove, "LO"}},     // Branch of Service
+        {0x00101090, {A::Remove, "LO"}},     // Medical Record Locator
+        {0x00101100, {A::Remove, "SQ"}},     // Referenced Patient Photo Sequence
+        {0x00102000, {A::Remove, "LO"}},     // Medical Alerts
+        {0x00102110, {A::Remove, "LO"}},     // Allergies
+        {0x00102150, {A::Remove, "LO"}},     // Country of Residence
+        {0x00102152, {A::Remove, "LO"}},     // Region of Residence
+        {0x00102154, {A::Remove, "SH"}},     // Patient's Telephone Numbers
+        {0x00102155, {A::Remove, "LT"}},     // Patient's Telecom Information
+        {0x00102160, {A::Remove, "SH"}},     // Ethnic Group
+        {0x00102180, {A::Remove, "SH"}},     // Occupation
+        {0x001021A0, {A::Remove, "CS"}},     // Smoking Status
+        {0x001021B0, {A::Remove, "LT"}},     // Additional Patient History
+        {0x001021C0, {A::Remove, "US"}},     // Pregnancy Status
+        {0x001021D0, {A::Remove, "DA"}},     // Last Menstrual Date
+        {0x001021F0, {A::Remove, "LO"}},     // Patient's Religious Preference
+        {0x00102203, {A::Remove, "CS"}},     // Patient's Sex Neutered
+        {0x00102297, {A::Remove, "PN"}},     // Responsible Person
+        {0x00102299, {A::Remove, "LO"}},     // Responsible Organization
+        {0x00104000, {A::Remove, "LT"}},     // Patient Comments
+        {0x00181000, {A::Remove, "LO"}},     // Device Serial Number
+        {0x00181002, {A::Uid, "UI"}},        // Device UID
+        {0x00181004, {A::Remove, "LO"}},     // Plate ID
+        {0x00181005, {A::Remove, "LO"}},     // Generator ID
+        {0x00181007, {A::Remove, "LO"}},     // Cassette ID
+        {0x00181008, {A::Remove, "LO"}},     // Gantry ID
+        {0x00181030, {A::Remove, "LO"}},     // Protocol Name
+        {0x00181200, {A::Remove, "DA"}},     // Date of Last Calibration
+        {0x00181201, {A::Remove, "TM"}},     // Time of Last Calibration
+        {0x00181400, {A::Remove, "LO"}},     // Acquisition Device Processing Description
+        {0x00184000, {A::Remove, "LT"}},     // Acquisition Comments
+        {0x0018700A, {A::Remove, "SH"}},     // Detector ID
+        {0x00189424, {A::Remove, "LT"}},     // Acquisition Protocol Description
+        {0x0018A003, {A::Remove, "ST"}},     // Contribution Description
+        {0x0020000D, {A::Uid, "UI"}},        // Study Instance UID
+        {0x0020000E, {A::Uid, "UI"}},        // Series Instance UID
+        {0x00200010, {A::Empty, "SH"}},      // Study ID
+        {0x00200052, {A::Uid, "UI"}},        // Frame of Reference UID
+        {0x00200200, {A::Uid, "UI"}},        // Synchronization Frame of Reference UID
+        {0x00204000, {A::Remove, "LT"}},     // Image Comments
+        {0x00209158, {A::Remove, "LT"}},     // Frame Comments
+        {0x00209161, {A::Uid, "UI"}},        // Concatenation UID
+        {0x00209164, {A::Uid, "UI"}},        // Dimension Organization UID
+        {0x00281199, {A::Uid, "UI"}},        // Palette Color Lookup Table UID
+        {0x00281214, {A::Uid, "UI"}},        // Large Palette Color Lookup Table UID
+        {0x00321020, {A::Remove, "LO"}},     // Scheduled Study Location
+        {0x00321021, {A::Remove, "AE"}},     // Scheduled Study Location AE Title
+        {0x00321030, {A::Remove, "LO"}},     // Reason for Study
+        {0x00321032, {A::Remove, "PN"}},     // Requesting Physician
+        {0x00321033, {A::Remove, "LO"}},     // Requesting Service
+        {0x00321060, {A::Remove, "LO"}},     // Requested Procedure Description
+        {0x00321070, {A::Remove, "LO"}},     // Requested Contrast Agent
+        {0x00324000, {A::Remove, "LT"}},     // Study Comments
+        {0x00380010, {A::Remove, "LO"}},     // Admission ID
+        {0x00380011, {A::Remove, "LO"}},     // Issuer of Admission ID
+        {0x00380014, {A::Remove, "SQ"}},     // Issuer of Admission ID Sequence
+        {0x0038001E, {A::Remove, "LO"}},     // Scheduled Patient Institution Residence
+        {0x00380020, {A::Remove, "DA"}},     // Admitting Date
+        {0x00380021, {A::Remove, "TM"}},     // Admitting Time
+        {0x00380040, {A::Remove, "LO"}},     // Discharge Diagnosis Description
+        {0x00380050, {A::Remove, "LO"}},     // Special Needs
+        {0x00380060, {A::Remove, "LO"}},     // Service Episode ID
+        {0x00380062, {A::Remove, "LO"}},     // Service Episode Description
+        {0x00380300, {A::Remove, "LO"}},     // Current Patient Location
+        {0x00380400, {A::Remove, "LO"}},     // Patient's Institution Residence
+        {0x00380500, {A::Remove, "LO"}},     // Patient State
+        {0x00384000, {A::Remove, "LT"}},     // Visit Comments
+        {0x00400001, {A::Remove, "AE"}},     // Scheduled Station AE Title
+        {0x00400002, {A::Remove, "DA"}},     // Scheduled Procedure Step Start Date
+        {0x00400003, {A::Remove, "TM"}},     // Scheduled Procedure Step Start Time
+        {0x00400004, {A::Remove, "DA"}},     // Scheduled Procedure Step End Date
+        {0x00400005, {A::Remove, "TM"}},     // Scheduled Procedure Step End Time
+        {0x00400006, {A::Remove, "PN"}},     // Scheduled Performing Physician's Name
+        {0x00400007, {A::Remove, "LO"}},     // Scheduled Procedure Step Description
+        {0x00400009, {A::Remove, "SH"}},     // Scheduled Procedure Step ID
+        {0x0040000B, {A::Remove, "SQ"}},     // Scheduled Performing Physician Identification Sequence
+        {0x00400010, {A::Remove, "SH"}},     // Scheduled Station Name
+        {0x00400011, {A::Remove, "SH"}},     // Scheduled Procedure Step Location
+        {0x00400012, {A::Remove, "LO"}},     // Pre-Medication
+        {0x00400241, {A::Remove, "AE"}},     // Performed Station AE Title
+        {0x00400242, {A::Remove, "SH"}},     // Performed Station Name
+        {0x00400243, {A::Remove, "SH"}},     // Performed Location
+        {0x00400244, {A::Remove, "DA"}},     // Performed Procedure Step Start Date
+        {0x00400245, {A::Remove, "TM"}},     // Performed Procedure Step Start Time
+        {0x00400250, {A::Remove, "DA"}},     // Performed Procedure Step End Date
+        {0x00400251, {A::Remove, "TM"}},     // Performed Procedure Step End Time
+        {0x00400253, {A::Remove, "SH"}},     // Performed Procedure Step ID
+        {0x00400254, {A::Remove, "LO"}},     // Performed Procedure Step Description
+        {0x00400275, {A::Remove, "SQ"}},     // Request Attributes Sequence
+        {0x00400280, {A::Remove, "ST"}},     // Comments on the Performed Procedure Step
+        {0x00401001, {A::Remove, "SH"}},     // Requested Procedure ID
+        {0x00401004, {A::Remove, "LO"}},     // Patient Transport Arrangements
+        {0x00401005, {A::Remove, "LO"}},     // Requested Procedure Location
+        {0x00401010, {A::Remove, "PN"}},     // Names of Intended Recipients of Results
+        {0x00401102, {A::Remove, "ST"}},     // Person's Address
+        {0x00401103, {A::Remove, "LO"}},     // Person's Telephone Numbers
+        {0x00401400, {A::Remove, "LT"}},     // Requested Procedure Comments
+        {0x00402001, {A::Remove, "LO"}},     // Reason for the Imaging Service Request
+        {0x00402008, {A::Remove, "PN"}},     // Order Entered By
+        {0x00402009, {A::Remove, "SH"}},     // Order Enterer's Location
+        {0x00402010, {A::Remove, "SH"}},     // Order Callback Phone Number
+        {0x00402016, {A::Empty, "LO"}},      // Placer Order Number / Imaging Service Request
+        {0x00402017, {A::Empty, "LO"}},      // Filler Order Number / Imaging Service Request
+        {0x00402400, {A::Remove, "LT"}},     // Imaging Service Request Comments
+        {0x00403001, {A::Remove, "LO"}},     // Confidentiality Constraint on Patient Data Description
+        {0x0040A027, {A::Remove, "LO"}},     // Verifying Organization
+        {0x0040A075, {A::Dummy, "PN"}},      // Verifying Observer Name
+        {0x0040A123, {A::Dummy, "PN"}},      // Person Name
+        {0x0040A124, {A::Uid, "UI"}},        // UID
+        {0x0040A730, {A::Remove, "SQ"}},     // Content Sequence
+        {0x00700084, {A::Empty, "PN"}},      // Content Creator's Name
+        {0x00880140, {A::Uid, "UI"}},        // Storage Media File-set UID
+        {0x04000561, {A::Remove, "SQ"}},     // Original Attributes Sequence
+        {0x30060024, {A::Uid, "UI"}},        // Referenced Frame of Reference UID
+    };
+    for (const auto& [tag, rule] : rules) {
+        profile.rules.emplace(tag, rule);
+    }
+    return profile;
+}
+
+} // namespace
+
+// One pass over a file, recording the edits the profile asks for
+class DeidentificationPass {
+public:
+    DeidentificationPass(const DicomDeidentifier& owner, std::string_view data, DeidentificationPlan& plan)
+        : owner_(owner), profile_(owner.profile_), data_(data), plan_(plan) {}
+
+    void run() {
+        if (data_.size() < 132 || data_.compare(128, 4, "DICM") != 0) {
+            throw std::invalid_argument("not a DICOM Part 10 file");
+        }
+        const size_t dataset = parseMeta(132);
+        const bool explicit_vr = transfer_syntax_ != kImplicitLittleEndian;
+        if (transfer_syntax_.empty()) {
+            throw std::invalid_argument("DICOM file has no transfer syntax");
+        }
+        if (transfer_syntax_ == kDeflatedLittleEndian || transfer_syntax_ == kExplicitBigEndian) {
+            throw std::invalid_argument("cannot de-identify transfer syntax " + transfer_syntax_);
+        }
+        int64_t delta = 0;
+        parseDataset(dataset, data_.size(), explicit_vr, true, delta);
+
+        std::sort(plan_.edits.begin(), plan_.edits.end(), [](const DicomEdit& a, const DicomEdit& b) {
+            return a.offset != b.offset ? a.offset < b.offset : a.length < b.length;
+        });
+        int64_t size = static_cast<int64_t>(data_.size());
+        for (const auto& edit : plan_.edits) {
+            size += static_cast<int64_t>(edit.replacement.size()) - static_cast<int64_t>(edit.length);
+        }
+        plan_.output_bytes = static_cast<size_t>(size);
+    }
+
+private:
+    struct Element {
+        uint32_t tag;
+        char vr[3];
+        size_t start;
+        size_t value;
+        uint32_t length;
+    };
+
+    [[noreturn]] void malformed(size_t pos) const {
+        throw std::invalid_argument("malformed DICOM element at offset " + std::to_string(pos));
+    }
+
+    Element readElement(size_t pos, size_t end, bool explicit_vr) const {
+        if (pos + 8 > end) {
+            malformed(pos);
+        }
+        Element e;
+        e.tag = (static_cast<uint32_t>(read16(data_, pos)) << 16) | read16(data_, pos + 2);
+        e.start = pos;
+        e.vr[0] = e.vr[1] = e.vr[2] = '\0';
+        if ((e.tag >> 16) == 0xFFFE || !explicit_vr) {
+            e.length = read32(data_, pos + 4);
+            e.value = pos + 8;
+        } else {
+            e.vr[0] = data_[pos + 4];
+            e.vr[1] = data_[pos + 5];
+            if (longFormVr(e.vr)) {
+                if (pos + 12 > end) {
+                    malformed(pos);
+                }
+                e.length = read32(data_, pos + 8);
+                e.value = pos + 12;
+            } else {
+                e.length = read16(data_, pos + 6);
+                e.value = pos + 8;
+            }
+        }
+        if (e.length != kUndefinedLength && e.value + e.length > end) {
+            malformed(pos);
+        }
+        return e;
+    }
+
+    // File meta information is always explicit VR little endian
+    size_t parseMeta(size_t pos) {
+        size_t group_length_value = 0;
+        uint32_t group_length = 0;
+        int64_t delta = 0;
+        while (pos + 8 <= data_.size() && read16(data_, pos) == 0x0002) {
+            Element e = readElement(pos, data_.size(), true);
+            if (e.length == kUndefinedLength) {
+                malformed(pos);
+            }
+            const std::string_view value = data_.substr(e.value, e.length);
+            if (e.tag == kMetaGroupLength && e.length == 4) {
+                group_length_value = e.value;
+                group_length = read32(data_, e.value);
+            } else if (e.tag == kTransferSyntaxUid) {
+                transfer_syntax_ = trimmed(value);
+            } else if (e.tag == kMediaStorageSopInstanceUid && !trimmed(value).empty()) {
+                replace(e, e.value + e.length, "UI", owner_.replacementUid(trimmed(value)), true, delta);
+            }
+            pos = e.value + e.length;
+        }
+        if (group_length_value != 0 && delta != 0) {
+            patchLength(group_length_value, static_cast<uint32_t>(group_length + delta));
+        }
+        return pos;
+    }
+
+    DeidRule ruleFor(uint32_t tag) const {
+        const uint32_t group = tag >> 16;
+        const uint32_t element = tag & 0xffff;
+        if (tag == kPatientIdentityRemoved || tag == kDeidentificationMethod) {
+            return {DeidAction::Dummy, ""};
+        }
+        if ((group & 1) != 0 && profile_.remove_private_groups) {
+            return {DeidAction::Remove, ""};
+        }
+        // Group lengths (retired outside the meta group) would go stale
+        if (element == 0 && group != 0x0002) {
+            return {DeidAction::Remove, ""};
+        }
+        // Overlay and curve data can carry burned-in annotations
+        if ((group & 0xff00) == 0x5000 || ((group & 0xff00) == 0x6000 && (element == 0x3000 || element == 0x4000))) {
+            return {DeidAction::Remove, ""};
+        }
+        auto it = profile_.rules.find(tag);
+        return it == profile_.rules.end() ? DeidRule{DeidAction::Keep, ""} : it->second;
+    }
+
+    bool isSequence(const Element& e, bool explicit_vr) const {
+        if (explicit_vr && e.vr[0] != '\0') {
+            return std::strncmp(e.vr, "SQ", 2) == 0 ||
+                   (std::strncmp(e.vr, "UN", 2) == 0 && e.length == kUndefinedLength);
+        }
+        if (e.length == kUndefinedLength) {
+            return e.tag != kPixelData;
+        }
+        // Implicit VR carries no type; a value that opens with an item is a sequence
+        return e.length >= 8 && read32(data_, e.value) == 0xE000FFFE;
+    }
+
+    // Walks the items of a sequence element; returns the offset after it
+    size_t parseItems(const Element& sequence, size_t end, bool explicit_vr, int64_t& delta) {
+        const bool undefined = sequence.length == kUndefinedLength;
+        const size_t limit = undefined ? end : sequence.value + sequence.length;
+        size_t pos = sequence.value;
+        while (pos < limit) {
+            if (pos + 8 > limit) {
+                malformed(pos);
+            }
+            const uint32_t tag = (static_cast<uint32_t>(read16(data_, pos)) << 16) | read16(data_, pos + 2);
+            const uint32_t length = read32(data_, pos + 4);
+            if (tag == kSequenceDelimiter && undefined) {
+                return pos + 8;
+            }
+            if (tag != kItem) {
+                malformed(pos);
+            }
+            int64_t inner = 0;
+            if (length == kUndefinedLength) {
+                pos = parseDataset(pos + 8, limit, explicit_vr, false, inner);
+            } else {
+                if (pos + 8 + length > limit) {
+                    malformed(pos);
+                }
+                parseDataset(pos + 8, pos + 8 + length, explicit_vr, false, inner);
+                if (inner != 0) {
+                    patchLength(pos + 4, static_cast<uint32_t>(length + inner));
+                }
+                pos += 8 + length;
+            }
+            delta += inner;
+        }
+        if (undefined) {
+            throw std::invalid_argument("unterminated DICOM sequence at offset " + std::to_string(sequence.start));
+        }
+        return limit;
+    }
+
+    // Encapsulated pixel data: offset table and fragments up to the delimiter
+    size_t skipFragments(size_t pos, size_t end) const {
+        while (pos + 8 <= end) {
+            const uint32_t tag = (static_cast<uint32_t>(read16(data_, pos)) << 16) | read16(data_, pos + 2);
+            const uint32_t length = read32(data_, pos + 4);
+            if (tag == kSequenceDelimiter) {
+                return pos + 8;
+            }
+            if (tag != kItem || length == kUndefinedLength || pos + 8 + length > end) {
+                malformed(pos);
+            }
+            pos += 8 + length;
+        }
+        malformed(pos);
+    }
+
+    // Elements of a dataset or item up to `end` or an item delimiter;
+    // returns the offset after the last one consumed
+    size_t parseDataset(size_t pos, size_t end, bool explicit_vr, bool top_level, int64_t& delta) {
+        while (pos < end) {
+            const Element e = readElement(pos, end, explicit_vr);
+            if (e.tag == kItemDelimiter) {
+                return e.value;
+            }
+            if (top_level && e.tag > kPatientIdentityRemoved) {
+                addMarkers(pos, e.tag, explicit_vr, delta);
+            }
+            pos = parseElement(e, end, explicit_vr, top_level, delta);
+        }
+        if (top_level) {
+            addMarkers(pos, UINT32_MAX, explicit_vr, delta);
+        }
+        return pos;
+    }
+
+    size_t parseElement(const Element& e, size_t end, bool explicit_vr, bool top_level, int64_t& delta) {
+        const DeidRule rule = ruleFor(e.tag);
+        size_t after;
+        if (e.tag == kPixelData && e.length == kUndefinedLength) {
+            after = skipFragments(e.value, end);
+        } else if (isSequence(e, explicit_vr)) {
+            // Undefined-length UN holds implicit VR items (PS3.5 6.2.2)
+            const bool items_explicit = explicit_vr && std::strncmp(e.vr, "UN", 2) != 0;
+            if (rule.action == DeidAction::Keep) {
+                int64_t inner = 0;
+                after = parseItems(e, end, items_explicit, inner);
+                if (inner != 0 && e.length != kUndefinedLength) {
+                    patchLength(e.value - 4, static_cast<uint32_t>(e.length + inner));
+                }
+                delta += inner;
+                return after;
+            }
+            // Dropped or emptied whole; the walk only finds where it ends
+            const size_t edits = plan_.edits.size();
+            const int changed = plan_.elements_changed;
+            int64_t ignored = 0;
+            after = parseItems(e, end, items_explicit, ignored);
+            plan_.edits.resize(edits);
+            plan_.elements_changed = changed;
+        } else if (e.length == kUndefinedLength) {
+            // Only sequences and encapsulated pixel data may leave it undefined
+            malformed(e.start);
+        } else {
+            after = e.value + e.length;
+        }
+
+        const char* vr = explicit_vr && e.vr[0] != '\0' ? e.vr : rule.vr;
+        const std::string_view value = e.length == kUndefinedLength ? std::string_view()
+                                                                    : data_.substr(e.value, e.length);
+        switch (rule.action) {
+            case DeidAction::Keep:
+                break;
+            case DeidAction::Remove:
+                edit(e.start, after - e.start, std::string(), delta);
+                break;
+            case DeidAction::Empty:
+                if (e.length != 0) {
+                    edit(e.start, after - e.start, elementHeader(e.tag, vr, explicit_vr, 0), delta);
+                }
+                break;
+            case DeidAction::Dummy:
+                if (e.tag == kPatientIdentityRemoved) {
+                    has_identity_removed_ = has_identity_removed_ || top_level;
+                    replace(e, after, "CS", "YES", explicit_vr, delta);
+                } else if (e.tag == kDeidentificationMethod) {
+                    has_method_ = has_method_ || top_level;
+                    replace(e, after, "LO", kMethod, explicit_vr, delta);
+                } else {
+                    replace(e, after, vr, dummyValue(vr), explicit_vr, delta);
+                }
+                break;
+            case DeidAction::Uid: {
+                // Multi-valued UIDs are replaced value by value; empty values
+                // stay empty, they identify nothing
+                const std::string original = trimmed(value);
+                if (original.empty()) {
+                    break;
+                }
+                std::string uids;
+                size_t begin = 0;
+                while (begin <= original.size()) {
+                    size_t split = original.find('\\', begin);
+                    split = split == std::string::npos ? original.size() : split;
+                    if (begin > 0) {
+                        uids += '\\';
+                    }
+                    if (split > begin) {
+                        uids += owner_.replacementUid(original.substr(begin, split - begin));
+                    }
+                    begin = split + 1;
+                }
+                if (top_level && e.tag == kSopInstanceUid) {
+                    plan_.sop_instance_uid = uids;
+                }
+                replace(e, after, vr, uids, explicit_vr, delta);
+                break;
+            }
+            case DeidAction::Pseudonym:
+                replace(e, after, vr, owner_.pseudonym(trimmed(value)), explicit_vr, delta);
+                break;
+        }
+        return after;
+    }
+
+    void replace(const Element& e, size_t after, const char* vr, std::string value, bool explicit_vr,
+                 int64_t& delta) {
+        value = padded(std::move(value), vr);
+        std::string replacement = elementHeader(e.tag, vr, explicit_vr, static_cast<uint32_t>(value.size()));
+        replacement += value;
+        edit(e.start, after - e.start, std::move(replacement), delta);
+    }
+
+    // Inserts the markers that sort before `next_tag` and are neither in the
+    // source nor inserted yet, so each lands at its place in tag order
+    void addMarkers(size_t pos, uint32_t next_tag, bool explicit_vr, int64_t& delta) {
+        std::string inserted;
+        if (!has_identity_removed_ && next_tag > kPatientIdentityRemoved) {
+            has_identity_removed_ = true;
+            const std::string value = padded("YES", "CS");
+            inserted += elementHeader(kPatientIdentityRemoved, "CS", explicit_vr, static_cast<uint32_t>(value.size()));
+            inserted += value;
+        }
+        if (!has_method_ && next_tag > kDeidentificationMethod) {
+            has_method_ = true;
+            const std::string value = padded(kMethod, "LO");
+            inserted += elementHeader(kDeidentificationMethod, "LO", explicit_vr, static_cast<uint32_t>(value.size()));
+            inserted += value;
+        }
+        if (!inserted.empty()) {
+            edit(pos, 0, std::move(inserted), delta);
+        }
+    }
+
+    void edit(size_t offset, size_t length, std::string replacement, int64_t& delta) {
+        delta += static_cast<int64_t>(replacement.size()) - static_cast<int64_t>(length);
+        plan_.edits.push_back({offset, length, std::move(replacement)});
+        ++plan_.elements_changed;
+    }
+
+    // Same-size patch of a 32-bit length field
+    void patchLength(size_t offset, uint32_t length) {
+        std::string bytes;
+        append32(bytes, length);
+        plan_.edits.push_back({offset, 4, std::move(bytes)});
+    }
+
+    const DicomDeidentifier& owner_;
+    const DeidentificationProfile& profile_;
+    std::string_view data_;
+    DeidentificationPlan& plan_;
+    std::string transfer_syntax_;
+    bool has_identity_removed_ = false;
+    bool has_method_ = false;
+};
+
+const DeidentificationProfile* DeidentificationProfile::byName(const std::string& name) {
+    static const DeidentificationProfile basic = makeBasicProfile();
+    return name == basic.name ? &basic : nullptr;
+}
+
+DicomDeidentifier::DicomDeidentifier(const DeidentificationProfile& profile, std::string salt)
+    : profile_(profile), salt_(std::move(salt)) {}
+
+std::string DicomDeidentifier::saltFromEnvironment() {
+    const char* salt = std::getenv("IMAGING_DEID_SALT");
+    if (salt && *salt) {
+        return salt;
+    }
+    std::cerr << "IMAGING_DEID_SALT is not set: replacement UIDs will not match across runs" << std::endl;
+    std::random_device random;
+    std::string generated;
+    for (int i = 0; i < 8; ++i) {
+        append32(generated, random());
+    }
+    return generated;
+}
+
+std::string DicomDeidentifier::replacementUid(std::string_view uid) const {
+    const auto digest = hmacSha256(salt_, std::string("uid:").append(uid));
+    // 128 bits as one decimal component under the 2.25 (UUID) root, PS3.5 B.2
+    unsigned __int128 value = 0;
+    for (int i = 0; i < 16; ++i) {
+        value = (value << 8) | digest[i];
+    }
+    std::string digits;
+    do {
+        digits += static_cast<char>('0' + static_cast<int>(value % 10));
+        value /= 10;
+    } while (value != 0);
+    std::reverse(digits.begin(), digits.end());
+    return "2.25." + digits;
+}
+
+std::string DicomDeidentifier::pseudonym(std::string_view value) const {
+    static const char hex[] = "0123456789ABCDEF";
+    const auto digest = hmacSha256(salt_, std::string("id:").append(value));
+    std::string out;
+    for (int i = 0; i < 8; ++i) {
+        out += hex[digest[i] >> 4];
+        out += hex[digest[i] & 0xf];
+    }
+    return out;
+}
+
+DeidentificationPlan DicomDeidentifier::plan(std::string_view dicom) const {
+    DeidentificationPlan plan;
+    DeidentificationPass(*this, dicom, plan).run();
+    return plan;
+}
+
+std::string DicomDeidentifier::render(std::string_view dicom, const DeidentificationPlan& plan) {
+    std::string out;
+    out.reserve(plan.output_bytes);
+    size_t cursor = 0;
+    for (const auto& edit : plan.edits) {
+        out.append(dicom.data() + cursor, edit.offset - cursor);
+        out += edit.replacement;
+        cursor = edit.offset + edit.length;
+    }
+    out.append(dicom.data() + cursor, dicom.size() - cursor);
+    return out;
+}
+
+void DicomDeidentifier::write(int fd, std::string_view dicom, const DeidentificationPlan& plan) {
+    std::vector<iovec> slices;
+    slices.reserve(plan.edits.size() * 2 + 1);
+    size_t cursor = 0;
+    auto add = [&](const char* data, size_t size) {
+        if (size > 0) {
+            slices.push_back({const_cast<char*>(data), size});
+        }
+    };
+    for (const auto& edit : plan.edits) {
+        add(dicom.data() + cursor, edit.offset - cursor);
+        add(edit.replacement.data(), edit.replacement.size());
+        cursor = edit.offset + edit.length;
+    }
+    add(dicom.data() + cursor, dicom.size() - cursor);
+
+    size_t next = 0;
+    while (next < slices.size()) {
+        const int count = static_cast<int>(std::min<size_t>(slices.size() - next, IOV_MAX));
+        ssize_t written = ::writev(fd, slices.data() + next, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("cannot write de-identified file: ") + std::strerror(errno));
+        }
+        // Drop what was written; a short write leaves a partial slice
+        while (next < slices.size() && static_cast<size_t>(written) >= slices[next].iov_len) {
+            written -= static_cast<ssize_t>(slices[next].iov_len);
+            ++next;
+        }
+        if (written > 0) {
+            slices[next].iov_base = static_cast<char*>(slices[next].iov_base) + written;
+            slices[next].iov_len -= static_cast<size_t>(written);
+        }
+    }
+}
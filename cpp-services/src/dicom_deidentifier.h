@@ -0,0 +1,103 @@
+/**
+ * DICOM De-identifier
+ * Removes or replaces identifying attributes in Part 10 files on the way to
+ * research pipelines, without decoding or re-encoding anything else.
+ *
+ * One pass over the element headers applies a tag action profile and records
+ * edits: byte ranges of the source to replace (often with nothing). The
+ * output is then the source with those ranges swapped, written as a list of
+ * slices, so pixel data and every untouched element are copied straight from
+ * the input buffer and the cost is close to that of copying the file.
+ * Lengths of enclosing sequences, items and the file meta group are patched
+ * when their contents change size. Nested sequences are walked; encapsulated
+ * pixel data is skipped over by its fragment headers.
+ *
+ * The "basic" profile follows the PS3.15 Annex E Basic Application Level
+ * Confidentiality Profile for the attributes common in radiology objects:
+ * names, dates, institutions and free text are removed, emptied or given
+ * dummy values, private groups are dropped, and UIDs are replaced. Replacement
+ * UIDs ("2.25." + decimal digest) and patient pseudonyms are an HMAC-SHA256
+ * of the original value under a secret salt, so a study keeps its structure
+ * across files and runs that share the salt. Patient Identity Removed and
+ * De-identification Method are added.
+ *
+ * Explicit and implicit VR little endian are supported, with or without
+ * encapsulated pixel data; deflated and big endian transfer syntaxes are
+ * rejected.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class DeidAction {
+    Keep,
+    Remove,     // X: drop the element
+    Empty,      // Z: keep it with a zero-length value
+    Dummy,      // D: replace with a fixed value of the same VR
+    Uid,        // U: replace with a UID derived from the original
+    Pseudonym,  // replace with a value derived from the original, same for every file
+};
+
+struct DeidRule {
+    DeidAction action;
+    char vr[3];     // used when the transfer syntax does not carry the VR
+};
+
+struct DeidentificationProfile {
+    std::string name;
+    std::unordered_map<uint32_t, DeidRule> rules;   // by tag, (group << 16) | element
+    bool remove_private_groups = true;
+
+    // Null for unknown names; "basic" is the only profile for now
+    static const DeidentificationProfile* byName(const std::string& name);
+};
+
+// Replace source bytes [offset, offset + length) with `replacement`
+struct DicomEdit {
+    size_t offset;
+    size_t length;
+    std::string replacement;
+};
+
+struct DeidentificationPlan {
+    std::vector<DicomEdit> edits;   // ascending and non-overlapping
+    size_t output_bytes = 0;
+    int elements_changed = 0;
+    std::string sop_instance_uid;   // as written to the output
+};
+
+class DicomDeidentifier {
+public:
+    DicomDeidentifier(const DeidentificationProfile& profile, std::string salt);
+
+    // Throws std::invalid_argument for malformed files and unsupported
+    // transfer syntaxes
+    DeidentificationPlan plan(std::string_view dicom) const;
+
+    // The de-identified file, in memory
+    static std::string render(std::string_view dicom, const DeidentificationPlan& plan);
+    // Streams the de-identified file to `fd` with gathered writes straight
+    // from the source buffer; throws std::runtime_error when writing fails
+    static void write(int fd, std::string_view dicom, const DeidentificationPlan& plan);
+
+    // IMAGING_DEID_SALT; without it a random per-process salt is used, and
+    // replacement UIDs then differ between runs
+    static std::string saltFromEnvironment();
+
+    const DeidentificationProfile& profile() const { return profile_; }
+
+    std::string replacementUid(std::string_view uid) const;
+    std::string pseudonym(std::string_view value) const;
+
+private:
+    friend class DeidentificationPass;
+
+    const DeidentificationProfile& profile_;
+    std::string salt_;
+};
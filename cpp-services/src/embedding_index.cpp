@@ -0,0 +1,597 @@
+/**
+ * Embedding Index Implementation
+ */
+
+#include "embedding_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "embedding_model.h"
+#include "image_kernels.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'H', 'N', 'S', 'W', '1'};
+constexpr size_t kHeaderBytes = 4096;
+constexpr size_t kInitialCapacity = 1024;
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+std::runtime_error ioError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+// Changes on every boot; "unknown" where /proc does not say, so an index
+// left dirty is then always rebuilt
+std::string bootId() {
+    std::ifstream in("/proc/sys/kernel/random/boot_id");
+    std::string id;
+    std::getline(in, id);
+    return id.empty() ? "unknown" : id;
+}
+
+// Per-thread visited marks for graph searches. Each search takes a new tag,
+// so the marks never need clearing between searches.
+struct VisitedMarks {
+    std::vector<uint32_t> marks;
+    uint32_t tag = 0;
+
+    uint32_t begin(size_t nodes) {
+        if (marks.size() < nodes) {
+            marks.resize(nodes + nodes / 2 + kInitialCapacity, 0);
+        }
+        if (++tag == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            tag = 1;
+        }
+        return tag;
+    }
+};
+
+thread_local VisitedMarks visited;
+
+} // namespace
+
+struct EmbeddingIndex::FileHeader {
+    char magic[8];
+    uint32_t dim;
+    uint32_t m;
+    uint32_t max_level;
+    uint32_t slot_bytes;
+    uint64_t capacity;
+    uint64_t count;         // nodes fully linked; written last on insert
+    uint32_t entry_point;
+    int32_t top_level;
+    char dirty_boot[40];    // boot ID since the first insert after a clean close; empty when clean
+};
+
+EmbeddingIndexConfig EmbeddingIndexConfig::fromEnvironment() {
+    EmbeddingIndexConfig config;
+    config.m = std::max(4, envInt("IMAGING_INDEX_M", config.m));
+    config.ef_construction = envInt("IMAGING_INDEX_EF_CONSTRUCTION", config.ef_construction);
+    config.ef_search = envInt("IMAGING_INDEX_EF_SEARCH", config.ef_search);
+    return config;
+}
+
+EmbeddingIndex::EmbeddingIndex(const std::string& path, size_t dim, EmbeddingIndexConfig config)
+    : path_(path),
+      dim_(dim),
+      m_(static_cast<uint32_t>(config.m)),
+      config_(config),
+      boot_id_(bootId()),
+      level_rng_(std::random_device{}()) {
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ < 0) {
+        throw ioError("cannot open embedding index", path_);
+    }
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+        ::close(fd_);
+        throw ioError("cannot stat embedding index", path_);
+    }
+
+    FileHeader existing = {};
+    bool created = st.st_size == 0;
+    if (!created) {
+        if (::pread(fd_, &existing, sizeof(existing), 0) != static_cast<ssize_t>(sizeof(existing)) ||
+            std::memcmp(existing.magic, kMagic, sizeof(kMagic)) != 0 || existing.max_level != kMaxLevel) {
+            ::close(fd_);
+            throw std::runtime_error("not an embedding index: " + path_);
+        }
+        existing.dirty_boot[sizeof(existing.dirty_boot) - 1] = '\0';
+        if (existing.dirty_boot[0] != '\0' && (boot_id_ != existing.dirty_boot || boot_id_ == "unknown")) {
+            std::cerr << "Embedding index " << path_ << ": the system restarted before it was closed, "
+                      << "rebuilding it from the embedding store" << std::endl;
+            if (::ftruncate(fd_, 0) != 0) {
+                ::close(fd_);
+                throw ioError("cannot reset embedding index", path_);
+            }
+            created = true;
+        }
+    }
+    if (!created) {
+        // Left marked by a process of this boot: its writes are all in the page cache
+        dirty_ = existing.dirty_boot[0] != '\0';
+        if (existing.dim != dim_) {
+            ::close(fd_);
+            throw std::runtime_error("embedding index " + path_ + " holds dimension " +
+                                     std::to_string(existing.dim) + ", the model produces " + std::to_string(dim_));
+        }
+        m_ = existing.m;
+    }
+
+    // Slot: vector | bottom links (count + 2m) | upper links (count + m) per
+    // level | content hash | level, padded to a cache line
+    links_offset_ = dim_ * sizeof(float);
+    meta_offset_ = links_offset_ + sizeof(uint32_t) * ((1 + 2 * m_) + kMaxLevel * (1 + m_));
+    slot_bytes_ = (meta_offset_ + sizeof(ContentHash) + sizeof(uint32_t) + 63) / 64 * 64;
+
+    try {
+        if (created) {
+            map(kInitialCapacity);
+            std::memcpy(header_->magic, kMagic, sizeof(kMagic));
+            header_->dim = static_cast<uint32_t>(dim_);
+            header_->m = m_;
+            header_->max_level = kMaxLevel;
+            header_->slot_bytes = static_cast<uint32_t>(slot_bytes_);
+            header_->capacity = kInitialCapacity;
+            header_->count = 0;
+            ::msync(base_, kHeaderBytes, MS_SYNC);
+        } else {
+            if (existing.slot_bytes != slot_bytes_ || existing.count > existing.capacity ||
+                static_cast<uint64_t>(st.st_size) < kHeaderBytes + existing.capacity * slot_bytes_) {
+                throw std::runtime_error("embedding index " + path_ + " is damaged");
+            }
+            map(existing.capacity);
+        }
+    } catch (...) {
+        if (base_) {
+            ::munmap(base_, mapped_bytes_);
+        }
+        ::close(fd_);
+        throw;
+    }
+
+    const uint32_t count = static_cast<uint32_t>(header_->count);
+    if (count > 0 && header_->entry_point >= count) {
+        header_->entry_point = 0;
+        header_->top_level = static_cast<int32_t>(levelOf(0));
+    }
+    by_hash_.reserve(count);
+    for (uint32_t node = 0; node < count; ++node) {
+        by_hash_.emplace(hashOf(node), node);
+    }
+    std::cout << "Embedding index " << path_ << ": " << count << " embeddings, M=" << m_ << std::endl;
+}
+
+EmbeddingIndex::~EmbeddingIndex() {
+    if (base_) {
+        if (::msync(base_, mapped_bytes_, MS_SYNC) == 0 && dirty_) {
+            std::memset(header_->dirty_boot, 0, sizeof(header_->dirty_boot));
+            ::msync(base_, kHeaderBytes, MS_SYNC);
+        }
+        ::munmap(base_, mapped_bytes_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+void EmbeddingIndex::map(size_t capacity) {
+    const size_t bytes = kHeaderBytes + capacity * slot_bytes_;
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+        throw ioError("cannot stat embedding index", path_);
+    }
+    if (static_cast<size_t>(st.st_size) < bytes && ::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+        throw ioError("cannot grow embedding index", path_);
+    }
+
+    void* mapped = base_ ? ::mremap(base_, mapped_bytes_, bytes, MREMAP_MAYMOVE)
+                         : ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+    if (mapped == MAP_FAILED) {
+        throw ioError("cannot map embedding index", path_);
+    }
+    // Populated up front, so early queries do not pay a page fault per node
+    // they visit; afterwards graph walks jump between unrelated slots, where
+    // readahead would only evict pages that are about to be used
+    ::madvise(mapped, bytes, MADV_RANDOM);
+    base_ = static_cast<char*>(mapped);
+    mapped_bytes_ = bytes;
+    header_ = reinterpret_cast<FileHeader*>(base_);
+    nodes_ = base_ + kHeaderBytes;
+}
+
+// Synced before the first page it guards is written, so no torn write can
+// reach the disk without it
+void EmbeddingIndex::markDirty() {
+    if (dirty_) {
+        return;
+    }
+    std::memset(header_->dirty_boot, 0, sizeof(header_->dirty_boot));
+    boot_id_.copy(header_->dirty_boot, sizeof(header_->dirty_boot) - 1);
+    if (::msync(base_, kHeaderBytes, MS_SYNC) != 0) {
+        throw ioError("cannot sync embedding index", path_);
+    }
+    dirty_ = true;
+}
+
+void EmbeddingIndex::reserve(size_t nodes) {
+    if (nodes <= header_->capacity) {
+        return;
+    }
+    const size_t capacity = std::max<size_t>(header_->capacity * 2, nodes);
+    map(capacity);
+    header_->capacity = capacity;
+}
+
+uint32_t* EmbeddingIndex::linksOf(uint32_t node, int level) const {
+    const size_t offset = links_offset_ + sizeof(uint32_t) * (level == 0 ? 0 : (1 + 2 * m_) + (level - 1) * (1 + m_));
+    return reinterpret_cast<uint32_t*>(nodes_ + node * slot_bytes_ + offset);
+}
+
+ContentHash EmbeddingIndex::hashOf(uint32_t node) const {
+    ContentHash hash;
+    std::memcpy(&hash, nodes_ + node * slot_bytes_ + meta_offset_, sizeof(hash));
+    return hash;
+}
+
+uint32_t EmbeddingIndex::levelOf(uint32_t node) const {
+    uint32_t level;
+    std::memcpy(&level, nodes_ + node * slot_bytes_ + meta_offset_ + sizeof(ContentHash), sizeof(level));
+    return std::min<uint32_t>(level, kMaxLevel);
+}
+
+size_t EmbeddingIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return header_->count;
+}
+
+bool EmbeddingIndex::contains(const ContentHash& hash) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return by_hash_.count(hash) > 0;
+}
+
+uint32_t EmbeddingIndex::greedyStep(const float* query, uint32_t entry, int level, uint32_t count) const {
+    uint32_t current = entry;
+    float best;
+    const float* entry_row = vectorOf(entry);
+    kernels::dotProducts(query, &entry_row, 1, dim_, &best);
+    best = 1.0f - best;
+
+    std::vector<uint32_t> ids;
+    std::vector<const float*> rows;
+    std::vector<float> scores;
+    for (bool moved = true; moved;) {
+        moved = false;
+        const uint32_t* links = linksOf(current, level);
+        const uint32_t n = std::min(links[0], maxLinks(level));
+        ids.clear();
+        rows.clear();
+        for (uint32_t i = 1; i <= n; ++i) {
+            if (links[i] < count) {
+                ids.push_back(links[i]);
+                rows.push_back(vectorOf(links[i]));
+            }
+        }
+        scores.resize(ids.size());
+        kernels::dotProducts(query, rows.data(), rows.size(), dim_, scores.data());
+        for (size_t j = 0; j < ids.size(); ++j) {
+            if (1.0f - scores[j] < best) {
+                best = 1.0f - scores[j];
+                current = ids[j];
+                moved = true;
+            }
+        }
+    }
+    return current;
+}
+
+std::vector<EmbeddingIndex::Candidate> EmbeddingIndex::searchLayer(const float* query, uint32_t entry, size_t ef,
+                                                                   int level, uint32_t count) const {
+    const uint32_t tag = visited.begin(count);
+    uint32_t* marks = visited.marks.data();
+
+    // frontier: closest first; best: the ef closest so far, farthest on top
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> frontier;
+    std::priority_queue<Candidate> best;
+
+    float similarity;
+    const float* entry_row = vectorOf(entry);
+    kernels::dotProducts(query, &entry_row, 1, dim_, &similarity);
+    frontier.emplace(1.0f - similarity, entry);
+    best.emplace(1.0f - similarity, entry);
+    marks[entry] = tag;
+
+    std::vector<uint32_t> ids;
+    std::vector<const float*> rows;
+    std::vector<float> scores;
+    while (!frontier.empty()) {
+        const Candidate closest = frontier.top();
+        if (closest.first > best.top().first && best.size() >= ef) {
+            break;
+        }
+        frontier.pop();
+
+        const uint32_t* links = linksOf(closest.second, level);
+        const uint32_t n = std::min(links[0], maxLinks(level));
+        ids.clear();
+        rows.clear();
+        for (uint32_t i = 1; i <= n; ++i) {
+            const uint32_t neighbour = links[i];
+            if (neighbour >= count || marks[neighbour] == tag) {
+                continue;
+            }
+            marks[neighbour] = tag;
+            ids.push_back(neighbour);
+            rows.push_back(vectorOf(neighbour));
+            __builtin_prefetch(rows.back());
+        }
+        // All unvisited neighbours in one kernel call
+        scores.resize(ids.size());
+        kernels::dotProducts(query, rows.data(), rows.size(), dim_, scores.data());
+        for (size_t j = 0; j < ids.size(); ++j) {
+            const float distance = 1.0f - scores[j];
+            if (best.size() < ef || distance < best.top().first) {
+                frontier.emplace(distance, ids[j]);
+                best.emplace(distance, ids[j]);
+                if (best.size() > ef) {
+                    best.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<Candidate> result(best.size());
+    for (size_t i = result.size(); i-- > 0;) {
+        result[i] = best.top();
+        best.pop();
+    }
+    return result;
+}
+
+// HNSW neighbour heuristic: walking candidates from the closest, keep one
+// only if it is closer to the node than to every neighbour already kept.
+// Links then spread across directions instead of bunching in one cluster,
+// which keeps the graph navigable.
+std::vector<uint32_t> EmbeddingIndex::selectNeighbours(const std::vector<Candidate>& candidates,
+                                                       size_t limit) const {
+    std::vector<uint32_t> kept;
+    std::vector<const float*> kept_rows;
+    std::vector<float> scores;
+    for (const auto& [distance, node] : candidates) {
+        if (kept.size() >= limit) {
+            break;
+        }
+        const float* row = vectorOf(node);
+        scores.resize(kept.size());
+        kernels::dotProducts(row, kept_rows.data(), kept_rows.size(), dim_, scores.data());
+        bool diverse = true;
+        for (float score : scores) {
+            if (1.0f - score < distance) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) {
+            kept.push_back(node);
+            kept_rows.push_back(row);
+        }
+    }
+    return kept;
+}
+
+void EmbeddingIndex::link(uint32_t node, uint32_t neighbour, int level) {
+    uint32_t* links = linksOf(node, level);
+    const uint32_t limit = maxLinks(level);
+    const uint32_t n = std::min(links[0], limit);
+    if (n < limit) {
+        links[1 + n] = neighbour;
+        links[0] = n + 1;
+        return;
+    }
+
+    // Full: re-select among the current links and the new one
+    std::vector<uint32_t> ids(links + 1, links + 1 + n);
+    ids.push_back(neighbour);
+    std::vector<const float*> rows(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        rows[i] = vectorOf(ids[i]);
+    }
+    std::vector<float> scores(ids.size());
+    kernels::dotProducts(vectorOf(node), rows.data(), rows.size(), dim_, scores.data());
+    std::vector<Candidate> candidates(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        candidates[i] = {1.0f - scores[i], ids[i]};
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    const std::vector<uint32_t> kept = selectNeighbours(candidates, limit);
+    std::copy(kept.begin(), kept.end(), links + 1);
+    links[0] = static_cast<uint32_t>(kept.size());
+}
+
+bool EmbeddingIndex::insert(const ContentHash& hash, const float* embedding) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (by_hash_.count(hash)) {
+        return false;
+    }
+    const uint32_t count = static_cast<uint32_t>(header_->count);
+    markDirty();
+    reserve(static_cast<size_t>(count) + 1);
+
+    // Level drawn with P(level >= l) = m^-l
+    std::uniform_real_distribution<double> uniform(std::nextafter(0.0, 1.0), 1.0);
+    const int level = std::min(kMaxLevel, static_cast<int>(-std::log(uniform(level_rng_)) /
+                                                           std::log(static_cast<double>(m_))));
+    const uint32_t node = count;
+    char* slot = nodes_ + node * slot_bytes_;
+    std::memset(slot, 0, slot_bytes_);
+    std::memcpy(slot, embedding, dim_ * sizeof(float));
+    std::memcpy(slot + meta_offset_, &hash, sizeof(hash));
+    const uint32_t stored_level = static_cast<uint32_t>(level);
+    std::memcpy(slot + meta_offset_ + sizeof(hash), &stored_level, sizeof(stored_level));
+
+    if (count > 0) {
+        const int top = header_->top_level;
+        uint32_t entry = header_->entry_point;
+        for (int l = top; l > level; --l) {
+            entry = greedyStep(embedding, entry, l, count);
+        }
+        for (int l = std::min(level, top); l >= 0; --l) {
+            const auto candidates = searchLayer(embedding, entry, config_.ef_construction, l, count);
+            const auto neighbours = selectNeighbours(candidates, m_);
+            uint32_t* links = linksOf(node, l);
+            std::copy(neighbours.begin(), neighbours.end(), links + 1);
+            links[0] = static_cast<uint32_t>(neighbours.size());
+            for (uint32_t neighbour : neighbours) {
+                link(neighbour, node, l);
+            }
+            entry = candidates.front().second;
+        }
+    }
+    if (count == 0 || level > header_->top_level) {
+        header_->entry_point = node;
+        header_->top_level = level;
+    }
+    // Published last: until the count covers the node, searches skip links to it
+    header_->count = count + 1;
+    by_hash_.emplace(hash, node);
+    return true;
+}
+
+std::vector<IndexMatch> EmbeddingIndex::search(const float* query, size_t k, size_t ef) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const uint32_t count = static_cast<uint32_t>(header_->count);
+    if (count == 0 || k == 0) {
+        return {};
+    }
+    ef = std::max(ef > 0 ? ef : static_cast<size_t>(config_.ef_search), k);
+
+    uint32_t entry = header_->entry_point;
+    for (int l = header_->top_level; l > 0; --l) {
+        entry = greedyStep(query, entry, l, count);
+    }
+    const auto candidates = searchLayer(query, entry, ef, 0, count);
+
+    std::vector<IndexMatch> matches;
+    matches.reserve(std::min(k, candidates.size()));
+    for (size_t i = 0; i < candidates.size() && i < k; ++i) {
+        matches.push_back({hashOf(candidates[i].second), 1.0f - candidates[i].first});
+    }
+    return matches;
+}
+
+EmbeddingIndexer::EmbeddingIndexer(const EmbeddingModel& model, EmbeddingStore& store, EmbeddingIndex& index)
+    : model_(model),
+      store_(store),
+      index_(index),
+      max_queued_bytes_(static_cast<size_t>(envInt("IMAGING_INDEX_QUEUE_MB", 256)) << 20),
+      worker_([this] {
+          backfill();
+          run();
+      }) {}
+
+EmbeddingIndexer::~EmbeddingIndexer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    worker_.join();
+}
+
+bool EmbeddingIndexer::submit(const std::string& patient_id, std::string_view image) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queued_bytes_ + image.size() > max_queued_bytes_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        queued_bytes_ += image.size();
+    }
+    // Copied outside the lock; the bytes were reserved above
+    Job job{patient_id, std::string(image)};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(job));
+    }
+    wake_.notify_one();
+    return true;
+}
+
+void EmbeddingIndexer::backfill() {
+    size_t added = 0;
+    std::vector<float> embedding;
+    for (const auto& hash : store_.hashes()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) {
+                return;
+            }
+        }
+        if (!index_.contains(hash) && store_.find(EmbeddingKey{hash, 0}, embedding)) {
+            added += index_.insert(hash, embedding.data()) ? 1 : 0;
+        }
+    }
+    if (added > 0) {
+        std::cout << "Embedding index: added " << added << " embeddings from the store" << std::endl;
+    }
+}
+
+void EmbeddingIndexer::run() {
+    std::vector<float> embedding;
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        try {
+            // Analyzed images come without hints; linked even when already
+            // indexed, since the same study may arrive for another patient
+            const EmbeddingKey key{contentHash(job.image), 0};
+            const bool indexed = index_.contains(key.content);
+            if (!store_.find(key, embedding)) {
+                embedding = model_.embed(job.image);
+                store_.insert(key, embedding);
+            }
+            store_.link(store_.patientKey(job.patient_id), key);
+            if (!indexed) {
+                index_.insert(key.content, embedding.data());
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Indexing image failed: " << e.what() << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_bytes_ -= job.image.size();
+    }
+}
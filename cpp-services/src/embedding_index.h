@@ -0,0 +1,170 @@
+/**
+ * Embedding Index
+ * Approximate nearest-neighbour search over image embeddings, for "find
+ * similar cases" across the whole archive without running models over it.
+ *
+ * The index is an HNSW graph (Malkov and Yashunin): a stack of proximity
+ * graphs where each layer holds a random, exponentially thinning subset of
+ * the nodes. A query descends greedily through the sparse layers and runs a
+ * bounded best-first search (`ef` candidates) on the full bottom layer, so
+ * it touches a few thousand vectors even at millions of entries. Similarity
+ * is the dot product of unit-length embeddings (cosine), scored a node's
+ * neighbours at a time with the dispatched dot-product kernel.
+ *
+ * Nodes are fixed-size slots (vector, links per layer, content hash) in one
+ * file that is memory-mapped shared, so the index is used in place, is
+ * persistent without a save step, and opens without reading it into the
+ * heap. Inserts are incremental and exclusive; queries run concurrently with
+ * each other. Only embeddings made without preprocessing hints are indexed,
+ * so each image has one node.
+ *
+ * The index is derived data and is not synced per insert. After a process
+ * crash every write is still in the page cache, and the node count, written
+ * last, hides a node whose insert was cut short. After a kernel crash or
+ * power loss the file may hold any mix of old and new pages, including
+ * neighbour lists rewritten in place, so it is not trusted: the header is
+ * marked with the boot ID before the first insert after a clean close, and
+ * an index still marked by an earlier boot is emptied when opened. Either
+ * way, embeddings missing from the index are re-inserted from the
+ * EmbeddingStore by EmbeddingIndexer.
+ *
+ * Configured with IMAGING_EMBEDDING_INDEX (file path), IMAGING_INDEX_M
+ * (default 16), IMAGING_INDEX_EF_CONSTRUCTION (default 128) and
+ * IMAGING_INDEX_EF_SEARCH (default 64). M is fixed when the file is created.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "embedding_store.h"
+
+class EmbeddingModel;
+
+struct EmbeddingIndexConfig {
+    int m = 16;                 // links per node on upper layers, 2 * m on the bottom one
+    int ef_construction = 128;  // candidates examined when linking a new node
+    int ef_search = 64;         // default candidates examined per query
+
+    static EmbeddingIndexConfig fromEnvironment();
+};
+
+struct IndexMatch {
+    ContentHash hash;
+    float similarity;
+};
+
+class EmbeddingIndex {
+public:
+    // Opens or creates the index file; throws std::runtime_error when it
+    // cannot be mapped or was built for another dimension
+    EmbeddingIndex(const std::string& path, size_t dim, EmbeddingIndexConfig config);
+    ~EmbeddingIndex();
+    EmbeddingIndex(const EmbeddingIndex&) = delete;
+    EmbeddingIndex& operator=(const EmbeddingIndex&) = delete;
+
+    size_t dim() const { return dim_; }
+    size_t size() const;
+    bool contains(const ContentHash& hash) const;
+
+    // `embedding` must be unit length; false when the hash is already indexed
+    bool insert(const ContentHash& hash, const float* embedding);
+
+    // Up to k nearest embeddings, most similar first. ef (0: the configured
+    // default) trades latency for recall and is raised to at least k.
+    std::vector<IndexMatch> search(const float* query, size_t k, size_t ef = 0) const;
+
+private:
+    using Candidate = std::pair<float, uint32_t>;    // distance (1 - similarity), node
+
+    static constexpr int kMaxLevel = 4;     // upper layers; 16^-4 of nodes reach the top
+
+    struct FileHeader;
+
+    float* vectorOf(uint32_t node) const { return reinterpret_cast<float*>(nodes_ + node * slot_bytes_); }
+    uint32_t* linksOf(uint32_t node, int level) const;
+    uint32_t maxLinks(int level) const { return level == 0 ? 2 * m_ : m_; }
+    ContentHash hashOf(uint32_t node) const;
+    uint32_t levelOf(uint32_t node) const;
+
+    void map(size_t capacity);
+    void markDirty();
+    void reserve(size_t nodes);
+    uint32_t greedyStep(const float* query, uint32_t entry, int level, uint32_t count) const;
+    std::vector<Candidate> searchLayer(const float* query, uint32_t entry, size_t ef, int level,
+                                       uint32_t count) const;
+    std::vector<uint32_t> selectNeighbours(const std::vector<Candidate>& candidates, size_t limit) const;
+    void link(uint32_t node, uint32_t neighbour, int level);
+
+    std::string path_;
+    size_t dim_;
+    uint32_t m_;
+    EmbeddingIndexConfig config_;
+    size_t slot_bytes_ = 0;
+    size_t links_offset_ = 0;
+    size_t meta_offset_ = 0;
+
+    int fd_ = -1;
+    char* base_ = nullptr;
+    size_t mapped_bytes_ = 0;
+    FileHeader* header_ = nullptr;
+    char* nodes_ = nullptr;
+    std::string boot_id_;
+    bool dirty_ = false;    // the header carries boot_id_ until a clean close
+
+    std::unordered_map<ContentHash, uint32_t, ContentHashHasher> by_hash_;
+    std::mt19937_64 level_rng_;
+    mutable std::shared_mutex mutex_;
+};
+
+// Adds analyzed images to the index in the background, so AnalyzeImage does
+// not wait for the embedding model. Images are copied into a queue bounded
+// by IMAGING_INDEX_QUEUE_MB (default 256); when it is full they are dropped
+// rather than slowing analysis. On start, embeddings already in the store but
+// missing from the index are inserted first.
+class EmbeddingIndexer {
+public:
+    EmbeddingIndexer(const EmbeddingModel& model, EmbeddingStore& store, EmbeddingIndex& index);
+    ~EmbeddingIndexer();
+    EmbeddingIndexer(const EmbeddingIndexer&) = delete;
+    EmbeddingIndexer& operator=(const EmbeddingIndexer&) = delete;
+
+    // False when the image was dropped
+    bool submit(const std::string& patient_id, std::string_view image);
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Job {
+        std::string patient_id;
+        std::string image;
+    };
+
+    void run();
+    void backfill();
+
+    const EmbeddingModel& model_;
+    EmbeddingStore& store_;
+    EmbeddingIndex& index_;
+    size_t max_queued_bytes_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Job> queue_;
+    size_t queued_bytes_ = 0;
+    bool stopping_ = false;
+    std::atomic<uint64_t> dropped_{0};
+    std::thread worker_;
+};
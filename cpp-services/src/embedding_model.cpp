@@ -0,0 +1,193 @@
+/**
+ * Embedding Model Implementation
+ */
+
+#include "embedding_model.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+#include <onnxruntime_cxx_api.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "embedding_store.h"
+#include "image_kernels.h"
+#include "pipeline_stage.h"
+#include "thread_budget.h"
+
+namespace {
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+// The decoded Mat as the kernels see it, without converting it
+PixelPlane pixelPlaneOf(const cv::Mat& image) {
+    PixelDepth depth;
+    switch (image.depth()) {
+        case CV_8U:  depth = PixelDepth::U8; break;
+        case CV_16U: depth = PixelDepth::U16; break;
+        case CV_16S: depth = PixelDepth::S16; break;
+        case CV_32F: depth = PixelDepth::F32; break;
+        default:
+            throw std::invalid_argument("unsupported image sample type");
+    }
+    return {image.data, depth, image.cols, image.rows, image.step1()};
+}
+
+} // namespace
+
+struct EmbeddingModel::Session {
+    Ort::Env env{ORT_LOGGING_LEVEL_WARNING, "embedding"};
+    std::unique_ptr<Ort::Session> session;
+    Ort::MemoryInfo memory = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    std::string input_name;
+    std::string output_name;
+};
+
+EmbeddingModelConfig EmbeddingModelConfig::fromEnvironment() {
+    EmbeddingModelConfig config;
+    if (const char* path = std::getenv("IMAGING_EMBEDDING_MODEL"); path && *path) {
+        config.path = path;
+    }
+    config.input_size = envInt("IMAGING_EMBEDDING_INPUT_SIZE", config.input_size);
+    config.orientation = OrientationConfig::fromEnvironment();
+    return config;
+}
+
+EmbeddingModel::EmbeddingModel(EmbeddingModelConfig config)
+    : config_(std::move(config)),
+      session_(std::make_unique<Session>()) {
+    Ort::SessionOptions options;
+    ThreadBudgetManager::instance().applyToSessionOptions(options);
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    session_->session = std::make_unique<Ort::Session>(session_->env, config_.path.c_str(), options);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    if (session_->session->GetInputCount() != 1 || session_->session->GetOutputCount() < 1) {
+        throw std::runtime_error("embedding model must have one image input");
+    }
+    session_->input_name = session_->session->GetInputNameAllocated(0, allocator).get();
+    session_->output_name = session_->session->GetOutputNameAllocated(0, allocator).get();
+
+    auto shape = session_->session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (shape.size() != 4) {
+        throw std::runtime_error("embedding model input must be [N, C, H, W]");
+    }
+    channels_ = shape[1] > 0 ? static_cast<int>(shape[1]) : 1;
+    height_ = shape[2] > 0 ? static_cast<int>(shape[2]) : config_.input_size;
+    width_ = shape[3] > 0 ? static_cast<int>(shape[3]) : config_.input_size;
+    if (channels_ != 1 && channels_ != 3) {
+        throw std::runtime_error("embedding model input must have 1 or 3 channels");
+    }
+
+    // Symbolic output sizes are only known after a run, which also warms
+    // the session before the first request
+    std::vector<float> blank(static_cast<size_t>(channels_) * height_ * width_, 0.0f);
+    dim_ = run(blank).size();
+    if (dim_ == 0) {
+        throw std::runtime_error("embedding model produced an empty output");
+    }
+
+    // A broken orientation classifier costs accuracy on rotated images only,
+    // so embedding carries on without it
+    try {
+        orientation_ = std::make_unique<OrientationNormalizer>(config_.orientation);
+    } catch (const std::exception& e) {
+        std::cerr << "Orientation classifier unavailable: " << e.what() << std::endl;
+        orientation_ = std::make_unique<OrientationNormalizer>(OrientationConfig{});
+    }
+
+    std::cout << "Embedding model " << config_.path << ": " << channels_ << "x" << height_ << "x" << width_
+              << " -> " << dim_ << std::endl;
+}
+
+EmbeddingModel::~EmbeddingModel() = default;
+
+uint64_t hintsDigest(const EmbeddingHints& hints) {
+    if (hints.orientation.empty() && !hints.window) {
+        return 0;
+    }
+    std::string canonical = std::to_string(hints.orientation.size()) + ":";
+    canonical += hints.orientation;
+    if (hints.window) {
+        const double values[] = {hints.window->center, hints.window->width, hints.window->rescale_slope,
+                                 hints.window->rescale_intercept};
+        canonical.append(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+    const uint64_t digest = contentHash(canonical).low;
+    return digest != 0 ? digest : 1;
+}
+
+std::string EmbeddingModel::name() const {
+    const size_t slash = config_.path.find_last_of('/');
+    return slash == std::string::npos ? config_.path : config_.path.substr(slash + 1);
+}
+
+std::vector<float> EmbeddingModel::run(const std::vector<float>& tensor) const {
+    const int64_t shape[4] = {1, channels_, height_, width_};
+    Ort::Value input = Ort::Value::CreateTensor<float>(session_->memory, const_cast<float*>(tensor.data()),
+                                                       tensor.size(), shape, 4);
+    const char* inputs[] = {session_->input_name.c_str()};
+    const char* outputs[] = {session_->output_name.c_str()};
+    auto result = session_->session->Run(Ort::RunOptions{}, inputs, &input, 1, outputs, 1);
+
+    const auto info = result[0].GetTensorTypeAndShapeInfo();
+    const float* values = result[0].GetTensorData<float>();
+    return std::vector<float>(values, values + info.GetElementCount());
+}
+
+std::vector<float> EmbeddingModel::embed(std::string_view encoded_image, const EmbeddingHints& hints) const {
+    // Checked before decoding so malformed hints fail fast
+    std::optional<ImageOrientation> from_geometry = orientationFromGeometry(hints.orientation);
+    if (hints.window && !(hints.window->width > 0.0)) {
+        throw std::invalid_argument("window width must be positive");
+    }
+    cv::Mat image;
+    {
+        StageScope stage(PipelineStage::Decode);
+        cv::Mat encoded(1, static_cast<int>(encoded_image.size()), CV_8UC1,
+                        const_cast<char*>(encoded_image.data()));
+        image = cv::imdecode(encoded, cv::IMREAD_GRAYSCALE | cv::IMREAD_ANYDEPTH);
+        if (image.empty()) {
+            throw std::invalid_argument("cannot decode image");
+        }
+    }
+
+    std::vector<float> tensor(static_cast<size_t>(channels_) * height_ * width_);
+    {
+        StageScope stage(PipelineStage::Preprocess);
+        const size_t pixels = static_cast<size_t>(height_) * width_;
+        const PixelPlane plane = pixelPlaneOf(image);
+        // Window, orientation, resize and normalization in one pass over
+        // the stored pixels, writing the first channel in place
+        const ImageOrientation orientation =
+            from_geometry ? *from_geometry : orientation_->resolve(plane, hints.window, {});
+        TensorMapping mapping;
+        mapping.window = hints.window;
+        mapping.mean = config_.mean;
+        mapping.stddev = config_.stddev;
+        kernels::resampleToTensor(plane, mapping, tensor.data(), width_, height_, orientation);
+        for (int c = 1; c < channels_; ++c) {
+            std::memcpy(tensor.data() + c * pixels, tensor.data(), pixels * sizeof(float));
+        }
+    }
+
+    StageScope stage(PipelineStage::Inference);
+    std::vector<float> embedding = run(tensor);
+    if (embedding.size() != dim_) {
+        throw std::runtime_error("embedding model output changed size");
+    }
+    return embedding;
+}
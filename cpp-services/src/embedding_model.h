@@ -0,0 +1,81 @@
+/**
+ * Embedding Model
+ * Runs an image encoder that maps one image to a feature vector, for
+ * comparing images with each other rather than classifying them. Any ONNX
+ * model with one image input [N, C, H, W] (C of 1 or 3) and one output
+ * [N, D] fits; fixed input sizes are honoured, symbolic ones use
+ * IMAGING_EMBEDDING_INPUT_SIZE (default 224).
+ *
+ * The model is read from IMAGING_EMBEDDING_MODEL (default
+ * /app/models/embedding.onnx) and shares the ONNX Runtime thread budget of
+ * the analysis models.
+ *
+ * Decoded pixels stay at their stored depth (8 or 16 bit) until a single
+ * resampling pass windows, orients, resizes and normalizes them into the
+ * input tensor, so 16-bit dynamic range reaches the model and no full-size
+ * converted copy is made. Images are brought to the canonical orientation
+ * on the way in (see orientation.h), from DICOM geometry when the caller
+ * passes it and from the orientation classifier otherwise.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "orientation.h"
+
+struct EmbeddingModelConfig {
+    std::string path = "/app/models/embedding.onnx";
+    int input_size = 224;
+    float mean = 0.485f;       // applied to [0, 1] intensities
+    float stddev = 0.229f;
+    OrientationConfig orientation;
+
+    static EmbeddingModelConfig fromEnvironment();
+};
+
+// What the caller knows about an image beyond its pixels
+struct EmbeddingHints {
+    std::string_view orientation;               // DICOM geometry, see orientation.h
+    const WindowLevelParams* window = nullptr;  // VOI window of the stored values; null: full range
+};
+
+// Digest of the hints that change what an image embeds to, for keying
+// stored embeddings (EmbeddingKey::hints); 0 when no hint is given
+uint64_t hintsDigest(const EmbeddingHints& hints);
+
+class EmbeddingModel {
+public:
+    // Loads the model and runs it once to learn the embedding size; throws
+    // std::exception when the file is missing or does not fit
+    explicit EmbeddingModel(EmbeddingModelConfig config);
+    ~EmbeddingModel();
+    EmbeddingModel(const EmbeddingModel&) = delete;
+    EmbeddingModel& operator=(const EmbeddingModel&) = delete;
+
+    size_t dim() const { return dim_; }
+    std::string name() const;
+
+    // Decodes an encoded image (PNG, JPEG, TIFF, ...; 8 or 16 bit) and runs
+    // the model; thread-safe. Throws std::invalid_argument for undecodable
+    // images and malformed hints.
+    std::vector<float> embed(std::string_view encoded_image, const EmbeddingHints& hints = {}) const;
+
+private:
+    struct Session;
+
+    std::vector<float> run(const std::vector<float>& tensor) const;
+
+    EmbeddingModelConfig config_;
+    std::unique_ptr<Session> session_;
+    std::unique_ptr<OrientationNormalizer> orientation_;
+    int channels_ = 1;
+    int height_ = 0;
+    int width_ = 0;
+    size_t dim_ = 0;
+};
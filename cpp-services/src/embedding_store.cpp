@@ -0,0 +1,571 @@
+/**
+ * Embedding Store Implementation
+ */
+
+#include "embedding_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hmac_sha256.h"
+#include "image_kernels.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'I', 'M', 'G', 'E', 'M', 'B', '0', '2'};
+constexpr char kLegacyMagic[8] = {'I', 'M', 'G', 'E', 'M', 'B', '0', '1'};
+constexpr char kLinksMagic[8] = {'I', 'M', 'G', 'P', 'A', 'T', '0', '2'};
+constexpr char kUnsaltedLinksMagic[8] = {'I', 'M', 'G', 'P', 'A', 'T', '0', '1'};
+constexpr size_t kHeaderBytes = 32;
+constexpr size_t kRecordHeaderBytes = 32;    // content hash (16), hints digest (patient key before 02), stored at
+constexpr size_t kLinksHeaderBytes = 16;     // magic, salt check
+constexpr size_t kLinkBytes = 40;            // patient key, content hash (16), hints digest, linked at
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t load64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::runtime_error ioError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+uint64_t saltedKey(std::string_view salt, std::string_view prefix, std::string_view value) {
+    const auto digest = hmacSha256(salt, std::string(prefix).append(value));
+    uint64_t key;
+    std::memcpy(&key, digest.data(), sizeof(key));
+    return key;
+}
+
+int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void encodeLink(uint64_t patient_key, const EmbeddingKey& key, int64_t linked_at_ms, char* out) {
+    std::memcpy(out, &patient_key, 8);
+    std::memcpy(out + 8, &key.content.high, 8);
+    std::memcpy(out + 16, &key.content.low, 8);
+    std::memcpy(out + 24, &key.hints, 8);
+    std::memcpy(out + 32, &linked_at_ms, 8);
+}
+
+// Appended at the current end under the writer lock, so records never
+// interleave; a short write is cut back off
+void appendBytes(int fd, const std::string& path, const char* bytes, size_t size) {
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        throw ioError("cannot stat embedding store", path);
+    }
+    ssize_t written = ::pwrite(fd, bytes, size, st.st_size);
+    if (written != static_cast<ssize_t>(size)) {
+        int saved = errno;
+        if (::ftruncate(fd, st.st_size) != 0) {
+            std::cerr << "Embedding store " << path << ": cannot drop a partial record" << std::endl;
+        }
+        errno = written < 0 ? saved : ENOSPC;
+        throw ioError("cannot append to embedding store", path);
+    }
+}
+
+// Whole records after the header; a partial one left by a crash is cut off
+size_t wholeRecords(int fd, const std::string& path, off_t file_size, size_t header_bytes, size_t record_bytes) {
+    const size_t count = (static_cast<size_t>(file_size) - header_bytes) / record_bytes;
+    const off_t whole = static_cast<off_t>(header_bytes + count * record_bytes);
+    if (whole != file_size) {
+        std::cerr << "Embedding store " << path << ": dropping a partial record" << std::endl;
+        if (::ftruncate(fd, whole) != 0) {
+            throw ioError("cannot truncate embedding store", path);
+        }
+    }
+    return count;
+}
+
+} // namespace
+
+std::string ContentHash::hex() const {
+    static const char digits[] = "0123456789abcdef";
+    std::string out(32, '0');
+    for (int i = 0; i < 16; ++i) {
+        out[15 - i] = digits[(high >> (4 * i)) & 0xf];
+        out[31 - i] = digits[(low >> (4 * i)) & 0xf];
+    }
+    return out;
+}
+
+ContentHash ContentHash::fromHex(std::string_view hex) {
+    if (hex.size() != 32) {
+        throw std::invalid_argument("content hash must be 32 hex digits");
+    }
+    ContentHash hash;
+    for (size_t i = 0; i < 32; ++i) {
+        char c = hex[i];
+        uint64_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            throw std::invalid_argument("content hash must be 32 hex digits");
+        }
+        uint64_t& half = i < 16 ? hash.high : hash.low;
+        half = (half << 4) | digit;
+    }
+    return hash;
+}
+
+// Four independent lanes over 32-byte stripes keep the multipliers busy, so
+// hashing a study runs near memory bandwidth; the lanes are folded two ways
+// for the two halves
+ContentHash contentHash(std::string_view data) {
+    const char* p = data.data();
+    const char* end = p + data.size();
+    uint64_t v1 = kPrime1 + kPrime2;
+    uint64_t v2 = kPrime2;
+    uint64_t v3 = 0;
+    uint64_t v4 = 0 - kPrime1;
+    for (; p + 32 <= end; p += 32) {
+        v1 = round64(v1, load64(p));
+        v2 = round64(v2, load64(p + 8));
+        v3 = round64(v3, load64(p + 16));
+        v4 = round64(v4, load64(p + 24));
+    }
+    uint64_t tail1 = kPrime4;
+    uint64_t tail2 = kPrime3;
+    for (; p + 8 <= end; p += 8) {
+        tail1 = round64(tail1, load64(p));
+        tail2 = round64(tail2, ~load64(p));
+    }
+    for (; p < end; ++p) {
+        tail1 = rotl(tail1 ^ (static_cast<uint8_t>(*p) * kPrime4), 11) * kPrime1;
+        tail2 = rotl(tail2 ^ (static_cast<uint8_t>(*p) * kPrime2), 17) * kPrime3;
+    }
+    const uint64_t length = data.size();
+    ContentHash hash;
+    hash.high = avalanche(rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18) + tail1 + length);
+    hash.low = avalanche(rotl(v1, 29) ^ rotl(v2, 41) ^ rotl(v3, 3) ^ rotl(v4, 53) ^ tail2 ^ (length * kPrime3));
+    return hash;
+}
+
+void normalizeEmbedding(std::vector<float>& embedding) {
+    double norm = 0.0;
+    for (float v : embedding) {
+        norm += static_cast<double>(v) * v;
+    }
+    if (norm > 0.0) {
+        const float scale = static_cast<float>(1.0 / std::sqrt(norm));
+        for (float& v : embedding) {
+            v *= scale;
+        }
+    }
+}
+
+EmbeddingStore::EmbeddingStore(const std::string& path, size_t dim, std::string patient_salt)
+    : path_(path),
+      links_path_(path + ".patients"),
+      patient_salt_(std::move(patient_salt)),
+      dim_(dim),
+      record_bytes_(kRecordHeaderBytes + dim * sizeof(float)) {
+    if (dim_ == 0) {
+        throw std::runtime_error("embedding dimension must be positive");
+    }
+    if (patient_salt_.empty()) {
+        throw std::runtime_error("patient key salt must not be empty");
+    }
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ < 0) {
+        throw ioError("cannot open embedding store", path_);
+    }
+    links_fd_ = ::open(links_path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (links_fd_ < 0) {
+        ::close(fd_);
+        throw ioError("cannot open embedding store", links_path_);
+    }
+    try {
+        load();
+    } catch (...) {
+        ::close(fd_);
+        ::close(links_fd_);
+        throw;
+    }
+    std::cout << "Embedding store " << path_ << ": " << records_.size()
+              << " embeddings of dimension " << dim_ << " for " << by_patient_.size() << " patients" << std::endl;
+}
+
+EmbeddingStore::~EmbeddingStore() {
+    ::fdatasync(fd_);
+    ::close(fd_);
+    ::fdatasync(links_fd_);
+    ::close(links_fd_);
+}
+
+std::string EmbeddingStore::patientSaltFromEnvironment() {
+    const char* salt = std::getenv("IMAGING_PATIENT_KEY_SALT");
+    if (!salt || !*salt) {
+        throw std::runtime_error("IMAGING_PATIENT_KEY_SALT is not set");
+    }
+    return salt;
+}
+
+uint64_t EmbeddingStore::patientKey(std::string_view patient_id) const {
+    return saltedKey(patient_salt_, "patient:", patient_id);
+}
+
+size_t EmbeddingStore::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return records_.size();
+}
+
+void EmbeddingStore::encodeRecord(const Record& record, const float* vector, char* out) const {
+    std::memcpy(out, &record.key.content.high, 8);
+    std::memcpy(out + 8, &record.key.content.low, 8);
+    std::memcpy(out + 16, &record.key.hints, 8);
+    std::memcpy(out + 24, &record.stored_at_ms, 8);
+    std::memcpy(out + kRecordHeaderBytes, vector, dim_ * sizeof(float));
+}
+
+void EmbeddingStore::load() {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+        throw ioError("cannot stat embedding store", path_);
+    }
+    char header[kHeaderBytes] = {};
+    if (st.st_size == 0) {
+        std::memcpy(header, kMagic, sizeof(kMagic));
+        const uint32_t dim = static_cast<uint32_t>(dim_);
+        std::memcpy(header + 8, &dim, sizeof(dim));
+        if (::pwrite(fd_, header, kHeaderBytes, 0) != static_cast<ssize_t>(kHeaderBytes)) {
+            throw ioError("cannot write embedding store", path_);
+        }
+        loadLinks();
+        return;
+    }
+
+    if (::pread(fd_, header, kHeaderBytes, 0) != static_cast<ssize_t>(kHeaderBytes)) {
+        throw std::runtime_error("not an embedding store: " + path_);
+    }
+    const bool legacy = std::memcmp(header, kLegacyMagic, sizeof(kLegacyMagic)) == 0;
+    if (!legacy && std::memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("not an embedding store: " + path_);
+    }
+    uint32_t dim;
+    std::memcpy(&dim, header + 8, sizeof(dim));
+    if (dim != dim_) {
+        throw std::runtime_error("embedding store " + path_ + " holds dimension " + std::to_string(dim) +
+                                 ", the model produces " + std::to_string(dim_));
+    }
+
+    const size_t count = wholeRecords(fd_, path_, st.st_size, kHeaderBytes, record_bytes_);
+
+    // Read in large slabs; the store is sequential and read once. Stores of
+    // the previous format carry an unsalted patient key where the hints
+    // digest is now; their vectors were all made without hints.
+    const size_t batch = std::max<size_t>(1, (8 << 20) / record_bytes_);
+    std::vector<char> buffer(batch * record_bytes_);
+    records_.reserve(count);
+    for (size_t done = 0; done < count;) {
+        const size_t n = std::min(batch, count - done);
+        const size_t bytes = n * record_bytes_;
+        const off_t offset = static_cast<off_t>(kHeaderBytes + done * record_bytes_);
+        if (::pread(fd_, buffer.data(), bytes, offset) != static_cast<ssize_t>(bytes)) {
+            throw ioError("cannot read embedding store", path_);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const char* p = buffer.data() + i * record_bytes_;
+            Record record;
+            uint64_t third;
+            std::memcpy(&record.key.content.high, p, 8);
+            std::memcpy(&record.key.content.low, p + 8, 8);
+            std::memcpy(&third, p + 16, 8);
+            std::memcpy(&record.stored_at_ms, p + 24, 8);
+            record.key.hints = legacy ? 0 : third;
+            if (by_key_.find(record.key) == by_key_.end()) {
+                addRecord(record, reinterpret_cast<const float*>(p + kRecordHeaderBytes));
+            }
+        }
+        done += n;
+    }
+
+    if (legacy) {
+        convertLegacy();
+    } else {
+        loadLinks();
+    }
+}
+
+void EmbeddingStore::loadLinks() {
+    struct stat st;
+    if (::fstat(links_fd_, &st) != 0) {
+        throw ioError("cannot stat embedding store", links_path_);
+    }
+    if (st.st_size == 0) {
+        writeLinksHeader();
+        return;
+    }
+    char header[kLinksHeaderBytes] = {};
+    if (::pread(links_fd_, header, kLinksHeaderBytes, 0) != static_cast<ssize_t>(kLinksHeaderBytes)) {
+        throw std::runtime_error("not an embedding link file: " + links_path_);
+    }
+    if (std::memcmp(header, kUnsaltedLinksMagic, sizeof(kUnsaltedLinksMagic)) == 0) {
+        std::cout << "Embedding store " << links_path_ << ": dropping "
+                  << (st.st_size - kLinksHeaderBytes) / kLinkBytes
+                  << " links with unsalted patient keys" << std::endl;
+        writeLinksHeader();
+        return;
+    }
+    if (std::memcmp(header, kLinksMagic, sizeof(kLinksMagic)) != 0) {
+        throw std::runtime_error("not an embedding link file: " + links_path_);
+    }
+    uint64_t check;
+    std::memcpy(&check, header + 8, sizeof(check));
+    if (check != saltedKey(patient_salt_, "check:", "")) {
+        throw std::runtime_error("embedding link file " + links_path_ +
+                                 " was keyed under another IMAGING_PATIENT_KEY_SALT");
+    }
+
+    const size_t count = wholeRecords(links_fd_, links_path_, st.st_size, kLinksHeaderBytes, kLinkBytes);
+    const size_t batch = (8 << 20) / kLinkBytes;
+    std::vector<char> buffer(batch * kLinkBytes);
+    for (size_t done = 0; done < count;) {
+        const size_t n = std::min(batch, count - done);
+        const size_t bytes = n * kLinkBytes;
+        const off_t offset = static_cast<off_t>(kLinksHeaderBytes + done * kLinkBytes);
+        if (::pread(links_fd_, buffer.data(), bytes, offset) != static_cast<ssize_t>(bytes)) {
+            throw ioError("cannot read embedding store", links_path_);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const char* p = buffer.data() + i * kLinkBytes;
+            uint64_t patient_key;
+            EmbeddingKey key;
+            Link link;
+            std::memcpy(&patient_key, p, 8);
+            std::memcpy(&key.content.high, p + 8, 8);
+            std::memcpy(&key.content.low, p + 16, 8);
+            std::memcpy(&key.hints, p + 24, 8);
+            std::memcpy(&link.linked_at_ms, p + 32, 8);
+            // A link whose vector a crash cut off is dropped with it
+            auto it = by_key_.find(key);
+            if (it != by_key_.end()) {
+                link.index = it->second;
+                addLink(patient_key, link);
+            }
+        }
+        done += n;
+    }
+}
+
+// An empty link file for the current salt, replacing whatever was there
+void EmbeddingStore::writeLinksHeader() {
+    char header[kLinksHeaderBytes] = {};
+    std::memcpy(header, kLinksMagic, sizeof(kLinksMagic));
+    const uint64_t check = saltedKey(patient_salt_, "check:", "");
+    std::memcpy(header + 8, &check, sizeof(check));
+    if (::ftruncate(links_fd_, 0) != 0 ||
+        ::pwrite(links_fd_, header, kLinksHeaderBytes, 0) != static_cast<ssize_t>(kLinksHeaderBytes) ||
+        ::fdatasync(links_fd_) != 0) {
+        throw ioError("cannot write embedding store", links_path_);
+    }
+}
+
+// The link file is reset first, then the vectors under the new header are
+// swapped in by rename: a crash in between leaves the old store, which is
+// converted again when next opened. Its unsalted patient keys are dropped.
+void EmbeddingStore::convertLegacy() {
+    std::cout << "Embedding store " << path_ << ": converting to per-patient links; "
+              << "links with unsalted patient keys are dropped" << std::endl;
+    writeLinksHeader();
+
+    const std::string converted = path_ + ".converting";
+    int out = ::open(converted.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (out < 0) {
+        throw ioError("cannot convert embedding store", converted);
+    }
+    char header[kHeaderBytes] = {};
+    std::memcpy(header, kMagic, sizeof(kMagic));
+    const uint32_t dim = static_cast<uint32_t>(dim_);
+    std::memcpy(header + 8, &dim, sizeof(dim));
+    bool written = ::pwrite(out, header, kHeaderBytes, 0) == static_cast<ssize_t>(kHeaderBytes);
+    std::vector<char> record(record_bytes_);
+    for (size_t i = 0; written && i < records_.size(); ++i) {
+        encodeRecord(records_[i], row(i), record.data());
+        const off_t offset = static_cast<off_t>(kHeaderBytes + i * record_bytes_);
+        written = ::pwrite(out, record.data(), record_bytes_, offset) == static_cast<ssize_t>(record_bytes_);
+    }
+    if (!written || ::fdatasync(out) != 0 || ::rename(converted.c_str(), path_.c_str()) != 0) {
+        const int saved = errno;
+        ::close(out);
+        ::unlink(converted.c_str());
+        errno = saved;
+        throw ioError("cannot convert embedding store", path_);
+    }
+    ::close(fd_);
+    fd_ = out;
+}
+
+void EmbeddingStore::addRecord(const Record& record, const float* vector) {
+    const size_t index = records_.size();
+    if (index % kBlockRows == 0) {
+        blocks_.emplace_back(new float[kBlockRows * dim_]);
+    }
+    std::memcpy(row(index), vector, dim_ * sizeof(float));
+    records_.push_back(record);
+    by_key_.emplace(record.key, index);
+}
+
+bool EmbeddingStore::addLink(uint64_t patient_key, const Link& link) {
+    auto& links = by_patient_[patient_key];
+    for (const auto& existing : links) {
+        if (existing.index == link.index) {
+            return false;
+        }
+    }
+    links.push_back(link);
+    return true;
+}
+
+bool EmbeddingStore::insert(const EmbeddingKey& key, std::vector<float>& embedding) {
+    if (embedding.size() != dim_) {
+        throw std::invalid_argument("embedding has dimension " + std::to_string(embedding.size()) +
+                                    ", the store holds " + std::to_string(dim_));
+    }
+    normalizeEmbedding(embedding);
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (by_key_.count(key)) {
+        return false;
+    }
+    const Record record{key, nowMs()};
+    std::vector<char> bytes(record_bytes_);
+    encodeRecord(record, embedding.data(), bytes.data());
+    appendBytes(fd_, path_, bytes.data(), bytes.size());
+    addRecord(record, embedding.data());
+    return true;
+}
+
+bool EmbeddingStore::link(uint64_t patient_key, const EmbeddingKey& key) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = by_key_.find(key);
+    if (it == by_key_.end()) {
+        throw std::invalid_argument("no embedding stored for " + key.content.hex());
+    }
+    const Link link{it->second, nowMs()};
+    auto patient = by_patient_.find(patient_key);
+    if (patient != by_patient_.end()) {
+        for (const auto& existing : patient->second) {
+            if (existing.index == link.index) {
+                return false;
+            }
+        }
+    }
+    char bytes[kLinkBytes];
+    encodeLink(patient_key, key, link.linked_at_ms, bytes);
+    appendBytes(links_fd_, links_path_, bytes, kLinkBytes);
+    return addLink(patient_key, link);
+}
+
+bool EmbeddingStore::find(const EmbeddingKey& key, std::vector<float>& embedding) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = by_key_.find(key);
+    if (it == by_key_.end()) {
+        return false;
+    }
+    const float* vector = row(it->second);
+    embedding.assign(vector, vector + dim_);
+    return true;
+}
+
+std::vector<ContentHash> EmbeddingStore::hashes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<ContentHash> out;
+    out.reserve(records_.size());
+    for (const auto& record : records_) {
+        if (record.key.hints == 0) {
+            out.push_back(record.key.content);
+        }
+    }
+    return out;
+}
+
+std::vector<EmbeddingSimilarity> EmbeddingStore::compare(uint64_t patient_key, const float* query,
+                                                         const std::vector<ContentHash>& only,
+                                                         const ContentHash& exclude) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto patient = by_patient_.find(patient_key);
+    if (patient == by_patient_.end()) {
+        return {};
+    }
+
+    // Newest first; an image embedded under several hints counts once
+    std::vector<Link> links = patient->second;
+    std::sort(links.begin(), links.end(), [](const Link& a, const Link& b) {
+        return a.linked_at_ms > b.linked_at_ms;
+    });
+    std::vector<Link> selected;
+    selected.reserve(links.size());
+    std::unordered_set<ContentHash, ContentHashHasher> seen;
+    for (const Link& link : links) {
+        const ContentHash& hash = records_[link.index].key.content;
+        if (hash == exclude) {
+            continue;
+        }
+        if (!only.empty() && std::find(only.begin(), only.end(), hash) == only.end()) {
+            continue;
+        }
+        if (seen.insert(hash).second) {
+            selected.push_back(link);
+        }
+    }
+
+    // One kernel call over every prior instead of a loop of scalar dot products
+    std::vector<const float*> rows(selected.size());
+    for (size_t i = 0; i < selected.size(); ++i) {
+        rows[i] = row(selected[i].index);
+    }
+    std::vector<float> scores(selected.size());
+    kernels::dotProducts(query, rows.data(), rows.size(), dim_, scores.data());
+
+    std::vector<EmbeddingSimilarity> results(selected.size());
+    for (size_t i = 0; i < selected.size(); ++i) {
+        results[i] = {records_[selected[i].index].key.content, scores[i], selected[i].linked_at_ms};
+    }
+    return results;
+}
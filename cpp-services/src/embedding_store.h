@@ -0,0 +1,160 @@
+/**
+ * Embedding Store
+ * Model embeddings of analyzed images, kept so a new image can be compared
+ * with a patient's priors without running the model over the priors again.
+ *
+ * Embeddings are keyed by a 128-bit hash of the encoded image bytes plus a
+ * digest of the preprocessing hints they were made with (orientation and
+ * VOI window), since the same bytes embed differently under other hints.
+ * Which patients an image belongs to is kept apart from the vector, as link
+ * rows of (patient key, embedding key), so a study that arrives again under
+ * another or a corrected patient ID is linked to that patient too. Patient
+ * keys are an HMAC-SHA256 of the ID under a secret salt, so the link file
+ * cannot be joined to patient IDs by hashing candidates; the ID itself is
+ * never written. The link file records a check value of the salt, and a
+ * store opened under another salt is refused rather than silently losing
+ * every link.
+ *
+ * Vectors go to the store file: a fixed header followed by fixed-size
+ * records (content hash, hints digest, time stored, float32 vector). Links
+ * go to "<store>.patients": a fixed header followed by fixed-size rows
+ * (patient key, content hash, hints digest, time linked). Both are appended
+ * as images are embedded and linked and read back whole at startup; a
+ * record cut short by a crash is dropped when the file is next opened.
+ * Stores of the previous format (one patient key per vector) are converted
+ * when opened. Links made before patient keys were salted cannot be re-keyed
+ * without the IDs, so they are dropped then; images are linked again as
+ * they are analyzed.
+ *
+ * The content hash is not cryptographic. It identifies images from callers
+ * the service already trusts with patient data, not adversarial inputs.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct ContentHash {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    std::string hex() const;
+    // Throws std::invalid_argument unless `hex` is 32 hex digits
+    static ContentHash fromHex(std::string_view hex);
+
+    bool operator==(const ContentHash& other) const { return high == other.high && low == other.low; }
+};
+
+struct ContentHashHasher {
+    size_t operator()(const ContentHash& hash) const { return static_cast<size_t>(hash.low); }
+};
+
+// One stored embedding: the image and the preprocessing it went through
+struct EmbeddingKey {
+    ContentHash content;
+    uint64_t hints = 0;     // digest of the preprocessing hints; 0: none given
+
+    bool operator==(const EmbeddingKey& other) const { return content == other.content && hints == other.hints; }
+};
+
+struct EmbeddingKeyHasher {
+    size_t operator()(const EmbeddingKey& key) const {
+        return static_cast<size_t>(key.content.low ^ (key.hints * 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+ContentHash contentHash(std::string_view data);
+// Scales to unit length, so dot products are cosine similarities
+void normalizeEmbedding(std::vector<float>& embedding);
+
+struct EmbeddingSimilarity {
+    ContentHash hash;
+    float similarity;       // cosine; embeddings are stored unit length
+    int64_t stored_at_ms;   // Unix time the image was linked to the patient
+};
+
+class EmbeddingStore {
+public:
+    // Opens or creates the store and its link file; throws
+    // std::runtime_error when a file cannot be used, holds embeddings of
+    // another dimension or links keyed under another salt
+    EmbeddingStore(const std::string& path, size_t dim, std::string patient_salt);
+    ~EmbeddingStore();
+    EmbeddingStore(const EmbeddingStore&) = delete;
+    EmbeddingStore& operator=(const EmbeddingStore&) = delete;
+
+    size_t dim() const { return dim_; }
+    size_t size() const;
+    const std::string& path() const { return path_; }
+
+    // IMAGING_PATIENT_KEY_SALT; throws std::runtime_error when it is not
+    // set, since links keyed under a per-process salt would be lost on restart
+    static std::string patientSaltFromEnvironment();
+    // The key `patient_id` is linked under
+    uint64_t patientKey(std::string_view patient_id) const;
+
+    // Normalizes `embedding` to unit length and appends it; false when the
+    // key is already stored. Throws std::runtime_error when the write fails.
+    bool insert(const EmbeddingKey& key, std::vector<float>& embedding);
+    bool find(const EmbeddingKey& key, std::vector<float>& embedding) const;
+    // Links a stored embedding to a patient; false when already linked.
+    // Throws std::invalid_argument when `key` is not stored and
+    // std::runtime_error when the write fails.
+    bool link(uint64_t patient_key, const EmbeddingKey& key);
+    // Content hashes of embeddings stored without hints, oldest first
+    std::vector<ContentHash> hashes() const;
+
+    // Similarity of `query` (unit length) to the embeddings linked to the
+    // patient, newest first and one per image (the most recently linked).
+    // `only`, when not empty, restricts the priors compared; `exclude` is
+    // skipped (the query image itself).
+    std::vector<EmbeddingSimilarity> compare(uint64_t patient_key, const float* query,
+                                             const std::vector<ContentHash>& only,
+                                             const ContentHash& exclude) const;
+
+private:
+    struct Record {
+        EmbeddingKey key;
+        int64_t stored_at_ms;
+    };
+
+    struct Link {
+        size_t index;           // into records_
+        int64_t linked_at_ms;
+    };
+
+    // Vectors live in fixed blocks that are never moved, so row pointers
+    // stay valid while the store grows
+    static constexpr size_t kBlockRows = 4096;
+
+    float* row(size_t index) const { return blocks_[index / kBlockRows].get() + (index % kBlockRows) * dim_; }
+    void load();
+    void loadLinks();
+    void writeLinksHeader();
+    void convertLegacy();
+    void encodeRecord(const Record& record, const float* vector, char* out) const;
+    void addRecord(const Record& record, const float* vector);
+    bool addLink(uint64_t patient_key, const Link& link);
+
+    std::string path_;
+    std::string links_path_;
+    std::string patient_salt_;
+    size_t dim_;
+    size_t record_bytes_;
+    int fd_ = -1;
+    int links_fd_ = -1;
+
+    std::vector<Record> records_;
+    std::vector<std::unique_ptr<float[]>> blocks_;
+    std::unordered_map<EmbeddingKey, size_t, EmbeddingKeyHasher> by_key_;
+    std::unordered_map<uint64_t, std::vector<Link>> by_patient_;
+    mutable std::shared_mutex mutex_;
+};
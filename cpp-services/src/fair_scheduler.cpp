@@ -0,0 +1,267 @@
+/**
+ * Fair Scheduler Implementation
+ */
+
+#include "fair_scheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace {
+
+constexpr int kBands = 3;
+
+// Handler threads re-check cancellation at this interval while queued
+constexpr auto kCancelPollInterval = std::chrono::milliseconds(50);
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+} // namespace
+
+RequestPriority parseRequestPriority(const std::string& priority) {
+    if (priority == "urgent" || priority == "stat") {
+        return RequestPriority::Urgent;
+    }
+    if (priority == "routine") {
+        return RequestPriority::Routine;
+    }
+    return RequestPriority::Normal;
+}
+
+FairSchedulerConfig FairSchedulerConfig::fromEnvironment(int max_concurrent) {
+    FairSchedulerConfig config;
+    config.max_concurrent = std::max(1, max_concurrent);
+    config.default_caller_limit = envInt("IMAGING_CALLER_CONCURRENCY", 0);
+    config.max_queued_per_caller = envInt("IMAGING_CALLER_MAX_QUEUED", config.max_queued_per_caller);
+
+    if (const char* quotas = std::getenv("IMAGING_CALLER_QUOTAS")) {
+        std::stringstream stream(quotas);
+        std::string entry;
+        while (std::getline(stream, entry, ',')) {
+            auto eq = entry.find('=');
+            if (eq == std::string::npos) {
+                continue;
+            }
+            int limit = std::atoi(entry.c_str() + eq + 1);
+            if (limit > 0) {
+                config.caller_limits[entry.substr(0, eq)] = limit;
+            }
+        }
+    }
+    return config;
+}
+
+FairScheduler::Ticket::Ticket(Ticket&& other) noexcept
+    : scheduler_(other.scheduler_),
+      caller_(std::move(other.caller_)),
+      status_(other.status_),
+      queue_time_(other.queue_time_) {
+    other.scheduler_ = nullptr;
+}
+
+FairScheduler::Ticket& FairScheduler::Ticket::operator=(Ticket&& other) noexcept {
+    if (this != &other) {
+        release();
+        scheduler_ = other.scheduler_;
+        caller_ = std::move(other.caller_);
+        status_ = other.status_;
+        queue_time_ = other.queue_time_;
+        other.scheduler_ = nullptr;
+    }
+    return *this;
+}
+
+FairScheduler::Ticket::~Ticket() {
+    release();
+}
+
+void FairScheduler::Ticket::release() {
+    if (scheduler_) {
+        scheduler_->release(caller_);
+        scheduler_ = nullptr;
+    }
+}
+
+FairScheduler::FairScheduler(const FairSchedulerConfig& config)
+    : config_(config) {}
+
+FairScheduler::Ticket FairScheduler::acquire(const std::string& caller, RequestPriority priority, int cost,
+                                             std::chrono::steady_clock::time_point deadline,
+                                             const std::function<bool()>& is_cancelled) {
+    const auto start = std::chrono::steady_clock::now();
+    const int band = static_cast<int>(priority);
+
+    Ticket ticket;
+    ticket.caller_ = caller;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    CallerState& state = callers_[caller];
+    if (state.queued >= config_.max_queued_per_caller) {
+        state.rejected_total++;
+        ticket.status_ = AdmitStatus::QueueFull;
+        return ticket;
+    }
+
+    auto waiter = std::make_shared<Waiter>();
+    waiter->cost = std::max(1, cost);
+    state.queues[band].push_back(waiter);
+    state.queued++;
+    if (!state.in_round[band]) {
+        state.in_round[band] = true;
+        rounds_[band].push_back(caller);
+    }
+    dispatchLocked();
+
+    while (!waiter->admitted) {
+        auto wake = std::min(deadline, std::chrono::steady_clock::now() + kCancelPollInterval);
+        waiter->cv.wait_until(lock, wake);
+        if (waiter->admitted) {
+            break;
+        }
+        bool timed_out = std::chrono::steady_clock::now() >= deadline;
+        if (timed_out || (is_cancelled && is_cancelled())) {
+            removeWaiterLocked(caller, band, waiter);
+            callers_[caller].rejected_total++;
+            forgetIfIdleLocked(caller);
+            ticket.status_ = timed_out ? AdmitStatus::TimedOut : AdmitStatus::Cancelled;
+            return ticket;
+        }
+    }
+
+    ticket.scheduler_ = this;
+    ticket.status_ = AdmitStatus::Admitted;
+    ticket.queue_time_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    return ticket;
+}
+
+void FairScheduler::setMaxConcurrent(int max_concurrent) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_.max_concurrent = std::max(1, max_concurrent);
+    dispatchLocked();
+}
+
+std::vector<CallerStats> FairScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<CallerStats> result;
+    for (const auto& [caller, state] : callers_) {
+        result.push_back({caller, state.active, state.queued, state.admitted_total, state.rejected_total});
+    }
+    return result;
+}
+
+int FairScheduler::callerLimitLocked(const std::string& caller) const {
+    auto it = config_.caller_limits.find(caller);
+    if (it != config_.caller_limits.end()) {
+        return it->second;
+    }
+    if (config_.default_caller_limit > 0) {
+        return config_.default_caller_limit;
+    }
+    return std::max(1, config_.max_concurrent - 1);
+}
+
+void FairScheduler::dispatchLocked() {
+    while (active_ < config_.max_concurrent) {
+        bool admitted = false;
+        for (int band = 0; band < kBands && !admitted; ++band) {
+            admitted = dispatchBandLocked(band);
+        }
+        if (!admitted) {
+            return;
+        }
+    }
+}
+
+// One deficit-round-robin step within a band. Callers at their concurrency
+// limit are skipped without earning credit, so they do not bank a burst.
+// Rounds continue until a request is admitted or every caller in the band
+// is at its limit: nothing else restarts dispatch, so stopping while a
+// caller still needs credit for a request costing several quanta would
+// leave it queued with slots free.
+bool FairScheduler::dispatchBandLocked(int band) {
+    auto& round = rounds_[band];
+    size_t capped = 0;      // consecutive callers skipped at their limit
+    while (!round.empty() && capped < round.size()) {
+        const std::string caller = round.front();
+        CallerState& state = callers_[caller];
+        auto& queue = state.queues[band];
+
+        if (state.active >= callerLimitLocked(caller)) {
+            round.pop_front();
+            round.push_back(caller);
+            capped++;
+            continue;
+        }
+        capped = 0;
+
+        auto waiter = queue.front();
+        if (state.deficit[band] < waiter->cost) {
+            state.deficit[band] += config_.quantum;
+            round.pop_front();
+            round.push_back(caller);
+            continue;
+        }
+
+        state.deficit[band] -= waiter->cost;
+        queue.pop_front();
+        if (queue.empty()) {
+            state.deficit[band] = 0;
+            state.in_round[band] = false;
+            round.pop_front();
+        }
+
+        state.queued--;
+        state.active++;
+        state.admitted_total++;
+        active_++;
+        waiter->admitted = true;
+        waiter->cv.notify_one();
+        return true;
+    }
+    return false;
+}
+
+void FairScheduler::removeWaiterLocked(const std::string& caller, int band,
+                                       const std::shared_ptr<Waiter>& waiter) {
+    CallerState& state = callers_[caller];
+    auto& queue = state.queues[band];
+    auto it = std::find(queue.begin(), queue.end(), waiter);
+    if (it == queue.end()) {
+        return;
+    }
+    queue.erase(it);
+    state.queued--;
+    if (queue.empty() && state.in_round[band]) {
+        state.deficit[band] = 0;
+        state.in_round[band] = false;
+        auto& round = rounds_[band];
+        round.erase(std::find(round.begin(), round.end(), caller));
+    }
+}
+
+// Caller names come from request metadata, so every distinct one would
+// otherwise stay in the map for good. An idle caller has no deficit left
+// (it is reset when the queue empties), so dropping it loses no fairness.
+void FairScheduler::forgetIfIdleLocked(const std::string& caller) {
+    auto it = callers_.find(caller);
+    if (it != callers_.end() && it->second.active == 0 && it->second.queued == 0) {
+        callers_.erase(it);
+    }
+}
+
+void FairScheduler::release(const std::string& caller) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    callers_[caller].active--;
+    active_--;
+    forgetIfIdleLocked(caller);
+    dispatchLocked();
+}
@@ -0,0 +1,126 @@
+/**
+ * Fair Scheduler
+ * Admission control in front of the imaging pipeline. Callers (identified from
+ * gRPC metadata) get their own queues, served by deficit round robin inside
+ * each priority band, and a per-caller cap on requests in the pipeline. One
+ * caller's backfill therefore cannot starve another caller's interactive reads.
+ *
+ * Bands follow the request `priority` field: all waiting "urgent" requests are
+ * admitted before "normal", and "normal" before "routine".
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class RequestPriority {
+    Urgent = 0,
+    Normal = 1,
+    Routine = 2
+};
+
+RequestPriority parseRequestPriority(const std::string& priority);
+
+struct FairSchedulerConfig {
+    int max_concurrent = 4;          // requests inside the pipeline at once
+    int default_caller_limit = 0;    // 0: max_concurrent - 1, keeping a slot for other callers
+    int max_queued_per_caller = 256;
+    int quantum = 4;                 // DRR credit per round, in cost units
+    std::map<std::string, int> caller_limits;
+
+    // IMAGING_CALLER_CONCURRENCY, IMAGING_CALLER_MAX_QUEUED and
+    // IMAGING_CALLER_QUOTAS="js-gateway=4,python-agents=2"
+    static FairSchedulerConfig fromEnvironment(int max_concurrent);
+};
+
+// Callers are forgotten once they have nothing queued or running, so the
+// totals cover a caller's current busy period, not the process lifetime
+struct CallerStats {
+    std::string caller;
+    int active;
+    int queued;
+    uint64_t admitted_total;
+    uint64_t rejected_total;
+};
+
+class FairScheduler {
+public:
+    enum class AdmitStatus { Admitted, QueueFull, TimedOut, Cancelled };
+
+    // Releases the pipeline slot when destroyed
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(Ticket&& other) noexcept;
+        Ticket& operator=(Ticket&& other) noexcept;
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        ~Ticket();
+
+        AdmitStatus status() const { return status_; }
+        explicit operator bool() const { return status_ == AdmitStatus::Admitted; }
+        std::chrono::microseconds queueTime() const { return queue_time_; }
+
+    private:
+        friend class FairScheduler;
+        void release();
+
+        FairScheduler* scheduler_ = nullptr;
+        std::string caller_;
+        AdmitStatus status_ = AdmitStatus::Cancelled;
+        std::chrono::microseconds queue_time_{0};
+    };
+
+    explicit FairScheduler(const FairSchedulerConfig& config);
+
+    // Blocks the handler thread until the request is admitted, the deadline
+    // passes or is_cancelled() returns true. `cost` weights large payloads in
+    // the round robin (e.g. megabytes of image data, at least 1).
+    Ticket acquire(const std::string& caller, RequestPriority priority, int cost,
+                   std::chrono::steady_clock::time_point deadline,
+                   const std::function<bool()>& is_cancelled);
+
+    // Follows thread budget rebalances; the caller limits scale with it
+    void setMaxConcurrent(int max_concurrent);
+
+    std::vector<CallerStats> stats() const;
+
+private:
+    struct Waiter {
+        int cost;
+        bool admitted = false;
+        std::condition_variable cv;
+    };
+
+    struct CallerState {
+        std::deque<std::shared_ptr<Waiter>> queues[3];
+        int deficit[3] = {0, 0, 0};
+        bool in_round[3] = {false, false, false};
+        int active = 0;
+        int queued = 0;
+        uint64_t admitted_total = 0;
+        uint64_t rejected_total = 0;
+    };
+
+    int callerLimitLocked(const std::string& caller) const;
+    void dispatchLocked();
+    bool dispatchBandLocked(int band);
+    void removeWaiterLocked(const std::string& caller, int band, const std::shared_ptr<Waiter>& waiter);
+    void forgetIfIdleLocked(const std::string& caller);
+    void release(const std::string& caller);
+
+    FairSchedulerConfig config_;
+    mutable std::mutex mutex_;
+    std::map<std::string, CallerState> callers_;
+    std::deque<std::string> rounds_[3];   // callers with waiting requests, per band
+    int active_ = 0;
+};
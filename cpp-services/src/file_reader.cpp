@@ -0,0 +1,594 @@
+/**
+ * File Reader Implementation
+ *
+ * The io_uring backend talks to the kernel through the raw system calls and
+ * ring layout from <linux/io_uring.h>, so there is no liburing dependency.
+ * One thread owns the ring: it opens files, queues their reads in chunks of
+ * at most chunk_bytes, reaps completions and hands finished files to the sink.
+ */
+
+#include "file_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+size_t pageSize() {
+    static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return page;
+}
+
+} // namespace
+
+BufferPool::BufferPool(size_t buffer_bytes, int buffers)
+    : buffer_bytes_((buffer_bytes + pageSize() - 1) / pageSize() * pageSize()),
+      buffers_(std::max(buffers, 1)) {
+    void* arena = ::mmap(nullptr, buffer_bytes_ * buffers_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        throw std::runtime_error(std::string("Cannot allocate I/O buffer pool: ") + std::strerror(errno));
+    }
+    arena_ = static_cast<char*>(arena);
+    free_.reserve(buffers_);
+    for (int i = buffers_ - 1; i >= 0; --i) {
+        free_.push_back(buffer(i));
+    }
+}
+
+BufferPool::~BufferPool() {
+    ::munmap(arena_, buffer_bytes_ * buffers_);
+}
+
+char* BufferPool::acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    available_.wait(lock, [this] { return !free_.empty(); });
+    char* buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+}
+
+char* BufferPool::tryAcquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        return nullptr;
+    }
+    char* buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(char* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(buffer);
+    }
+    available_.notify_one();
+}
+
+FileData::~FileData() {
+    if (pooled_) {
+        pool_->release(pooled_);
+    }
+}
+
+// Both backends fill FileData through these, so the buffer rules live once
+class ReadBackend {
+public:
+    virtual ~ReadBackend() = default;
+    virtual const char* name() const = 0;
+    virtual void readAll(const std::vector<std::string>& paths, const FileReader::Sink& sink) = 0;
+
+protected:
+    explicit ReadBackend(BufferPool& pool) : pool_(pool) {}
+
+    static std::unique_ptr<FileData> newFile(const std::string& path) {
+        auto file = std::make_unique<FileData>();
+        file->path_ = path;
+        return file;
+    }
+
+    static void fail(FileData& file, int error) {
+        file.error_ = error;
+        file.size_ = 0;
+    }
+
+    // Opens and stats the file; -1 with the file marked failed on error
+    static int open(FileData& file, size_t& size) {
+        int fd = ::open(file.path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fail(file, errno);
+            return -1;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            fail(file, errno);
+            ::close(fd);
+            return -1;
+        }
+        if (!S_ISREG(info.st_mode)) {
+            fail(file, S_ISDIR(info.st_mode) ? EISDIR : EINVAL);
+            ::close(fd);
+            return -1;
+        }
+        size = static_cast<size_t>(info.st_size);
+        return fd;
+    }
+
+    bool fitsPool(size_t size) const { return size <= pool_.bufferBytes(); }
+
+    void attachPooled(FileData& file, char* buffer, size_t size) {
+        file.pool_ = &pool_;
+        file.pooled_ = buffer;
+        file.data_ = buffer;
+        file.size_ = size;
+    }
+
+    static void attachHeap(FileData& file, size_t size) {
+        file.heap_.reset(new char[std::max<size_t>(size, 1)]);
+        file.data_ = file.heap_.get();
+        file.size_ = size;
+    }
+
+    static char* destination(FileData& file) { return file.data_; }
+    static bool pooled(const FileData& file) { return file.pooled_ != nullptr; }
+    static char* pooledBuffer(const FileData& file) { return file.pooled_; }
+
+    BufferPool& pool_;
+};
+
+class ThreadReadBackend final : public ReadBackend {
+public:
+    ThreadReadBackend(const FileReaderConfig& config, BufferPool& pool)
+        : ReadBackend(pool),
+          // Never more readers than buffers, or they could all wait on each other
+          threads_(std::max(1, std::min({config.queue_depth, 32, pool.buffers()}))) {}
+
+    const char* name() const override { return "threads"; }
+
+    void readAll(const std::vector<std::string>& paths, const FileReader::Sink& sink) override {
+        std::atomic<size_t> next{0};
+        std::mutex sink_mutex;
+        std::exception_ptr failure;
+
+        auto worker = [&] {
+            for (size_t i = next++; i < paths.size(); i = next++) {
+                auto file = read(paths[i]);
+                std::lock_guard<std::mutex> lock(sink_mutex);
+                if (failure) {
+                    return;
+                }
+                try {
+                    sink(std::move(file));
+                } catch (...) {
+                    failure = std::current_exception();
+                    next = paths.size();
+                    return;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        const int count = static_cast<int>(std::min<size_t>(threads_, paths.size()));
+        for (int i = 1; i < count; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+private:
+    std::unique_ptr<FileData> read(const std::string& path) {
+        auto file = newFile(path);
+        size_t size = 0;
+        int fd = open(*file, size);
+        if (fd < 0) {
+            return file;
+        }
+        if (fitsPool(size)) {
+            attachPooled(*file, pool_.acquire(), size);
+        } else {
+            attachHeap(*file, size);
+        }
+        char* out = destination(*file);
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::pread(fd, out + done, size - done, static_cast<off_t>(done));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                fail(*file, n == 0 ? EIO : errno);
+                break;
+            }
+            done += static_cast<size_t>(n);
+        }
+        ::close(fd);
+        return file;
+    }
+
+    int threads_;
+};
+
+class UringReadBackend final : public ReadBackend {
+public:
+    // Null when the kernel (or a seccomp profile) does not offer io_uring
+    static std::unique_ptr<UringReadBackend> create(const FileReaderConfig& config, BufferPool& pool,
+                                                    std::string& reason) {
+        std::unique_ptr<UringReadBackend> backend(new UringReadBackend(config, pool));
+        if (!backend->setup(reason)) {
+            return nullptr;
+        }
+        return backend;
+    }
+
+    ~UringReadBackend() override {
+        if (sqes_) {
+            ::munmap(sqes_, sqes_bytes_);
+        }
+        if (cq_ring_ && cq_ring_ != sq_ring_) {
+            ::munmap(cq_ring_, cq_ring_bytes_);
+        }
+        if (sq_ring_) {
+            ::munmap(sq_ring_, sq_ring_bytes_);
+        }
+        if (ring_fd_ >= 0) {
+            ::close(ring_fd_);
+        }
+    }
+
+    const char* name() const override { return registered_ ? "io_uring (registered buffers)" : "io_uring"; }
+
+    void readAll(const std::vector<std::string>& paths, const FileReader::Sink& sink) override {
+        try {
+            run(paths, sink);
+        } catch (...) {
+            abandon();
+            throw;
+        }
+    }
+
+private:
+    struct OpenFile {
+        std::unique_ptr<FileData> data;
+        int fd = -1;
+        int outstanding = 0;    // chunk reads queued or in flight
+    };
+
+    struct Read {
+        OpenFile* file = nullptr;
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    void run(const std::vector<std::string>& paths, const FileReader::Sink& sink) {
+        size_t next = 0;
+        while (next < paths.size() || !queued_.empty() || in_flight_ > 0) {
+            // Fill the ring: pending chunks first, then open more files
+            while (in_flight_ < depth_) {
+                if (queued_.empty()) {
+                    if (next >= paths.size() || !openNext(paths[next], sink)) {
+                        break;
+                    }
+                    ++next;
+                    continue;
+                }
+                prepare(queued_.front());
+                queued_.pop_front();
+            }
+            submitAndReap(sink);
+        }
+    }
+
+    // After a failure (usually a throwing sink): wait out the reads the
+    // kernel still owns, then drop every open file so the ring can be reused
+    void abandon() {
+        while (in_flight_ > 0) {
+            int rc = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit_, 1,
+                                                IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (rc < 0 && errno != EINTR) {
+                break;
+            }
+            if (rc > 0) {
+                to_submit_ -= std::min<unsigned>(to_submit_, static_cast<unsigned>(rc));
+            }
+            unsigned head = *cq_head_;
+            const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                free_slots_.push_back(static_cast<int>(cqes_[head & cq_mask_].user_data));
+                --in_flight_;
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+        queued_.clear();
+        for (auto& file : open_files_) {
+            ::close(file->fd);
+        }
+        open_files_.clear();
+    }
+
+    UringReadBackend(const FileReaderConfig& config, BufferPool& pool)
+        : ReadBackend(pool),
+          depth_(std::max(1, std::min(config.queue_depth, 4096))),
+          chunk_bytes_(std::max<size_t>(config.chunk_bytes, 64 * 1024)) {}
+
+    bool setup(std::string& reason) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, depth_, &params));
+        if (ring_fd_ < 0) {
+            reason = std::string("io_uring_setup: ") + std::strerror(errno);
+            return false;
+        }
+        // IORING_OP_READ arrived with the same kernel (5.6) as this feature
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            reason = "kernel lacks IORING_OP_READ";
+            return false;
+        }
+
+        sq_ring_bytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_bytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_bytes_ = cq_ring_bytes_ = std::max(sq_ring_bytes_, cq_ring_bytes_);
+        }
+        sq_ring_ = mapRing(sq_ring_bytes_, IORING_OFF_SQ_RING);
+        cq_ring_ = single_mmap ? sq_ring_ : mapRing(cq_ring_bytes_, IORING_OFF_CQ_RING);
+        sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(mapRing(sqes_bytes_, IORING_OFF_SQES));
+        if (!sq_ring_ || !cq_ring_ || !sqes_) {
+            reason = std::string("io_uring mmap: ") + std::strerror(errno);
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sq_ring_);
+        char* cq = static_cast<char*>(cq_ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        depth_ = std::min(depth_, static_cast<int>(sq_entries_));
+
+        slots_.resize(depth_);
+        for (int i = depth_ - 1; i >= 0; --i) {
+            free_slots_.push_back(i);
+        }
+
+        // Registered buffers skip pinning pages on every read. Registration
+        // counts against RLIMIT_MEMLOCK, so plain reads are the fallback.
+        std::vector<iovec> buffers(pool_.buffers());
+        for (int i = 0; i < pool_.buffers(); ++i) {
+            buffers[i].iov_base = pool_.buffer(i);
+            buffers[i].iov_len = pool_.bufferBytes();
+        }
+        registered_ = ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+                                buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+        return true;
+    }
+
+    void* mapRing(size_t bytes, off_t offset) {
+        void* ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    // Opens one file and queues its chunks; false when it must wait for a
+    // pool buffer that only completions in flight can free up
+    bool openNext(const std::string& path, const FileReader::Sink& sink) {
+        auto file = newFile(path);
+        size_t size = 0;
+        int fd = open(*file, size);
+        if (fd < 0 || size == 0) {
+            if (fd >= 0) {
+                ::close(fd);
+                attachHeap(*file, 0);
+            }
+            sink(std::move(file));
+            return true;
+        }
+        if (fitsPool(size)) {
+            char* buffer = pool_.tryAcquire();
+            if (!buffer && in_flight_ > 0) {
+                ::close(fd);
+                return false;
+            }
+            // Nothing in flight: every buffer is with the consumer
+            attachPooled(*file, buffer ? buffer : pool_.acquire(), size);
+        } else {
+            attachHeap(*file, size);
+        }
+
+        open_files_.push_back(std::make_unique<OpenFile>());
+        OpenFile* open_file = open_files_.back().get();
+        open_file->data = std::move(file);
+        open_file->fd = fd;
+        for (size_t offset = 0; offset < size; offset += chunk_bytes_) {
+            queued_.push_back({open_file, offset, std::min(chunk_bytes_, size - offset)});
+            open_file->outstanding++;
+        }
+        return true;
+    }
+
+    void prepare(const Read& read) {
+        const int slot = free_slots_.back();
+        free_slots_.pop_back();
+        slots_[slot] = read;
+
+        const unsigned tail = *sq_tail_;
+        const unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        FileData& data = *read.file->data;
+        const bool fixed = registered_ && pooled(data);
+        sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = read.file->fd;
+        sqe->off = read.offset;
+        sqe->addr = reinterpret_cast<uint64_t>(destination(data) + read.offset);
+        sqe->len = static_cast<uint32_t>(read.length);
+        if (fixed) {
+            sqe->buf_index = static_cast<uint16_t>(pool_.indexOf(pooledBuffer(data)));
+        }
+        sqe->user_data = static_cast<uint64_t>(slot);
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+        ++in_flight_;
+    }
+
+    void submitAndReap(const FileReader::Sink& sink) {
+        if (in_flight_ == 0) {
+            return;
+        }
+        // Submit everything prepared and wait for at least one completion
+        int rc;
+        do {
+            rc = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit_, 1,
+                                            IORING_ENTER_GETEVENTS, nullptr, 0));
+        } while (rc < 0 && errno == EINTR);
+        if (rc < 0) {
+            throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+        }
+        to_submit_ -= std::min<unsigned>(to_submit_, static_cast<unsigned>(rc));
+
+        // Each entry is consumed before the sink runs, so a throwing sink
+        // leaves the ring consistent for abandon()
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe cqe = cqes_[head & cq_mask_];
+            __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+            complete(static_cast<int>(cqe.user_data), cqe.res, sink);
+        }
+    }
+
+    void complete(int slot, int result, const FileReader::Sink& sink) {
+        Read read = slots_[slot];
+        free_slots_.push_back(slot);
+        --in_flight_;
+        OpenFile* file = read.file;
+
+        if (result == -EAGAIN || result == -EINTR) {
+            queued_.push_front(read);
+            return;
+        }
+        if (result < 0 || (result == 0 && read.length > 0)) {
+            if (file->data->error() == 0) {
+                fail(*file->data, result < 0 ? -result : EIO);
+            }
+        } else if (static_cast<size_t>(result) < read.length && file->data->error() == 0) {
+            // Short read: queue the rest
+            queued_.push_front({file, read.offset + result, read.length - result});
+            return;
+        }
+
+        if (--file->outstanding > 0) {
+            return;
+        }
+        ::close(file->fd);
+        std::unique_ptr<FileData> data = std::move(file->data);
+        open_files_.erase(std::find_if(open_files_.begin(), open_files_.end(),
+                                       [file](const std::unique_ptr<OpenFile>& f) { return f.get() == file; }));
+        sink(std::move(data));
+    }
+
+    int depth_;
+    size_t chunk_bytes_;
+    bool registered_ = false;
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_bytes_ = 0;
+    size_t cq_ring_bytes_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_bytes_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    std::vector<Read> slots_;
+    std::vector<int> free_slots_;
+    std::deque<Read> queued_;
+    std::vector<std::unique_ptr<OpenFile>> open_files_;
+    int in_flight_ = 0;
+    unsigned to_submit_ = 0;
+};
+
+FileReaderConfig FileReaderConfig::fromEnvironment() {
+    FileReaderConfig config;
+    if (const char* backend = std::getenv("IMAGING_IO_BACKEND")) {
+        config.backend = backend;
+    }
+    config.queue_depth = envInt("IMAGING_IO_QUEUE_DEPTH", config.queue_depth);
+    config.buffer_bytes = static_cast<size_t>(envInt("IMAGING_IO_BUFFER_MB", 4)) << 20;
+    config.buffers = envInt("IMAGING_IO_BUFFERS", config.buffers);
+    return config;
+}
+
+FileReader::FileReader(FileReaderConfig config)
+    : config_(std::move(config)),
+      pool_(std::make_unique<BufferPool>(config_.buffer_bytes, config_.buffers)) {
+    if (config_.backend != "threads") {
+        std::string reason;
+        backend_ = UringReadBackend::create(config_, *pool_, reason);
+        if (!backend_) {
+            if (config_.backend == "io_uring") {
+                throw std::runtime_error("io_uring unavailable: " + reason);
+            }
+            std::cerr << "io_uring unavailable (" << reason << "), reading with threads" << std::endl;
+        }
+    }
+    if (!backend_) {
+        backend_ = std::make_unique<ThreadReadBackend>(config_, *pool_);
+    }
+}
+
+FileReader::~FileReader() = default;
+
+void FileReader::readAll(const std::vector<std::string>& paths, const Sink& sink) {
+    backend_->readAll(paths, sink);
+}
+
+const char* FileReader::backendName() const {
+    return backend_->name();
+}
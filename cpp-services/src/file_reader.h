@@ -0,0 +1,112 @@
+/**
+ * File Reader
+ * Bulk reads of local files for study ingestion and backfill. Instead of one
+ * blocking read() per file, many reads are kept in flight so NVMe devices see
+ * a deep queue, and each file is handed to the caller (the parse stage) the
+ * moment its last byte lands.
+ *
+ * The io_uring backend submits reads into a fixed pool of buffers registered
+ * with the kernel, which skips the per-I/O page pinning. Where io_uring is
+ * unavailable (old kernels, or container seccomp profiles that block it) a
+ * pool of threads issuing pread() takes over behind the same interface.
+ * Files larger than a pool buffer are read into their own heap buffer.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Fixed-size buffers carved from one mapping, so the io_uring backend can
+// register them once. acquire() blocks while all buffers are out.
+class BufferPool {
+public:
+    BufferPool(size_t buffer_bytes, int buffers);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    char* acquire();
+    char* tryAcquire();
+    void release(char* buffer);
+
+    size_t bufferBytes() const { return buffer_bytes_; }
+    int buffers() const { return buffers_; }
+    char* buffer(int index) const { return arena_ + index * buffer_bytes_; }
+    int indexOf(const char* buffer) const { return static_cast<int>((buffer - arena_) / buffer_bytes_); }
+
+private:
+    size_t buffer_bytes_;
+    int buffers_;
+    char* arena_ = nullptr;
+    std::vector<char*> free_;
+    std::mutex mutex_;
+    std::condition_variable available_;
+};
+
+// One file's contents, in a pool buffer or a heap buffer; released when
+// destroyed. error() is the errno of a failed open or read.
+class FileData {
+public:
+    FileData() = default;
+    ~FileData();
+    FileData(const FileData&) = delete;
+    FileData& operator=(const FileData&) = delete;
+
+    const std::string& path() const { return path_; }
+    std::string_view data() const { return std::string_view(data_, size_); }
+    int error() const { return error_; }
+
+private:
+    friend class ReadBackend;
+
+    std::string path_;
+    BufferPool* pool_ = nullptr;
+    char* pooled_ = nullptr;
+    std::unique_ptr<char[]> heap_;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+    int error_ = 0;
+};
+
+struct FileReaderConfig {
+    std::string backend = "auto";       // "auto", "io_uring" or "threads"
+    int queue_depth = 64;               // reads in flight
+    size_t buffer_bytes = 4 << 20;      // pool buffer size; larger files go to the heap
+    int buffers = 96;                   // pool buffers, shared by reads and handed-off files
+    size_t chunk_bytes = 1 << 20;       // largest single read request
+
+    // IMAGING_IO_BACKEND, IMAGING_IO_QUEUE_DEPTH, IMAGING_IO_BUFFER_MB and
+    // IMAGING_IO_BUFFERS
+    static FileReaderConfig fromEnvironment();
+};
+
+class ReadBackend;
+
+class FileReader {
+public:
+    // Called once per file, in completion order, from one thread at a time.
+    // Holding on to the FileData keeps its pool buffer out of circulation,
+    // which is how a slow consumer throttles reading.
+    using Sink = std::function<void(std::unique_ptr<FileData>)>;
+
+    explicit FileReader(FileReaderConfig config = FileReaderConfig::fromEnvironment());
+    ~FileReader();
+
+    // Blocks until every path has been delivered to `sink`
+    void readAll(const std::vector<std::string>& paths, const Sink& sink);
+
+    const char* backendName() const;
+    const FileReaderConfig& config() const { return config_; }
+
+private:
+    FileReaderConfig config_;
+    std::unique_ptr<BufferPool> pool_;
+    std::unique_ptr<ReadBackend> backend_;
+};
@@ -0,0 +1,15 @@
+/**
+ * HMAC-SHA256
+ * Keyed digests for values derived from patient data under a secret salt:
+ * replacement UIDs and pseudonyms when de-identifying, and the patient keys
+ * of the embedding store. Without the salt the derived value cannot be
+ * matched back to the input by hashing candidate IDs.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+std::array<uint8_t, 32> hmacSha256(std::string_view key, std::string_view message);
@@ -0,0 +1,323 @@
+/**
+ * Image Kernels Implementation
+ * Runtime dispatch to the per-ISA kernel tables
+ */
+
+#include "image_kernels.h"
+#include "image_kernels_dispatch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+namespace kernels {
+
+namespace {
+
+// Elements per parallel chunk; below two chunks the kernels run inline
+constexpr size_t kPixelGrain = 64 * 1024;
+
+struct Dispatch {
+    CpuIsa isa;
+    const KernelTable* table;
+};
+
+// Rows are split across the pool; each chunk sums into its own slot, merged
+// in order so results do not depend on the team size
+template <typename Src, typename Kernel>
+ImageStatistics statisticsOf(Kernel kernel, const Src* src, int width, int height, size_t stride, int shift) {
+    ImageStatistics total{};
+    if (width <= 0 || height <= 0) {
+        return total;
+    }
+    const size_t row_grain = std::max<size_t>(1, kPixelGrain / width);
+    std::vector<ImageStatistics> partial((height + row_grain - 1) / row_grain, ImageStatistics{});
+    parallel::forRange(0, height, row_grain, [&](size_t begin, size_t end) {
+        kernel(src, width, height, stride, static_cast<int>(begin), static_cast<int>(end), shift,
+               &partial[begin / row_grain]);
+    });
+    for (const auto& chunk : partial) {
+        for (int bin = 0; bin < 256; ++bin) {
+            total.histogram[bin] += chunk.histogram[bin];
+        }
+        total.pixels += chunk.pixels;
+        total.interior += chunk.interior;
+        total.laplacian_sum += chunk.laplacian_sum;
+        total.laplacian_sq_sum += chunk.laplacian_sq_sum;
+        total.noise_abs_sum += chunk.noise_abs_sum;
+    }
+    return total;
+}
+
+// Bilinear taps for reading a source, through an orientation, at the output
+// size: output pixel (x, y) blends the source elements at
+// row_offset[2y + {0,1}] + col_offset[2x + {0,1}]
+struct SamplingGrid {
+    std::vector<ptrdiff_t> col_offset;
+    std::vector<float> x_weight;
+    std::vector<ptrdiff_t> row_offset;
+    std::vector<float> y_weight;
+};
+
+SamplingGrid samplingGrid(int src_width, int src_height, size_t stride,
+                          int dst_width, int dst_height, ImageOrientation orientation) {
+    // The oriented source is a view with its own size and element strides;
+    // taps are computed in it (as in the plain resize) and turned into
+    // offsets into the real source
+    const unsigned bits = static_cast<unsigned>(orientation);
+    const bool transpose = (bits & 4) != 0;
+    const int view_width = transpose ? src_height : src_width;
+    const int view_height = transpose ? src_width : src_height;
+    const ptrdiff_t step_u = transpose ? static_cast<ptrdiff_t>(stride) : 1;
+    const ptrdiff_t step_v = transpose ? 1 : static_cast<ptrdiff_t>(stride);
+    auto offsetU = [&](int u) { return ((bits & 1) ? view_width - 1 - u : u) * step_u; };
+    auto offsetV = [&](int v) { return ((bits & 2) ? view_height - 1 - v : v) * step_v; };
+
+    SamplingGrid grid;
+    grid.col_offset.resize(2 * static_cast<size_t>(dst_width));
+    grid.x_weight.resize(dst_width);
+    const float scale_x = static_cast<float>(view_width) / static_cast<float>(dst_width);
+    for (int dx = 0; dx < dst_width; ++dx) {
+        float sx = std::max((dx + 0.5f) * scale_x - 0.5f, 0.0f);
+        int x0 = std::min(static_cast<int>(sx), view_width - 1);
+        grid.col_offset[2 * dx] = offsetU(x0);
+        grid.col_offset[2 * dx + 1] = offsetU(x0 + 1 < view_width ? x0 + 1 : x0);
+        grid.x_weight[dx] = sx - static_cast<float>(x0);
+    }
+    grid.row_offset.resize(2 * static_cast<size_t>(dst_height));
+    grid.y_weight.resize(dst_height);
+    const float scale_y = static_cast<float>(view_height) / static_cast<float>(dst_height);
+    for (int dy = 0; dy < dst_height; ++dy) {
+        float sy = std::max((dy + 0.5f) * scale_y - 0.5f, 0.0f);
+        int y0 = std::min(static_cast<int>(sy), view_height - 1);
+        grid.row_offset[2 * dy] = offsetV(y0);
+        grid.row_offset[2 * dy + 1] = offsetV(y0 + 1 < view_height ? y0 + 1 : y0);
+        grid.y_weight[dy] = sy - static_cast<float>(y0);
+    }
+    return grid;
+}
+
+// Same folding as the window-level kernels, plus the normalization
+TensorCoefficients tensorCoefficients(PixelDepth depth, const TensorMapping& mapping) {
+    TensorCoefficients c{};
+    if (const WindowLevelParams* p = mapping.window) {
+        const double width = p->width > 1.0 ? p->width : 1.0;
+        const double scale = width > 1.0 ? 1.0 / (width - 1.0) : 1.0;
+        c.gain = static_cast<float>(p->rescale_slope * scale);
+        c.bias = static_cast<float>((p->rescale_intercept - (p->center - 0.5)) * scale + 0.5);
+    } else {
+        switch (depth) {
+            case PixelDepth::U8:  c.gain = 1.0f / 255.0f; c.bias = 0.0f; break;
+            case PixelDepth::U16: c.gain = 1.0f / 65535.0f; c.bias = 0.0f; break;
+            case PixelDepth::S16: c.gain = 1.0f / 65535.0f; c.bias = 32768.0f / 65535.0f; break;
+            case PixelDepth::F32: c.gain = 1.0f; c.bias = 0.0f; break;
+        }
+    }
+    c.scale = 1.0f / mapping.stddev;
+    c.offset = -mapping.mean / mapping.stddev;
+    return c;
+}
+
+template <typename Src, typename Kernel>
+void resampleRows(Kernel kernel, const void* src, const SamplingGrid& grid, const TensorCoefficients& c,
+                  float* dst, int dst_width, int dst_height) {
+    const size_t row_grain = std::max<size_t>(1, kPixelGrain / dst_width);
+    parallel::forRange(0, dst_height, row_grain, [&](size_t begin, size_t end) {
+        kernel(static_cast<const Src*>(src), dst, dst_width, static_cast<int>(begin), static_cast<int>(end),
+               grid.col_offset.data(), grid.x_weight.data(), grid.row_offset.data(), grid.y_weight.data(), c);
+    });
+}
+
+Dispatch selectKernels() {
+    CpuIsa isa = detectCpuIsa();
+    const KernelTable* table;
+    switch (isa) {
+        case CpuIsa::AVX512: table = kernelTableAvx512(); break;
+        case CpuIsa::AVX2:   table = kernelTableAvx2(); break;
+        case CpuIsa::SSE42:  table = kernelTableSse42(); break;
+        default:             table = kernelTableBaseline(); break;
+    }
+    std::cout << "Image kernels dispatched to " << cpuIsaName(isa) << std::endl;
+    return {isa, table};
+}
+
+const Dispatch& dispatch() {
+    static const Dispatch selected = selectKernels();
+    return selected;
+}
+
+} // namespace
+
+CpuIsa activeIsa() {
+    return dispatch().isa;
+}
+
+void windowLevel(const uint16_t* src, float* dst, size_t count, const WindowLevelParams& params) {
+    auto kernel = dispatch().table->window_level_u16_f32;
+    parallel::forRange(0, count, kPixelGrain, [&](size_t begin, size_t end) {
+        kernel(src + begin, dst + begin, end - begin, params);
+    });
+}
+
+void windowLevel(const int16_t* src, float* dst, size_t count, const WindowLevelParams& params) {
+    auto kernel = dispatch().table->window_level_s16_f32;
+    parallel::forRange(0, count, kPixelGrain, [&](size_t begin, size_t end) {
+        kernel(src + begin, dst + begin, end - begin, params);
+    });
+}
+
+void windowLevel(const uint16_t* src, uint8_t* dst, size_t count, const WindowLevelParams& params) {
+    auto kernel = dispatch().table->window_level_u16_u8;
+    parallel::forRange(0, count, kPixelGrain, [&](size_t begin, size_t end) {
+        kernel(src + begin, dst + begin, end - begin, params);
+    });
+}
+
+void windowLevel(const int16_t* src, uint8_t* dst, size_t count, const WindowLevelParams& params) {
+    auto kernel = dispatch().table->window_level_s16_u8;
+    parallel::forRange(0, count, kPixelGrain, [&](size_t begin, size_t end) {
+        kernel(src + begin, dst + begin, end - begin, params);
+    });
+}
+
+void normalize(const uint8_t* src, float* dst, size_t count, float scale, float mean, float stddev) {
+    auto kernel = dispatch().table->normalize_u8;
+    parallel::forRange(0, count, kPixelGrain, [&](size_t begin, size_t end) {
+        kernel(src + begin, dst + begin, end - begin, scale, mean, stddev);
+    });
+}
+
+void normalize(const float* src, float* dst, size_t count, float mean, float stddev) {
+    auto kernel = dispatch().table->normalize_f32;
+    parallel::forRange(0, count, kPixelGrain, [&](size_t begin, size_t end) {
+        kernel(src + begin, dst + begin, end - begin, mean, stddev);
+    });
+}
+
+void resizeBilinear(const float* src, int src_width, int src_height,
+                    float* dst, int dst_width, int dst_height) {
+    if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0) {
+        return;
+    }
+
+    // Column taps are shared by every row, so compute them once here
+    std::vector<int> x_index(dst_width);
+    std::vector<float> x_weight(dst_width);
+    const float scale_x = static_cast<float>(src_width) / static_cast<float>(dst_width);
+    for (int dx = 0; dx < dst_width; ++dx) {
+        float sx = std::max((dx + 0.5f) * scale_x - 0.5f, 0.0f);
+        int x0 = std::min(static_cast<int>(sx), src_width - 1);
+        x_index[dx] = x0;
+        x_weight[dx] = sx - static_cast<float>(x0);
+    }
+
+    auto kernel = dispatch().table->resize_bilinear;
+    const size_t row_grain = std::max<size_t>(1, kPixelGrain / dst_width);
+    parallel::forRange(0, dst_height, row_grain, [&](size_t begin, size_t end) {
+        kernel(src, src_width, src_height, dst, dst_width, dst_height,
+               static_cast<int>(begin), static_cast<int>(end), x_index.data(), x_weight.data());
+    });
+}
+
+void resizeBilinear(const float* src, int src_width, int src_height,
+                    float* dst, int dst_width, int dst_height, ImageOrientation orientation) {
+    if (orientation == ImageOrientation::Identity) {
+        resizeBilinear(src, src_width, src_height, dst, dst_width, dst_height);
+        return;
+    }
+    if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0) {
+        return;
+    }
+
+    const SamplingGrid grid = samplingGrid(src_width, src_height, src_width, dst_width, dst_height, orientation);
+    auto kernel = dispatch().table->resize_bilinear_gather;
+    const size_t row_grain = std::max<size_t>(1, kPixelGrain / dst_width);
+    parallel::forRange(0, dst_height, row_grain, [&](size_t begin, size_t end) {
+        kernel(src, dst, dst_width, static_cast<int>(begin), static_cast<int>(end),
+               grid.col_offset.data(), grid.x_weight.data(), grid.row_offset.data(), grid.y_weight.data());
+    });
+}
+
+void resampleToTensor(const PixelPlane& src, const TensorMapping& mapping, float* dst,
+                      int dst_width, int dst_height, ImageOrientation orientation) {
+    if (src.width <= 0 || src.height <= 0 || dst_width <= 0 || dst_height <= 0) {
+        return;
+    }
+
+    const SamplingGrid grid = samplingGrid(src.width, src.height, src.stride, dst_width, dst_height, orientation);
+    const TensorCoefficients c = tensorCoefficients(src.depth, mapping);
+    const KernelTable* table = dispatch().table;
+    switch (src.depth) {
+        case PixelDepth::U8:
+            resampleRows<uint8_t>(table->resample_tensor_u8, src.data, grid, c, dst, dst_width, dst_height);
+            break;
+        case PixelDepth::U16:
+            resampleRows<uint16_t>(table->resample_tensor_u16, src.data, grid, c, dst, dst_width, dst_height);
+            break;
+        case PixelDepth::S16:
+            resampleRows<int16_t>(table->resample_tensor_s16, src.data, grid, c, dst, dst_width, dst_height);
+            break;
+        case PixelDepth::F32:
+            resampleRows<float>(table->resample_tensor_f32, src.data, grid, c, dst, dst_width, dst_height);
+            break;
+    }
+}
+
+std::vector<int> nonMaxSuppression(const std::vector<DetectionBox>& boxes, float iou_threshold) {
+    const size_t n = boxes.size();
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return boxes[a].score > boxes[b].score; });
+
+    // Structure-of-arrays in score order so the overlap kernel streams contiguously
+    std::vector<float> x1(n), y1(n), x2(n), y2(n), area(n);
+    for (size_t i = 0; i < n; ++i) {
+        const auto& box = boxes[order[i]];
+        x1[i] = box.x1;
+        y1[i] = box.y1;
+        x2[i] = box.x2;
+        y2[i] = box.y2;
+        area[i] = (box.x2 - box.x1) * (box.y2 - box.y1);
+    }
+
+    std::vector<uint8_t> suppressed(n, 0);
+    std::vector<int> keep;
+    const KernelTable* table = dispatch().table;
+    for (size_t i = 0; i < n; ++i) {
+        if (suppressed[i]) {
+            continue;
+        }
+        keep.push_back(order[i]);
+        const float reference[4] = {x1[i], y1[i], x2[i], y2[i]};
+        const size_t rest = i + 1;
+        table->suppress_overlaps(x1.data() + rest, y1.data() + rest, x2.data() + rest, y2.data() + rest,
+                                 area.data() + rest, n - rest, reference, iou_threshold,
+                                 suppressed.data() + rest);
+    }
+    return keep;
+}
+
+ImageStatistics imageStatistics(const uint8_t* src, int width, int height, size_t stride) {
+    return statisticsOf(dispatch().table->image_statistics_u8, src, width, height, stride, 0);
+}
+
+ImageStatistics imageStatistics(const uint16_t* src, int width, int height, size_t stride, int shift) {
+    return statisticsOf(dispatch().table->image_statistics_u16, src, width, height, stride, shift);
+}
+
+void dotProducts(const float* query, const float* const* rows, size_t count, size_t dim, float* out) {
+    auto kernel = dispatch().table->dot_products;
+    // Small batches (a graph node's neighbours) skip the pool bookkeeping
+    if (count * dim < 2 * kPixelGrain) {
+        kernel(query, rows, count, dim, out);
+        return;
+    }
+    const size_t row_grain = std::max<size_t>(1, kPixelGrain / std::max<size_t>(dim, 1));
+    parallel::forRange(0, count, row_grain, [&](size_t begin, size_t end) {
+        kernel(query, rows + begin, end - begin, dim, out + begin);
+    });
+}
+
+} // namespace kernels
@@ -0,0 +1,125 @@
+/**
+ * Image Kernels
+ * Hot per-pixel kernels used by DICOM processing, preprocessing and
+ * post-processing. Each kernel is compiled for several instruction sets and
+ * the best variant for the running CPU is selected once at startup, so a
+ * single binary runs on every node of the fleet. Large inputs are split across
+ * the OpenMP pipeline budget (see parallel.h).
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.h"
+
+struct WindowLevelParams {
+    double center;
+    double width;
+    double rescale_slope = 1.0;
+    double rescale_intercept = 0.0;
+};
+
+// How to read a plane so it comes out in canonical orientation: bit 0
+// mirrors the output columns, bit 1 the output rows, bit 2 swaps the axes
+// (output columns run down the source). Rotations are clockwise.
+enum class ImageOrientation : uint8_t {
+    Identity = 0,
+    FlipHorizontal = 1,
+    FlipVertical = 2,
+    Rotate180 = 3,
+    Transpose = 4,
+    Rotate90 = 5,
+    Rotate270 = 6,
+    Transverse = 7,
+};
+
+// Stored sample type of a decoded plane
+enum class PixelDepth : uint8_t {
+    U8,
+    U16,
+    S16,
+    F32,
+};
+
+// A decoded single-channel plane at its stored depth, not converted;
+// `stride` is in elements
+struct PixelPlane {
+    const void* data;
+    PixelDepth depth;
+    int width;
+    int height;
+    size_t stride;
+};
+
+// Stored values to model input: through the window when one is given,
+// otherwise scaled from the depth's full range to [0, 1] (F32 is taken as
+// [0, 1] already), then (v - mean) / stddev
+struct TensorMapping {
+    const WindowLevelParams* window = nullptr;
+    float mean = 0.0f;
+    float stddev = 1.0f;
+};
+
+struct DetectionBox {
+    float x1, y1, x2, y2;
+    float score;
+};
+
+// Sums for image quality checks; value-initialize before accumulating
+struct ImageStatistics {
+    uint64_t histogram[256];        // intensities >> shift, clamped to 255
+    uint64_t pixels;
+    uint64_t interior;              // pixels with all eight neighbours
+    double laplacian_sum;           // 4-neighbour Laplacian over interior pixels
+    double laplacian_sq_sum;
+    double noise_abs_sum;           // |Immerkaer noise mask response| over interior pixels
+};
+
+namespace kernels {
+
+// Instruction set the kernels were dispatched to
+CpuIsa activeIsa();
+
+// DICOM linear VOI LUT (PS3.3 C.11.2.1.2) applied to stored pixel values,
+// producing normalized [0, 1] intensities or display-ready 8-bit values
+void windowLevel(const uint16_t* src, float* dst, size_t count, const WindowLevelParams& params);
+void windowLevel(const int16_t* src, float* dst, size_t count, const WindowLevelParams& params);
+void windowLevel(const uint16_t* src, uint8_t* dst, size_t count, const WindowLevelParams& params);
+void windowLevel(const int16_t* src, uint8_t* dst, size_t count, const WindowLevelParams& params);
+
+// dst = (src * scale - mean) / stddev
+void normalize(const uint8_t* src, float* dst, size_t count, float scale, float mean, float stddev);
+void normalize(const float* src, float* dst, size_t count, float mean, float stddev);
+
+// Bilinear resize of a single-channel float plane (half-pixel centers, as cv::INTER_LINEAR)
+void resizeBilinear(const float* src, int src_width, int src_height,
+                    float* dst, int dst_width, int dst_height);
+
+// The same, reading the source in `orientation`: the transform costs nothing
+// beyond the resize, and no reoriented copy of the source is made. dst is
+// laid out in the output orientation.
+void resizeBilinear(const float* src, int src_width, int src_height,
+                    float* dst, int dst_width, int dst_height, ImageOrientation orientation);
+
+// Decoded plane to model input in one pass: every source sample the
+// bilinear resize reads is mapped as above where it is read, so no
+// full-size float or 8-bit copy of the source is made and 16-bit precision
+// reaches the tensor. dst is laid out in the output orientation.
+void resampleToTensor(const PixelPlane& src, const TensorMapping& mapping, float* dst,
+                      int dst_width, int dst_height, ImageOrientation orientation = ImageOrientation::Identity);
+
+// Greedy non-maximum suppression; returns indices of kept boxes ordered by score
+std::vector<int> nonMaxSuppression(const std::vector<DetectionBox>& boxes, float iou_threshold);
+
+// Histogram, Laplacian and noise sums of a single-channel plane in one pass;
+// `stride` is in elements. 16-bit values are binned by value >> shift.
+ImageStatistics imageStatistics(const uint8_t* src, int width, int height, size_t stride);
+ImageStatistics imageStatistics(const uint16_t* src, int width, int height, size_t stride, int shift);
+
+// out[i] = dot(query, rows[i]); with unit-length vectors, cosine similarity
+void dotProducts(const float* query, const float* const* rows, size_t count, size_t dim, float* out);
+
+} // namespace kernels
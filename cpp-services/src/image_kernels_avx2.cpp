@@ -0,0 +1,8 @@
+/**
+ * Image Kernels - AVX2 + FMA variant
+ * Compiler flags for this file are set in CMakeLists.txt
+ */
+
+#define IMAGE_KERNELS_NS avx2
+#define IMAGE_KERNELS_TABLE kernelTableAvx2
+#include "image_kernels_impl.h"
@@ -0,0 +1,8 @@
+/**
+ * Image Kernels - AVX-512 variant
+ * Compiler flags for this file are set in CMakeLists.txt
+ */
+
+#define IMAGE_KERNELS_NS avx512
+#define IMAGE_KERNELS_TABLE kernelTableAvx512
+#include "image_kernels_impl.h"
@@ -0,0 +1,8 @@
+/**
+ * Image Kernels - baseline (x86-64 / SSE2) variant
+ * Compiler flags for this file are set in CMakeLists.txt
+ */
+
+#define IMAGE_KERNELS_NS baseline
+#define IMAGE_KERNELS_TABLE kernelTableBaseline
+#include "image_kernels_impl.h"
@@ -0,0 +1,69 @@
+/**
+ * Image Kernel Dispatch Table (internal)
+ * One table per instruction set; see image_kernels_impl.h
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "image_kernels.h"
+
+namespace kernels {
+
+// A tensor mapping folded into clamp(v * gain + bias, 0, 1) * scale + offset
+struct TensorCoefficients {
+    float gain;
+    float bias;
+    float scale;
+    float offset;
+};
+
+struct KernelTable {
+    void (*window_level_u16_f32)(const uint16_t*, float*, size_t, const WindowLevelParams&);
+    void (*window_level_s16_f32)(const int16_t*, float*, size_t, const WindowLevelParams&);
+    void (*window_level_u16_u8)(const uint16_t*, uint8_t*, size_t, const WindowLevelParams&);
+    void (*window_level_s16_u8)(const int16_t*, uint8_t*, size_t, const WindowLevelParams&);
+    void (*normalize_u8)(const uint8_t*, float*, size_t, float, float, float);
+    void (*normalize_f32)(const float*, float*, size_t, float, float);
+    // Fills destination rows [row_begin, row_end); x_index/x_weight are the
+    // per-column source taps, precomputed by the caller
+    void (*resize_bilinear)(const float*, int, int, float*, int, int, int, int, const int*, const float*);
+    // Same for any sampling grid: each output pixel blends the source
+    // elements at row_offset[2y + {0,1}] + col_offset[2x + {0,1}]
+    void (*resize_bilinear_gather)(const float* src, float* dst, int dst_width, int row_begin, int row_end,
+                                   const ptrdiff_t* col_offset, const float* x_weight,
+                                   const ptrdiff_t* row_offset, const float* y_weight);
+    // The gather resize over stored values, mapping each sample it reads
+    void (*resample_tensor_u8)(const uint8_t* src, float* dst, int dst_width, int row_begin, int row_end,
+                               const ptrdiff_t* col_offset, const float* x_weight,
+                               const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c);
+    void (*resample_tensor_u16)(const uint16_t* src, float* dst, int dst_width, int row_begin, int row_end,
+                                const ptrdiff_t* col_offset, const float* x_weight,
+                                const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c);
+    void (*resample_tensor_s16)(const int16_t* src, float* dst, int dst_width, int row_begin, int row_end,
+                                const ptrdiff_t* col_offset, const float* x_weight,
+                                const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c);
+    void (*resample_tensor_f32)(const float* src, float* dst, int dst_width, int row_begin, int row_end,
+                                const ptrdiff_t* col_offset, const float* x_weight,
+                                const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c);
+    // Marks boxes [0, count) whose IoU with the reference box exceeds the threshold
+    void (*suppress_overlaps)(const float* x1, const float* y1, const float* x2, const float* y2,
+                              const float* area, size_t count, const float* reference,
+                              float iou_threshold, uint8_t* suppressed);
+    // out[i] = dot(query, rows[i]) over `dim` floats, for i in [0, count)
+    void (*dot_products)(const float* query, const float* const* rows, size_t count, size_t dim, float* out);
+    // Adds rows [row_begin, row_end) of a plane to `out`
+    void (*image_statistics_u8)(const uint8_t* src, int width, int height, size_t stride,
+                                int row_begin, int row_end, int shift, ImageStatistics* out);
+    void (*image_statistics_u16)(const uint16_t* src, int width, int height, size_t stride,
+                                 int row_begin, int row_end, int shift, ImageStatistics* out);
+};
+
+const KernelTable* kernelTableBaseline();
+const KernelTable* kernelTableSse42();
+const KernelTable* kernelTableAvx2();
+const KernelTable* kernelTableAvx512();
+
+} // namespace kernels
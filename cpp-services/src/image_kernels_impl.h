@@ -0,0 +1,339 @@
+/**
+ * Image Kernel Bodies (internal)
+ *
+ * Included once per instruction set by image_kernels_<isa>.cpp, each compiled
+ * with its own -m flags. The loops are written for the auto-vectorizer.
+ *
+ * Everything here must stay free of std:: templates and other inline functions
+ * with external linkage: the linker keeps one copy of those, and it may be the
+ * AVX-512 one. Helpers are static and live in a per-ISA namespace.
+ */
+
+#ifndef IMAGE_KERNELS_NS
+#error "Define IMAGE_KERNELS_NS and IMAGE_KERNELS_TABLE before including image_kernels_impl.h"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+#include "image_kernels_dispatch.h"
+
+namespace kernels {
+namespace IMAGE_KERNELS_NS {
+
+static inline float clampUnit(float v) {
+    v = v < 0.0f ? 0.0f : v;
+    return v > 1.0f ? 1.0f : v;
+}
+
+// Folds rescale slope/intercept and the VOI window into y = x * gain + bias
+static inline void windowCoefficients(const WindowLevelParams& p, float& gain, float& bias) {
+    double width = p.width > 1.0 ? p.width : 1.0;
+    double scale = width > 1.0 ? 1.0 / (width - 1.0) : 1.0;
+    gain = static_cast<float>(p.rescale_slope * scale);
+    bias = static_cast<float>((p.rescale_intercept - (p.center - 0.5)) * scale + 0.5);
+}
+
+template <typename Src>
+static void windowLevelFloat(const Src* src, float* dst, size_t count, const WindowLevelParams& params) {
+    float gain, bias;
+    windowCoefficients(params, gain, bias);
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = clampUnit(static_cast<float>(src[i]) * gain + bias);
+    }
+}
+
+template <typename Src>
+static void windowLevelByte(const Src* src, uint8_t* dst, size_t count, const WindowLevelParams& params) {
+    float gain, bias;
+    windowCoefficients(params, gain, bias);
+    gain *= 255.0f;
+    bias = bias * 255.0f + 0.5f;
+    for (size_t i = 0; i < count; ++i) {
+        float v = static_cast<float>(src[i]) * gain + bias;
+        v = v < 0.0f ? 0.0f : v;
+        v = v > 255.0f ? 255.0f : v;
+        dst[i] = static_cast<uint8_t>(v);
+    }
+}
+
+static void windowLevelU16F32(const uint16_t* src, float* dst, size_t count, const WindowLevelParams& p) {
+    windowLevelFloat(src, dst, count, p);
+}
+
+static void windowLevelS16F32(const int16_t* src, float* dst, size_t count, const WindowLevelParams& p) {
+    windowLevelFloat(src, dst, count, p);
+}
+
+static void windowLevelU16U8(const uint16_t* src, uint8_t* dst, size_t count, const WindowLevelParams& p) {
+    windowLevelByte(src, dst, count, p);
+}
+
+static void windowLevelS16U8(const int16_t* src, uint8_t* dst, size_t count, const WindowLevelParams& p) {
+    windowLevelByte(src, dst, count, p);
+}
+
+static void normalizeU8(const uint8_t* src, float* dst, size_t count, float scale, float mean, float stddev) {
+    const float gain = scale / stddev;
+    const float bias = -mean / stddev;
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = static_cast<float>(src[i]) * gain + bias;
+    }
+}
+
+static void normalizeF32(const float* src, float* dst, size_t count, float mean, float stddev) {
+    const float gain = 1.0f / stddev;
+    const float bias = -mean / stddev;
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = src[i] * gain + bias;
+    }
+}
+
+static void resizeBilinear(const float* src, int src_width, int src_height,
+                           float* dst, int dst_width, int dst_height, int row_begin, int row_end,
+                           const int* x_index, const float* x_weight) {
+    const float scale_y = static_cast<float>(src_height) / static_cast<float>(dst_height);
+    for (int dy = row_begin; dy < row_end; ++dy) {
+        float sy = (static_cast<float>(dy) + 0.5f) * scale_y - 0.5f;
+        sy = sy < 0.0f ? 0.0f : sy;
+        int y0 = static_cast<int>(sy);
+        y0 = y0 > src_height - 1 ? src_height - 1 : y0;
+        const int y1 = y0 + 1 < src_height ? y0 + 1 : y0;
+        const float wy = sy - static_cast<float>(y0);
+
+        const float* row0 = src + static_cast<size_t>(y0) * src_width;
+        const float* row1 = src + static_cast<size_t>(y1) * src_width;
+        float* out = dst + static_cast<size_t>(dy) * dst_width;
+        for (int dx = 0; dx < dst_width; ++dx) {
+            const int x0 = x_index[dx];
+            const int x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+            const float wx = x_weight[dx];
+            const float top = row0[x0] + (row0[x1] - row0[x0]) * wx;
+            const float bottom = row1[x0] + (row1[x1] - row1[x0]) * wx;
+            out[dx] = top + (bottom - top) * wy;
+        }
+    }
+}
+
+static void resizeBilinearGather(const float* src, float* dst, int dst_width, int row_begin, int row_end,
+                                 const ptrdiff_t* col_offset, const float* x_weight,
+                                 const ptrdiff_t* row_offset, const float* y_weight) {
+    for (int dy = row_begin; dy < row_end; ++dy) {
+        const float* row0 = src + row_offset[2 * dy];
+        const float* row1 = src + row_offset[2 * dy + 1];
+        const float wy = y_weight[dy];
+        float* out = dst + static_cast<size_t>(dy) * dst_width;
+        for (int dx = 0; dx < dst_width; ++dx) {
+            const ptrdiff_t x0 = col_offset[2 * dx];
+            const ptrdiff_t x1 = col_offset[2 * dx + 1];
+            const float wx = x_weight[dx];
+            const float top = row0[x0] + (row0[x1] - row0[x0]) * wx;
+            const float bottom = row1[x0] + (row1[x1] - row1[x0]) * wx;
+            out[dx] = top + (bottom - top) * wy;
+        }
+    }
+}
+
+template <typename Src>
+static void resampleTensor(const Src* src, float* dst, int dst_width, int row_begin, int row_end,
+                           const ptrdiff_t* col_offset, const float* x_weight,
+                           const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c) {
+    const float gain = c.gain, bias = c.bias, scale = c.scale, offset = c.offset;
+    for (int dy = row_begin; dy < row_end; ++dy) {
+        const Src* row0 = src + row_offset[2 * dy];
+        const Src* row1 = src + row_offset[2 * dy + 1];
+        const float wy = y_weight[dy];
+        float* out = dst + static_cast<size_t>(dy) * dst_width;
+        for (int dx = 0; dx < dst_width; ++dx) {
+            const ptrdiff_t x0 = col_offset[2 * dx];
+            const ptrdiff_t x1 = col_offset[2 * dx + 1];
+            const float wx = x_weight[dx];
+            // Mapped before blending, so the window's clamp acts per sample
+            const float a = clampUnit(static_cast<float>(row0[x0]) * gain + bias);
+            const float b = clampUnit(static_cast<float>(row0[x1]) * gain + bias);
+            const float p = clampUnit(static_cast<float>(row1[x0]) * gain + bias);
+            const float q = clampUnit(static_cast<float>(row1[x1]) * gain + bias);
+            const float top = a + (b - a) * wx;
+            const float bottom = p + (q - p) * wx;
+            out[dx] = (top + (bottom - top) * wy) * scale + offset;
+        }
+    }
+}
+
+static void resampleTensorU8(const uint8_t* src, float* dst, int dst_width, int row_begin, int row_end,
+                             const ptrdiff_t* col_offset, const float* x_weight,
+                             const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c) {
+    resampleTensor(src, dst, dst_width, row_begin, row_end, col_offset, x_weight, row_offset, y_weight, c);
+}
+
+static void resampleTensorU16(const uint16_t* src, float* dst, int dst_width, int row_begin, int row_end,
+                              const ptrdiff_t* col_offset, const float* x_weight,
+                              const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c) {
+    resampleTensor(src, dst, dst_width, row_begin, row_end, col_offset, x_weight, row_offset, y_weight, c);
+}
+
+static void resampleTensorS16(const int16_t* src, float* dst, int dst_width, int row_begin, int row_end,
+                              const ptrdiff_t* col_offset, const float* x_weight,
+                              const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c) {
+    resampleTensor(src, dst, dst_width, row_begin, row_end, col_offset, x_weight, row_offset, y_weight, c);
+}
+
+static void resampleTensorF32(const float* src, float* dst, int dst_width, int row_begin, int row_end,
+                              const ptrdiff_t* col_offset, const float* x_weight,
+                              const ptrdiff_t* row_offset, const float* y_weight, const TensorCoefficients& c) {
+    resampleTensor(src, dst, dst_width, row_begin, row_end, col_offset, x_weight, row_offset, y_weight, c);
+}
+
+static void suppressOverlaps(const float* x1, const float* y1, const float* x2, const float* y2,
+                             const float* area, size_t count, const float* reference,
+                             float iou_threshold, uint8_t* suppressed) {
+    const float rx1 = reference[0], ry1 = reference[1], rx2 = reference[2], ry2 = reference[3];
+    const float rarea = (rx2 - rx1) * (ry2 - ry1);
+    for (size_t i = 0; i < count; ++i) {
+        float ix1 = x1[i] > rx1 ? x1[i] : rx1;
+        float iy1 = y1[i] > ry1 ? y1[i] : ry1;
+        float ix2 = x2[i] < rx2 ? x2[i] : rx2;
+        float iy2 = y2[i] < ry2 ? y2[i] : ry2;
+        float w = ix2 - ix1;
+        float h = iy2 - iy1;
+        w = w > 0.0f ? w : 0.0f;
+        h = h > 0.0f ? h : 0.0f;
+        const float intersection = w * h;
+        const float union_area = area[i] + rarea - intersection;
+        // IoU > t  <=>  intersection > t * union, avoiding the division
+        suppressed[i] |= static_cast<uint8_t>(intersection > iou_threshold * union_area);
+    }
+}
+
+static void dotProducts(const float* query, const float* const* rows, size_t count, size_t dim, float* out) {
+    for (size_t i = 0; i < count; ++i) {
+        const float* row = rows[i];
+        // Eight partial sums break the add dependency chain and let the
+        // reduction vectorize without -ffast-math reassociation
+        float partial[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        size_t d = 0;
+        for (; d + 8 <= dim; d += 8) {
+            for (size_t k = 0; k < 8; ++k) {
+                partial[k] += query[d + k] * row[d + k];
+            }
+        }
+        float sum = ((partial[0] + partial[1]) + (partial[2] + partial[3]))
+                  + ((partial[4] + partial[5]) + (partial[6] + partial[7]));
+        for (; d < dim; ++d) {
+            sum += query[d] * row[d];
+        }
+        out[i] = sum;
+    }
+}
+
+// Columns per accumulator block in imageStatistics
+static const int kStatisticsTile = 256;
+
+template <typename Src>
+static void imageStatistics(const Src* src, int width, int height, size_t stride,
+                            int row_begin, int row_end, int shift, ImageStatistics* out) {
+    // Four sub-histograms, so runs of one value (background) do not
+    // serialize on a single counter
+    uint32_t histogram[4][256] = {};
+    // Per-column float sums, folded into the doubles every 16 rows: the
+    // column loops then vectorize without reassociating a reduction
+    float lap[kStatisticsTile] = {};
+    float lap_sq[kStatisticsTile] = {};
+    float noise[kStatisticsTile] = {};
+    int pending_rows = 0;
+
+    for (int y = row_begin; y < row_end; ++y) {
+        const Src* row = src + static_cast<size_t>(y) * stride;
+        int x = 0;
+        for (; x + 4 <= width; x += 4) {
+            for (int k = 0; k < 4; ++k) {
+                const unsigned bin = static_cast<unsigned>(row[x + k]) >> shift;
+                histogram[k][bin > 255 ? 255 : bin]++;
+            }
+        }
+        for (; x < width; ++x) {
+            const unsigned bin = static_cast<unsigned>(row[x]) >> shift;
+            histogram[0][bin > 255 ? 255 : bin]++;
+        }
+
+        if (y >= 1 && y <= height - 2 && width >= 3) {
+            // Laplacian (edges - 4c) and Immerkaer's mask [1 -2 1; -2 4 -2; 1 -2 1],
+            // which cancels first and second order structure and leaves noise
+            const Src* above = row - stride;
+            const Src* below = row + stride;
+            for (int x0 = 1; x0 < width - 1; x0 += kStatisticsTile) {
+                const int count = width - 1 - x0 < kStatisticsTile ? width - 1 - x0 : kStatisticsTile;
+                const Src* a = above + x0;
+                const Src* c = row + x0;
+                const Src* b = below + x0;
+                for (int j = 0; j < count; ++j) {
+                    const float centre = static_cast<float>(c[j]);
+                    const float edges = static_cast<float>(a[j]) + static_cast<float>(b[j]) +
+                                        static_cast<float>(c[j - 1]) + static_cast<float>(c[j + 1]);
+                    const float corners = static_cast<float>(a[j - 1]) + static_cast<float>(a[j + 1]) +
+                                          static_cast<float>(b[j - 1]) + static_cast<float>(b[j + 1]);
+                    const float l = edges - 4.0f * centre;
+                    const float n = corners - 2.0f * edges + 4.0f * centre;
+                    lap[j] += l;
+                    lap_sq[j] += l * l;
+                    noise[j] += n < 0.0f ? -n : n;
+                }
+            }
+            out->interior += static_cast<uint64_t>(width - 2);
+            ++pending_rows;
+        }
+
+        if (pending_rows == 16 || (y == row_end - 1 && pending_rows > 0)) {
+            for (int j = 0; j < kStatisticsTile; ++j) {
+                out->laplacian_sum += lap[j];
+                out->laplacian_sq_sum += lap_sq[j];
+                out->noise_abs_sum += noise[j];
+                lap[j] = 0.0f;
+                lap_sq[j] = 0.0f;
+                noise[j] = 0.0f;
+            }
+            pending_rows = 0;
+        }
+    }
+    for (int bin = 0; bin < 256; ++bin) {
+        out->histogram[bin] += static_cast<uint64_t>(histogram[0][bin]) + histogram[1][bin] +
+                               histogram[2][bin] + histogram[3][bin];
+    }
+    out->pixels += static_cast<uint64_t>(row_end - row_begin) * static_cast<uint64_t>(width);
+}
+
+static void imageStatisticsU8(const uint8_t* src, int width, int height, size_t stride,
+                              int row_begin, int row_end, int shift, ImageStatistics* out) {
+    imageStatistics(src, width, height, stride, row_begin, row_end, shift, out);
+}
+
+static void imageStatisticsU16(const uint16_t* src, int width, int height, size_t stride,
+                               int row_begin, int row_end, int shift, ImageStatistics* out) {
+    imageStatistics(src, width, height, stride, row_begin, row_end, shift, out);
+}
+
+} // namespace IMAGE_KERNELS_NS
+
+const KernelTable* IMAGE_KERNELS_TABLE() {
+    static const KernelTable table = {
+        IMAGE_KERNELS_NS::windowLevelU16F32,
+        IMAGE_KERNELS_NS::windowLevelS16F32,
+        IMAGE_KERNELS_NS::windowLevelU16U8,
+        IMAGE_KERNELS_NS::windowLevelS16U8,
+        IMAGE_KERNELS_NS::normalizeU8,
+        IMAGE_KERNELS_NS::normalizeF32,
+        IMAGE_KERNELS_NS::resizeBilinear,
+        IMAGE_KERNELS_NS::resizeBilinearGather,
+        IMAGE_KERNELS_NS::resampleTensorU8,
+        IMAGE_KERNELS_NS::resampleTensorU16,
+        IMAGE_KERNELS_NS::resampleTensorS16,
+        IMAGE_KERNELS_NS::resampleTensorF32,
+        IMAGE_KERNELS_NS::suppressOverlaps,
+        IMAGE_KERNELS_NS::dotProducts,
+        IMAGE_KERNELS_NS::imageStatisticsU8,
+        IMAGE_KERNELS_NS::imageStatisticsU16,
+    };
+    return &table;
+}
+
+} // namespace kernels
@@ -0,0 +1,8 @@
+/**
+ * Image Kernels - SSE4.2 variant
+ * Compiler flags for this file are set in CMakeLists.txt
+ */
+
+#define IMAGE_KERNELS_NS sse42
+#define IMAGE_KERNELS_TABLE kernelTableSse42
+#include "image_kernels_impl.h"
@@ -0,0 +1,166 @@
+/**
+ * Image Quality Gate Implementation
+ */
+
+#include "image_quality.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <opencv2/core.hpp>
+
+#include "image_kernels.h"
+
+namespace {
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+// Streams whose format has an end marker that never arrived. Bytes after
+// the marker (padding, appended metadata) do not count.
+bool endMarkerMissing(std::string_view data) {
+    const auto byte = [&](size_t i) { return static_cast<uint8_t>(data[i]); };
+    if (data.size() >= 2 && byte(0) == 0xFF && byte(1) == 0xD8) {
+        // Entropy-coded data stuffs every 0xFF, so an EOI after the last SOS
+        // is the real one (earlier ones end embedded thumbnails)
+        const size_t scan = data.rfind("\xFF\xDA");
+        return scan == std::string_view::npos || data.find("\xFF\xD9", scan) == std::string_view::npos;
+    }
+    if (data.size() >= 8 && data.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0) {
+        return data.find("IEND", 8) == std::string_view::npos;
+    }
+    return false;
+}
+
+// Decoders fill whole MCU rows (8 or 16 pixels in JPEG) where the data ran
+// out; a shorter uniform run is more likely a border than missing data
+constexpr int kMinTruncatedRows = 8;
+
+// Rows at the bottom that all repeat one value: what decoders leave where
+// the data ran out
+template <typename T>
+int uniformTailRows(const cv::Mat& image) {
+    const T value = image.ptr<T>(image.rows - 1)[0];
+    int rows = 0;
+    for (int y = image.rows - 1; y >= 0; --y, ++rows) {
+        const T* row = image.ptr<T>(y);
+        for (int x = 0; x < image.cols; ++x) {
+            if (row[x] != value) {
+                return rows;
+            }
+        }
+    }
+    return rows;
+}
+
+int percentileBin(const ImageStatistics& stats, double p) {
+    const double target = p * static_cast<double>(stats.pixels);
+    uint64_t seen = 0;
+    for (int bin = 0; bin < 256; ++bin) {
+        seen += stats.histogram[bin];
+        if (static_cast<double>(seen) > target) {
+            return bin;
+        }
+    }
+    return 255;
+}
+
+} // namespace
+
+ImageQualityConfig ImageQualityConfig::fromEnvironment() {
+    ImageQualityConfig config;
+    if (const char* check = std::getenv("IMAGING_QUALITY_CHECK"); check && std::strcmp(check, "0") == 0) {
+        config.enabled = false;
+    }
+    config.max_clipped = envInt("IMAGING_QUALITY_MAX_CLIPPED", 95) / 100.0;
+    config.min_range = envInt("IMAGING_QUALITY_MIN_RANGE", static_cast<int>(config.min_range));
+    config.max_noise = envInt("IMAGING_QUALITY_MAX_NOISE", static_cast<int>(config.max_noise));
+    config.min_sharpness = envInt("IMAGING_QUALITY_MIN_SHARPNESS", static_cast<int>(config.min_sharpness));
+    return config;
+}
+
+ImageQuality assessImageQuality(std::string_view encoded_image, const PixelPlane* decoded,
+                                const ImageQualityConfig& config) {
+    ImageQuality quality;
+    quality.assessed = true;
+    const bool marker_missing = endMarkerMissing(encoded_image);
+
+    if (!decoded || (decoded->depth != PixelDepth::U8 && decoded->depth != PixelDepth::U16) ||
+        decoded->width <= 0 || decoded->height <= 0) {
+        if (marker_missing) {
+            quality.issues.push_back("truncated");
+            quality.truncated_fraction = 1.0;
+        }
+        quality.issues.push_back("undecodable");
+        quality.usable = false;
+        return quality;
+    }
+
+    // A header over the caller's plane; nothing is copied
+    const bool wide = decoded->depth == PixelDepth::U16;
+    const cv::Mat image(decoded->height, decoded->width, wide ? CV_16UC1 : CV_8UC1,
+                        const_cast<void*>(decoded->data),
+                        decoded->stride * (wide ? sizeof(uint16_t) : sizeof(uint8_t)));
+
+    // Everything below is in 8-bit levels
+    ImageStatistics stats;
+    double scale = 1.0;
+    int tail_rows = 0;
+    if (!wide) {
+        stats = kernels::imageStatistics(image.ptr<uint8_t>(), image.cols, image.rows, image.step1());
+        tail_rows = marker_missing ? uniformTailRows<uint8_t>(image) : 0;
+    } else {
+        double max_value = 0.0;
+        cv::minMaxLoc(image, nullptr, &max_value);
+        int bits = 8;
+        while (bits < 16 && static_cast<double>(1 << bits) <= max_value) {
+            ++bits;
+        }
+        stats = kernels::imageStatistics(image.ptr<uint16_t>(), image.cols, image.rows, image.step1(), bits - 8);
+        scale = 255.0 / ((1 << bits) - 1);
+        tail_rows = marker_missing ? uniformTailRows<uint16_t>(image) : 0;
+    }
+
+    quality.clipped_fraction = static_cast<double>(stats.histogram[0] + stats.histogram[255]) /
+                               static_cast<double>(stats.pixels);
+    quality.dynamic_range = percentileBin(stats, 0.99) - percentileBin(stats, 0.01);
+    if (stats.interior > 0) {
+        const double n = static_cast<double>(stats.interior);
+        const double mean = stats.laplacian_sum / n;
+        quality.sharpness = std::max(0.0, stats.laplacian_sq_sum / n - mean * mean) * scale * scale;
+        // Immerkaer (1996): sigma = sqrt(pi / 2) / (6 (W - 2)(H - 2)) * sum |I * N|
+        quality.noise_sigma = std::sqrt(M_PI / 2.0) * stats.noise_abs_sum / (6.0 * n) * scale;
+    }
+
+    const bool blank = quality.dynamic_range < config.min_range;
+    // A missing marker alone is not truncation: only a block row or more
+    // the decoder had no data for is
+    if (tail_rows >= kMinTruncatedRows) {
+        quality.issues.push_back("truncated");
+        quality.truncated_fraction = static_cast<double>(tail_rows) / image.rows;
+    }
+    if (blank) {
+        quality.issues.push_back("blank");
+    }
+    if (quality.clipped_fraction > config.max_clipped) {
+        quality.issues.push_back("saturated");
+    }
+    if (quality.noise_sigma > config.max_noise) {
+        quality.issues.push_back("noisy");
+    }
+    quality.usable = quality.issues.empty();
+    // Blur degrades results without making them meaningless
+    if (!blank && quality.sharpness < config.min_sharpness) {
+        quality.issues.push_back("blurred");
+    }
+    return quality;
+}
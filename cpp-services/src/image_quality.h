@@ -0,0 +1,49 @@
+/**
+ * Image Quality Gate
+ * Cheap checks run before inference, so blank, truncated, badly exposed or
+ * noise-swamped images are answered with a quality finding instead of a
+ * model run, and every analysis reports measured quality metrics.
+ *
+ * The gate runs on a plane the caller decoded, at stored depth. One
+ * dispatched kernel pass gathers the histogram, the Laplacian and
+ * Immerkaer's noise estimate:
+ *   - clipped fraction: pixels at the lowest or highest level
+ *   - dynamic range: 1st to 99th percentile, in 8-bit levels
+ *   - sharpness: variance of the Laplacian (8-bit scale); low means blurred
+ *   - noise sigma: in 8-bit levels
+ * 16-bit images are measured on the bits actually in use, so 12-bit data in
+ * a 16-bit container is not mistaken for a dark image. An image counts as
+ * truncated only when its stream has no end marker (JPEG EOI after the last
+ * scan, PNG IEND) and decoding failed or left at least a JPEG block row (8
+ * rows) of uniform rows at the bottom; bytes trailing a complete stream are
+ * ignored.
+ *
+ * Blur alone marks an image degraded but still analyzed. Thresholds come
+ * from IMAGING_QUALITY_MAX_CLIPPED (percent, default 95),
+ * IMAGING_QUALITY_MIN_RANGE (default 4), IMAGING_QUALITY_MAX_NOISE (default
+ * 40) and IMAGING_QUALITY_MIN_SHARPNESS (default 2); IMAGING_QUALITY_CHECK=0
+ * turns the gate off.
+ */
+
+#pragma once
+
+#include <string_view>
+
+#include "image_kernels.h"
+#include "imaging_types.h"
+
+struct ImageQualityConfig {
+    bool enabled = true;
+    double max_clipped = 0.95;
+    double min_range = 4.0;
+    double max_noise = 40.0;
+    double min_sharpness = 2.0;
+
+    static ImageQualityConfig fromEnvironment();
+};
+
+// `decoded` is the grayscale plane decoded from `encoded_image` (8 or 16
+// bit), or null when decoding failed. Never throws for bad image data: an
+// undecodable image is reported as such.
+ImageQuality assessImageQuality(std::string_view encoded_image, const PixelPlane* decoded,
+                                const ImageQualityConfig& config);
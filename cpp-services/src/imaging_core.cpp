@@ -0,0 +1,130 @@
+/**
+ * Imaging Core Implementation
+ */
+
+#include "imaging_core.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include "alloc_tracker.h"
+#include "imaging_service.h"
+#include "operating_mode.h"
+#include "parallel.h"
+#include "phi_redactor.h"
+#include "pipeline_stage.h"
+#include "thread_budget.h"
+#include "tracing.h"
+
+namespace {
+
+// Answer for an image the quality gate rejected, in place of a model result
+ImageAnalysisResult unusableImageResult(ImageQuality quality) {
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    ImageAnalysisResult result;
+    result.analysis_id = "QC-" + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+    std::string issues;
+    for (const auto& issue : quality.issues) {
+        issues += (issues.empty() ? "" : ", ") + issue;
+    }
+    Finding finding;
+    finding.type = "artifact";
+    finding.description = "Image not usable for automated analysis: " + issues;
+    finding.location = "whole image";
+    finding.confidence = 1.0;
+    finding.severity = "severe";
+    result.findings.push_back(std::move(finding));
+    result.confidence_score = 0.0;
+    result.interpretation = "Not analyzed: image quality is insufficient (" + issues + ")";
+    result.recommendations.push_back("Repeat the acquisition or resend the complete image");
+    result.urgency_level = "routine";
+    result.model_used = "quality-gate";
+    result.quality = std::move(quality);
+    return result;
+}
+
+// At stored depth and channels, for the quality gate; empty when the stream
+// cannot be decoded
+cv::Mat decodeImage(std::string_view data) {
+    try {
+        cv::Mat encoded(1, static_cast<int>(data.size()), CV_8UC1, const_cast<char*>(data.data()));
+        return cv::imdecode(encoded, cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
+    } catch (const cv::Exception&) {
+        // Corrupt streams some codecs reject by throwing
+        return cv::Mat();
+    }
+}
+
+} // namespace
+
+void ImagingCore::initializeProcess() {
+    // Size the OpenMP, OpenCV and ONNX Runtime pools before any session is created
+    alloc_tracker::initializeFromEnvironment();
+    parallel::configure();
+    OperatingModeController::instance().initialize(ThreadBudgetManager::policyFromEnvironment());
+    tracing::Tracer::instance().configure(tracing::Tracer::configFromEnvironment());
+}
+
+ImagingCore::ImagingCore()
+    : service_(std::make_unique<ImagingService>()),
+      quality_config_(ImageQualityConfig::fromEnvironment()) {
+    if (const char* model = std::getenv("IMAGING_PHI_MODEL"); model && *model) {
+        try {
+            redactor_ = std::make_unique<PhiRedactor>(PhiRedactorConfig::fromEnvironment());
+        } catch (const std::exception& e) {
+            std::cerr << "Burned-in text redaction disabled: " << e.what() << std::endl;
+        }
+    }
+}
+
+ImagingCore::~ImagingCore() = default;
+
+ImageAnalysisResult ImagingCore::analyzeImage(const AnalyzeImageRequest& request) {
+    StageScope stage(PipelineStage::Analysis);
+    ImageQuality quality;
+    if (quality_config_.enabled) {
+        StageScope quality_stage(PipelineStage::Quality);
+        cv::Mat image;
+        {
+            StageScope decode_stage(PipelineStage::Decode);
+            image = decodeImage(request.image_data);
+        }
+        cv::Mat gray = image;
+        if (image.channels() > 1) {
+            cv::cvtColor(image, gray, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        }
+        const bool measurable = !gray.empty() && (gray.depth() == CV_8U || gray.depth() == CV_16U);
+        const PixelPlane plane{gray.data, gray.depth() == CV_16U ? PixelDepth::U16 : PixelDepth::U8,
+                               gray.cols, gray.rows, gray.step1()};
+        quality = assessImageQuality(request.image_data, measurable ? &plane : nullptr, quality_config_);
+        if (!quality.usable) {
+            return unusableImageResult(std::move(quality));
+        }
+    }
+    ImageAnalysisResult result = service_->analyzeImage(request.patient_id, request.image_type,
+                                                        request.image_data, request.symptoms,
+                                                        request.priority);
+    result.quality = std::move(quality);
+    return result;
+}
+
+DicomProcessingResult ImagingCore::processDicom(const ProcessDicomRequest& request) {
+    StageScope stage(PipelineStage::Dicom);
+    if (request.redact_burned_in_text && !redactor_) {
+        throw std::runtime_error("burned-in text redaction is not configured");
+    }
+    DicomProcessingResult result =
+        service_->processDicom(request.patient_id, request.dicom_data, request.analysis_types);
+    if (request.redact_burned_in_text) {
+        StageScope redact_stage(PipelineStage::Redact);
+        redactor_->redact(result.processed_images);
+    }
+    return result;
+}
+
+HealthInfo ImagingCore::health() const {
+    return service_->getHealthInfo();
+}
@@ -0,0 +1,85 @@
+/**
+ * Imaging Core
+ * Stable in-process API of the imaging library, for callers on the same host
+ * that would otherwise serialize large images through gRPC to localhost. The
+ * gRPC server is a thin adapter over this class, as are the batch tool and
+ * benchmarks. Only standard library types are exposed, so embedders need
+ * neither OpenCV nor ONNX Runtime headers.
+ *
+ * Buffers: request payloads are std::string_view over caller-owned memory
+ * (a mapped file, a frame grabber buffer, a protobuf field). They are read
+ * in place, never copied, and must stay valid until the call returns.
+ * Results are returned by value and moved out, so processed images are
+ * not copied on the way back either.
+ *
+ * Calls are thread-safe and throw std::exception on invalid input or
+ * processing failures. The quality gate (image_quality.h) decodes the
+ * image for itself ahead of the analysis. Images that fail the gate are
+ * not analyzed; the result then carries only a quality finding. Each call
+ * runs inside its pipeline stage marker (Analysis or Dicom); callers that
+ * want per-stage metrics open a StageRecorder around the call.
+ *
+ *     ImagingCore::initializeProcess();
+ *     ImagingCore core;
+ *     AnalyzeImageRequest request;
+ *     request.image_type = "xray";
+ *     request.image_data = std::string_view(mapped_png, mapped_size);
+ *     ImageAnalysisResult result = core.analyzeImage(request);
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "image_quality.h"
+#include "imaging_types.h"
+
+// Bumped on incompatible changes to the declarations below
+#define IMAGING_CORE_API_VERSION 3
+
+class ImagingService;
+class PhiRedactor;
+
+struct AnalyzeImageRequest {
+    std::string patient_id;
+    std::string image_type;             // "xray", "ct", "mri", "ultrasound"
+    std::string_view image_data;        // encoded image (PNG, JPEG, TIFF, ...), caller-owned
+    std::vector<std::string> symptoms;
+    std::string priority = "normal";
+};
+
+struct ProcessDicomRequest {
+    std::string patient_id;
+    std::string_view dicom_data;        // Part 10 file, caller-owned
+    std::vector<std::string> analysis_types;
+    // Fill burned-in text in the processed images; needs redactsBurnedInText()
+    bool redact_burned_in_text = false;
+};
+
+class ImagingCore {
+public:
+    // Process-wide setup from the environment: allocation tracking, the
+    // OpenMP pool, thread budget and operating mode, and tracing. Call once,
+    // before the first ImagingCore is constructed.
+    static void initializeProcess();
+
+    ImagingCore();
+    ~ImagingCore();
+    ImagingCore(const ImagingCore&) = delete;
+    ImagingCore& operator=(const ImagingCore&) = delete;
+
+    ImageAnalysisResult analyzeImage(const AnalyzeImageRequest& request);
+    DicomProcessingResult processDicom(const ProcessDicomRequest& request);
+
+    HealthInfo health() const;
+    // True when IMAGING_PHI_MODEL names a usable text detector
+    bool redactsBurnedInText() const { return redactor_ != nullptr; }
+
+private:
+    std::unique_ptr<ImagingService> service_;
+    std::unique_ptr<PhiRedactor> redactor_;
+    ImageQualityConfig quality_config_;
+};
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <memory>
@@ -13,47 +14,7 @@
 #include <opencv2/opencv.hpp>
 #include <onnxruntime_cxx_api.h>
 
-struct BoundingBox {
-    int x, y, width, height;
-};
-
-struct Finding {
-    std::string type;
-    std::string description;
-    std::string location;
-    double confidence;
-    std::string severity;
-    bool has_bounding_box = false;
-    BoundingBox bbox;
-};
-
-struct ImageAnalysisResult {
-    std::string analysis_id;
-    std::vector<Finding> findings;
-    double confidence_score;
-    std::string interpretation;
-    std::vector<std::string> recommendations;
-    std::string urgency_level;
-    std::string model_used;
-};
-
-struct ProcessedImage {
-    std::string series_uid;
-    std::string image_data;
-    std::string modality;
-    std::map<std::string, std::string> metadata;
-};
-
-struct DicomProcessingResult {
-    std::map<std::string, std::string> metadata;
-    std::vector<ProcessedImage> processed_images;
-};
-
-struct HealthInfo {
-    double uptime_seconds;
-    int processed_images;
-    double average_processing_time;
-};
+#include "imaging_types.h"
 
 class AIInference;
 class DicomProcessor;
@@ -73,24 +34,27 @@ public:
     ImagingService();
     ~ImagingService();
     
+    // image_data and dicom_data are views over the caller's buffer, which
+    // must stay valid for the duration of the call; nothing copies them
     ImageAnalysisResult analyzeImage(
         const std::string& patient_id,
         const std::string& image_type,
-        const std::string& image_data,
+        std::string_view image_data,
         const std::vector<std::string>& symptoms,
         const std::string& priority
     );
     
     DicomProcessingResult processDicom(
         const std::string& patient_id,
-        const std::string& dicom_data,
+        std::string_view dicom_data,
         const std::vector<std::string>& analysis_types
     );
     
     HealthInfo getHealthInfo() const;
     
 private:
-    cv::Mat decodeImage(const std::string& image_data);
+    // cv::imdecode over a Mat header wrapping the bytes in place
+    cv::Mat decodeImage(std::string_view image_data);
     std::string generateAnalysisId(const std::string& patient_id);
     std::string determineUrgencyLevel(const std::vector<Finding>& findings, 
                                     const std::vector<std::string>& symptoms);
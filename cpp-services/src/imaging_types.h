@@ -0,0 +1,68 @@
+/**
+ * Imaging Result Types
+ * Plain results of image analysis and DICOM processing, shared by the core
+ * library, its public API and the front ends. Deliberately free of OpenCV and
+ * ONNX Runtime types.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct BoundingBox {
+    int x, y, width, height;
+};
+
+struct Finding {
+    std::string type;
+    std::string description;
+    std::string location;
+    double confidence;
+    std::string severity;
+    bool has_bounding_box = false;
+    BoundingBox bbox;
+};
+
+struct ImageQuality {
+    bool assessed = false;
+    bool usable = true;                 // false: analysis was skipped
+    // "undecodable", "truncated", "blank", "saturated", "noisy"; "blurred"
+    // alone leaves the image usable
+    std::vector<std::string> issues;
+    double clipped_fraction = 0.0;      // pixels at the lowest or highest level
+    double dynamic_range = 0.0;         // 1st to 99th percentile, 8-bit levels
+    double sharpness = 0.0;             // variance of the Laplacian, 8-bit scale
+    double noise_sigma = 0.0;           // 8-bit levels
+    double truncated_fraction = 0.0;    // rows left blank by missing data
+};
+
+struct ImageAnalysisResult {
+    std::string analysis_id;
+    std::vector<Finding> findings;
+    double confidence_score;
+    std::string interpretation;
+    std::vector<std::string> recommendations;
+    std::string urgency_level;
+    std::string model_used;
+    ImageQuality quality;
+};
+
+struct ProcessedImage {
+    std::string series_uid;
+    std::string image_data;
+    std::string modality;
+    std::map<std::string, std::string> metadata;
+};
+
+struct DicomProcessingResult {
+    std::map<std::string, std::string> metadata;
+    std::vector<ProcessedImage> processed_images;
+};
+
+struct HealthInfo {
+    double uptime_seconds;
+    int processed_images;
+    double average_processing_time;
+};
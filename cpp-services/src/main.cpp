@@ -3,14 +3,38 @@
  * C++ gRPC service for medical image analysis using ONNX Runtime
  */
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 #include <grpcpp/grpcpp.h>
+#include <grpcpp/resource_quota.h>
 #include <grpcpp/health_check_service_interface.h>
 #include <grpcpp/ext/proto_server_reflection_plugin.h>
 
-#include "imaging_service.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc_tracker.h"
+#include "cpu_profiler.h"
+#include "dicom_deidentifier.h"
+#include "embedding_index.h"
+#include "embedding_model.h"
+#include "embedding_store.h"
+#include "fair_scheduler.h"
+#include "imaging_core.h"
+#include "operating_mode.h"
+#include "payload_source.h"
+#include "prior_cache.h"
+#include "pipeline_stage.h"
+#include "shared_memory.h"
+#include "thread_budget.h"
+#include "tracing.h"
 #include "medical_imaging.grpc.pb.h"
 
 using grpc::Server;
@@ -18,36 +42,364 @@ using grpc::ServerBuilder;
 using grpc::ServerContext;
 using grpc::Status;
 
+namespace {
+
+// Longest a request waits for admission when the caller set no deadline
+constexpr auto kMaxAdmissionWait = std::chrono::minutes(5);
+
+constexpr int kMegabyte = 1024 * 1024;
+
+// One gRPC listener. The unix socket runs as its own server so sidecars on
+// the host get their own message limit and handler threads, and a burst from
+// them cannot take the threads network callers need (and vice versa)
+struct ListenerConfig {
+    std::string name;
+    std::string address;
+    int max_message_bytes = 100 * kMegabyte;
+    int max_threads = 0;    // 0: follow the thread budget
+};
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed >= 0 ? parsed : fallback;
+}
+
+std::string metadataValue(const ServerContext* context, const char* key) {
+    const auto& metadata = context->client_metadata();
+    auto it = metadata.find(key);
+    return it == metadata.end() ? std::string() : std::string(it->second.data(), it->second.size());
+}
+
+// "tenant/caller" from x-tenant-id / x-caller-id metadata, falling back to the
+// peer host so unlabelled callers are at least separated per machine
+std::string callerIdentity(const ServerContext* context) {
+    std::string caller = metadataValue(context, "x-caller-id");
+    if (caller.empty()) {
+        // "ipv4:10.0.0.5:43122" -> "ipv4:10.0.0.5"
+        caller = context->peer();
+        auto port = caller.rfind(':');
+        if (port != std::string::npos && port > caller.find(':')) {
+            caller.resize(port);
+        }
+    }
+    std::string tenant = metadataValue(context, "x-tenant-id");
+    return tenant.empty() ? caller : tenant + "/" + caller;
+}
+
+std::chrono::steady_clock::time_point admissionDeadline(const ServerContext* context) {
+    auto now = std::chrono::steady_clock::now();
+    auto remaining = context->deadline() - std::chrono::system_clock::now();
+    if (remaining > kMaxAdmissionWait) {
+        return now + kMaxAdmissionWait;
+    }
+    return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(remaining);
+}
+
+Status admissionFailure(FairScheduler::AdmitStatus status) {
+    switch (status) {
+        case FairScheduler::AdmitStatus::QueueFull:
+            return Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Too many queued requests for this caller");
+        case FairScheduler::AdmitStatus::TimedOut:
+            return Status(grpc::StatusCode::DEADLINE_EXCEEDED, "Deadline exceeded while queued");
+        default:
+            return Status(grpc::StatusCode::CANCELLED, "Request cancelled while queued");
+    }
+}
+
+// Maps the payload named by a SharedMemoryRef; the segment is unmapped when
+// `segment` goes out of scope, after the response has been built
+Status mapSharedPayload(const ServerContext* context, const SharedMemoryRegistry* registry,
+                        const medical_imaging::SharedMemoryRef& ref, std::optional<SharedMemorySegment>& segment) {
+    if (!registry) {
+        return Status(grpc::StatusCode::FAILED_PRECONDITION, "Shared memory transport is disabled");
+    }
+    if (!isLocalPeer(context->peer())) {
+        return Status(grpc::StatusCode::PERMISSION_DENIED, "Shared memory transport requires a local caller");
+    }
+    SharedMemoryHandle handle;
+    handle.segment = ref.segment();
+    handle.offset = ref.offset();
+    handle.length = ref.length();
+    handle.result_offset = ref.result_offset();
+    handle.result_capacity = ref.result_capacity();
+    try {
+        segment.emplace(handle, *registry);
+    } catch (const std::invalid_argument& e) {
+        return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+    } catch (const std::exception& e) {
+        return Status(grpc::StatusCode::FAILED_PRECONDITION, e.what());
+    }
+    return Status::OK;
+}
+
+// A payload read from a PayloadLocation, or a prior the prefetcher already
+// holds; either way its bytes stay alive until the response has been built
+struct LocatedPayload {
+    std::unique_ptr<PayloadData> data;
+    std::shared_ptr<const PriorImage> prior;
+
+    std::string_view view() const { return prior ? prior->encoded->view() : data->view(); }
+};
+
+PayloadLocation payloadLocation(const medical_imaging::PayloadLocation& location) {
+    PayloadLocation resolved;
+    resolved.uri = location.uri();
+    resolved.offset = location.offset();
+    resolved.length = location.length();
+    return resolved;
+}
+
+// Sizes a located payload from storage (stat or HEAD) before admission, so
+// it is charged what it will read rather than the range the caller claims,
+// and one over the payload limit is refused without taking a slot
+Status sizePayloadLocation(const PayloadSource& source, const medical_imaging::PayloadLocation& location,
+                           PayloadVersion& version, size_t& bytes) {
+    try {
+        version = source.version(location.uri());
+        bytes = static_cast<size_t>(source.payloadSize(payloadLocation(location), version));
+    } catch (const std::invalid_argument& e) {
+        return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+    } catch (const std::length_error& e) {
+        return Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+    } catch (const std::exception& e) {
+        return Status(grpc::StatusCode::UNAVAILABLE, e.what());
+    }
+    return Status::OK;
+}
+
+// `version` is what sizePayloadLocation found before admission
+Status readPayloadLocation(const PayloadSource& source, PriorCache& priors,
+                           const medical_imaging::PayloadLocation& location, const PayloadVersion& version,
+                           std::optional<LocatedPayload>& payload) {
+    payload.emplace();
+    // Priors are cached whole, so only whole-object references can hit,
+    // and only while the file or object is still the version cached
+    if (location.offset() == 0 && location.length() == 0) {
+        payload->prior = priors.find(location.uri(), version);
+        if (payload->prior) {
+            return Status::OK;
+        }
+    }
+    try {
+        payload->data = source.read(payloadLocation(location));
+    } catch (const std::invalid_argument& e) {
+        return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+    } catch (const std::length_error& e) {
+        return Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+    } catch (const std::exception& e) {
+        return Status(grpc::StatusCode::UNAVAILABLE, e.what());
+    }
+    return Status::OK;
+}
+
+// Orientation and VOI window sent along with an image to embed; the hints
+// point into `window`
+template <typename Request>
+EmbeddingHints embeddingHints(const Request& request, WindowLevelParams& window) {
+    EmbeddingHints hints;
+    hints.orientation = request.image_orientation();
+    if (request.window_width() > 0.0) {
+        window.center = request.window_center();
+        window.width = request.window_width();
+        hints.window = &window;
+    }
+    return hints;
+}
+
+void populateStageMetrics(const StageRecorder& recorder,
+                          google::protobuf::RepeatedPtrField<medical_imaging::StageMetrics>* out) {
+    for (const auto& metrics : recorder.stages()) {
+        auto* stage = out->Add();
+        stage->set_stage(pipelineStageName(metrics.stage));
+        stage->set_calls(metrics.calls);
+        stage->set_wall_time_ms(metrics.wall_time_ms);
+        stage->set_allocations(metrics.allocations);
+        stage->set_bytes_allocated(metrics.bytes_allocated);
+        stage->set_peak_live_bytes(metrics.peak_live_bytes);
+    }
+}
+
+} // namespace
+
+// Pipeline and admission state shared by every listener, so callers on the
+// unix socket and on TCP are scheduled against each other fairly
+struct ImagingPipeline {
+    ImagingCore core;
+    FairScheduler scheduler;
+    PayloadSource payload_source;
+    PriorPrefetcher prefetcher;
+    // Both set when IMAGING_EMBEDDING_STORE names the store file and
+    // IMAGING_PATIENT_KEY_SALT keys its patient links
+    std::unique_ptr<EmbeddingModel> embedding_model;
+    std::unique_ptr<EmbeddingStore> embedding_store;
+    // Set when IMAGING_EMBEDDING_INDEX also names the index file
+    std::unique_ptr<EmbeddingIndex> embedding_index;
+    std::unique_ptr<EmbeddingIndexer> indexer;
+    // Keys replacement UIDs and pseudonyms for ProcessDicom de-identification
+    std::string deidentification_salt;
+    // Set when IMAGING_SHM_TRANSPORT=1 and the registry socket is listening
+    std::unique_ptr<SharedMemoryRegistry> shared_memory;
+    
+    ImagingPipeline()
+        : scheduler(FairSchedulerConfig::fromEnvironment(
+              ThreadBudgetManager::instance().budget().concurrent_requests)),
+          payload_source(PayloadSourceConfig::fromEnvironment()),
+          prefetcher(payload_source, PriorPrefetcher::Config::fromEnvironment()),
+          deidentification_salt(DicomDeidentifier::saltFromEnvironment()) {
+        ThreadBudgetManager::instance().addListener([this](const ThreadBudget& budget) {
+            scheduler.setMaxConcurrent(budget.concurrent_requests);
+        });
+        if (const char* store = std::getenv("IMAGING_EMBEDDING_STORE"); store && *store) {
+            try {
+                embedding_model = std::make_unique<EmbeddingModel>(EmbeddingModelConfig::fromEnvironment());
+                embedding_store = std::make_unique<EmbeddingStore>(store, embedding_model->dim(),
+                                                                   EmbeddingStore::patientSaltFromEnvironment());
+            } catch (const std::exception& e) {
+                std::cerr << "Longitudinal comparison disabled: " << e.what() << std::endl;
+                embedding_model.reset();
+            }
+        }
+        if (sharedMemoryTransportEnabled()) {
+            try {
+                shared_memory = std::make_unique<SharedMemoryRegistry>(SharedMemoryRegistry::pathFromEnvironment());
+            } catch (const std::exception& e) {
+                std::cerr << "Shared memory transport disabled: " << e.what() << std::endl;
+            }
+        }
+        const char* index = std::getenv("IMAGING_EMBEDDING_INDEX");
+        if (embedding_store && index && *index) {
+            try {
+                embedding_index = std::make_unique<EmbeddingIndex>(index, embedding_model->dim(),
+                                                                   EmbeddingIndexConfig::fromEnvironment());
+                indexer = std::make_unique<EmbeddingIndexer>(*embedding_model, *embedding_store, *embedding_index);
+            } catch (const std::exception& e) {
+                std::cerr << "Similar image search disabled: " << e.what() << std::endl;
+            }
+        }
+    }
+};
+
 class MedicalImagingServiceImpl final : public medical_imaging::MedicalImagingService::Service {
 private:
-    std::unique_ptr<ImagingService> imaging_service_;
+    ImagingCore& imaging_core_;
+    FairScheduler& scheduler_;
+    const PayloadSource& payload_source_;
+    PriorPrefetcher& prefetcher_;
+    const EmbeddingModel* embedding_model_;
+    EmbeddingStore* embedding_store_;
+    EmbeddingIndex* embedding_index_;
+    EmbeddingIndexer* indexer_;
+    const std::string& deidentification_salt_;
+    const SharedMemoryRegistry* shared_memory_;
     
-public:
-    MedicalImagingServiceImpl() {
-        imaging_service_ = std::make_unique<ImagingService>();
+    FairScheduler::Ticket admit(ServerContext* context, const std::string& priority, size_t payload_bytes) {
+        StageScope stage(PipelineStage::Admission);
+        // Cost in megabytes so one 100MB study weighs like many small images
+        int cost = static_cast<int>(payload_bytes >> 20) + 1;
+        return scheduler_.acquire(callerIdentity(context), parseRequestPriority(priority), cost,
+                                  admissionDeadline(context),
+                                  [context] { return context->IsCancelled(); });
     }
     
+public:
+    explicit MedicalImagingServiceImpl(ImagingPipeline& pipeline)
+        : imaging_core_(pipeline.core),
+          scheduler_(pipeline.scheduler),
+          payload_source_(pipeline.payload_source),
+          prefetcher_(pipeline.prefetcher),
+          embedding_model_(pipeline.embedding_model.get()),
+          embedding_store_(pipeline.embedding_store.get()),
+          embedding_index_(pipeline.embedding_index.get()),
+          indexer_(pipeline.indexer.get()),
+          deidentification_salt_(pipeline.deidentification_salt),
+          shared_memory_(pipeline.shared_memory.get()) {}
+    
     Status AnalyzeImage(ServerContext* context,
                        const medical_imaging::ImageAnalysisRequest* request,
                        medical_imaging::ImageAnalysisResponse* response) override {
         
         std::cout << "Analyzing image for patient: " << request->patient_id() << std::endl;
         
+        StageRecorder recorder;
+        const bool shared = request->has_image_ref();
+        const bool located = request->has_image_location();
+        size_t payload_bytes = shared ? request->image_ref().length() : request->image_data().size();
+        PayloadVersion located_version;
+        if (located && !shared) {
+            Status sized = sizePayloadLocation(payload_source_, request->image_location(), located_version,
+                                               payload_bytes);
+            if (!sized.ok()) {
+                return sized;
+            }
+        }
+        tracing::Span span("AnalyzeImage", metadataValue(context, "traceparent"));
+        if (span.recording()) {
+            span.setAttribute("imaging.image_type", request->image_type());
+            span.setAttribute("imaging.priority", request->priority());
+            span.setAttribute("imaging.payload_bytes", std::to_string(payload_bytes));
+            span.setAttribute("imaging.transport", shared ? "shm" : located ? "location" : "inline");
+        }
+        
+        // Priors start loading before admission, so they overlap the wait
+        // for a slot as well as this image's analysis
+        auto hint = request->metadata().find("prefetch");
+        if (hint != request->metadata().end()) {
+            int queued = prefetcher_.prefetch(parsePrefetchHint(hint->second));
+            if (span.recording()) {
+                span.setAttribute("imaging.prefetch_queued", std::to_string(queued));
+            }
+        }
+        
+        auto ticket = admit(context, request->priority(), payload_bytes);
+        if (!ticket) {
+            span.setError("admission rejected");
+            return admissionFailure(ticket.status());
+        }
+        
+        std::optional<SharedMemorySegment> segment;
+        if (shared) {
+            Status mapped = mapSharedPayload(context, shared_memory_, request->image_ref(), segment);
+            if (!mapped.ok()) {
+                span.setError(mapped.error_message());
+                return mapped;
+            }
+        }
+        std::optional<LocatedPayload> located_payload;
+        if (located && !shared) {
+            Status read = readPayloadLocation(payload_source_, prefetcher_.cache(),
+                                              request->image_location(), located_version, located_payload);
+            if (!read.ok()) {
+                span.setError(read.error_message());
+                return read;
+            }
+        }
+        
         try {
             auto start_time = std::chrono::high_resolution_clock::now();
             
-            // Process the image analysis request
-            auto result = imaging_service_->analyzeImage(
-                request->patient_id(),
-                request->image_type(),
-                request->image_data(),
-                std::vector<std::string>(request->symptoms().begin(), request->symptoms().end()),
-                request->priority()
-            );
+            // Process the image analysis request; the payload is read in place
+            AnalyzeImageRequest analysis;
+            analysis.patient_id = request->patient_id();
+            analysis.image_type = request->image_type();
+            analysis.image_data = segment ? segment->payload()
+                                : located_payload ? located_payload->view()
+                                : std::string_view(request->image_data());
+            analysis.symptoms.assign(request->symptoms().begin(), request->symptoms().end());
+            analysis.priority = request->priority();
+            ImageAnalysisResult result = imaging_core_.analyzeImage(analysis);
+            if (indexer_ && result.quality.usable) {
+                indexer_->submit(analysis.patient_id, analysis.image_data);
+            }
             
             auto end_time = std::chrono::high_resolution_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
             
+            StageScope response_stage(PipelineStage::Response);
+            
             // Populate response
             response->set_analysis_id(result.analysis_id);
             response->set_patient_id(request->patient_id());
@@ -82,11 +434,28 @@ public:
                 response->add_recommendations(recommendation);
             }
             
+            if (result.quality.assessed) {
+                auto* quality = response->mutable_quality();
+                quality->set_assessed(true);
+                quality->set_usable(result.quality.usable);
+                for (const auto& issue : result.quality.issues) {
+                    quality->add_issues(issue);
+                }
+                quality->set_clipped_fraction(result.quality.clipped_fraction);
+                quality->set_dynamic_range(result.quality.dynamic_range);
+                quality->set_sharpness(result.quality.sharpness);
+                quality->set_noise_sigma(result.quality.noise_sigma);
+                quality->set_truncated_fraction(result.quality.truncated_fraction);
+            }
+            
+            populateStageMetrics(recorder, response->mutable_stage_metrics());
+            
             std::cout << "Image analysis completed in " << duration.count() << "ms" << std::endl;
             return Status::OK;
             
         } catch (const std::exception& e) {
             std::cerr << "Image analysis failed: " << e.what() << std::endl;
+            span.setError(e.what());
             response->set_success(false);
             response->set_error_message(e.what());
             return Status(grpc::StatusCode::INTERNAL, e.what());
@@ -99,26 +468,126 @@ public:
         
         std::cout << "Processing DICOM for patient: " << request->patient_id() << std::endl;
         
+        StageRecorder recorder;
+        const bool shared = request->has_dicom_ref();
+        const bool located = request->has_dicom_location();
+        size_t payload_bytes = shared ? request->dicom_ref().length() : request->dicom_data().size();
+        const DeidentificationProfile* profile = nullptr;
+        if (!request->deidentify().empty()) {
+            profile = DeidentificationProfile::byName(request->deidentify());
+            if (!profile) {
+                return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                              "unknown de-identification profile: " + request->deidentify());
+            }
+        }
+        if (request->redact_burned_in_text() && !imaging_core_.redactsBurnedInText()) {
+            return Status(grpc::StatusCode::FAILED_PRECONDITION, "burned-in text redaction is not configured");
+        }
+        PayloadVersion located_version;
+        if (located && !shared) {
+            Status sized = sizePayloadLocation(payload_source_, request->dicom_location(), located_version,
+                                               payload_bytes);
+            if (!sized.ok()) {
+                return sized;
+            }
+        }
+        tracing::Span span("ProcessDicom", metadataValue(context, "traceparent"));
+        if (span.recording()) {
+            span.setAttribute("imaging.payload_bytes", std::to_string(payload_bytes));
+            span.setAttribute("imaging.transport", shared ? "shm" : located ? "location" : "inline");
+        }
+        
+        auto ticket = admit(context, "normal", payload_bytes);
+        if (!ticket) {
+            span.setError("admission rejected");
+            return admissionFailure(ticket.status());
+        }
+        
+        std::optional<SharedMemorySegment> segment;
+        if (shared) {
+            Status mapped = mapSharedPayload(context, shared_memory_, request->dicom_ref(), segment);
+            if (!mapped.ok()) {
+                span.setError(mapped.error_message());
+                return mapped;
+            }
+        }
+        std::optional<LocatedPayload> located_payload;
+        if (located && !shared) {
+            Status read = readPayloadLocation(payload_source_, prefetcher_.cache(),
+                                              request->dicom_location(), located_version, located_payload);
+            if (!read.ok()) {
+                span.setError(read.error_message());
+                return read;
+            }
+        }
+        
         try {
-            auto result = imaging_service_->processDicom(
-                request->patient_id(),
-                request->dicom_data(),
-                std::vector<std::string>(request->analysis_types().begin(), request->analysis_types().end())
-            );
+            ProcessDicomRequest dicom;
+            dicom.patient_id = request->patient_id();
+            dicom.dicom_data = segment ? segment->payload()
+                             : located_payload ? located_payload->view()
+                             : std::string_view(request->dicom_data());
+            dicom.analysis_types.assign(request->analysis_types().begin(), request->analysis_types().end());
+            dicom.redact_burned_in_text = request->redact_burned_in_text();
+            
+            // Processing runs on the de-identified file, so nothing it
+            // extracts can carry what the profile removed
+            std::string deidentified;
+            int deidentified_elements = 0;
+            if (profile) {
+                StageScope deidentify_stage(PipelineStage::Deidentify);
+                DicomDeidentifier deidentifier(*profile, deidentification_salt_);
+                DeidentificationPlan plan;
+                try {
+                    plan = deidentifier.plan(dicom.dicom_data);
+                } catch (const std::invalid_argument& e) {
+                    span.setError(e.what());
+                    response->set_success(false);
+                    response->set_error_message(e.what());
+                    return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+                }
+                deidentified = DicomDeidentifier::render(dicom.dicom_data, plan);
+                deidentified_elements = plan.elements_changed;
+                dicom.dicom_data = deidentified;
+            }
+            DicomProcessingResult result = imaging_core_.processDicom(dicom);
+            
+            StageScope response_stage(PipelineStage::Response);
             
             response->set_patient_id(request->patient_id());
             response->set_success(true);
+            if (profile) {
+                response->set_deidentified_elements(deidentified_elements);
+                uint64_t offset = 0;
+                if (segment && segment->writeResult(deidentified, offset)) {
+                    auto* ref = response->mutable_deidentified_ref();
+                    ref->set_segment(segment->segment());
+                    ref->set_offset(offset);
+                    ref->set_length(deidentified.size());
+                } else {
+                    response->set_deidentified_dicom(std::move(deidentified));
+                }
+            }
             
             // Add DICOM metadata
             for (const auto& [key, value] : result.metadata) {
                 (*response->mutable_dicom_metadata())[key] = value;
             }
             
-            // Add processed images
-            for (const auto& image : result.processed_images) {
+            // Add processed images: written into the caller's segment when
+            // they fit, otherwise moved into the response
+            for (auto& image : result.processed_images) {
                 auto* processed_image = response->add_processed_images();
                 processed_image->set_series_uid(image.series_uid);
-                processed_image->set_image_data(image.image_data);
+                uint64_t offset = 0;
+                if (segment && segment->writeResult(image.image_data, offset)) {
+                    auto* ref = processed_image->mutable_image_ref();
+                    ref->set_segment(segment->segment());
+                    ref->set_offset(offset);
+                    ref->set_length(image.image_data.size());
+                } else {
+                    processed_image->set_image_data(std::move(image.image_data));
+                }
                 processed_image->set_modality(image.modality);
                 
                 for (const auto& [key, value] : image.metadata) {
@@ -126,10 +595,241 @@ public:
                 }
             }
             
+            populateStageMetrics(recorder, response->mutable_stage_metrics());
             return Status::OK;
             
         } catch (const std::exception& e) {
             std::cerr << "DICOM processing failed: " << e.what() << std::endl;
+            span.setError(e.what());
+            response->set_success(false);
+            response->set_error_message(e.what());
+            return Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+    }
+    
+    Status CompareWithPriors(ServerContext* context,
+                            const medical_imaging::LongitudinalComparisonRequest* request,
+                            medical_imaging::LongitudinalComparisonResponse* response) override {
+        
+        if (!embedding_store_) {
+            return Status(grpc::StatusCode::FAILED_PRECONDITION, "longitudinal comparison is not configured");
+        }
+        if (request->patient_id().empty()) {
+            return Status(grpc::StatusCode::INVALID_ARGUMENT, "patient_id is required");
+        }
+        std::vector<ContentHash> only;
+        try {
+            for (const auto& hash : request->prior_hashes()) {
+                only.push_back(ContentHash::fromHex(hash));
+            }
+        } catch (const std::invalid_argument& e) {
+            return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+        }
+        
+        StageRecorder recorder;
+        const bool located = request->has_image_location();
+        size_t payload_bytes = request->image_data().size();
+        PayloadVersion located_version;
+        if (located) {
+            Status sized = sizePayloadLocation(payload_source_, request->image_location(), located_version,
+                                               payload_bytes);
+            if (!sized.ok()) {
+                return sized;
+            }
+        }
+        tracing::Span span("CompareWithPriors", metadataValue(context, "traceparent"));
+        if (span.recording()) {
+            span.setAttribute("imaging.payload_bytes", std::to_string(payload_bytes));
+            span.setAttribute("imaging.transport", located ? "location" : "inline");
+        }
+        
+        auto ticket = admit(context, "normal", payload_bytes);
+        if (!ticket) {
+            span.setError("admission rejected");
+            return admissionFailure(ticket.status());
+        }
+        
+        std::optional<LocatedPayload> located_payload;
+        if (located) {
+            Status read = readPayloadLocation(payload_source_, prefetcher_.cache(),
+                                              request->image_location(), located_version, located_payload);
+            if (!read.ok()) {
+                span.setError(read.error_message());
+                return read;
+            }
+        }
+        
+        try {
+            auto start_time = std::chrono::high_resolution_clock::now();
+            const std::string_view image = located_payload ? located_payload->view()
+                                         : std::string_view(request->image_data());
+            
+            // The hash and hints decide whether the model runs at all: an
+            // image seen before with the same hints is compared from its
+            // stored embedding. It is linked to this patient either way, so
+            // a study first stored under another patient ID counts here too.
+            const ContentHash hash = contentHash(image);
+            const uint64_t patient = embedding_store_->patientKey(request->patient_id());
+            WindowLevelParams window{};
+            const EmbeddingHints hints = embeddingHints(*request, window);
+            const EmbeddingKey key{hash, hintsDigest(hints)};
+            std::vector<float> embedding;
+            const bool cached = embedding_store_->find(key, embedding);
+            if (!cached) {
+                embedding = embedding_model_->embed(image, hints);
+                embedding_store_->insert(key, embedding);
+                // The index holds embeddings made without hints, like the
+                // ones the indexer adds
+                if (embedding_index_ && key.hints == 0) {
+                    embedding_index_->insert(hash, embedding.data());
+                }
+            }
+            embedding_store_->link(patient, key);
+            auto priors = embedding_store_->compare(patient, embedding.data(), only, hash);
+            
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::high_resolution_clock::now() - start_time);
+            
+            StageScope response_stage(PipelineStage::Response);
+            response->set_patient_id(request->patient_id());
+            response->set_content_hash(hash.hex());
+            response->set_embedding_cached(cached);
+            for (const auto& prior : priors) {
+                auto* out = response->add_priors();
+                out->set_content_hash(prior.hash.hex());
+                out->set_similarity(prior.similarity);
+                out->set_stored_at_ms(prior.stored_at_ms);
+            }
+            response->set_processing_time_ms(duration.count());
+            response->set_model_used(embedding_model_->name());
+            response->set_success(true);
+            populateStageMetrics(recorder, response->mutable_stage_metrics());
+            return Status::OK;
+            
+        } catch (const std::invalid_argument& e) {
+            span.setError(e.what());
+            response->set_success(false);
+            response->set_error_message(e.what());
+            return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+        } catch (const std::exception& e) {
+            std::cerr << "Longitudinal comparison failed: " << e.what() << std::endl;
+            span.setError(e.what());
+            response->set_success(false);
+            response->set_error_message(e.what());
+            return Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+    }
+    
+    Status FindSimilarImages(ServerContext* context,
+                            const medical_imaging::SimilarImagesRequest* request,
+                            medical_imaging::SimilarImagesResponse* response) override {
+        
+        if (!embedding_index_) {
+            return Status(grpc::StatusCode::FAILED_PRECONDITION, "similar image search is not configured");
+        }
+        const bool by_hash = !request->content_hash().empty();
+        ContentHash query_hash;
+        if (by_hash) {
+            try {
+                query_hash = ContentHash::fromHex(request->content_hash());
+            } catch (const std::invalid_argument& e) {
+                return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+            }
+        }
+        const size_t max_results = static_cast<size_t>(std::clamp(
+            request->max_results() > 0 ? request->max_results() : 10, 1, 1000));
+        const size_t breadth = static_cast<size_t>(std::clamp(request->search_breadth(), 0, 10000));
+        
+        const bool located = !by_hash && request->has_image_location();
+        size_t payload_bytes = request->image_data().size();
+        PayloadVersion located_version;
+        if (located) {
+            Status sized = sizePayloadLocation(payload_source_, request->image_location(), located_version,
+                                               payload_bytes);
+            if (!sized.ok()) {
+                return sized;
+            }
+        }
+        tracing::Span span("FindSimilarImages", metadataValue(context, "traceparent"));
+        if (span.recording()) {
+            span.setAttribute("imaging.payload_bytes", std::to_string(payload_bytes));
+            span.setAttribute("imaging.query", by_hash ? "hash" : located ? "location" : "inline");
+        }
+        
+        auto ticket = admit(context, "normal", payload_bytes);
+        if (!ticket) {
+            span.setError("admission rejected");
+            return admissionFailure(ticket.status());
+        }
+        
+        std::optional<LocatedPayload> located_payload;
+        if (located) {
+            Status read = readPayloadLocation(payload_source_, prefetcher_.cache(),
+                                              request->image_location(), located_version, located_payload);
+            if (!read.ok()) {
+                span.setError(read.error_message());
+                return read;
+            }
+        }
+        
+        try {
+            auto start_time = std::chrono::high_resolution_clock::now();
+            
+            WindowLevelParams window{};
+            std::vector<float> embedding;
+            bool cached;
+            if (by_hash) {
+                cached = embedding_store_->find(EmbeddingKey{query_hash, 0}, embedding);
+                if (!cached) {
+                    return Status(grpc::StatusCode::NOT_FOUND, "no embedding stored for " + request->content_hash());
+                }
+            } else {
+                const std::string_view image = located_payload ? located_payload->view()
+                                             : std::string_view(request->image_data());
+                // Query images are not stored: without a patient they are
+                // not anyone's prior
+                query_hash = contentHash(image);
+                const EmbeddingHints hints = embeddingHints(*request, window);
+                cached = embedding_store_->find(EmbeddingKey{query_hash, hintsDigest(hints)}, embedding);
+                if (!cached) {
+                    embedding = embedding_model_->embed(image, hints);
+                    normalizeEmbedding(embedding);
+                }
+            }
+            
+            // One extra result covers the query image itself when indexed
+            auto matches = embedding_index_->search(embedding.data(), max_results + 1, breadth);
+            matches.erase(std::remove_if(matches.begin(), matches.end(),
+                                         [&](const IndexMatch& match) { return match.hash == query_hash; }),
+                          matches.end());
+            if (matches.size() > max_results) {
+                matches.resize(max_results);
+            }
+            
+            auto duration = std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start_time);
+            
+            StageScope response_stage(PipelineStage::Response);
+            for (const auto& match : matches) {
+                auto* image = response->add_images();
+                image->set_content_hash(match.hash.hex());
+                image->set_similarity(match.similarity);
+            }
+            response->set_content_hash(query_hash.hex());
+            response->set_embedding_cached(cached);
+            response->set_indexed_images(static_cast<int64_t>(embedding_index_->size()));
+            response->set_processing_time_ms(duration.count());
+            response->set_success(true);
+            return Status::OK;
+            
+        } catch (const std::invalid_argument& e) {
+            span.setError(e.what());
+            response->set_success(false);
+            response->set_error_message(e.what());
+            return Status(grpc::StatusCode::INVALID_ARGUMENT, e.what());
+        } catch (const std::exception& e) {
+            std::cerr << "Similar image search failed: " << e.what() << std::endl;
+            span.setError(e.what());
             response->set_success(false);
             response->set_error_message(e.what());
             return Status(grpc::StatusCode::INTERNAL, e.what());
@@ -140,40 +840,223 @@ public:
                       const medical_imaging::HealthCheckRequest* request,
                       medical_imaging::HealthCheckResponse* response) override {
         
-        auto health_info = imaging_service_->getHealthInfo();
+        auto health_info = imaging_core_.health();
         
         response->set_status("healthy");
         response->set_uptime_seconds(health_info.uptime_seconds);
         response->set_processed_images(health_info.processed_images);
         response->set_average_processing_time(health_info.average_processing_time);
+        response->set_operating_mode(operatingModeName(OperatingModeController::instance().current()->mode));
         
         return Status::OK;
     }
 };
 
-void RunServer() {
-    std::string server_address("0.0.0.0:50051");
-    MedicalImagingServiceImpl service;
+class ImagingAdminServiceImpl final : public medical_imaging::ImagingAdminService::Service {
+public:
+    Status SetOperatingMode(ServerContext* context,
+                           const medical_imaging::OperatingModeRequest* request,
+                           medical_imaging::OperatingModeResponse* response) override {
+        
+        OperatingMode mode;
+        if (!parseOperatingMode(request->mode(), mode)) {
+            response->set_success(false);
+            response->set_error_message("Unknown operating mode: " + request->mode());
+            return Status(grpc::StatusCode::INVALID_ARGUMENT, response->error_message());
+        }
+        
+        auto previous = OperatingModeController::instance().current();
+        auto profile = OperatingModeController::instance().setMode(mode);
+        
+        response->set_previous_mode(operatingModeName(previous->mode));
+        populateProfile(*profile, response);
+        return Status::OK;
+    }
     
-    grpc::EnableDefaultHealthCheckService(true);
-    grpc::reflection::InitProtoReflectionServerBuilderPlugin();
+    Status GetOperatingMode(ServerContext* context,
+                           const medical_imaging::OperatingModeRequest* request,
+                           medical_imaging::OperatingModeResponse* response) override {
+        
+        auto profile = OperatingModeController::instance().current();
+        populateProfile(*profile, response);
+        return Status::OK;
+    }
     
+    Status GetAllocationMetrics(ServerContext* context,
+                               const medical_imaging::AllocationMetricsRequest* request,
+                               medical_imaging::AllocationMetricsResponse* response) override {
+        
+        if (request->tracking() == "on" || request->tracking() == "off") {
+            alloc_tracker::setEnabled(request->tracking() == "on");
+        }
+        
+        response->set_available(alloc_tracker::available());
+        response->set_enabled(alloc_tracker::enabled());
+        response->set_live_bytes(alloc_tracker::liveBytes());
+        response->set_peak_live_bytes(alloc_tracker::peakLiveBytes());
+        for (int i = 0; i < static_cast<int>(PipelineStage::Count); ++i) {
+            auto stage = static_cast<PipelineStage>(i);
+            auto totals = alloc_tracker::stageTotals(stage);
+            auto* metrics = response->add_stages();
+            metrics->set_stage(pipelineStageName(stage));
+            metrics->set_allocations(totals.allocations);
+            metrics->set_frees(totals.frees);
+            metrics->set_bytes_allocated(totals.bytes_allocated);
+            metrics->set_bytes_freed(totals.bytes_freed);
+        }
+        return Status::OK;
+    }
+    
+    Status CaptureCpuProfile(ServerContext* context,
+                            const medical_imaging::CpuProfileRequest* request,
+                            medical_imaging::CpuProfileResponse* response) override {
+        
+        auto duration = std::chrono::milliseconds(request->duration_ms() > 0 ? request->duration_ms() : 10000);
+        std::cout << "Capturing CPU profile for " << duration.count() << "ms" << std::endl;
+        
+        try {
+            auto result = CpuProfiler::instance().capture(duration, request->frequency_hz(),
+                                                          CpuProfiler::defaultOutputDir());
+            
+            response->set_success(true);
+            response->set_output_path(result.output_path);
+            response->set_samples(result.samples);
+            response->set_dropped_samples(result.dropped_samples);
+            response->set_duration_ms(result.duration.count());
+            for (const auto& [stage, samples] : result.samples_by_stage) {
+                (*response->mutable_samples_by_stage())[stage] = samples;
+            }
+            
+            std::cout << "CPU profile written to " << result.output_path << std::endl;
+            return Status::OK;
+            
+        } catch (const std::exception& e) {
+            std::cerr << "CPU profile capture failed: " << e.what() << std::endl;
+            response->set_success(false);
+            response->set_error_message(e.what());
+            return Status(grpc::StatusCode::FAILED_PRECONDITION, e.what());
+        }
+    }
+    
+private:
+    static void populateProfile(const OperatingProfile& profile,
+                                medical_imaging::OperatingModeResponse* response) {
+        response->set_mode(operatingModeName(profile.mode));
+        response->set_success(true);
+        response->set_cpu_cores(profile.threads.cpu_cores);
+        response->set_concurrent_requests(profile.threads.concurrent_requests);
+        response->set_ort_intra_op_threads(profile.threads.ort_intra_op_threads);
+        response->set_omp_threads(profile.threads.omp_threads);
+        response->set_opencv_threads(profile.threads.opencv_threads);
+    }
+};
+
+// Services are registered per server, so each listener gets its own
+// instances over the shared pipeline
+std::unique_ptr<Server> StartListener(const ListenerConfig& config,
+                                      const std::vector<grpc::Service*>& services) {
     ServerBuilder builder;
     
     // Listen on the given address without any authentication mechanism
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
+    builder.AddListeningPort(config.address, grpc::InsecureServerCredentials());
+    for (grpc::Service* service : services) {
+        builder.RegisterService(service);
+    }
     
-    // Register "service" as the instance through which we'll communicate with
-    // clients. In this case it corresponds to an *synchronous* service.
-    builder.RegisterService(&service);
+    // Cap handler threads at the listener's own limit, or at the thread
+    // budget, in which case the quota follows rebalances
+    auto quota = std::make_shared<grpc::ResourceQuota>(config.name);
+    if (config.max_threads > 0) {
+        quota->SetMaxThreads(config.max_threads);
+    } else {
+        ThreadBudgetManager::instance().addListener([quota](const ThreadBudget& budget) {
+            quota->SetMaxThreads(budget.grpc_max_threads);
+        });
+    }
+    builder.SetResourceQuota(*quota);
     
     // Set max message size (for large medical images)
-    builder.SetMaxReceiveMessageSize(100 * 1024 * 1024); // 100MB
-    builder.SetMaxSendMessageSize(100 * 1024 * 1024);    // 100MB
+    builder.SetMaxReceiveMessageSize(config.max_message_bytes);
+    builder.SetMaxSendMessageSize(config.max_message_bytes);
     
-    // Finally assemble the server
     std::unique_ptr<Server> server(builder.BuildAndStart());
-    std::cout << "Medical Imaging Service listening on " << server_address << std::endl;
+    if (!server) {
+        throw std::runtime_error("Cannot listen on " + config.address);
+    }
+    std::cout << "Medical Imaging Service listening on " << config.address
+              << " (max message " << config.max_message_bytes / kMegabyte << "MB, "
+              << (config.max_threads > 0 ? std::to_string(config.max_threads) : std::string("budgeted"))
+              << " threads)" << std::endl;
+    return server;
+}
+
+// IMAGING_UNIX_SOCKET=/run/imaging/imaging.sock adds a listener for callers on
+// this host; IMAGING_UNIX_MAX_MESSAGE_MB (default 512) and
+// IMAGING_UNIX_MAX_THREADS (default: thread budget) configure it
+bool UnixListenerFromEnvironment(ListenerConfig& config) {
+    const char* path = std::getenv("IMAGING_UNIX_SOCKET");
+    if (!path || !*path) {
+        return false;
+    }
+    config.name = "medical_imaging_service_unix";
+    config.address = std::string("unix:") + path;
+    config.max_message_bytes = std::min(envInt("IMAGING_UNIX_MAX_MESSAGE_MB", 512), 2047) * kMegabyte;
+    config.max_threads = envInt("IMAGING_UNIX_MAX_THREADS", 0);
+    
+    // A socket left behind by a previous run would make the bind fail
+    struct stat info;
+    if (::lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        ::unlink(path);
+    }
+    return true;
+}
+
+// The admin service has no authentication, so it gets its own listener,
+// on loopback unless IMAGING_ADMIN_ADDRESS says otherwise ("off" disables
+// it). Requests are small and rare; a few threads are enough.
+bool AdminListenerFromEnvironment(ListenerConfig& config) {
+    const char* address = std::getenv("IMAGING_ADMIN_ADDRESS");
+    config.name = "medical_imaging_admin";
+    config.address = address && *address ? address : "127.0.0.1:50052";
+    config.max_message_bytes = 4 * kMegabyte;
+    config.max_threads = 4;
+    if (config.address == "off") {
+        return false;
+    }
+    const bool local = config.address.rfind("127.", 0) == 0 || config.address.rfind("localhost:", 0) == 0 ||
+                       config.address.rfind("[::1]:", 0) == 0 || config.address.rfind("unix:", 0) == 0;
+    if (!local) {
+        std::cerr << "Warning: admin service listening on non-loopback address " << config.address << std::endl;
+    }
+    return true;
+}
+
+void RunServer() {
+    ImagingPipeline pipeline;
+    MedicalImagingServiceImpl service(pipeline);
+    ImagingAdminServiceImpl admin_service;
+    
+    grpc::EnableDefaultHealthCheckService(true);
+    grpc::reflection::InitProtoReflectionServerBuilderPlugin();
+    
+    ListenerConfig tcp;
+    tcp.name = "medical_imaging_service";
+    tcp.address = "0.0.0.0:50051";
+    std::unique_ptr<Server> server = StartListener(tcp, {&service});
+    
+    ListenerConfig unix_config;
+    std::unique_ptr<MedicalImagingServiceImpl> unix_service;
+    std::unique_ptr<Server> unix_server;
+    if (UnixListenerFromEnvironment(unix_config)) {
+        unix_service = std::make_unique<MedicalImagingServiceImpl>(pipeline);
+        unix_server = StartListener(unix_config, {unix_service.get()});
+    }
+    
+    ListenerConfig admin_config;
+    std::unique_ptr<Server> admin_server;
+    if (AdminListenerFromEnvironment(admin_config)) {
+        admin_server = StartListener(admin_config, {&admin_service});
+    }
     
     // Wait for the server to shutdown. Note that some other thread must be
     // responsible for shutting down the server for this call to ever return.
@@ -184,6 +1067,7 @@ int main(int argc, char** argv) {
     std::cout << "Starting Medical Imaging Service..." << std::endl;
     
     try {
+        ImagingCore::initializeProcess();
         RunServer();
     } catch (const std::exception& e) {
         std::cerr << "Server failed to start: " << e.what() << std::endl;
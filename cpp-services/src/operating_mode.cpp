@@ -0,0 +1,50 @@
+/**
+ * Operating Mode Implementation
+ */
+
+#include "operating_mode.h"
+
+#include <iostream>
+
+OperatingModeController& OperatingModeController::instance() {
+    static OperatingModeController controller;
+    return controller;
+}
+
+OperatingModeController::OperatingModeController() {
+    profile_ = buildProfile(ThreadBudgetManager::instance().policy().mode, 0);
+}
+
+void OperatingModeController::initialize(const ThreadBudgetPolicy& policy) {
+    std::lock_guard<std::mutex> lock(switch_mutex_);
+    ThreadBudgetManager::instance().configure(policy);
+    std::atomic_store(&profile_, buildProfile(policy.mode, 0));
+}
+
+std::shared_ptr<const OperatingProfile> OperatingModeController::setMode(OperatingMode mode) {
+    std::lock_guard<std::mutex> lock(switch_mutex_);
+    auto previous = current();
+    if (previous->mode == mode) {
+        return previous;
+    }
+
+    std::cout << "Switching operating mode: " << operatingModeName(previous->mode)
+              << " -> " << operatingModeName(mode) << std::endl;
+
+    ThreadBudgetManager::instance().setMode(mode);
+    std::atomic_store(&profile_, buildProfile(mode, previous->generation + 1));
+    return current();
+}
+
+std::shared_ptr<const OperatingProfile> OperatingModeController::current() const {
+    return std::atomic_load(&profile_);
+}
+
+std::shared_ptr<const OperatingProfile> OperatingModeController::buildProfile(
+        OperatingMode mode, uint64_t generation) const {
+    auto profile = std::make_shared<OperatingProfile>();
+    profile->mode = mode;
+    profile->threads = ThreadBudgetManager::instance().budget();
+    profile->generation = generation;
+    return profile;
+}
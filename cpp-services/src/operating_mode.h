@@ -0,0 +1,50 @@
+/**
+ * Operating Mode
+ * Service-wide latency/throughput switch. A mode change re-splits the thread
+ * budget (thread_budget.h) and publishes the resulting OperatingProfile for
+ * the admin API.
+ *
+ * Nothing is drained or rejected. The fair scheduler's concurrency limit
+ * and the gRPC handler quota follow the new budget at once. The OpenMP and
+ * OpenCV thread counts are process-wide and change at once too: an
+ * in-flight request runs its remaining parallel regions at the new width,
+ * which changes how its work is split, never its results. ONNX Runtime
+ * sessions keep the intra- and inter-op thread counts they were created
+ * with; only sessions created after the switch use the new split.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "thread_budget.h"
+
+struct OperatingProfile {
+    OperatingMode mode;
+    ThreadBudget threads;
+    uint64_t generation;    // increments on every switch
+};
+
+class OperatingModeController {
+public:
+    static OperatingModeController& instance();
+
+    // Initial mode from the thread budget policy
+    void initialize(const ThreadBudgetPolicy& policy);
+
+    // Switches modes; returns the profile that is now active. Concurrent
+    // switches are serialized, and switching to the current mode is a no-op.
+    std::shared_ptr<const OperatingProfile> setMode(OperatingMode mode);
+
+    // Lock-free snapshot
+    std::shared_ptr<const OperatingProfile> current() const;
+
+private:
+    OperatingModeController();
+    std::shared_ptr<const OperatingProfile> buildProfile(OperatingMode mode, uint64_t generation) const;
+
+    std::mutex switch_mutex_;   // serializes setMode/initialize
+    std::shared_ptr<const OperatingProfile> profile_;
+};
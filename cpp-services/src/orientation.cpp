@@ -0,0 +1,241 @@
+/**
+ * Orientation Normalization Implementation
+ */
+
+#include "orientation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "thread_budget.h"
+
+namespace {
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+struct Vec3 {
+    double x, y, z;
+};
+
+double dot(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+Vec3 cross(const Vec3& a, const Vec3& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+std::vector<std::string> splitValues(std::string_view value) {
+    std::vector<std::string> parts;
+    size_t begin = 0;
+    while (begin <= value.size()) {
+        size_t end = value.find('\\', begin);
+        end = end == std::string_view::npos ? value.size() : end;
+        std::string part(value.substr(begin, end - begin));
+        part.erase(0, part.find_first_not_of(' '));
+        part.erase(part.find_last_not_of(' ') + 1);
+        parts.push_back(std::move(part));
+        begin = end + 1;
+    }
+    return parts;
+}
+
+// Patient Orientation code ("L", "PF", ...) as a direction in the DICOM
+// patient frame: +x left, +y posterior, +z head
+Vec3 codeDirection(const std::string& code) {
+    Vec3 v{0.0, 0.0, 0.0};
+    for (char c : code) {
+        switch (c) {
+            case 'L': v.x += 1.0; break;
+            case 'R': v.x -= 1.0; break;
+            case 'P': v.y += 1.0; break;
+            case 'A': v.y -= 1.0; break;
+            case 'H': v.z += 1.0; break;
+            case 'F': v.z -= 1.0; break;
+            default:
+                throw std::invalid_argument("unknown patient orientation code: " + code);
+        }
+    }
+    if (code.empty()) {
+        throw std::invalid_argument("empty patient orientation code");
+    }
+    return v;
+}
+
+} // namespace
+
+struct OrientationNormalizer::Session {
+    Ort::Env env{ORT_LOGGING_LEVEL_WARNING, "orientation"};
+    std::unique_ptr<Ort::Session> session;
+    Ort::MemoryInfo memory = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    std::string input_name;
+    std::string output_name;
+};
+
+OrientationConfig OrientationConfig::fromEnvironment() {
+    OrientationConfig config;
+    if (const char* path = std::getenv("IMAGING_ORIENTATION_MODEL"); path && *path) {
+        config.model_path = path;
+    }
+    config.min_confidence = std::min(envInt("IMAGING_ORIENTATION_MIN_CONFIDENCE", 80), 100) / 100.0f;
+    return config;
+}
+
+const char* imageOrientationName(ImageOrientation orientation) {
+    switch (orientation) {
+        case ImageOrientation::Identity:       return "identity";
+        case ImageOrientation::FlipHorizontal: return "flip-horizontal";
+        case ImageOrientation::FlipVertical:   return "flip-vertical";
+        case ImageOrientation::Rotate180:      return "rotate-180";
+        case ImageOrientation::Transpose:      return "transpose";
+        case ImageOrientation::Rotate90:       return "rotate-90";
+        case ImageOrientation::Rotate270:      return "rotate-270";
+        case ImageOrientation::Transverse:     return "transverse";
+    }
+    return "identity";
+}
+
+std::optional<ImageOrientation> orientationFromGeometry(std::string_view geometry) {
+    if (geometry.find_first_not_of(' ') == std::string_view::npos) {
+        return std::nullopt;
+    }
+    // Directions of increasing column (row vector) and increasing row
+    Vec3 row, column;
+    const std::vector<std::string> parts = splitValues(geometry);
+    if (parts.size() == 6) {
+        double v[6];
+        for (int i = 0; i < 6; ++i) {
+            char* end = nullptr;
+            v[i] = std::strtod(parts[i].c_str(), &end);
+            if (parts[i].empty() || *end != '\0') {
+                throw std::invalid_argument("image orientation is not six direction cosines");
+            }
+        }
+        row = {v[0], v[1], v[2]};
+        column = {v[3], v[4], v[5]};
+    } else if (parts.size() == 2) {
+        row = codeDirection(parts[0]);
+        column = codeDirection(parts[1]);
+    } else {
+        throw std::invalid_argument("image orientation must be six direction cosines or two codes");
+    }
+
+    // The plane's dominant normal picks the canonical directions for the
+    // image's right (u) and down (v)
+    const Vec3 normal = cross(row, column);
+    const double nx = std::fabs(normal.x), ny = std::fabs(normal.y), nz = std::fabs(normal.z);
+    if (nx == 0.0 && ny == 0.0 && nz == 0.0) {
+        throw std::invalid_argument("image orientation directions are parallel");
+    }
+    Vec3 u, v;
+    if (nz >= nx && nz >= ny) {
+        u = {1.0, 0.0, 0.0};     // axial: left, posterior
+        v = {0.0, 1.0, 0.0};
+    } else if (ny >= nx) {
+        u = {1.0, 0.0, 0.0};     // coronal and frontal projections: left, feet
+        v = {0.0, 0.0, -1.0};
+    } else {
+        u = {0.0, 1.0, 0.0};     // sagittal and laterals: posterior, feet
+        v = {0.0, 0.0, -1.0};
+    }
+
+    unsigned bits = 0;
+    if (std::fabs(dot(u, column)) > std::fabs(dot(u, row))) {
+        // Output columns run down the source
+        bits = 4 | (dot(u, column) < 0.0 ? 1 : 0) | (dot(v, row) < 0.0 ? 2 : 0);
+    } else {
+        bits = (dot(u, row) < 0.0 ? 1 : 0) | (dot(v, column) < 0.0 ? 2 : 0);
+    }
+    return static_cast<ImageOrientation>(bits);
+}
+
+OrientationNormalizer::OrientationNormalizer(OrientationConfig config)
+    : config_(std::move(config)) {
+    if (config_.model_path.empty()) {
+        return;
+    }
+    session_ = std::make_unique<Session>();
+    Ort::SessionOptions options;
+    ThreadBudgetManager::instance().applyToSessionOptions(options);
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    session_->session = std::make_unique<Ort::Session>(session_->env, config_.model_path.c_str(), options);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    if (session_->session->GetInputCount() != 1 || session_->session->GetOutputCount() < 1) {
+        throw std::runtime_error("orientation classifier must have one image input");
+    }
+    session_->input_name = session_->session->GetInputNameAllocated(0, allocator).get();
+    session_->output_name = session_->session->GetOutputNameAllocated(0, allocator).get();
+
+    auto shape = session_->session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (shape.size() != 4) {
+        throw std::runtime_error("orientation classifier input must be [N, C, H, W]");
+    }
+    channels_ = shape[1] > 0 ? static_cast<int>(shape[1]) : 1;
+    size_ = shape[2] > 0 ? static_cast<int>(shape[2]) : size_;
+    if (channels_ != 1 && channels_ != 3) {
+        throw std::runtime_error("orientation classifier input must have 1 or 3 channels");
+    }
+    std::cout << "Orientation classifier " << config_.model_path << ": " << channels_ << "x" << size_ << "x"
+              << size_ << std::endl;
+}
+
+OrientationNormalizer::~OrientationNormalizer() = default;
+
+ImageOrientation OrientationNormalizer::resolve(const PixelPlane& plane, const WindowLevelParams* window,
+                                                std::string_view geometry) const {
+    if (auto from_geometry = orientationFromGeometry(geometry)) {
+        return *from_geometry;
+    }
+    return session_ ? classify(plane, window) : ImageOrientation::Identity;
+}
+
+ImageOrientation OrientationNormalizer::classify(const PixelPlane& plane, const WindowLevelParams* window) const {
+    // The classifier sees a size_ x size_ thumbnail of [0, 1] intensities;
+    // only that is materialized
+    const size_t pixels = static_cast<size_t>(size_) * size_;
+    std::vector<float> tensor(channels_ * pixels);
+    TensorMapping mapping;
+    mapping.window = window;
+    kernels::resampleToTensor(plane, mapping, tensor.data(), size_, size_);
+    for (int c = 1; c < channels_; ++c) {
+        std::memcpy(tensor.data() + c * pixels, tensor.data(), pixels * sizeof(float));
+    }
+
+    const int64_t shape[4] = {1, channels_, size_, size_};
+    Ort::Value input = Ort::Value::CreateTensor<float>(session_->memory, tensor.data(), tensor.size(), shape, 4);
+    const char* inputs[] = {session_->input_name.c_str()};
+    const char* outputs[] = {session_->output_name.c_str()};
+    auto result = session_->session->Run(Ort::RunOptions{}, inputs, &input, 1, outputs, 1);
+    const size_t count = result[0].GetTensorTypeAndShapeInfo().GetElementCount();
+    if (count != 8) {
+        throw std::runtime_error("orientation classifier must output 8 scores");
+    }
+
+    // Softmax confidence of the best class
+    const float* scores = result[0].GetTensorData<float>();
+    const size_t best = std::max_element(scores, scores + count) - scores;
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += std::exp(static_cast<double>(scores[i] - scores[best]));
+    }
+    if (1.0 / sum < config_.min_confidence) {
+        return ImageOrientation::Identity;
+    }
+    return static_cast<ImageOrientation>(best);
+}
@@ -0,0 +1,69 @@
+/**
+ * Orientation Normalization
+ * Works out how an image must be read to reach the orientation the models
+ * were trained on, so rotated, mirrored or transposed inputs do not turn
+ * into low-confidence results. The transform is not applied here: callers
+ * pass it to kernels::resizeBilinear, which samples the source through it
+ * during the resize preprocessing does anyway.
+ *
+ * Canonical is the radiological display convention: patient left on the
+ * right of the image and feet at the bottom for projections and coronal
+ * planes, posterior at the bottom for axial planes, posterior on the right
+ * for sagittal planes and laterals. DICOM geometry is used when the caller
+ * has it, either Image Orientation (Patient) (0020,0037) as six direction
+ * cosines or Patient Orientation (0020,0020) as two codes ("L\F").
+ * Otherwise a tiny ONNX classifier (IMAGING_ORIENTATION_MODEL; input
+ * [1, C, S, S], output 8 scores in ImageOrientation order) looks at a
+ * thumbnail resampled straight from the stored pixels. Its answer is used
+ * only at IMAGING_ORIENTATION_MIN_CONFIDENCE percent (default 80) or more.
+ * Without either source the image is left as it is.
+ */
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "image_kernels.h"
+
+struct OrientationConfig {
+    std::string model_path;             // empty: no classifier
+    float min_confidence = 0.8f;
+
+    static OrientationConfig fromEnvironment();
+};
+
+const char* imageOrientationName(ImageOrientation orientation);
+
+// Transform from DICOM geometry; nullopt for an empty string. Throws
+// std::invalid_argument when the value is neither six cosines nor two codes.
+std::optional<ImageOrientation> orientationFromGeometry(std::string_view geometry);
+
+class OrientationNormalizer {
+public:
+    // Loads the classifier when configured; throws std::exception when its
+    // file is missing or does not fit
+    explicit OrientationNormalizer(OrientationConfig config);
+    ~OrientationNormalizer();
+    OrientationNormalizer(const OrientationNormalizer&) = delete;
+    OrientationNormalizer& operator=(const OrientationNormalizer&) = delete;
+
+    bool hasClassifier() const { return session_ != nullptr; }
+
+    // Geometry when given, otherwise the classifier on the plane as seen
+    // through `window` (null: full range); thread-safe
+    ImageOrientation resolve(const PixelPlane& plane, const WindowLevelParams* window,
+                             std::string_view geometry) const;
+
+private:
+    struct Session;
+
+    ImageOrientation classify(const PixelPlane& plane, const WindowLevelParams* window) const;
+
+    OrientationConfig config_;
+    std::unique_ptr<Session> session_;
+    int channels_ = 1;
+    int size_ = 64;
+};
@@ -0,0 +1,55 @@
+/**
+ * Parallel Loops Implementation
+ */
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace parallel {
+
+namespace {
+std::atomic<int> max_threads{1};
+} // namespace
+
+namespace detail {
+
+std::atomic<int> active_regions{0};
+
+int teamSize(int active) {
+    return std::max(1, max_threads.load(std::memory_order_relaxed) / (active + 1));
+}
+
+} // namespace detail
+
+void configure() {
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if (const char* env = std::getenv("IMAGING_OMP_THREADS")) {
+        int requested = std::atoi(env);
+        if (requested > 0) {
+            threads = requested;
+        }
+    }
+
+    // Nested teams inside a pipeline region would bypass the per-region sizing
+    omp_set_max_active_levels(1);
+    omp_set_dynamic(0);
+    setMaxThreads(threads);
+
+    std::cout << "OpenMP pipeline budget: " << threads << " threads" << std::endl;
+}
+
+int maxThreads() {
+    return max_threads.load(std::memory_order_relaxed);
+}
+
+void setMaxThreads(int threads) {
+    threads = std::max(1, threads);
+    max_threads.store(threads, std::memory_order_relaxed);
+    omp_set_num_threads(threads);
+}
+
+} // namespace parallel
@@ -0,0 +1,64 @@
+/**
+ * Parallel Loops
+ * OpenMP-backed loop helpers for per-pixel and per-slice work in the imaging
+ * pipeline.
+ *
+ * Several gRPC handler threads can be inside the pipeline at once, each next to
+ * ONNX Runtime's own pools. A fixed team per region would multiply into
+ * oversubscription, so every region sizes its team from the OpenMP budget
+ * divided by the number of regions currently running.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include <omp.h>
+
+namespace parallel {
+
+// Applies IMAGING_OMP_THREADS (default: hardware threads) and disables nested
+// regions. Call once at startup, before ONNX Runtime sessions are created.
+// In the service the ThreadBudgetManager then owns the thread count.
+void configure();
+
+int maxThreads();
+void setMaxThreads(int threads);
+
+namespace detail {
+extern std::atomic<int> active_regions;
+int teamSize(int active);
+} // namespace detail
+
+// Runs body(chunk_begin, chunk_end) over [begin, end) in chunks of about
+// `grain` items. Small ranges and saturated budgets run inline on the caller.
+//
+// Per-slice loops pass grain = 1, per-pixel loops a grain large enough to
+// amortize the fork (64K pixels or a few rows).
+template <typename Body>
+void forRange(size_t begin, size_t end, size_t grain, Body&& body) {
+    if (end <= begin) {
+        return;
+    }
+    grain = grain == 0 ? 1 : grain;
+    const size_t chunks = (end - begin + grain - 1) / grain;
+
+    const int active = detail::active_regions.fetch_add(1, std::memory_order_relaxed);
+    const int team = detail::teamSize(active);
+    if (chunks < 2 || team < 2 || omp_in_parallel()) {
+        detail::active_regions.fetch_sub(1, std::memory_order_relaxed);
+        body(begin, end);
+        return;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(team)
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        const size_t chunk_begin = begin + chunk * grain;
+        const size_t chunk_end = chunk_begin + grain < end ? chunk_begin + grain : end;
+        body(chunk_begin, chunk_end);
+    }
+    detail::active_regions.fetch_sub(1, std::memory_order_relaxed);
+}
+
+} // namespace parallel
@@ -0,0 +1,519 @@
+/**
+ * Payload Source Implementation
+ */
+
+#include "payload_source.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kFileScheme[] = "file://";
+constexpr char kObjectScheme[] = "s3://";
+constexpr char kHttpScheme[] = "http://";
+constexpr int kHttpTimeoutSeconds = 30;
+
+std::string systemError(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+bool startsWith(const std::string& text, const char* prefix) {
+    return text.rfind(prefix, 0) == 0;
+}
+
+std::string canonicalPath(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (!::realpath(path.c_str(), resolved)) {
+        return std::string();
+    }
+    return resolved;
+}
+
+void checkPayloadLimit(uint64_t size, uint64_t limit, const std::string& uri) {
+    if (size > limit) {
+        throw std::length_error("Payload of " + std::to_string(size) + " bytes exceeds the " +
+                                std::to_string(limit >> 20) + "MB limit: " + uri);
+    }
+}
+
+// Resolves [offset, offset + length) against the payload size
+uint64_t payloadLength(uint64_t size, uint64_t offset, uint64_t length, uint64_t limit, const std::string& uri) {
+    if (offset > size || (length > 0 && length > size - offset)) {
+        throw std::invalid_argument("Range exceeds the size of " + uri);
+    }
+    uint64_t resolved = length > 0 ? length : size - offset;
+    if (resolved == 0) {
+        throw std::invalid_argument("Empty payload at " + uri);
+    }
+    checkPayloadLimit(resolved, limit, uri);
+    return resolved;
+}
+
+// A replaced file has a new inode, a rewritten one a new mtime
+PayloadVersion fileVersion(const struct stat& info) {
+    return PayloadVersion{static_cast<uint64_t>(info.st_size),
+                          std::to_string(info.st_ino) + ":" + std::to_string(info.st_mtim.tv_sec) + "." +
+                              std::to_string(info.st_mtim.tv_nsec)};
+}
+
+// Percent-encodes an object key for the request path, keeping '/'
+std::string encodeKey(const std::string& key) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string encoded;
+    encoded.reserve(key.size());
+    for (unsigned char c : key) {
+        bool unreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                          c == '-' || c == '_' || c == '.' || c == '~' || c == '/';
+        if (unreserved) {
+            encoded += static_cast<char>(c);
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0xF];
+        }
+    }
+    return encoded;
+}
+
+struct HttpEndpoint {
+    std::string host;
+    std::string port = "80";
+    std::string path_prefix;
+};
+
+HttpEndpoint parseEndpoint(const std::string& url) {
+    if (!startsWith(url, kHttpScheme)) {
+        throw std::invalid_argument("Object store URL must be http://host[:port]: " + url);
+    }
+    HttpEndpoint endpoint;
+    std::string rest = url.substr(sizeof(kHttpScheme) - 1);
+    auto slash = rest.find('/');
+    if (slash != std::string::npos) {
+        endpoint.path_prefix = rest.substr(slash);
+        while (!endpoint.path_prefix.empty() && endpoint.path_prefix.back() == '/') {
+            endpoint.path_prefix.pop_back();
+        }
+        rest.resize(slash);
+    }
+    auto colon = rest.rfind(':');
+    if (colon != std::string::npos && rest.find(']') == std::string::npos) {
+        endpoint.port = rest.substr(colon + 1);
+        rest.resize(colon);
+    }
+    endpoint.host = rest;
+    if (endpoint.host.empty()) {
+        throw std::invalid_argument("Object store URL has no host: " + url);
+    }
+    return endpoint;
+}
+
+// One HTTP/1.1 exchange on its own connection. The body is received straight
+// into the caller's buffer, which is sized for exactly the requested range.
+class HttpConnection {
+public:
+    explicit HttpConnection(const HttpEndpoint& endpoint) : endpoint_(endpoint) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        int rc = ::getaddrinfo(endpoint.host.c_str(), endpoint.port.c_str(), &hints, &addresses);
+        if (rc != 0) {
+            throw std::runtime_error("Cannot resolve object store " + endpoint.host + ": " + ::gai_strerror(rc));
+        }
+        for (addrinfo* a = addresses; a && fd_ < 0; a = a->ai_next) {
+            fd_ = ::socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+            if (fd_ < 0) {
+                continue;
+            }
+            timeval timeout{kHttpTimeoutSeconds, 0};
+            ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            ::setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            if (::connect(fd_, a->ai_addr, a->ai_addrlen) != 0) {
+                ::close(fd_);
+                fd_ = -1;
+            }
+        }
+        ::freeaddrinfo(addresses);
+        if (fd_ < 0) {
+            throw std::runtime_error(systemError("Cannot connect to object store " + endpoint.host));
+        }
+    }
+
+    ~HttpConnection() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    // HEAD: the object's size and ETag
+    PayloadVersion head(const std::string& path) {
+        sendRequest("HEAD", path, std::string());
+        Response response = readHeaders(nullptr, 0);
+        checkStatus(response, 200, path);
+        return PayloadVersion{response.content_length, response.etag};
+    }
+
+    // GET of bytes [first, first + size) into `destination`, only from the
+    // version with `etag`
+    void getRange(const std::string& path, uint64_t first, uint64_t size, const std::string& etag,
+                  char* destination) {
+        std::string headers = "Range: bytes=" + std::to_string(first) + "-" + std::to_string(first + size - 1) +
+                              "\r\n";
+        if (!etag.empty()) {
+            headers += "If-Match: " + etag + "\r\n";
+        }
+        sendRequest("GET", path, headers);
+        size_t received = 0;
+        Response response = readHeaders(destination, size, &received);
+        // Stores that ignore If-Match still report the ETag they served
+        if (response.status == 412 || (!etag.empty() && !response.etag.empty() && response.etag != etag)) {
+            throw std::runtime_error("Object changed while it was read: " + path);
+        }
+        checkStatus(response, 206, path);
+        if (response.content_length != size) {
+            throw std::runtime_error("Object store returned " + std::to_string(response.content_length) +
+                                     " bytes for a " + std::to_string(size) + " byte range of " + path);
+        }
+        while (received < size) {
+            ssize_t n = ::recv(fd_, destination + received, size - received, 0);
+            if (n <= 0) {
+                throw std::runtime_error(n == 0 ? "Object store closed the connection early for " + path
+                                                : systemError("Object store read failed for " + path));
+            }
+            received += static_cast<size_t>(n);
+        }
+    }
+
+private:
+    struct Response {
+        int status = 0;
+        uint64_t content_length = 0;
+        std::string etag;
+    };
+
+    void sendRequest(const char* method, const std::string& path, const std::string& headers) {
+        std::string request = std::string(method) + " " + endpoint_.path_prefix + path + " HTTP/1.1\r\n" +
+                              "Host: " + endpoint_.host + ":" + endpoint_.port + "\r\n" + headers +
+                              "Connection: close\r\n\r\n";
+        size_t sent = 0;
+        while (sent < request.size()) {
+            ssize_t n = ::send(fd_, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                throw std::runtime_error(systemError("Object store request failed"));
+            }
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    // Reads up to the end of the headers; body bytes that arrived with them
+    // are moved to the front of `body` (at most `body_capacity` bytes)
+    Response readHeaders(char* body, size_t body_capacity, size_t* body_received = nullptr) {
+        std::string buffer;
+        size_t end = std::string::npos;
+        char chunk[4096];
+        while (end == std::string::npos) {
+            ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                throw std::runtime_error("Object store sent an incomplete response");
+            }
+            buffer.append(chunk, static_cast<size_t>(n));
+            end = buffer.find("\r\n\r\n");
+            if (end == std::string::npos && buffer.size() > 64 * 1024) {
+                throw std::runtime_error("Object store response headers too large");
+            }
+        }
+
+        Response response;
+        std::istringstream headers(buffer.substr(0, end));
+        std::string line;
+        std::getline(headers, line);
+        if (line.compare(0, 5, "HTTP/") != 0 || line.size() < 12) {
+            throw std::runtime_error("Malformed object store response");
+        }
+        response.status = std::atoi(line.c_str() + 9);
+        while (std::getline(headers, line)) {
+            auto colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if (name == "content-length") {
+                response.content_length = std::strtoull(line.c_str() + colon + 1, nullptr, 10);
+            } else if (name == "etag") {
+                response.etag = line.substr(colon + 1);
+                while (!response.etag.empty() && std::isspace(static_cast<unsigned char>(response.etag.front()))) {
+                    response.etag.erase(0, 1);
+                }
+                while (!response.etag.empty() && std::isspace(static_cast<unsigned char>(response.etag.back()))) {
+                    response.etag.pop_back();
+                }
+            }
+        }
+
+        const size_t leftover = buffer.size() - (end + 4);
+        if (body_received) {
+            if (leftover > body_capacity) {
+                throw std::runtime_error("Object store sent more data than requested");
+            }
+            std::memcpy(body, buffer.data() + end + 4, leftover);
+            *body_received = leftover;
+        }
+        return response;
+    }
+
+    static void checkStatus(const Response& response, int expected, const std::string& path) {
+        if (response.status == 404) {
+            throw std::invalid_argument("Object not found: " + path);
+        }
+        if (response.status != expected) {
+            throw std::runtime_error("Object store returned HTTP " + std::to_string(response.status) +
+                                     " for " + path);
+        }
+    }
+
+    const HttpEndpoint& endpoint_;
+    int fd_ = -1;
+};
+
+} // namespace
+
+PayloadSourceConfig PayloadSourceConfig::fromEnvironment() {
+    PayloadSourceConfig config;
+    if (const char* roots = std::getenv("IMAGING_FILE_ROOTS")) {
+        std::stringstream list(roots);
+        std::string root;
+        while (std::getline(list, root, ':')) {
+            if (!root.empty()) {
+                config.file_roots.push_back(root);
+            }
+        }
+    }
+    if (const char* url = std::getenv("IMAGING_OBJECT_STORE_URL")) {
+        config.object_store_url = url;
+    }
+    config.range_bytes = static_cast<size_t>(envInt("IMAGING_OBJECT_RANGE_MB", 8)) << 20;
+    config.parallel_ranges = envInt("IMAGING_OBJECT_PARALLEL_RANGES", config.parallel_ranges);
+    config.max_payload_bytes = static_cast<uint64_t>(envInt("IMAGING_MAX_PAYLOAD_MB", 100)) << 20;
+    return config;
+}
+
+PayloadSource::PayloadSource(PayloadSourceConfig config)
+    : config_(std::move(config)) {
+    // Compare against resolved roots, so a symlinked root still matches
+    for (auto& root : config_.file_roots) {
+        std::string resolved = canonicalPath(root);
+        if (!resolved.empty()) {
+            root = resolved;
+        }
+        while (root.size() > 1 && root.back() == '/') {
+            root.pop_back();
+        }
+    }
+    if (!config_.object_store_url.empty()) {
+        parseEndpoint(config_.object_store_url);
+    }
+    config_.range_bytes = std::max<size_t>(config_.range_bytes, 64 * 1024);
+    config_.parallel_ranges = std::max(config_.parallel_ranges, 1);
+}
+
+std::unique_ptr<PayloadData> PayloadSource::read(const PayloadLocation& location) const {
+    const std::string& uri = location.uri;
+    if (startsWith(uri, kObjectScheme)) {
+        std::string rest = uri.substr(sizeof(kObjectScheme) - 1);
+        auto slash = rest.find('/');
+        if (slash == std::string::npos || slash == 0 || slash + 1 == rest.size()) {
+            throw std::invalid_argument("Object reference must be s3://bucket/key: " + uri);
+        }
+        return readObject(rest.substr(0, slash), rest.substr(slash + 1), location.offset, location.length);
+    }
+    std::string path = startsWith(uri, kFileScheme) ? uri.substr(sizeof(kFileScheme) - 1) : uri;
+    if (path.empty() || path[0] != '/') {
+        throw std::invalid_argument("Unsupported payload location: " + uri);
+    }
+    return readFile(path, location.offset, location.length);
+}
+
+PayloadVersion PayloadSource::version(const std::string& uri) const {
+    if (startsWith(uri, kObjectScheme)) {
+        std::string rest = uri.substr(sizeof(kObjectScheme) - 1);
+        auto slash = rest.find('/');
+        if (slash == std::string::npos || slash == 0 || slash + 1 == rest.size()) {
+            throw std::invalid_argument("Object reference must be s3://bucket/key: " + uri);
+        }
+        if (config_.object_store_url.empty()) {
+            throw std::invalid_argument("Object references need IMAGING_OBJECT_STORE_URL");
+        }
+        const HttpEndpoint endpoint = parseEndpoint(config_.object_store_url);
+        HttpConnection connection(endpoint);
+        return connection.head("/" + encodeKey(rest.substr(0, slash)) + "/" + encodeKey(rest.substr(slash + 1)));
+    }
+    std::string path = startsWith(uri, kFileScheme) ? uri.substr(sizeof(kFileScheme) - 1) : uri;
+    if (path.empty() || path[0] != '/') {
+        throw std::invalid_argument("Unsupported payload location: " + uri);
+    }
+    const std::string resolved = allowedPath(path);
+    struct stat info;
+    if (::stat(resolved.c_str(), &info) != 0) {
+        throw std::runtime_error(systemError("Cannot stat " + path));
+    }
+    if (!S_ISREG(info.st_mode)) {
+        throw std::invalid_argument("Not a regular file: " + path);
+    }
+    return fileVersion(info);
+}
+
+uint64_t PayloadSource::payloadSize(const PayloadLocation& location, const PayloadVersion& version) const {
+    return payloadLength(version.size, location.offset, location.length, config_.max_payload_bytes, location.uri);
+}
+
+std::string PayloadSource::allowedPath(const std::string& path) const {
+    const std::string resolved = canonicalPath(path);
+    for (const auto& root : config_.file_roots) {
+        if (!resolved.empty() && (resolved == root || root == "/" ||
+                                  resolved.compare(0, root.size() + 1, root + "/") == 0)) {
+            return resolved;
+        }
+    }
+    throw std::invalid_argument("File is not under an allowed root: " + path);
+}
+
+std::unique_ptr<PayloadData> PayloadSource::readFile(const std::string& path, uint64_t offset,
+                                                     uint64_t length) const {
+    const std::string resolved = allowedPath(path);
+
+    // The resolved path has no symlinks left; refuse one swapped in since
+    int fd = ::open(resolved.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) {
+        throw std::runtime_error(systemError("Cannot open " + path));
+    }
+    struct Closer {
+        int fd;
+        ~Closer() { ::close(fd); }
+    } closer{fd};
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        throw std::invalid_argument("Not a regular file: " + path);
+    }
+    const uint64_t size = payloadLength(static_cast<uint64_t>(info.st_size), offset, length,
+                                        config_.max_payload_bytes, path);
+
+    // Copied, not mapped: a file truncated under a mapping faults its
+    // readers with SIGBUS, while pread just comes back short
+    auto payload = std::make_unique<PayloadData>();
+    payload->version_ = fileVersion(info);
+    ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_SEQUENTIAL);
+    payload->buffer_.reset(new char[size]);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::pread(fd, payload->buffer_.get() + done, size - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw std::runtime_error(n == 0 ? "Unexpected end of " + path : systemError("Cannot read " + path));
+        }
+        done += static_cast<size_t>(n);
+    }
+    payload->data_ = payload->buffer_.get();
+    payload->size_ = static_cast<size_t>(size);
+    return payload;
+}
+
+std::unique_ptr<PayloadData> PayloadSource::readObject(const std::string& bucket, const std::string& key,
+                                                       uint64_t offset, uint64_t length) const {
+    if (config_.object_store_url.empty()) {
+        throw std::invalid_argument("Object references need IMAGING_OBJECT_STORE_URL");
+    }
+    const HttpEndpoint endpoint = parseEndpoint(config_.object_store_url);
+    const std::string path = "/" + encodeKey(bucket) + "/" + encodeKey(key);
+    const std::string uri = std::string(kObjectScheme) + bucket + "/" + key;
+
+    // Every range is pinned to the version the HEAD saw
+    PayloadVersion version;
+    {
+        HttpConnection connection(endpoint);
+        version = connection.head(path);
+    }
+    const uint64_t size = payloadLength(version.size, offset, length, config_.max_payload_bytes, uri);
+    if (size > std::numeric_limits<size_t>::max() / 2) {
+        throw std::invalid_argument("Object too large: " + uri);
+    }
+
+    // Ranges go straight into their slice of one buffer, several at a time
+    auto payload = std::make_unique<PayloadData>();
+    payload->version_ = version;
+    payload->buffer_.reset(new char[size]);
+    const uint64_t range = config_.range_bytes;
+    const uint64_t ranges = (size + range - 1) / range;
+    std::atomic<uint64_t> next{0};
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+
+    auto fetch = [&] {
+        try {
+            for (uint64_t i = next++; i < ranges; i = next++) {
+                const uint64_t first = i * range;
+                const uint64_t bytes = std::min(range, size - first);
+                HttpConnection connection(endpoint);
+                connection.getRange(path, offset + first, bytes, version.tag, payload->buffer_.get() + first);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+            next = ranges;
+        }
+    };
+
+    const int workers = static_cast<int>(std::min<uint64_t>(ranges, config_.parallel_ranges));
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workers; ++i) {
+        threads.emplace_back(fetch);
+    }
+    fetch();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+
+    payload->data_ = payload->buffer_.get();
+    payload->size_ = static_cast<size_t>(size);
+    return payload;
+}
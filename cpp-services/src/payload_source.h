@@ -0,0 +1,111 @@
+/**
+ * Payload Source
+ * Reads request payloads the service fetches itself instead of receiving them
+ * inline: files under configured roots and objects in a local S3-compatible
+ * store. Files are read with pread and objects are fetched as parallel HTTP
+ * range requests, either way straight into one buffer the payload owns. The
+ * payload never passes through a gRPC message, and its bytes exist in memory
+ * once.
+ *
+ * Locations are "file:///abs/path" (or a bare absolute path) and
+ * "s3://bucket/key". Files outside IMAGING_FILE_ROOTS are refused, and object
+ * references need IMAGING_OBJECT_STORE_URL; with neither set every reference
+ * is rejected. Files are copied rather than mapped, so a writer truncating
+ * one mid-read makes the read fail instead of faulting the process with
+ * SIGBUS. Payloads larger than
+ * IMAGING_MAX_PAYLOAD_MB (default 100, the inline message limit) are refused
+ * before any byte is read.
+ *
+ * An object is read at the ETag a HEAD returns first: every range request
+ * carries If-Match with it, so an object overwritten mid-read fails the
+ * read instead of mixing bytes from two versions.
+ *
+ * The object store client speaks plain HTTP/1.1 with path-style URLs and
+ * unsigned requests, which is what a local stand-in (MinIO with a read-only
+ * anonymous policy on the study bucket) serves; it is not an AWS client.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct PayloadLocation {
+    std::string uri;
+    uint64_t offset = 0;
+    uint64_t length = 0;    // 0: to the end
+};
+
+// Which contents a file or object holds right now: its size, plus the inode
+// and mtime of a file or the ETag of an object. A cached copy is only reused
+// while the version it was read at still matches.
+struct PayloadVersion {
+    uint64_t size = 0;
+    std::string tag;
+
+    bool operator==(const PayloadVersion& other) const { return size == other.size && tag == other.tag; }
+    bool operator!=(const PayloadVersion& other) const { return !(*this == other); }
+};
+
+// Bytes of one payload, in memory it owns
+class PayloadData {
+public:
+    PayloadData() = default;
+    PayloadData(const PayloadData&) = delete;
+    PayloadData& operator=(const PayloadData&) = delete;
+
+    std::string_view view() const { return std::string_view(data_, size_); }
+    // Of the whole file or object
+    const PayloadVersion& version() const { return version_; }
+
+private:
+    friend class PayloadSource;
+
+    std::unique_ptr<char[]> buffer_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    PayloadVersion version_;
+};
+
+struct PayloadSourceConfig {
+    std::vector<std::string> file_roots;
+    std::string object_store_url;           // "http://127.0.0.1:9000"
+    size_t range_bytes = 8 << 20;           // size of one object range request
+    int parallel_ranges = 4;                // range requests in flight per object
+    uint64_t max_payload_bytes = uint64_t(100) << 20;
+
+    // IMAGING_FILE_ROOTS="/data/studies:/mnt/archive", IMAGING_OBJECT_STORE_URL,
+    // IMAGING_OBJECT_RANGE_MB, IMAGING_OBJECT_PARALLEL_RANGES and
+    // IMAGING_MAX_PAYLOAD_MB
+    static PayloadSourceConfig fromEnvironment();
+};
+
+class PayloadSource {
+public:
+    explicit PayloadSource(PayloadSourceConfig config);
+
+    // Throws std::invalid_argument for locations that are malformed or not
+    // allowed, std::length_error for payloads over max_payload_bytes, and
+    // std::runtime_error when reading fails
+    std::unique_ptr<PayloadData> read(const PayloadLocation& location) const;
+    // The current version of the whole file or object, without reading it;
+    // throws like read()
+    PayloadVersion version(const std::string& uri) const;
+    // Bytes read() would return for `location` given `version` of the whole
+    // file or object; throws like read()
+    uint64_t payloadSize(const PayloadLocation& location, const PayloadVersion& version) const;
+
+    const PayloadSourceConfig& config() const { return config_; }
+
+private:
+    std::string allowedPath(const std::string& path) const;
+    std::unique_ptr<PayloadData> readFile(const std::string& path, uint64_t offset, uint64_t length) const;
+    std::unique_ptr<PayloadData> readObject(const std::string& bucket, const std::string& key,
+                                            uint64_t offset, uint64_t length) const;
+
+    PayloadSourceConfig config_;
+};
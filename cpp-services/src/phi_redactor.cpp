@@ -0,0 +1,338 @@
+/**
+ * Burned-in Text Redactor Implementation
+ */
+
+#include "phi_redactor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <onnxruntime_cxx_api.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "parallel.h"
+#include "thread_budget.h"
+
+namespace {
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed > 0 ? parsed : fallback;
+}
+
+// Bounding boxes of 8-connected runs of cells above the threshold, in map
+// coordinates. Single cells are noise at this resolution.
+std::vector<BoundingBox> textBoxes(const float* map, int rows, int cols, float threshold) {
+    std::vector<uint8_t> pending(static_cast<size_t>(rows) * cols);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        pending[i] = map[i] > threshold;
+    }
+    std::vector<BoundingBox> boxes;
+    std::vector<int> stack;
+    for (int start = 0; start < rows * cols; ++start) {
+        if (!pending[start]) {
+            continue;
+        }
+        pending[start] = 0;
+        stack.assign(1, start);
+        int cells = 0;
+        int x0 = cols, y0 = rows, x1 = -1, y1 = -1;
+        while (!stack.empty()) {
+            const int cell = stack.back();
+            stack.pop_back();
+            const int y = cell / cols;
+            const int x = cell % cols;
+            ++cells;
+            x0 = std::min(x0, x);
+            x1 = std::max(x1, x);
+            y0 = std::min(y0, y);
+            y1 = std::max(y1, y);
+            for (int ny = std::max(0, y - 1); ny <= std::min(rows - 1, y + 1); ++ny) {
+                for (int nx = std::max(0, x - 1); nx <= std::min(cols - 1, x + 1); ++nx) {
+                    const int next = ny * cols + nx;
+                    if (pending[next]) {
+                        pending[next] = 0;
+                        stack.push_back(next);
+                    }
+                }
+            }
+        }
+        if (cells >= 2) {
+            boxes.push_back({x0, y0, x1 - x0 + 1, y1 - y0 + 1});
+        }
+    }
+    return boxes;
+}
+
+} // namespace
+
+struct PhiRedactor::Session {
+    Ort::Env env{ORT_LOGGING_LEVEL_WARNING, "phi_redactor"};
+    std::unique_ptr<Ort::Session> session;
+    Ort::MemoryInfo memory = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+    std::string input_name;
+    std::string output_name;
+};
+
+struct PhiRedactor::Frame {
+    ProcessedImage* image;
+    cv::Mat pixels;                     // decoded at full resolution, filled in place
+    ShapeBucket bucket;                 // input size, and where the image sits in it
+    std::vector<float> downscaled;      // model input plane
+    std::vector<BoundingBox> regions;   // full-resolution pixels
+};
+
+PhiRedactorConfig PhiRedactorConfig::fromEnvironment() {
+    PhiRedactorConfig config;
+    if (const char* path = std::getenv("IMAGING_PHI_MODEL"); path && *path) {
+        config.path = path;
+    }
+    config.input_size = envInt("IMAGING_PHI_INPUT_SIZE", config.input_size);
+    config.shape_step = envInt("IMAGING_PHI_SHAPE_STEP", config.shape_step);
+    config.threshold = std::min(envInt("IMAGING_PHI_THRESHOLD", 50), 100) / 100.0f;
+    config.max_batch = envInt("IMAGING_PHI_BATCH", config.max_batch);
+    if (const char* modalities = std::getenv("IMAGING_PHI_MODALITIES"); modalities && *modalities) {
+        config.modalities.clear();
+        std::stringstream list(modalities);
+        for (std::string modality; std::getline(list, modality, ',');) {
+            if (modality == "*") {
+                config.modalities.clear();
+                break;
+            }
+            if (!modality.empty()) {
+                config.modalities.insert(modality);
+            }
+        }
+    }
+    return config;
+}
+
+PhiRedactor::PhiRedactor(PhiRedactorConfig config)
+    : config_(std::move(config)),
+      session_(std::make_unique<Session>()) {
+    Ort::SessionOptions options;
+    ThreadBudgetManager::instance().applyToSessionOptions(options);
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+    // Memory plans are cached per input shape; buckets keep those few
+    options.EnableMemPattern();
+    session_->session = std::make_unique<Ort::Session>(session_->env, config_.path.c_str(), options);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    if (session_->session->GetInputCount() != 1 || session_->session->GetOutputCount() < 1) {
+        throw std::runtime_error("text detector must have one image input");
+    }
+    session_->input_name = session_->session->GetInputNameAllocated(0, allocator).get();
+    session_->output_name = session_->session->GetOutputNameAllocated(0, allocator).get();
+
+    auto shape = session_->session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (shape.size() != 4) {
+        throw std::runtime_error("text detector input must be [N, C, H, W]");
+    }
+    if (shape[0] > 0) {
+        config_.max_batch = static_cast<int>(shape[0]);
+        fixed_batch_ = true;
+    }
+    channels_ = shape[1] > 0 ? static_cast<int>(shape[1]) : 1;
+    height_ = shape[2] > 0 ? static_cast<int>(shape[2]) : config_.input_size;
+    width_ = shape[3] > 0 ? static_cast<int>(shape[3]) : config_.input_size;
+    if (channels_ != 1 && channels_ != 3) {
+        throw std::runtime_error("text detector input must have 1 or 3 channels");
+    }
+    if (shape[2] <= 0 && shape[3] <= 0) {
+        buckets_.emplace(config_.input_size, config_.shape_step);
+    }
+
+    std::cout << "Text detector " << config_.path << ": ";
+    if (buckets_) {
+        std::cout << channels_ << "x(dynamic), long side " << buckets_->longSide() << " in steps of "
+                  << buckets_->step() << " (up to " << buckets_->maxBuckets() << " shapes)";
+    } else {
+        std::cout << channels_ << "x" << height_ << "x" << width_;
+    }
+    std::cout << ", batches of " << config_.max_batch << std::endl;
+}
+
+PhiRedactor::~PhiRedactor() = default;
+
+bool PhiRedactor::checks(const std::string& modality) const {
+    return config_.modalities.empty() || config_.modalities.count(modality) > 0;
+}
+
+void PhiRedactor::detect(const std::vector<Frame*>& batch) const {
+    // Every frame of a batch is in the same bucket
+    const InputShape size = batch.front()->bucket.input;
+    const size_t plane = static_cast<size_t>(size.height) * size.width;
+    // A fixed batch dimension is filled with blank images
+    const size_t images = fixed_batch_ ? std::max<size_t>(config_.max_batch, batch.size()) : batch.size();
+    std::vector<float> tensor(images * channels_ * plane, 0.0f);
+    for (size_t n = 0; n < batch.size(); ++n) {
+        for (int c = 0; c < channels_; ++c) {
+            std::memcpy(tensor.data() + (n * channels_ + c) * plane, batch[n]->downscaled.data(),
+                        plane * sizeof(float));
+        }
+    }
+    const int64_t shape[4] = {static_cast<int64_t>(images), channels_, size.height, size.width};
+    Ort::Value input = Ort::Value::CreateTensor<float>(session_->memory, tensor.data(), tensor.size(), shape, 4);
+    const char* inputs[] = {session_->input_name.c_str()};
+    const char* outputs[] = {session_->output_name.c_str()};
+    auto result = session_->session->Run(Ort::RunOptions{}, inputs, &input, 1, outputs, 1);
+
+    const auto info = result[0].GetTensorTypeAndShapeInfo();
+    const auto dims = info.GetShape();
+    if (dims.size() < 3 || dims[0] != static_cast<int64_t>(images)) {
+        throw std::runtime_error("text detector output must be [N, 1, h, w] or [N, h, w]");
+    }
+    const int map_rows = static_cast<int>(dims[dims.size() - 2]);
+    const int map_cols = static_cast<int>(dims[dims.size() - 1]);
+    const size_t per_image = info.GetElementCount() / images;
+    const float* maps = result[0].GetTensorData<float>();
+
+    for (size_t n = 0; n < batch.size(); ++n) {
+        Frame& frame = *batch[n];
+        // Map cells span the whole input, padding included
+        const double scale_x = static_cast<double>(frame.pixels.cols) * size.width
+                             / (static_cast<double>(map_cols) * frame.bucket.content.width);
+        const double scale_y = static_cast<double>(frame.pixels.rows) * size.height
+                             / (static_cast<double>(map_rows) * frame.bucket.content.height);
+        // A cell of margin: strokes bleed past the cells the model marks
+        const int pad_x = std::max(2, static_cast<int>(std::ceil(scale_x)));
+        const int pad_y = std::max(2, static_cast<int>(std::ceil(scale_y)));
+        for (const auto& box : textBoxes(maps + n * per_image, map_rows, map_cols, config_.threshold)) {
+            const int x0 = std::max(0, static_cast<int>(box.x * scale_x) - pad_x);
+            const int y0 = std::max(0, static_cast<int>(box.y * scale_y) - pad_y);
+            const int x1 = std::min(frame.pixels.cols,
+                                    static_cast<int>(std::ceil((box.x + box.width) * scale_x)) + pad_x);
+            const int y1 = std::min(frame.pixels.rows,
+                                    static_cast<int>(std::ceil((box.y + box.height) * scale_y)) + pad_y);
+            if (x1 > x0 && y1 > y0) {
+                frame.regions.push_back({x0, y0, x1 - x0, y1 - y0});
+            }
+        }
+    }
+}
+
+int PhiRedactor::redact(std::vector<ProcessedImage>& images) const {
+    std::vector<Frame> frames;
+    for (auto& image : images) {
+        if (checks(image.modality)) {
+            frames.push_back(Frame{&image, cv::Mat(), {}, {}, {}});
+        }
+    }
+    if (frames.empty()) {
+        return 0;
+    }
+
+    // Decode and shrink every frame; the area filter keeps thin strokes
+    // that point sampling would drop, and only the small copy is converted.
+    // Nothing may throw out of the parallel region; failures are counted.
+    std::atomic<int> unchecked{0};
+    parallel::forRange(0, frames.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Frame& frame = frames[i];
+            try {
+                const std::string& data = frame.image->image_data;
+                cv::Mat encoded(1, static_cast<int>(data.size()), CV_8UC1, const_cast<char*>(data.data()));
+                frame.pixels = cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+                const int depth = frame.pixels.empty() ? -1 : frame.pixels.depth();
+                if (depth != CV_8U && depth != CV_16U) {
+                    unchecked++;
+                    continue;
+                }
+                cv::Mat gray = frame.pixels;
+                if (frame.pixels.channels() == 3) {
+                    cv::cvtColor(frame.pixels, gray, cv::COLOR_BGR2GRAY);
+                } else if (frame.pixels.channels() == 4) {
+                    cv::cvtColor(frame.pixels, gray, cv::COLOR_BGRA2GRAY);
+                }
+                if (buckets_) {
+                    frame.bucket = buckets_->bucketFor(gray.cols, gray.rows);
+                } else {
+                    frame.bucket.input = frame.bucket.content = {width_, height_};
+                }
+                const InputShape input = frame.bucket.input;
+                const InputShape content = frame.bucket.content;
+                cv::Mat small;
+                cv::resize(gray, small, cv::Size(content.width, content.height), 0, 0, cv::INTER_AREA);
+                std::vector<float> downscaled(static_cast<size_t>(input.height) * input.width, 0.0f);
+                cv::Mat plane(input.height, input.width, CV_32F, downscaled.data());
+                cv::Mat region = plane(cv::Rect(0, 0, content.width, content.height));
+                small.convertTo(region, CV_32F, depth == CV_16U ? 1.0 / 65535.0 : 1.0 / 255.0);
+                frame.downscaled = std::move(downscaled);
+            } catch (const std::exception&) {
+                unchecked++;
+            }
+        }
+    });
+    // An image that was not checked could carry text; it must not leave
+    if (unchecked.load() > 0) {
+        throw std::runtime_error("cannot check " + std::to_string(unchecked.load()) +
+                                 " image(s) for burned-in text");
+    }
+
+    // Batches hold one shape: frames are grouped by bucket, in order within one
+    std::vector<Frame*> decoded;
+    for (auto& frame : frames) {
+        decoded.push_back(&frame);
+    }
+    std::stable_sort(decoded.begin(), decoded.end(),
+                     [](const Frame* a, const Frame* b) { return a->bucket.input < b->bucket.input; });
+    const size_t max_batch = static_cast<size_t>(std::max(1, config_.max_batch));
+    std::vector<Frame*> batch;
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        batch.push_back(decoded[i]);
+        if (batch.size() == max_batch || i + 1 == decoded.size() ||
+            decoded[i + 1]->bucket.input != batch.front()->bucket.input) {
+            detect(batch);
+            batch.clear();
+        }
+    }
+
+    // Redacted images are re-encoded in parallel; as above, failures are
+    // counted rather than thrown
+    std::atomic<int> filled{0};
+    std::atomic<int> unencoded{0};
+    parallel::forRange(0, frames.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Frame& frame = frames[i];
+            if (frame.regions.empty()) {
+                continue;
+            }
+            try {
+                for (const auto& region : frame.regions) {
+                    frame.pixels(cv::Rect(region.x, region.y, region.width, region.height))
+                        .setTo(cv::Scalar(0, 0, 0, 0));
+                }
+                std::vector<uchar> png;
+                if (!cv::imencode(".png", frame.pixels, png, {cv::IMWRITE_PNG_COMPRESSION, 1})) {
+                    unencoded++;
+                    continue;
+                }
+                frame.image->image_data.assign(png.begin(), png.end());
+                filled += static_cast<int>(frame.regions.size());
+            } catch (const std::exception&) {
+                unencoded++;
+            }
+        }
+    });
+    // Returning the unredacted original would leak what was found
+    if (unencoded.load() > 0) {
+        throw std::runtime_error("cannot encode redacted image");
+    }
+    for (auto& frame : frames) {
+        frame.image->metadata["burned_in_text_regions"] = std::to_string(frame.regions.size());
+    }
+    return filled.load();
+}
@@ -0,0 +1,82 @@
+/**
+ * Burned-in Text Redactor
+ * Finds text burned into the pixels of processed DICOM images (patient
+ * names, dates and IDs drawn by ultrasound machines and secondary-capture
+ * tools) and fills it with black before the images leave the service.
+ *
+ * Detection is a small text-segmentation ONNX model run on a downscaled
+ * grayscale copy: one input [N, C, H, W] (C of 1 or 3, [0, 1] intensities)
+ * and one output [N, 1, h, w] or [N, h, w] of text probabilities, usually
+ * h = H / 4. All images of a result are decoded and downscaled in parallel
+ * and go through the model in batches, so a cine loop costs one or two runs
+ * rather than one per frame. Connected cells above the threshold become
+ * boxes, which are padded and filled at full resolution in the decoded
+ * image; only images with text are re-encoded (PNG, keeping bit depth).
+ *
+ * Models exported with dynamic height and width run each image at close to
+ * its own aspect ratio (see shape_buckets.h) rather than squashed into a
+ * square, which keeps the wide text lines of ultrasound and secondary
+ * capture frames legible. Frames are batched by shape bucket.
+ *
+ * Only modalities that commonly carry burned-in annotations are checked.
+ * Configured with IMAGING_PHI_MODEL (enables redaction; the ONNX file),
+ * IMAGING_PHI_INPUT_SIZE (default 320, for symbolic input dims; the long
+ * side when both are symbolic), IMAGING_PHI_SHAPE_STEP (default 32, the
+ * bucket granularity), IMAGING_PHI_THRESHOLD (percent, default 50),
+ * IMAGING_PHI_BATCH (default 16) and IMAGING_PHI_MODALITIES (default
+ * US,SC,OT,XC,ES; "*" for all).
+ */
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "imaging_types.h"
+#include "shape_buckets.h"
+
+struct PhiRedactorConfig {
+    std::string path;
+    int input_size = 320;
+    int shape_step = 32;
+    float threshold = 0.5f;
+    int max_batch = 16;
+    std::unordered_set<std::string> modalities{"US", "SC", "OT", "XC", "ES"};    // empty: all
+
+    static PhiRedactorConfig fromEnvironment();
+};
+
+class PhiRedactor {
+public:
+    // Loads the model; throws std::exception when the file is missing or
+    // does not fit
+    explicit PhiRedactor(PhiRedactorConfig config);
+    ~PhiRedactor();
+    PhiRedactor(const PhiRedactor&) = delete;
+    PhiRedactor& operator=(const PhiRedactor&) = delete;
+
+    // Redacts the images in place and records "burned_in_text_regions" in
+    // the metadata of every image checked; returns the regions filled.
+    // Fails closed: throws std::runtime_error, leaving no image half
+    // checked, when any image to check cannot be decoded, examined or
+    // re-encoded. Thread-safe.
+    int redact(std::vector<ProcessedImage>& images) const;
+
+private:
+    struct Session;
+    struct Frame;
+
+    bool checks(const std::string& modality) const;
+    void detect(const std::vector<Frame*>& batch) const;
+
+    PhiRedactorConfig config_;
+    std::unique_ptr<Session> session_;
+    int channels_ = 1;
+    int height_ = 0;
+    int width_ = 0;
+    bool fixed_batch_ = false;              // the model only takes max_batch images
+    std::optional<ShapeBuckets> buckets_;   // dynamic height and width
+};
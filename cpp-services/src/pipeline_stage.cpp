@@ -0,0 +1,103 @@
+/**
+ * Pipeline Stages Implementation
+ */
+
+#include "pipeline_stage.h"
+
+#include <algorithm>
+
+#include "alloc_tracker.h"
+
+namespace {
+thread_local PipelineStage current_stage = PipelineStage::Idle;
+thread_local StageRecorder* current_recorder = nullptr;
+} // namespace
+
+const char* pipelineStageName(PipelineStage stage) {
+    switch (stage) {
+        case PipelineStage::Admission:   return "admission";
+        case PipelineStage::Analysis:    return "analysis";
+        case PipelineStage::Quality:     return "quality";
+        case PipelineStage::Decode:      return "decode";
+        case PipelineStage::Preprocess:  return "preprocess";
+        case PipelineStage::Inference:   return "inference";
+        case PipelineStage::Postprocess: return "postprocess";
+        case PipelineStage::Dicom:       return "dicom";
+        case PipelineStage::Deidentify:  return "deidentify";
+        case PipelineStage::Redact:      return "redact";
+        case PipelineStage::Response:    return "response";
+        default:                         return "idle";
+    }
+}
+
+PipelineStage currentPipelineStage() {
+    return current_stage;
+}
+
+StageRecorder::StageRecorder()
+    : previous_(current_recorder) {
+    frames_.reserve(8);
+    stages_.reserve(static_cast<size_t>(PipelineStage::Count));
+    current_recorder = this;
+}
+
+StageRecorder::~StageRecorder() {
+    current_recorder = previous_;
+}
+
+StageRecorder* StageRecorder::current() {
+    return current_recorder;
+}
+
+void StageRecorder::enter(PipelineStage stage) {
+    auto& counters = alloc_tracker::threadCounters();
+    frames_.push_back({stage, std::chrono::steady_clock::now(), counters.allocations,
+                       counters.bytes_allocated, counters.live_bytes, counters.peak_live_bytes});
+    // Restart the peak so it measures this stage only; exit() folds it back
+    counters.peak_live_bytes = counters.live_bytes;
+}
+
+void StageRecorder::exit() {
+    if (frames_.empty()) {
+        return;
+    }
+    const Frame frame = frames_.back();
+    frames_.pop_back();
+
+    auto& counters = alloc_tracker::threadCounters();
+    const double wall_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - frame.start).count();
+    const int64_t peak = counters.peak_live_bytes - frame.live_bytes;
+    counters.peak_live_bytes = std::max(frame.saved_peak, counters.peak_live_bytes);
+
+    auto it = std::find_if(stages_.begin(), stages_.end(),
+                           [&](const StageMetrics& m) { return m.stage == frame.stage; });
+    if (it == stages_.end()) {
+        stages_.push_back({frame.stage, 0, 0.0, 0, 0, 0});
+        it = stages_.end() - 1;
+    }
+    it->calls++;
+    it->wall_time_ms += wall_ms;
+    it->allocations += counters.allocations - frame.allocations;
+    it->bytes_allocated += counters.bytes_allocated - frame.bytes_allocated;
+    it->peak_live_bytes = std::max(it->peak_live_bytes, peak);
+}
+
+StageScope::StageScope(PipelineStage stage)
+    : previous_(current_stage),
+      recorder_(current_recorder) {
+    current_stage = stage;
+    if (recorder_) {
+        recorder_->enter(stage);
+    }
+    if (tracing::Span::active()) {
+        span_.emplace(pipelineStageName(stage));
+    }
+}
+
+StageScope::~StageScope() {
+    current_stage = previous_;
+    if (recorder_) {
+        recorder_->exit();
+    }
+}
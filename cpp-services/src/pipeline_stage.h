@@ -0,0 +1,96 @@
+/**
+ * Pipeline Stages
+ * Marks which stage of a request the current thread is executing. The marker
+ * is a thread-local store, cheap enough to leave in the hot path; the CPU
+ * profiler attributes its samples to the active stage, and inside a sampled
+ * trace each scope is also recorded as a span.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "tracing.h"
+
+enum class PipelineStage {
+    Idle = 0,
+    Admission,      // waiting in the fair scheduler
+    Analysis,       // inside ImagingService, before a finer stage is marked
+    Quality,        // image quality gate ahead of inference
+    Decode,
+    Preprocess,
+    Inference,
+    Postprocess,
+    Dicom,
+    Deidentify,     // applying a de-identification profile to a DICOM file
+    Redact,         // finding and filling burned-in text in processed images
+    Response,       // building the gRPC response
+    Count
+};
+
+const char* pipelineStageName(PipelineStage stage);
+
+PipelineStage currentPipelineStage();
+
+struct StageMetrics {
+    PipelineStage stage;
+    int calls;
+    double wall_time_ms;
+    // Allocation figures stay zero unless alloc tracking is enabled
+    uint64_t allocations;
+    uint64_t bytes_allocated;
+    int64_t peak_live_bytes;    // highest growth of the thread's live bytes in the stage
+};
+
+// Collects per-stage wall time and allocations for one request on the calling
+// thread. Stages entered more than once are summed; nested stages are
+// reported separately and also counted in their enclosing stage.
+class StageRecorder {
+public:
+    StageRecorder();
+    ~StageRecorder();
+    StageRecorder(const StageRecorder&) = delete;
+    StageRecorder& operator=(const StageRecorder&) = delete;
+
+    // Completed stages, in order of first entry
+    const std::vector<StageMetrics>& stages() const { return stages_; }
+
+    static StageRecorder* current();
+
+private:
+    friend class StageScope;
+
+    struct Frame {
+        PipelineStage stage;
+        std::chrono::steady_clock::time_point start;
+        uint64_t allocations;
+        uint64_t bytes_allocated;
+        int64_t live_bytes;
+        int64_t saved_peak;
+    };
+
+    void enter(PipelineStage stage);
+    void exit();
+
+    std::vector<Frame> frames_;
+    std::vector<StageMetrics> stages_;
+    StageRecorder* previous_;
+};
+
+// Marks the calling thread as being in `stage` until the scope closes
+class StageScope {
+public:
+    explicit StageScope(PipelineStage stage);
+    ~StageScope();
+
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+
+private:
+    PipelineStage previous_;
+    StageRecorder* recorder_;
+    std::optional<tracing::Span> span_;
+};
@@ -0,0 +1,203 @@
+/**
+ * Prior Cache Implementation
+ */
+
+#include "prior_cache.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+#include "tracing.h"
+
+namespace {
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value || !*value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed >= 0 ? parsed : fallback;
+}
+
+} // namespace
+
+size_t PriorImage::bytes() const {
+    return (encoded ? encoded->view().size() : 0) + uri.size() + sizeof(*this);
+}
+
+PriorCache::PriorCache(size_t capacity_bytes)
+    : capacity_bytes_(capacity_bytes) {}
+
+std::shared_ptr<const PriorImage> PriorCache::find(const std::string& uri, const PayloadVersion& current) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(uri);
+    if (it == index_.end()) {
+        ++misses_;
+        return nullptr;
+    }
+    if ((*it->second)->version() != current) {
+        size_bytes_ -= (*it->second)->bytes();
+        lru_.erase(it->second);
+        index_.erase(it);
+        ++misses_;
+        return nullptr;
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return *it->second;
+}
+
+void PriorCache::insert(std::shared_ptr<const PriorImage> prior) {
+    const size_t bytes = prior->bytes();
+    if (bytes > capacity_bytes_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto existing = index_.find(prior->uri);
+    if (existing != index_.end()) {
+        size_bytes_ -= (*existing->second)->bytes();
+        lru_.erase(existing->second);
+        index_.erase(existing);
+    }
+    // Evicted entries stay alive for requests still holding them
+    while (size_bytes_ + bytes > capacity_bytes_ && !lru_.empty()) {
+        size_bytes_ -= lru_.back()->bytes();
+        index_.erase(lru_.back()->uri);
+        lru_.pop_back();
+    }
+    lru_.push_front(std::move(prior));
+    index_[lru_.front()->uri] = lru_.begin();
+    size_bytes_ += bytes;
+}
+
+size_t PriorCache::sizeBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_bytes_;
+}
+
+uint64_t PriorCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t PriorCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+std::vector<std::string> parsePrefetchHint(std::string_view hint) {
+    std::vector<std::string> uris;
+    size_t i = 0;
+    while (i < hint.size()) {
+        while (i < hint.size() && (hint[i] == ',' || hint[i] == ' ' || hint[i] == '\t' || hint[i] == '\n')) {
+            ++i;
+        }
+        size_t start = i;
+        while (i < hint.size() && hint[i] != ',' && hint[i] != ' ' && hint[i] != '\t' && hint[i] != '\n') {
+            ++i;
+        }
+        if (i > start) {
+            uris.emplace_back(hint.substr(start, i - start));
+        }
+    }
+    return uris;
+}
+
+PriorPrefetcher::Config PriorPrefetcher::Config::fromEnvironment() {
+    Config config;
+    config.cache_bytes = static_cast<size_t>(envInt("IMAGING_PRIOR_CACHE_MB", 512)) << 20;
+    config.threads = envInt("IMAGING_PREFETCH_THREADS", config.threads);
+    return config;
+}
+
+PriorPrefetcher::PriorPrefetcher(const PayloadSource& source, Config config)
+    : source_(source),
+      config_(config),
+      cache_(config.cache_bytes) {
+    if (config_.cache_bytes == 0) {
+        return;
+    }
+    for (int i = 0; i < config_.threads; ++i) {
+        workers_.emplace_back([this] { run(); });
+    }
+}
+
+PriorPrefetcher::~PriorPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+int PriorPrefetcher::prefetch(const std::vector<std::string>& uris) {
+    if (!enabled()) {
+        return 0;
+    }
+    int queued = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& uri : uris) {
+            if (queue_.size() >= config_.max_queued) {
+                break;
+            }
+            if (pending_.count(uri)) {
+                continue;
+            }
+            pending_.insert(uri);
+            queue_.push_back(uri);
+            ++queued;
+        }
+    }
+    if (queued > 0) {
+        wake_.notify_all();
+    }
+    return queued;
+}
+
+void PriorPrefetcher::run() {
+    for (;;) {
+        std::string uri;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            uri = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        // Checked here rather than when queued, so a hint repeated by every
+        // request of a session costs one lookup per loader, not per request
+        try {
+            if (!cache_.find(uri, source_.version(uri))) {
+                cache_.insert(load(uri));
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Prefetch of " << uri << " failed: " << e.what() << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.erase(uri);
+    }
+}
+
+std::shared_ptr<const PriorImage> PriorPrefetcher::load(const std::string& uri) const {
+    tracing::Span span("PrefetchPrior");
+    if (span.recording()) {
+        span.setAttribute("imaging.prior_uri", uri);
+    }
+
+    auto prior = std::make_shared<PriorImage>();
+    prior->uri = uri;
+    PayloadLocation location;
+    location.uri = uri;
+    prior->encoded = source_.read(location);
+    return prior;
+}
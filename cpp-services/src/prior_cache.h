@@ -0,0 +1,113 @@
+/**
+ * Prior Cache
+ * Related prior studies, fetched in the background while the current study
+ * is analyzed, so a comparison that follows finds them warm.
+ *
+ * Callers list priors in the `prefetch` entry of ImageAnalysisRequest.metadata
+ * as PayloadLocation URIs ("file:///..." or "s3://bucket/key") separated by
+ * commas or whitespace. PriorPrefetcher loads each one through PayloadSource
+ * on its own threads and puts the bytes in a byte-bounded LRU cache keyed by
+ * URI and version (size plus mtime or ETag). The cached bytes are copies the
+ * cache owns, never a mapping of the file, so a file truncated under the
+ * cache cannot fault a reader. Requests that later reference the same URI
+ * stat it and use the cached copy only while the version still matches; a
+ * file rewritten or truncated since is dropped and read afresh. Decoding is
+ * left to the request, which knows the orientation and window it needs.
+ *
+ * Sized with IMAGING_PRIOR_CACHE_MB (default 512, 0 disables prefetching)
+ * and IMAGING_PREFETCH_THREADS (default 2).
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "payload_source.h"
+
+struct PriorImage {
+    std::string uri;
+    std::unique_ptr<PayloadData> encoded;   // owned copy of the bytes as stored
+
+    const PayloadVersion& version() const { return encoded->version(); }
+    size_t bytes() const;
+};
+
+class PriorCache {
+public:
+    explicit PriorCache(size_t capacity_bytes);
+
+    // Marks the entry most recently used; null when not cached, or when the
+    // cached copy is of another version (the entry is then dropped)
+    std::shared_ptr<const PriorImage> find(const std::string& uri, const PayloadVersion& current);
+    void insert(std::shared_ptr<const PriorImage> prior);
+
+    size_t capacityBytes() const { return capacity_bytes_; }
+    size_t sizeBytes() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    using Entry = std::shared_ptr<const PriorImage>;
+
+    size_t capacity_bytes_;
+    size_t size_bytes_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    std::list<Entry> lru_;    // front: most recently used
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    mutable std::mutex mutex_;
+};
+
+// "file:///a.png, s3://b/c.dcm" -> URIs, for the `prefetch` metadata hint
+std::vector<std::string> parsePrefetchHint(std::string_view hint);
+
+class PriorPrefetcher {
+public:
+    struct Config {
+        size_t cache_bytes = size_t(512) << 20;
+        int threads = 2;
+        size_t max_queued = 256;
+
+        static Config fromEnvironment();
+    };
+
+    PriorPrefetcher(const PayloadSource& source, Config config);
+    ~PriorPrefetcher();
+    PriorPrefetcher(const PriorPrefetcher&) = delete;
+    PriorPrefetcher& operator=(const PriorPrefetcher&) = delete;
+
+    bool enabled() const { return !workers_.empty(); }
+
+    // Queues URIs that are neither cached nor already queued; returns how
+    // many were queued. Never blocks: hints beyond max_queued are dropped.
+    int prefetch(const std::vector<std::string>& uris);
+
+    PriorCache& cache() { return cache_; }
+
+private:
+    void run();
+    std::shared_ptr<const PriorImage> load(const std::string& uri) const;
+
+    const PayloadSource& source_;
+    Config config_;
+    PriorCache cache_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::string> queue_;
+    std::unordered_set<std::string> pending_;    // queued or loading
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,41 @@
+/**
+ * Input Shape Buckets Implementation
+ */
+
+#include "shape_buckets.h"
+
+#include <algorithm>
+#include <cmath>
+
+ShapeBuckets::ShapeBuckets(int long_side, int step)
+    : long_side_(std::max(1, long_side)),
+      step_(std::clamp(step, 1, std::max(1, long_side))) {
+    // The long side is a whole number of steps, so both sides stay aligned
+    long_side_ = (long_side_ + step_ - 1) / step_ * step_;
+}
+
+ShapeBucket ShapeBuckets::bucketFor(int image_width, int image_height) const {
+    ShapeBucket bucket;
+    if (image_width <= 0 || image_height <= 0) {
+        bucket.input = bucket.content = {long_side_, long_side_};
+        return bucket;
+    }
+    const bool landscape = image_width >= image_height;
+    const double aspect = landscape ? static_cast<double>(image_height) / image_width
+                                    : static_cast<double>(image_width) / image_height;
+    const int content_short = std::clamp(static_cast<int>(std::lround(long_side_ * aspect)), 1, long_side_);
+    const int input_short = std::min(long_side_, (content_short + step_ - 1) / step_ * step_);
+    if (landscape) {
+        bucket.input = {long_side_, input_short};
+        bucket.content = {long_side_, content_short};
+    } else {
+        bucket.input = {input_short, long_side_};
+        bucket.content = {content_short, long_side_};
+    }
+    return bucket;
+}
+
+size_t ShapeBuckets::maxBuckets() const {
+    // Landscape and portrait share the square bucket
+    return 2 * static_cast<size_t>(long_side_ / step_) - 1;
+}
@@ -0,0 +1,50 @@
+/**
+ * Input Shape Buckets
+ * Picks input sizes for image models exported with dynamic spatial dims, so
+ * an image runs at close to its own aspect ratio instead of being stretched
+ * to one square size. The long side is fixed, the short side is rounded up
+ * to a multiple of `step`, and the image is resized to fit and padded with
+ * zeros: at most step - 1 rows or columns are padding, and there are at
+ * most 2 * long_side / step shapes.
+ *
+ * Few shapes matter to ONNX Runtime, which plans a session's memory (its
+ * memory pattern) per distinct set of input shapes and caches the plans:
+ * with buckets, every batch after the first of its shape runs on a cached
+ * plan and an arena already sized for it. Batchers group images by bucket
+ * so that each batch has a single shape.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+struct InputShape {
+    int width = 0;
+    int height = 0;
+
+    bool operator==(const InputShape& other) const { return width == other.width && height == other.height; }
+    bool operator!=(const InputShape& other) const { return !(*this == other); }
+    bool operator<(const InputShape& other) const {
+        return height != other.height ? height < other.height : width < other.width;
+    }
+};
+
+struct ShapeBucket {
+    InputShape input;       // tensor size
+    InputShape content;     // the resized image, top-left in the tensor; the rest is zero
+};
+
+class ShapeBuckets {
+public:
+    ShapeBuckets(int long_side, int step);
+
+    ShapeBucket bucketFor(int image_width, int image_height) const;
+    size_t maxBuckets() const;
+
+    int longSide() const { return long_side_; }
+    int step() const { return step_; }
+
+private:
+    int long_side_;
+    int step_;
+};
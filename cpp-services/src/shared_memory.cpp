@@ -0,0 +1,404 @@
+/**
+ * Shared Memory Transport Implementation
+ */
+
+#include "shared_memory.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kReferencePrefix[] = "fd:";
+// Bounds the descriptors one caller can make the service hold
+constexpr int kMaxSegmentsPerConnection = 64;
+// Results start on cache-line boundaries so callers can read them in place
+constexpr uint64_t kResultAlignment = 64;
+
+std::string systemError(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+bool rangeEnd(uint64_t offset, uint64_t length, uint64_t& end) {
+    if (length > std::numeric_limits<uint64_t>::max() - offset) {
+        return false;
+    }
+    end = offset + length;
+    return true;
+}
+
+// Closes the descriptor on every exit path; the mappings outlive it
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd) : fd_(fd) {}
+    ~FileDescriptor() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+    int release() {
+        int fd = fd_;
+        fd_ = -1;
+        return fd;
+    }
+
+private:
+    int fd_;
+};
+
+// Without F_SEAL_SHRINK the owner could truncate the segment and fault the
+// service on its next read; only memfds answer F_GET_SEALS
+const char* unsealedReason(int fd) {
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        return "not a regular file";
+    }
+    int seals = ::fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        return "not a memfd sealed with F_SEAL_SHRINK";
+    }
+    return nullptr;
+}
+
+std::string randomToken() {
+    static const char kHex[] = "0123456789abcdef";
+    std::random_device random;
+    std::string token;
+    for (int i = 0; i < 4; ++i) {
+        uint32_t bits = random();
+        for (int j = 0; j < 8; ++j) {
+            token += kHex[(bits >> (4 * j)) & 0xf];
+        }
+    }
+    return token;
+}
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Invalid shared memory registry socket path: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+} // namespace
+
+bool sharedMemoryTransportEnabled() {
+    static const bool enabled = [] {
+        const char* value = std::getenv("IMAGING_SHM_TRANSPORT");
+        return value && (std::strcmp(value, "1") == 0 || std::strcmp(value, "on") == 0);
+    }();
+    return enabled;
+}
+
+bool isLocalPeer(const std::string& peer) {
+    return peer.rfind("unix:", 0) == 0 || peer.rfind("ipv4:127.", 0) == 0 ||
+           peer.rfind("ipv6:[::1]:", 0) == 0 || peer.rfind("ipv6:%5B::1%5D:", 0) == 0;
+}
+
+SharedMemoryRegistry::SharedMemoryRegistry(std::string path) : path_(std::move(path)) {
+    const sockaddr_un address = socketAddress(path_);
+    struct stat info;
+    if (::lstat(path_.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        ::unlink(path_.c_str());
+    }
+    FileDescriptor listener(::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    listener_ = listener.release();
+    if (listener_ < 0 || ::bind(listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(listener_, 64) != 0 || ::pipe2(wake_, O_CLOEXEC) != 0) {
+        const std::string error = systemError("Cannot listen on " + path_);
+        if (listener_ >= 0) {
+            ::close(listener_);
+        }
+        throw std::runtime_error(error);
+    }
+    worker_ = std::thread([this] { run(); });
+    std::cout << "Shared memory registry listening on " << path_ << std::endl;
+}
+
+SharedMemoryRegistry::~SharedMemoryRegistry() {
+    const char stop = 0;
+    if (::write(wake_[1], &stop, 1) < 0) {
+        // The worker also stops when the pipe closes below
+    }
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    for (int fd : {listener_, wake_[0], wake_[1]}) {
+        ::close(fd);
+    }
+    for (const auto& entry : entries_) {
+        ::close(entry.second.fd);
+    }
+    ::unlink(path_.c_str());
+}
+
+std::string SharedMemoryRegistry::pathFromEnvironment() {
+    const char* path = std::getenv("IMAGING_SHM_SOCKET");
+    return path && *path ? path : "/tmp/imaging-shm.sock";
+}
+
+int SharedMemoryRegistry::open(const std::string& segment) const {
+    if (segment.rfind(kReferencePrefix, 0) != 0) {
+        throw std::invalid_argument("Unsupported shared memory segment: " + segment);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(segment.substr(sizeof(kReferencePrefix) - 1));
+    if (it == entries_.end()) {
+        throw std::invalid_argument("Unknown shared memory segment: " + segment);
+    }
+    int fd = ::fcntl(it->second.fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        throw std::runtime_error(systemError("Cannot open " + segment));
+    }
+    return fd;
+}
+
+void SharedMemoryRegistry::run() {
+    std::vector<pollfd> polled;
+    std::vector<int> connections;
+    for (;;) {
+        polled.assign({{wake_[0], POLLIN, 0}, {listener_, POLLIN, 0}});
+        for (int connection : connections) {
+            polled.push_back({connection, POLLIN, 0});
+        }
+        if (::poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << systemError("Shared memory registry stopped") << std::endl;
+            break;
+        }
+        if (polled[0].revents) {
+            break;
+        }
+        for (size_t i = 2; i < polled.size(); ++i) {
+            const int connection = polled[i].fd;
+            // Messages still queued are answered before a hang-up is handled
+            const bool open = (polled[i].revents & POLLIN) ? receive(connection)
+                                                          : !(polled[i].revents & (POLLHUP | POLLERR | POLLNVAL));
+            if (!open) {
+                revoke(connection);
+                connections.erase(std::find(connections.begin(), connections.end(), connection));
+                ::close(connection);
+            }
+        }
+        if (polled[1].revents & POLLIN) {
+            int connection = ::accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connection >= 0) {
+                connections.push_back(connection);
+            }
+        }
+    }
+    for (int connection : connections) {
+        ::close(connection);
+    }
+}
+
+// False once the caller has closed the connection
+bool SharedMemoryRegistry::receive(int connection) {
+    char byte;
+    iovec data{&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received = ::recvmsg(connection, &message, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+    if (received == 0) {
+        return false;
+    }
+
+    int fd = -1;
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS &&
+            header->cmsg_len == CMSG_LEN(sizeof(int))) {
+            std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+    FileDescriptor guard(fd);
+    std::string reply;
+    if (fd < 0 || (message.msg_flags & MSG_CTRUNC)) {
+        reply = "error: expected one descriptor";
+    } else if (const char* reason = unsealedReason(fd)) {
+        reply = std::string("error: ") + reason;
+    } else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int& live = registered_[connection];
+        if (live >= kMaxSegmentsPerConnection) {
+            reply = "error: too many segments on this connection";
+        } else {
+            std::string token = randomToken();
+            entries_[token] = Entry{guard.release(), connection};
+            ++live;
+            reply = kReferencePrefix + token;
+        }
+    }
+    // A caller that went away is noticed on the next poll
+    ::send(connection, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    return true;
+}
+
+void SharedMemoryRegistry::revoke(int connection) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.connection == connection) {
+            ::close(it->second.fd);
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    registered_.erase(connection);
+}
+
+std::string registerSharedMemory(const std::string& socket_path, int fd, int& connection) {
+    if (connection < 0) {
+        const sockaddr_un address = socketAddress(socket_path);
+        connection = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (connection < 0 ||
+            ::connect(connection, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            const std::string error = systemError("Cannot connect to " + socket_path);
+            if (connection >= 0) {
+                ::close(connection);
+                connection = -1;
+            }
+            throw std::runtime_error(error);
+        }
+    }
+
+    char byte = 0;
+    iovec data{&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    if (::sendmsg(connection, &message, MSG_NOSIGNAL) < 0) {
+        throw std::runtime_error(systemError("Cannot register shared memory"));
+    }
+
+    char reply[128];
+    ssize_t received = ::recv(connection, reply, sizeof(reply), 0);
+    if (received <= 0) {
+        throw std::runtime_error(systemError("Shared memory registry did not answer"));
+    }
+    std::string answer(reply, static_cast<size_t>(received));
+    if (answer.rfind(kReferencePrefix, 0) != 0) {
+        throw std::runtime_error("Shared memory registry refused the segment: " + answer);
+    }
+    return answer;
+}
+
+SharedMemorySegment::SharedMemorySegment(const SharedMemoryHandle& handle, const SharedMemoryRegistry& registry)
+    : segment_(handle.segment),
+      result_offset_(handle.result_offset),
+      result_capacity_(handle.result_capacity) {
+    uint64_t payload_end = 0;
+    uint64_t result_end = 0;
+    if (handle.length == 0 || !rangeEnd(handle.offset, handle.length, payload_end) ||
+        !rangeEnd(handle.result_offset, handle.result_capacity, result_end)) {
+        throw std::invalid_argument("Invalid shared memory range in " + segment_);
+    }
+    const bool writable = handle.result_capacity > 0;
+    if (writable && handle.result_offset < payload_end && handle.offset < result_end) {
+        throw std::invalid_argument("Result area overlaps the payload in " + segment_);
+    }
+
+    const int fd = registry.open(segment_);
+    FileDescriptor guard(fd);
+    if (writable && (::fcntl(fd, F_GET_SEALS) & (F_SEAL_WRITE | F_SEAL_FUTURE_WRITE))) {
+        throw std::invalid_argument(segment_ + " is write-sealed but has a result area");
+    }
+    const int access = ::fcntl(fd, F_GETFL) & O_ACCMODE;
+    if (writable && access != O_RDWR) {
+        throw std::invalid_argument(segment_ + " was not passed writable but has a result area");
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        throw std::runtime_error(systemError("Cannot stat " + segment_));
+    }
+    const uint64_t size = static_cast<uint64_t>(info.st_size);
+    if (!S_ISREG(info.st_mode) || payload_end > size || result_end > size) {
+        throw std::invalid_argument("Shared memory range exceeds segment " + segment_);
+    }
+
+    char* payload = nullptr;
+    payload_map_ = map(fd, handle.offset, handle.length, PROT_READ, payload);
+    payload_ = std::string_view(payload, handle.length);
+    if (writable) {
+        try {
+            result_map_ = map(fd, handle.result_offset, handle.result_capacity,
+                              PROT_READ | PROT_WRITE, result_);
+        } catch (...) {
+            ::munmap(payload_map_.base, payload_map_.length);
+            throw;
+        }
+    }
+}
+
+SharedMemorySegment::~SharedMemorySegment() {
+    if (payload_map_.base) {
+        ::munmap(payload_map_.base, payload_map_.length);
+    }
+    if (result_map_.base) {
+        ::munmap(result_map_.base, result_map_.length);
+    }
+}
+
+SharedMemorySegment::Mapping SharedMemorySegment::map(int fd, uint64_t offset, uint64_t length,
+                                                      int protection, char*& data) {
+    static const uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    const uint64_t aligned = offset & ~(page - 1);
+    const uint64_t skip = offset - aligned;
+
+    // The payload is read front to back by the decoder; populate it up front
+    // instead of taking a fault per page
+    int flags = MAP_SHARED | (protection == PROT_READ ? MAP_POPULATE : 0);
+    void* base = ::mmap(nullptr, skip + length, protection, flags, fd, static_cast<off_t>(aligned));
+    if (base == MAP_FAILED) {
+        throw std::runtime_error(systemError("Cannot map shared memory segment"));
+    }
+    data = static_cast<char*>(base) + skip;
+    return {base, static_cast<size_t>(skip + length)};
+}
+
+bool SharedMemorySegment::writeResult(std::string_view data, uint64_t& offset) {
+    uint64_t start = (result_used_ + kResultAlignment - 1) & ~(kResultAlignment - 1);
+    if (!result_ || start > result_capacity_ || data.size() > result_capacity_ - start) {
+        return false;
+    }
+    std::memcpy(result_ + start, data.data(), data.size());
+    result_used_ = start + data.size();
+    offset = result_offset_ + start;
+    return true;
+}
@@ -0,0 +1,130 @@
+/**
+ * Shared Memory Transport
+ * Lets callers on the same host pass large payloads through a shared memory
+ * segment instead of the RPC body, skipping the copy into the gRPC receive
+ * buffer, the protobuf parse of the bytes field and, for results, the copy
+ * back. The request carries only a reference (see SharedMemoryRef in
+ * proto/medical_imaging.proto); the service maps the payload read-only and
+ * writes results into a separate area of the same segment.
+ *
+ * Off unless IMAGING_SHM_TRANSPORT=1, and only honoured for loopback or
+ * unix socket peers. The service never opens a segment by name: a name
+ * would be opened with the service's own credentials, so any local caller
+ * could have it read another process's segment. Instead the caller passes
+ * the descriptor itself over the registry socket (IMAGING_SHM_SOCKET,
+ * default /tmp/imaging-shm.sock) with SCM_RIGHTS and gets back an
+ * unguessable reference, "fd:<token>", for SharedMemoryRef.segment. Only
+ * memfds sealed with F_SEAL_SHRINK are accepted, so the caller cannot
+ * truncate the segment under the service's mapping. A reference lives as
+ * long as the registering connection stays open.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+struct SharedMemoryHandle {
+    std::string segment;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    uint64_t result_offset = 0;
+    uint64_t result_capacity = 0;
+};
+
+// IMAGING_SHM_TRANSPORT=1, read once
+bool sharedMemoryTransportEnabled();
+
+// gRPC peer strings for callers on this host: "unix:...", "ipv4:127.x.x.x:port"
+// and "ipv6:[::1]:port"
+bool isLocalPeer(const std::string& peer);
+
+// Receives segment descriptors from callers on this host and hands out
+// references to them. Each connection is a SOCK_SEQPACKET stream of
+// one-byte messages carrying one descriptor each; every message is
+// answered with the reference or "error: <reason>".
+class SharedMemoryRegistry {
+public:
+    // Listens on `path`, replacing a socket left behind by a previous run;
+    // throws std::runtime_error when it cannot
+    explicit SharedMemoryRegistry(std::string path);
+    ~SharedMemoryRegistry();
+    SharedMemoryRegistry(const SharedMemoryRegistry&) = delete;
+    SharedMemoryRegistry& operator=(const SharedMemoryRegistry&) = delete;
+
+    // IMAGING_SHM_SOCKET
+    static std::string pathFromEnvironment();
+
+    // A new descriptor for the segment behind an "fd:<token>" reference,
+    // owned by the caller; throws std::invalid_argument for unknown ones
+    int open(const std::string& segment) const;
+
+    const std::string& path() const { return path_; }
+
+private:
+    struct Entry {
+        int fd;
+        int connection;
+    };
+
+    void run();
+    bool receive(int connection);
+    void revoke(int connection);
+
+    std::string path_;
+    int listener_ = -1;
+    int wake_[2] = {-1, -1};
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::unordered_map<int, int> registered_;   // connection -> live references
+    std::thread worker_;
+};
+
+// Caller side: passes `fd` to the registry at `socket_path` and returns its
+// reference. `connection` is opened on first use and reused after; closing
+// it revokes every reference registered through it. Throws
+// std::runtime_error when the registry refuses the descriptor.
+std::string registerSharedMemory(const std::string& socket_path, int fd, int& connection);
+
+// Maps one request's view of a segment; unmapped when destroyed. Throws
+// std::invalid_argument for malformed or unknown handles and
+// std::runtime_error when the segment cannot be mapped.
+class SharedMemorySegment {
+public:
+    SharedMemorySegment(const SharedMemoryHandle& handle, const SharedMemoryRegistry& registry);
+    ~SharedMemorySegment();
+
+    SharedMemorySegment(const SharedMemorySegment&) = delete;
+    SharedMemorySegment& operator=(const SharedMemorySegment&) = delete;
+
+    // Read-only view of the payload, valid while this object lives
+    std::string_view payload() const { return payload_; }
+
+    // Appends `data` to the result area and returns its offset within the
+    // segment, or false when the remaining capacity is too small
+    bool writeResult(std::string_view data, uint64_t& offset);
+
+    const std::string& segment() const { return segment_; }
+
+private:
+    struct Mapping {
+        void* base = nullptr;
+        size_t length = 0;
+    };
+
+    static Mapping map(int fd, uint64_t offset, uint64_t length, int protection, char*& data);
+
+    std::string segment_;
+    Mapping payload_map_;
+    Mapping result_map_;
+    std::string_view payload_;
+    char* result_ = nullptr;
+    uint64_t result_offset_ = 0;
+    uint64_t result_capacity_ = 0;
+    uint64_t result_used_ = 0;
+};
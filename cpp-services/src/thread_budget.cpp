@@ -0,0 +1,215 @@
+/**
+ * Thread Budget Implementation
+ */
+
+#include "thread_budget.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <sched.h>
+
+#include <opencv2/core.hpp>
+#include <onnxruntime_cxx_api.h>
+
+#include "parallel.h"
+
+namespace {
+
+// Cores granted by the container's CFS quota, or 0 when unlimited or the
+// quota cannot be read (the caller then uses hardware_concurrency)
+int cgroupCpuLimit() {
+    // cgroup v2: "<quota> <period>" or "max <period>"
+    std::ifstream v2("/sys/fs/cgroup/cpu.max");
+    if (v2) {
+        std::string quota;
+        long period = 0;
+        if (v2 >> quota >> period && quota != "max" && period > 0) {
+            errno = 0;
+            char* end = nullptr;
+            const long limit = std::strtol(quota.c_str(), &end, 10);
+            if (errno != 0 || end == quota.c_str() || *end != '\0' || limit <= 0) {
+                std::cerr << "Ignoring malformed cgroup cpu.max quota '" << quota << "'" << std::endl;
+                return 0;
+            }
+            return static_cast<int>(std::min<long>(limit / period + (limit % period != 0), INT_MAX));
+        }
+        return 0;
+    }
+
+    // cgroup v1
+    std::ifstream quota_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream period_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    long quota = -1, period = 0;
+    if (quota_file >> quota && period_file >> period && quota > 0 && period > 0) {
+        return static_cast<int>((quota + period - 1) / period);
+    }
+    return 0;
+}
+
+int envInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (!value) {
+        return fallback;
+    }
+    int parsed = std::atoi(value);
+    return parsed >= 0 ? parsed : fallback;
+}
+
+} // namespace
+
+const char* operatingModeName(OperatingMode mode) {
+    return mode == OperatingMode::Throughput ? "throughput" : "latency";
+}
+
+bool parseOperatingMode(const std::string& name, OperatingMode& mode) {
+    if (name == "latency") {
+        mode = OperatingMode::Latency;
+        return true;
+    }
+    if (name == "throughput") {
+        mode = OperatingMode::Throughput;
+        return true;
+    }
+    return false;
+}
+
+ThreadBudgetManager& ThreadBudgetManager::instance() {
+    static ThreadBudgetManager manager;
+    return manager;
+}
+
+ThreadBudgetManager::ThreadBudgetManager()
+    : budget_(computeBudget(policy_)) {}
+
+ThreadBudgetPolicy ThreadBudgetManager::policyFromEnvironment() {
+    ThreadBudgetPolicy policy;
+    if (const char* mode = std::getenv("IMAGING_THREAD_MODE")) {
+        if (!parseOperatingMode(mode, policy.mode)) {
+            std::cerr << "Unknown IMAGING_THREAD_MODE '" << mode << "', using latency" << std::endl;
+        }
+    }
+    policy.cpu_cores = envInt("IMAGING_CPU_CORES", 0);
+    policy.reserved_cores = envInt("IMAGING_RESERVED_CORES", policy.reserved_cores);
+    return policy;
+}
+
+int ThreadBudgetManager::detectCpuCores() {
+    int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        cores = std::min(cores, CPU_COUNT(&mask));
+    }
+
+    int quota = cgroupCpuLimit();
+    if (quota > 0) {
+        cores = std::min(cores, quota);
+    }
+    return std::max(1, cores);
+}
+
+ThreadBudget ThreadBudgetManager::computeBudget(const ThreadBudgetPolicy& policy) {
+    ThreadBudget budget;
+    budget.mode = policy.mode;
+    budget.cpu_cores = policy.cpu_cores > 0 ? policy.cpu_cores : detectCpuCores();
+
+    const int reserved = std::min(std::max(0, policy.reserved_cores), budget.cpu_cores - 1);
+    const int compute_cores = budget.cpu_cores - reserved;
+
+    if (policy.mode == OperatingMode::Latency) {
+        // A handful of requests, each spreading across its share of the cores.
+        // Pipeline stages run one after another, so ORT, OpenCV and OpenMP can
+        // each use the full share without competing inside a request.
+        budget.concurrent_requests = std::max(1, compute_cores / 8);
+        const int per_request = std::max(1, compute_cores / budget.concurrent_requests);
+        budget.ort_intra_op_threads = per_request;
+        budget.opencv_threads = per_request;
+        // parallel::forRange already divides this by the number of active regions
+        budget.omp_threads = compute_cores;
+    } else {
+        // One request per core, every operator single-threaded
+        budget.concurrent_requests = compute_cores;
+        budget.ort_intra_op_threads = 1;
+        budget.opencv_threads = 1;
+        budget.omp_threads = 1;
+    }
+    budget.ort_inter_op_threads = 1;
+
+    // Handler threads beyond the pipeline slots only wait, but health checks and
+    // admin calls must still find one
+    budget.grpc_max_threads = budget.concurrent_requests + std::max(1, reserved) * 2 + 2;
+    return budget;
+}
+
+void ThreadBudgetManager::configure(const ThreadBudgetPolicy& policy) {
+    ThreadBudget budget = computeBudget(policy);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        policy_ = policy;
+        budget_ = budget;
+    }
+    apply(budget);
+}
+
+void ThreadBudgetManager::setMode(OperatingMode mode) {
+    ThreadBudgetPolicy policy = this->policy();
+    policy.mode = mode;
+    configure(policy);
+}
+
+ThreadBudget ThreadBudgetManager::budget() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_;
+}
+
+ThreadBudgetPolicy ThreadBudgetManager::policy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_;
+}
+
+void ThreadBudgetManager::applyToSessionOptions(Ort::SessionOptions& options) const {
+    ThreadBudget current = budget();
+    options.SetIntraOpNumThreads(current.ort_intra_op_threads);
+    options.SetInterOpNumThreads(current.ort_inter_op_threads);
+    options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+    // Spinning workers shave wake-up latency but burn cores other requests need
+    options.AddConfigEntry("session.intra_op.allow_spinning",
+                           current.mode == OperatingMode::Latency ? "1" : "0");
+}
+
+void ThreadBudgetManager::addListener(Listener listener) {
+    ThreadBudget current;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners_.push_back(listener);
+        current = budget_;
+    }
+    listener(current);
+}
+
+void ThreadBudgetManager::apply(const ThreadBudget& budget) {
+    parallel::setMaxThreads(budget.omp_threads);
+    cv::setNumThreads(budget.opencv_threads);
+
+    std::vector<Listener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners = listeners_;
+    }
+    for (const auto& listener : listeners) {
+        listener(budget);
+    }
+
+    std::cout << "Thread budget (" << operatingModeName(budget.mode) << " mode, "
+              << budget.cpu_cores << " cores): requests=" << budget.concurrent_requests
+              << " grpc=" << budget.grpc_max_threads
+              << " ort_intra=" << budget.ort_intra_op_threads
+              << " omp=" << budget.omp_threads
+              << " opencv=" << budget.opencv_threads << std::endl;
+}
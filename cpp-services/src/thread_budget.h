@@ -0,0 +1,78 @@
+/**
+ * Thread Budget
+ * One owner for the cores available to the service. gRPC sync threads, ONNX
+ * Runtime, OpenMP and OpenCV each default to the full core count; the manager
+ * splits the budget between them according to the operating mode and pushes
+ * the result to every runtime.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Ort { struct SessionOptions; }
+
+enum class OperatingMode {
+    Latency,     // few concurrent requests, each one fanned out across all cores
+    Throughput   // many concurrent requests, single-threaded operators
+};
+
+const char* operatingModeName(OperatingMode mode);
+bool parseOperatingMode(const std::string& name, OperatingMode& mode);
+
+struct ThreadBudgetPolicy {
+    OperatingMode mode = OperatingMode::Latency;
+    int cpu_cores = 0;          // 0: detect from the cgroup quota / affinity mask
+    int reserved_cores = 1;     // kept free for gRPC polling and completion queues
+};
+
+struct ThreadBudget {
+    OperatingMode mode;
+    int cpu_cores;
+    int grpc_max_threads;       // sync server handler threads (ResourceQuota)
+    int concurrent_requests;    // requests allowed inside the pipeline at once
+    int ort_intra_op_threads;
+    int ort_inter_op_threads;
+    int omp_threads;
+    int opencv_threads;
+};
+
+class ThreadBudgetManager {
+public:
+    using Listener = std::function<void(const ThreadBudget&)>;
+
+    static ThreadBudgetManager& instance();
+
+    // Reads IMAGING_THREAD_MODE, IMAGING_CPU_CORES and IMAGING_RESERVED_CORES
+    static ThreadBudgetPolicy policyFromEnvironment();
+
+    // Computes the budget and applies it to OpenMP and OpenCV
+    void configure(const ThreadBudgetPolicy& policy);
+    void setMode(OperatingMode mode);
+
+    ThreadBudget budget() const;
+    ThreadBudgetPolicy policy() const;
+
+    // ORT thread options are fixed per session; sessions read them here at
+    // creation and keep them across later rebalances
+    void applyToSessionOptions(Ort::SessionOptions& options) const;
+
+    // Called with the current budget immediately and after every rebalance;
+    // used for what the manager cannot reach directly (gRPC quota, scheduler)
+    void addListener(Listener listener);
+
+    static ThreadBudget computeBudget(const ThreadBudgetPolicy& policy);
+    static int detectCpuCores();
+
+private:
+    ThreadBudgetManager();
+    void apply(const ThreadBudget& budget);
+
+    mutable std::mutex mutex_;
+    ThreadBudgetPolicy policy_;
+    ThreadBudget budget_;
+    std::vector<Listener> listeners_;
+};
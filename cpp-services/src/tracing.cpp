@@ -0,0 +1,459 @@
+/**
+ * Tracing Implementation
+ */
+
+#include "tracing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace tracing {
+
+namespace {
+
+thread_local Span* current_span = nullptr;
+
+uint64_t unixNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void randomBytes(uint8_t* out, size_t size) {
+    thread_local std::mt19937_64 rng(std::random_device{}() ^
+                                     std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t value = rng();
+        std::memcpy(out + i, &value, std::min<size_t>(8, size - i));
+    }
+}
+
+bool allZero(const uint8_t* bytes, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        if (bytes[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string toHex(const uint8_t* bytes, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 0xf];
+    }
+    return hex;
+}
+
+bool fromHex(const std::string& hex, size_t offset, uint8_t* out, size_t size) {
+    if (hex.size() < offset + size * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < size * 2; ++i) {
+        char c = hex[offset + i];
+        int nibble;
+        if (c >= '0' && c <= '9') nibble = c - '0';
+        else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+        else return false;
+        if (i % 2 == 0) {
+            out[i / 2] = static_cast<uint8_t>(nibble << 4);
+        } else {
+            out[i / 2] |= static_cast<uint8_t>(nibble);
+        }
+    }
+    return true;
+}
+
+// Deterministic in the trace id, so every service samples a trace the same way
+bool sampleTrace(const uint8_t* trace_id, double ratio) {
+    if (ratio >= 1.0) {
+        return true;
+    }
+    if (ratio <= 0.0) {
+        return false;
+    }
+    uint64_t low = 0;
+    for (int i = 8; i < 16; ++i) {
+        low = (low << 8) | trace_id[i];
+    }
+    return static_cast<double>(low >> 11) < ratio * static_cast<double>(1ULL << 53);
+}
+
+void appendJsonString(std::string& out, const std::string& value) {
+    out += '"';
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    out += '"';
+}
+
+void appendAttribute(std::string& out, const std::string& key, const std::string& value) {
+    out += "{\"key\":";
+    appendJsonString(out, key);
+    out += ",\"value\":{\"stringValue\":";
+    appendJsonString(out, value);
+    out += "}}";
+}
+
+// OTLP/JSON ExportTraceServiceRequest for one batch
+std::string encodeOtlpJson(const std::vector<FinishedSpan>& spans, const std::string& service_name) {
+    std::string out;
+    out.reserve(256 + spans.size() * 320);
+    out += "{\"resourceSpans\":[{\"resource\":{\"attributes\":[";
+    appendAttribute(out, "service.name", service_name);
+    out += "]},\"scopeSpans\":[{\"scope\":{\"name\":\"medical_imaging\"},\"spans\":[";
+    for (size_t i = 0; i < spans.size(); ++i) {
+        const FinishedSpan& span = spans[i];
+        if (i > 0) {
+            out += ',';
+        }
+        out += "{\"traceId\":\"" + toHex(span.context.trace_id, 16) + "\"";
+        out += ",\"spanId\":\"" + toHex(span.context.span_id, 8) + "\"";
+        if (span.has_parent) {
+            out += ",\"parentSpanId\":\"" + toHex(span.parent_span_id, 8) + "\"";
+        }
+        out += ",\"name\":";
+        appendJsonString(out, span.name);
+        out += ",\"kind\":" + std::to_string(static_cast<int>(span.kind));
+        out += ",\"startTimeUnixNano\":\"" + std::to_string(span.start_unix_nanos) + "\"";
+        out += ",\"endTimeUnixNano\":\"" + std::to_string(span.end_unix_nanos) + "\"";
+        out += ",\"attributes\":[";
+        for (size_t a = 0; a < span.attributes.size(); ++a) {
+            if (a > 0) {
+                out += ',';
+            }
+            appendAttribute(out, span.attributes[a].first, span.attributes[a].second);
+        }
+        out += "]";
+        if (span.error) {
+            out += ",\"status\":{\"code\":2,\"message\":";
+            appendJsonString(out, span.error_message);
+            out += "}";
+        }
+        out += "}";
+    }
+    out += "]}]}]}";
+    return out;
+}
+
+// Minimal HTTP/1.1 POST for the OTLP/HTTP collector; returns the status code
+int httpPost(const std::string& url, const std::string& body) {
+    const std::string scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0) {
+        return -1;
+    }
+    std::string rest = url.substr(scheme.size());
+    std::string host_port = rest.substr(0, rest.find('/'));
+    std::string path = rest.find('/') == std::string::npos ? "/v1/traces" : rest.substr(rest.find('/'));
+    std::string host = host_port.substr(0, host_port.find(':'));
+    std::string port = host_port.find(':') == std::string::npos ? "4318" : host_port.substr(host_port.find(':') + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* addr = addresses; addr; addr = addr->ai_next) {
+        fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        timeval timeout{2, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return -1;
+    }
+
+    std::string request = "POST " + path + " HTTP/1.1\r\nHost: " + host_port +
+                          "\r\nContent-Type: application/json\r\nContent-Length: " +
+                          std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < request.size()) {
+        ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        sent += static_cast<size_t>(n);
+    }
+
+    char response[64] = {};
+    ssize_t received = recv(fd, response, sizeof(response) - 1, 0);
+    close(fd);
+    int status = -1;
+    if (received > 0) {
+        std::sscanf(response, "HTTP/%*s %d", &status);
+    }
+    return status;
+}
+
+} // namespace
+
+bool SpanContext::valid() const {
+    return !allZero(trace_id, sizeof(trace_id)) && !allZero(span_id, sizeof(span_id));
+}
+
+bool parseTraceparent(const std::string& header, SpanContext& context) {
+    // version(2) - trace id(32) - span id(16) - flags(2)
+    if (header.size() < 55 || header[2] != '-' || header[35] != '-' || header[52] != '-' ||
+        header.compare(0, 2, "ff") == 0) {
+        return false;
+    }
+    SpanContext parsed;
+    uint8_t flags = 0;
+    if (!fromHex(header, 3, parsed.trace_id, 16) || !fromHex(header, 36, parsed.span_id, 8) ||
+        !fromHex(header, 53, &flags, 1) || !parsed.valid()) {
+        return false;
+    }
+    parsed.sampled = (flags & 0x01) != 0;
+    context = parsed;
+    return true;
+}
+
+std::string formatTraceparent(const SpanContext& context) {
+    return "00-" + toHex(context.trace_id, 16) + "-" + toHex(context.span_id, 8) +
+           (context.sampled ? "-01" : "-00");
+}
+
+Span::Span(const char* name) {
+    Span* parent = current_span;
+    if (!parent || !parent->recording_) {
+        return;
+    }
+    std::memcpy(context_.trace_id, parent->context_.trace_id, sizeof(context_.trace_id));
+    std::memcpy(data_.parent_span_id, parent->context_.span_id, sizeof(data_.parent_span_id));
+    data_.has_parent = true;
+    start(name, SpanKind::Internal);
+}
+
+Span::Span(const char* name, const std::string& traceparent) {
+    Tracer& tracer = Tracer::instance();
+    if (!tracer.enabled()) {
+        return;
+    }
+
+    SpanContext parent;
+    bool sampled;
+    if (!traceparent.empty() && parseTraceparent(traceparent, parent)) {
+        // Parent-based: the caller's sampled flag decides, either way; our
+        // ratio only applies to traces that start here
+        std::memcpy(context_.trace_id, parent.trace_id, sizeof(context_.trace_id));
+        std::memcpy(data_.parent_span_id, parent.span_id, sizeof(data_.parent_span_id));
+        data_.has_parent = true;
+        sampled = parent.sampled;
+    } else {
+        randomBytes(context_.trace_id, sizeof(context_.trace_id));
+        data_.has_parent = false;
+        sampled = sampleTrace(context_.trace_id, tracer.sampleRatio());
+    }
+
+    if (sampled) {
+        start(name, SpanKind::Server);
+    }
+}
+
+void Span::start(const char* name, SpanKind kind) {
+    recording_ = true;
+    context_.sampled = true;
+    randomBytes(context_.span_id, sizeof(context_.span_id));
+    data_.name = name;
+    data_.kind = kind;
+    data_.error = false;
+    data_.start_unix_nanos = unixNanos();
+    previous_ = current_span;
+    current_span = this;
+}
+
+Span::~Span() {
+    if (!recording_) {
+        return;
+    }
+    current_span = previous_;
+    data_.end_unix_nanos = unixNanos();
+    data_.context = context_;
+    Tracer::instance().submit(std::move(data_));
+}
+
+void Span::setAttribute(const std::string& key, const std::string& value) {
+    if (recording_) {
+        data_.attributes.emplace_back(key, value);
+    }
+}
+
+void Span::setError(const std::string& message) {
+    if (recording_) {
+        data_.error = true;
+        data_.error_message = message;
+    }
+}
+
+bool Span::active() {
+    return current_span != nullptr && current_span->recording_;
+}
+
+Tracer& Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::~Tracer() {
+    shutdown();
+}
+
+TracerConfig Tracer::configFromEnvironment() {
+    TracerConfig config;
+    if (const char* ratio = std::getenv("IMAGING_TRACE_SAMPLE_RATIO")) {
+        config.sample_ratio = std::atof(ratio);
+    }
+    if (const char* exporter = std::getenv("IMAGING_TRACE_EXPORTER")) {
+        config.exporter = exporter;
+    }
+    if (const char* endpoint = std::getenv("IMAGING_TRACE_ENDPOINT")) {
+        config.endpoint = endpoint;
+    } else if (config.exporter == "file") {
+        config.endpoint = "/app/logs/traces.jsonl";
+    } else if (config.exporter == "otlp-http") {
+        config.endpoint = "http://localhost:4318/v1/traces";
+    }
+    return config;
+}
+
+void Tracer::configure(const TracerConfig& config) {
+    shutdown();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    sample_ratio_ = config.sample_ratio;
+    if (config.exporter == "none" || config.endpoint.empty()) {
+        return;
+    }
+
+    stopping_ = false;
+    exporter_ = std::thread(&Tracer::exportLoop, this);
+    enabled_.store(true, std::memory_order_relaxed);
+    std::cout << "Tracing enabled: " << config.exporter << " -> " << config.endpoint
+              << " (sample ratio " << config.sample_ratio << ")" << std::endl;
+}
+
+void Tracer::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled_.store(false, std::memory_order_relaxed);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (exporter_.joinable()) {
+        exporter_.join();
+    }
+}
+
+void Tracer::submit(FinishedSpan&& span) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || queue_.size() >= config_.max_queue_size) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue_.push_back(std::move(span));
+        accepted_++;
+        if (queue_.size() < config_.max_batch_size) {
+            return;
+        }
+    }
+    wake_.notify_one();
+}
+
+void Tracer::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t target = accepted_;
+    flush_requested_ = true;
+    wake_.notify_one();
+    flushed_.wait(lock, [&] { return handled_ >= target || !exporter_.joinable() || stopping_; });
+}
+
+void Tracer::exportLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait_for(lock, std::chrono::milliseconds(config_.flush_interval_ms),
+                       [&] { return stopping_ || flush_requested_ || queue_.size() >= config_.max_batch_size; });
+
+        // Drain everything queued, also on shutdown
+        while (!queue_.empty()) {
+            std::vector<FinishedSpan> batch;
+            size_t count = std::min(queue_.size(), config_.max_batch_size);
+            batch.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.begin() + count));
+            queue_.erase(queue_.begin(), queue_.begin() + count);
+
+            lock.unlock();
+            exportBatch(batch);
+            lock.lock();
+            handled_ += batch.size();
+        }
+        flush_requested_ = false;
+        flushed_.notify_all();
+
+        if (stopping_) {
+            return;
+        }
+    }
+}
+
+void Tracer::exportBatch(const std::vector<FinishedSpan>& batch) {
+    std::string payload = encodeOtlpJson(batch, config_.service_name);
+
+    bool ok;
+    if (config_.exporter == "file") {
+        std::ofstream out(config_.endpoint, std::ios::app);
+        out << payload << '\n';
+        ok = static_cast<bool>(out);
+    } else {
+        int status = httpPost(config_.endpoint, payload);
+        ok = status >= 200 && status < 300;
+    }
+
+    if (ok) {
+        exported_.fetch_add(batch.size(), std::memory_order_relaxed);
+    } else {
+        dropped_.fetch_add(batch.size(), std::memory_order_relaxed);
+    }
+}
+
+} // namespace tracing
@@ -0,0 +1,140 @@
+/**
+ * Tracing
+ * Lightweight request tracing with W3C trace-context propagation and batched
+ * OTLP/JSON export. The gRPC adapter opens a root span per request from the
+ * incoming `traceparent` metadata; every StageScope inside a sampled request
+ * becomes a child span. Unsampled requests cost one thread-local read per
+ * stage.
+ *
+ * Export runs on a background thread, either as OTLP/JSON lines appended to a
+ * file (the collector's otlpjsonfile format) or POSTed to an OTLP/HTTP
+ * collector endpoint.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tracing {
+
+struct SpanContext {
+    uint8_t trace_id[16] = {};
+    uint8_t span_id[8] = {};
+    bool sampled = false;
+
+    bool valid() const;
+};
+
+// "00-<32 hex trace id>-<16 hex span id>-<2 hex flags>"
+bool parseTraceparent(const std::string& header, SpanContext& context);
+std::string formatTraceparent(const SpanContext& context);
+
+enum class SpanKind { Internal = 1, Server = 2 };
+
+struct FinishedSpan {
+    SpanContext context;
+    uint8_t parent_span_id[8];
+    bool has_parent;
+    std::string name;
+    SpanKind kind;
+    uint64_t start_unix_nanos;
+    uint64_t end_unix_nanos;
+    std::vector<std::pair<std::string, std::string>> attributes;
+    bool error;
+    std::string error_message;
+};
+
+class Span {
+public:
+    // Child of the span currently open on this thread; does nothing when
+    // there is none or the trace is not sampled
+    explicit Span(const char* name);
+
+    // Request root, continuing the caller's trace when `traceparent` is valid
+    Span(const char* name, const std::string& traceparent);
+
+    ~Span();
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    bool recording() const { return recording_; }
+    const SpanContext& context() const { return context_; }
+
+    void setAttribute(const std::string& key, const std::string& value);
+    void setError(const std::string& message);
+
+    // True when this thread is inside a sampled span
+    static bool active();
+
+private:
+    void start(const char* name, SpanKind kind);
+
+    bool recording_ = false;
+    SpanContext context_;
+    Span* previous_ = nullptr;
+    FinishedSpan data_;
+};
+
+struct TracerConfig {
+    double sample_ratio = 0.01;        // for requests without a parent context
+    std::string exporter = "none";     // "none", "file", "otlp-http"
+    std::string endpoint;              // file path or http://host:port/v1/traces
+    std::string service_name = "medical_imaging_service";
+    size_t max_queue_size = 8192;
+    size_t max_batch_size = 512;
+    int flush_interval_ms = 1000;
+};
+
+class Tracer {
+public:
+    static Tracer& instance();
+
+    // IMAGING_TRACE_SAMPLE_RATIO, IMAGING_TRACE_EXPORTER, IMAGING_TRACE_ENDPOINT
+    static TracerConfig configFromEnvironment();
+
+    void configure(const TracerConfig& config);
+    void shutdown();
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+    double sampleRatio() const { return sample_ratio_; }
+
+    // Queues a finished span; drops it when the queue is full
+    void submit(FinishedSpan&& span);
+    // Blocks until everything queued so far has been exported
+    void flush();
+
+    uint64_t exportedSpans() const { return exported_.load(); }
+    uint64_t droppedSpans() const { return dropped_.load(); }
+
+private:
+    Tracer() = default;
+    ~Tracer();
+    void exportLoop();
+    void exportBatch(const std::vector<FinishedSpan>& batch);
+
+    TracerConfig config_;
+    std::atomic<bool> enabled_{false};
+    double sample_ratio_ = 0.0;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    std::vector<FinishedSpan> queue_;
+    bool stopping_ = false;
+    bool flush_requested_ = false;
+    uint64_t accepted_ = 0;     // spans queued so far
+    uint64_t handled_ = 0;      // spans the exporter has finished with
+    std::thread exporter_;
+
+    std::atomic<uint64_t> exported_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+} // namespace tracing
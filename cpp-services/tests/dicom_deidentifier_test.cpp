@@ -0,0 +1,530 @@
+/**
+ * DICOM De-identifier Tests
+ * The basic profile against PS3.15 Table E.1-1, and plans applied to small
+ * Part 10 files built here.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "dicom_deidentifier.h"
+
+namespace {
+
+constexpr const char* kExplicitLittleEndian = "1.2.840.10008.1.2.1";
+constexpr const char* kImplicitLittleEndian = "1.2.840.10008.1.2";
+constexpr const char* kExplicitBigEndian = "1.2.840.10008.1.2.2";
+
+// Basic Profile column of Table E.1-1, as printed: X remove, Z empty or
+// dummy, D dummy, U replace UID; "X/Z" and the like allow any of them
+const std::pair<uint32_t, const char*> kAnnexE[] = {
+    {0x00020003, "U"},      // Media Storage SOP Instance UID
+    {0x00080012, "X/D"},    // Instance Creation Date
+    {0x00080013, "X/Z/D"},  // Instance Creation Time
+    {0x00080014, "U"},      // Instance Creator UID
+    {0x00080015, "X"},      // Instance Coercion DateTime
+    {0x00080018, "U"},      // SOP Instance UID
+    {0x00080020, "Z"},      // Study Date
+    {0x00080021, "X/D"},    // Series Date
+    {0x00080022, "X/Z"},    // Acquisition Date
+    {0x00080023, "Z/D"},    // Content Date
+    {0x00080024, "X"},      // Overlay Date
+    {0x00080025, "X"},      // Curve Date
+    {0x0008002A, "X/Z/D"},  // Acquisition DateTime
+    {0x00080030, "Z"},      // Study Time
+    {0x00080031, "X/D"},    // Series Time
+    {0x00080032, "X/Z"},    // Acquisition Time
+    {0x00080033, "Z/D"},    // Content Time
+    {0x00080034, "X"},      // Overlay Time
+    {0x00080035, "X"},      // Curve Time
+    {0x00080050, "Z"},      // Accession Number
+    {0x00080058, "U"},      // Failed SOP Instance UID List
+    {0x00080080, "X/Z/D"},  // Institution Name
+    {0x00080081, "X"},      // Institution Address
+    {0x00080082, "X/Z/D"},  // Institution Code Sequence
+    {0x00080090, "Z"},      // Referring Physician's Name
+    {0x00080092, "X"},      // Referring Physician's Address
+    {0x00080094, "X"},      // Referring Physician's Telephone Numbers
+    {0x00080096, "X"},      // Referring Physician Identification Sequence
+    {0x0008009C, "Z"},      // Consulting Physician's Name
+    {0x0008009D, "X"},      // Consulting Physician Identification Sequence
+    {0x00080201, "X"},      // Timezone Offset From UTC
+    {0x00081010, "X/Z/D"},  // Station Name
+    {0x00081030, "X"},      // Study Description
+    {0x0008103E, "X"},      // Series Description
+    {0x00081040, "X"},      // Institutional Department Name
+    {0x00081048, "X"},      // Physician(s) of Record
+    {0x00081049, "X"},      // Physician(s) of Record Identification Sequence
+    {0x00081050, "X"},      // Performing Physician's Name
+    {0x00081052, "X"},      // Performing Physician Identification Sequence
+    {0x00081060, "X"},      // Name of Physician(s) Reading Study
+    {0x00081062, "X"},      // Physician(s) Reading Study Identification Sequence
+    {0x00081070, "X/Z/D"},  // Operators' Name
+    {0x00081072, "X/D"},    // Operator Identification Sequence
+    {0x00081080, "X"},      // Admitting Diagnoses Description
+    {0x00081084, "X"},      // Admitting Diagnoses Code Sequence
+    {0x00081120, "X"},      // Referenced Patient Sequence
+    {0x00081155, "U"},      // Referenced SOP Instance UID
+    {0x00081195, "U"},      // Transaction UID
+    {0x00082111, "X"},      // Derivation Description
+    {0x00083010, "U"},      // Irradiation Event UID
+    {0x00084000, "X"},      // Identifying Comments
+    {0x00100010, "Z"},      // Patient's Name
+    {0x00100020, "Z"},      // Patient ID
+    {0x00100021, "X"},      // Issuer of Patient ID
+    {0x00100030, "Z"},      // Patient's Birth Date
+    {0x00100032, "X"},      // Patient's Birth Time
+    {0x00100040, "Z"},      // Patient's Sex
+    {0x00100050, "X"},      // Patient's Insurance Plan Code Sequence
+    {0x00100101, "X"},      // Patient's Primary Language Code Sequence
+    {0x00100102, "X"},      // Patient's Primary Language Modifier Code Sequence
+    {0x00101000, "X"},      // Other Patient IDs
+    {0x00101001, "X"},      // Other Patient Names
+    {0x00101002, "X"},      // Other Patient IDs Sequence
+    {0x00101005, "X"},      // Patient's Birth Name
+    {0x00101010, "X"},      // Patient's Age
+    {0x00101020, "X"},      // Patient's Size
+    {0x00101030, "X"},      // Patient's Weight
+    {0x00101040, "X"},      // Patient's Address
+    {0x00101060, "X"},      // Patient's Mother's Birth Name
+    {0x00101080, "X"},      // Military Rank
+    {0x00101081, "X"},      // Branch of Service
+    {0x00101090, "X"},      // Medical Record Locator
+    {0x00101100, "X"},      // Referenced Patient Photo Sequence
+    {0x00102000, "X"},      // Medical Alerts
+    {0x00102110, "X"},      // Allergies
+    {0x00102150, "X"},      // Country of Residence
+    {0x00102152, "X"},      // Region of Residence
+    {0x00102154, "X"},      // Patient's Telephone Numbers
+    {0x00102155, "X"},      // Patient's Telecom Information
+    {0x00102160, "X"},      // Ethnic Group
+    {0x00102180, "X"},      // Occupation
+    {0x001021A0, "X"},      // Smoking Status
+    {0x001021B0, "X"},      // Additional Patient History
+    {0x001021C0, "X"},      // Pregnancy Status
+    {0x001021D0, "X"},      // Last Menstrual Date
+    {0x001021F0, "X"},      // Patient's Religious Preference
+    {0x00102203, "X/Z"},    // Patient's Sex Neutered
+    {0x00102297, "X"},      // Responsible Person
+    {0x00102299, "X"},      // Responsible Organization
+    {0x00104000, "X"},      // Patient Comments
+    {0x00181000, "X/Z/D"},  // Device Serial Number
+    {0x00181002, "U"},      // Device UID
+    {0x00181004, "X"},      // Plate ID
+    {0x00181005, "X"},      // Generator ID
+    {0x00181007, "X"},      // Cassette ID
+    {0x00181008, "X"},      // Gantry ID
+    {0x00181030, "X/D"},    // Protocol Name
+    {0x00181200, "X"},      // Date of Last Calibration
+    {0x00181201, "X"},      // Time of Last Calibration
+    {0x00181400, "X/D"},    // Acquisition Device Processing Description
+    {0x00184000, "X"},      // Acquisition Comments
+    {0x0018700A, "X/D"},    // Detector ID
+    {0x00189424, "X"},      // Acquisition Protocol Description
+    {0x0018A003, "X"},      // Contribution Description
+    {0x0020000D, "U"},      // Study Instance UID
+    {0x0020000E, "U"},      // Series Instance UID
+    {0x00200010, "Z"},      // Study ID
+    {0x00200052, "U"},      // Frame of Reference UID
+    {0x00200200, "U"},      // Synchronization Frame of Reference UID
+    {0x00204000, "X"},      // Image Comments
+    {0x00209158, "X"},      // Frame Comments
+    {0x00209161, "U"},      // Concatenation UID
+    {0x00209164, "U"},      // Dimension Organization UID
+    {0x00281199, "U"},      // Palette Color Lookup Table UID
+    {0x00281214, "U"},      // Large Palette Color Lookup Table UID
+    {0x00321020, "X"},      // Scheduled Study Location
+    {0x00321021, "X"},      // Scheduled Study Location AE Title
+    {0x00321030, "X"},      // Reason for Study
+    {0x00321032, "X"},      // Requesting Physician
+    {0x00321033, "X"},      // Requesting Service
+    {0x00321060, "X/Z"},    // Requested Procedure Description
+    {0x00321070, "X"},      // Requested Contrast Agent
+    {0x00324000, "X"},      // Study Comments
+    {0x00380010, "X"},      // Admission ID
+    {0x00380011, "X"},      // Issuer of Admission ID
+    {0x00380014, "X"},      // Issuer of Admission ID Sequence
+    {0x0038001E, "X"},      // Scheduled Patient Institution Residence
+    {0x00380020, "X"},      // Admitting Date
+    {0x00380021, "X"},      // Admitting Time
+    {0x00380040, "X"},      // Discharge Diagnosis Description
+    {0x00380050, "X"},      // Special Needs
+    {0x00380060, "X"},      // Service Episode ID
+    {0x00380062, "X"},      // Service Episode Description
+    {0x00380300, "X"},      // Current Patient Location
+    {0x00380400, "X"},      // Patient's Institution Residence
+    {0x00380500, "X"},      // Patient State
+    {0x00384000, "X"},      // Visit Comments
+    {0x00400001, "X"},      // Scheduled Station AE Title
+    {0x00400002, "X"},      // Scheduled Procedure Step Start Date
+    {0x00400003, "X"},      // Scheduled Procedure Step Start Time
+    {0x00400004, "X"},      // Scheduled Procedure Step End Date
+    {0x00400005, "X"},      // Scheduled Procedure Step End Time
+    {0x00400006, "X"},      // Scheduled Performing Physician's Name
+    {0x00400007, "X"},      // Scheduled Procedure Step Description
+    {0x00400009, "X"},      // Scheduled Procedure Step ID
+    {0x0040000B, "X"},      // Scheduled Performing Physician Identification Sequence
+    {0x00400010, "X"},      // Scheduled Station Name
+    {0x00400011, "X"},      // Scheduled Procedure Step Location
+    {0x00400012, "X"},      // Pre-Medication
+    {0x00400241, "X"},      // Performed Station AE Title
+    {0x00400242, "X"},      // Performed Station Name
+    {0x00400243, "X"},      // Performed Location
+    {0x00400244, "X"},      // Performed Procedure Step Start Date
+    {0x00400245, "X"},      // Performed Procedure Step Start Time
+    {0x00400250, "X"},      // Performed Procedure Step End Date
+    {0x00400251, "X"},      // Performed Procedure Step End Time
+    {0x00400253, "X"},      // Performed Procedure Step ID
+    {0x00400254, "X"},      // Performed Procedure Step Description
+    {0x00400275, "X"},      // Request Attributes Sequence
+    {0x00400280, "X"},      // Comments on the Performed Procedure Step
+    {0x00401001, "X"},      // Requested Procedure ID
+    {0x00401004, "X"},      // Patient Transport Arrangements
+    {0x00401005, "X"},      // Requested Procedure Location
+    {0x00401010, "X"},      // Names of Intended Recipients of Results
+    {0x00401102, "X"},      // Person's Address
+    {0x00401103, "X"},      // Person's Telephone Numbers
+    {0x00401400, "X"},      // Requested Procedure Comments
+    {0x00402001, "X"},      // Reason for the Imaging Service Request
+    {0x00402008, "X"},      // Order Entered By
+    {0x00402009, "X"},      // Order Enterer's Location
+    {0x00402010, "X"},      // Order Callback Phone Number
+    {0x00402016, "Z"},      // Placer Order Number / Imaging Service Request
+    {0x00402017, "Z"},      // Filler Order Number / Imaging Service Request
+    {0x00402400, "X"},      // Imaging Service Request Comments
+    {0x00403001, "X"},      // Confidentiality Constraint on Patient Data Description
+    {0x0040A027, "X"},      // Verifying Organization
+    {0x0040A075, "D"},      // Verifying Observer Name
+    {0x0040A123, "D"},      // Person Name
+    {0x0040A124, "U"},      // UID
+    {0x0040A730, "X"},      // Content Sequence
+    {0x00700084, "Z"},      // Content Creator's Name
+    {0x00880140, "U"},      // Storage Media File-set UID
+    {0x04000561, "X"},      // Original Attributes Sequence
+    {0x30060024, "U"},      // Referenced Frame of Reference UID
+};
+
+// Whether an action carries out one of the options an Annex E code allows;
+// a pseudonym is a dummy value that stays consistent across files
+bool allows(std::string_view code, DeidAction action) {
+    std::set<DeidAction> allowed;
+    for (const char c : code) {
+        switch (c) {
+            case 'X':
+                allowed.insert(DeidAction::Remove);
+                break;
+            case 'Z':
+                allowed.insert(DeidAction::Empty);
+                [[fallthrough]];
+            case 'D':
+                allowed.insert(DeidAction::Dummy);
+                allowed.insert(DeidAction::Pseudonym);
+                break;
+            case 'U':
+                allowed.insert(DeidAction::Uid);
+                break;
+        }
+    }
+    return allowed.count(action) != 0;
+}
+
+std::string le16(uint16_t v) {
+    return {static_cast<char>(v & 0xff), static_cast<char>(v >> 8)};
+}
+
+std::string le32(uint32_t v) {
+    return le16(static_cast<uint16_t>(v & 0xffff)) + le16(static_cast<uint16_t>(v >> 16));
+}
+
+uint16_t read16(std::string_view data, size_t pos) {
+    return static_cast<uint16_t>(static_cast<uint8_t>(data[pos]) | (static_cast<uint8_t>(data[pos + 1]) << 8));
+}
+
+uint32_t read32(std::string_view data, size_t pos) {
+    return read16(data, pos) | (static_cast<uint32_t>(read16(data, pos + 2)) << 16);
+}
+
+bool longForm(std::string_view vr) {
+    for (const char* v : {"OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV"}) {
+        if (vr == v) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string tagBytes(uint32_t tag) {
+    return le16(static_cast<uint16_t>(tag >> 16)) + le16(static_cast<uint16_t>(tag & 0xffff));
+}
+
+// An element as a writer would emit it, padded to even length
+std::string element(uint32_t tag, std::string_view vr, std::string value, bool explicit_vr = true) {
+    if (value.size() % 2 != 0) {
+        value += vr == "UI" || vr == "OB" ? '\0' : ' ';
+    }
+    std::string out = tagBytes(tag);
+    if (!explicit_vr) {
+        out += le32(static_cast<uint32_t>(value.size()));
+    } else if (longForm(vr)) {
+        out += std::string(vr) + std::string(2, '\0') + le32(static_cast<uint32_t>(value.size()));
+    } else {
+        out += std::string(vr) + le16(static_cast<uint16_t>(value.size()));
+    }
+    return out + value;
+}
+
+std::string item(const std::string& body) {
+    return tagBytes(0xFFFEE000) + le32(static_cast<uint32_t>(body.size())) + body;
+}
+
+std::string part10(const std::string& dataset, const char* transfer_syntax = kExplicitLittleEndian,
+                   const std::string& sop_instance_uid = "1.2.3.4.5.6.7") {
+    const std::string meta = element(0x00020001, "OB", std::string("\0\1", 2)) +
+                             element(0x00020003, "UI", sop_instance_uid) +
+                             element(0x00020010, "UI", transfer_syntax);
+    return std::string(128, '\0') + "DICM" +
+           element(0x00020000, "UL", le32(static_cast<uint32_t>(meta.size()))) + meta + dataset;
+}
+
+struct Parsed {
+    uint32_t tag;
+    std::string value;
+    size_t encoded_bytes;   // header and value
+};
+
+// Elements of a defined-length dataset; lengths have to add up exactly
+std::vector<Parsed> elements(std::string_view data, bool explicit_vr = true) {
+    std::vector<Parsed> out;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        if (pos + 8 > data.size()) {
+            throw std::runtime_error("truncated element header");
+        }
+        const uint32_t tag = (static_cast<uint32_t>(read16(data, pos)) << 16) | read16(data, pos + 2);
+        size_t value = pos + 8;
+        uint32_t length = 0;
+        const bool meta = (tag >> 16) == 0x0002;
+        if ((tag >> 16) == 0xFFFE || (!explicit_vr && !meta)) {
+            length = read32(data, pos + 4);
+        } else if (longForm(data.substr(pos + 4, 2))) {
+            length = read32(data, pos + 8);
+            value = pos + 12;
+        } else {
+            length = read16(data, pos + 6);
+        }
+        if (length == 0xFFFFFFFF || value + length > data.size()) {
+            throw std::runtime_error("element overruns its dataset");
+        }
+        out.push_back({tag, std::string(data.substr(value, length)), value + length - pos});
+        pos = value + length;
+    }
+    return out;
+}
+
+const std::string* find(const std::vector<Parsed>& parsed, uint32_t tag) {
+    for (const auto& p : parsed) {
+        if (p.tag == tag) {
+            return &p.value;
+        }
+    }
+    return nullptr;
+}
+
+std::string trimmed(std::string value) {
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\0')) {
+        value.pop_back();
+    }
+    return value;
+}
+
+std::string deidentify(const DicomDeidentifier& deid, const std::string& file) {
+    const DeidentificationPlan plan = deid.plan(file);
+    std::string out = DicomDeidentifier::render(file, plan);
+    EXPECT_EQ(out.size(), plan.output_bytes);
+    return out;
+}
+
+const DeidentificationProfile& basic() {
+    const DeidentificationProfile* profile = DeidentificationProfile::byName("basic");
+    if (profile == nullptr) {
+        throw std::runtime_error("no basic profile");
+    }
+    return *profile;
+}
+
+std::string sampleDataset() {
+    return element(0x00080012, "DA", "20240102") +
+           element(0x00080018, "UI", "1.2.3.4.5.6.7") +
+           element(0x00080020, "DA", "20240102") +
+           element(0x00080060, "CS", "CT") +
+           element(0x00080080, "LO", "General Hospital") +
+           element(0x00081140, "SQ",
+                   item(element(0x00081150, "UI", "1.2.840.10008.5.1.4.1.1.2") +
+                        element(0x00081155, "UI", "1.2.3.4.5.6.8"))) +
+           element(0x00090010, "LO", "VENDOR") +
+           element(0x00091001, "LO", "private detail") +
+           element(0x00100010, "PN", "Doe^Jane") +
+           element(0x00100020, "LO", "MRN-0042") +
+           element(0x00101002, "SQ", item(element(0x00100020, "LO", "OTHER-7"))) +
+           element(0x00102180, "SH", "Welder") +
+           element(0x0020000D, "UI", "1.2.3.4.1") +
+           element(0x00280010, "US", le16(2)) +
+           element(0x00380010, "LO", "ADM-99") +
+           element(0x7FE00010, "OW", std::string(8, '\x5a'));
+}
+
+} // namespace
+
+TEST(DicomDeidentifierProfile, EveryBasicRuleIsAnAnnexEOption) {
+    const DeidentificationProfile& profile = basic();
+    std::set<uint32_t> listed;
+    for (const auto& [tag, code] : kAnnexE) {
+        listed.insert(tag);
+        const auto it = profile.rules.find(tag);
+        ASSERT_NE(it, profile.rules.end()) << std::hex << "missing tag " << tag;
+        EXPECT_TRUE(allows(code, it->second.action)) << std::hex << "tag " << tag << " is " << code;
+    }
+    for (const auto& [tag, rule] : profile.rules) {
+        EXPECT_EQ(listed.count(tag), 1u) << std::hex << "tag " << tag << " is not in the Annex E table";
+    }
+    EXPECT_TRUE(profile.remove_private_groups);
+}
+
+TEST(DicomDeidentifierProfile, RulesCarryTheirValueRepresentation) {
+    for (const auto& [tag, rule] : basic().rules) {
+        EXPECT_EQ(std::string(rule.vr).size(), 2u) << std::hex << "tag " << tag;
+    }
+}
+
+TEST(DicomDeidentifier, AppliesTheProfileAndKeepsTheRest) {
+    const DicomDeidentifier deid(basic(), "salt");
+    const std::string out = deidentify(deid, part10(sampleDataset()));
+    const auto parsed = elements(std::string_view(out).substr(132));
+
+    for (const uint32_t removed : {0x00080012u, 0x00080080u, 0x00090010u, 0x00091001u, 0x00101002u,
+                                   0x00102180u, 0x00380010u}) {
+        EXPECT_EQ(find(parsed, removed), nullptr) << std::hex << "tag " << removed;
+    }
+    ASSERT_NE(find(parsed, 0x00080020), nullptr);
+    EXPECT_TRUE(find(parsed, 0x00080020)->empty());
+    EXPECT_EQ(trimmed(*find(parsed, 0x00100010)), "ANONYMOUS");
+    EXPECT_EQ(trimmed(*find(parsed, 0x00100020)), deid.pseudonym("MRN-0042"));
+    EXPECT_EQ(trimmed(*find(parsed, 0x0020000D)), deid.replacementUid("1.2.3.4.1"));
+
+    EXPECT_EQ(trimmed(*find(parsed, 0x00080060)), "CT");
+    EXPECT_EQ(*find(parsed, 0x00280010), le16(2));
+    EXPECT_EQ(*find(parsed, 0x7FE00010), std::string(8, '\x5a'));
+}
+
+TEST(DicomDeidentifier, ReplacesUidsInsideKeptSequences) {
+    const DicomDeidentifier deid(basic(), "salt");
+    const std::string out = deidentify(deid, part10(sampleDataset()));
+    const auto parsed = elements(std::string_view(out).substr(132));
+
+    const std::string* sequence = find(parsed, 0x00081140);
+    ASSERT_NE(sequence, nullptr);
+    const auto items = elements(*sequence);
+    ASSERT_EQ(items.size(), 1u);
+    EXPECT_EQ(items[0].tag, 0xFFFEE000u);
+    const auto inner = elements(items[0].value);
+    EXPECT_EQ(trimmed(*find(inner, 0x00081150)), "1.2.840.10008.5.1.4.1.1.2");
+    EXPECT_EQ(trimmed(*find(inner, 0x00081155)), deid.replacementUid("1.2.3.4.5.6.8"));
+}
+
+TEST(DicomDeidentifier, RewritesTheFileMetaToMatch) {
+    const DicomDeidentifier deid(basic(), "salt");
+    const std::string file = part10(sampleDataset());
+    const DeidentificationPlan plan = deid.plan(file);
+    const std::string out = DicomDeidentifier::render(file, plan);
+    const auto parsed = elements(std::string_view(out).substr(132));
+
+    const std::string uid = deid.replacementUid("1.2.3.4.5.6.7");
+    EXPECT_EQ(plan.sop_instance_uid, uid);
+    EXPECT_EQ(trimmed(*find(parsed, 0x00020003)), uid);
+    EXPECT_EQ(trimmed(*find(parsed, 0x00080018)), uid);
+
+    // The group length covers the rewritten meta elements exactly
+    size_t meta_bytes = 0;
+    for (const auto& p : parsed) {
+        if ((p.tag >> 16) == 0x0002 && p.tag != 0x00020000) {
+            meta_bytes += p.encoded_bytes;
+        }
+    }
+    EXPECT_EQ(read32(*find(parsed, 0x00020000), 0), meta_bytes);
+}
+
+TEST(DicomDeidentifier, AddsIdentityRemovedMarkersInTagOrder) {
+    const DicomDeidentifier deid(basic(), "salt");
+    const std::string out = deidentify(deid, part10(sampleDataset()));
+    const auto parsed = elements(std::string_view(out).substr(132));
+
+    EXPECT_EQ(trimmed(*find(parsed, 0x00120062)), "YES");
+    EXPECT_EQ(trimmed(*find(parsed, 0x00120063)), "Basic Application Confidentiality Profile");
+    for (size_t i = 1; i < parsed.size(); ++i) {
+        EXPECT_LT(parsed[i - 1].tag, parsed[i].tag);
+    }
+}
+
+TEST(DicomDeidentifier, ReplacementsFollowTheSalt) {
+    const DicomDeidentifier a(basic(), "one");
+    const DicomDeidentifier b(basic(), "one");
+    const DicomDeidentifier c(basic(), "two");
+    EXPECT_EQ(a.replacementUid("1.2.3"), b.replacementUid("1.2.3"));
+    EXPECT_NE(a.replacementUid("1.2.3"), c.replacementUid("1.2.3"));
+    EXPECT_NE(a.replacementUid("1.2.3"), a.replacementUid("1.2.4"));
+    EXPECT_EQ(a.replacementUid("1.2.3").rfind("2.25.", 0), 0u);
+    EXPECT_LE(a.replacementUid("1.2.3").size(), 64u);
+    EXPECT_EQ(a.pseudonym("MRN-1"), b.pseudonym("MRN-1"));
+    EXPECT_NE(a.pseudonym("MRN-1"), c.pseudonym("MRN-1"));
+}
+
+TEST(DicomDeidentifier, UsesProfileVrsForImplicitVrFiles) {
+    const DicomDeidentifier deid(basic(), "salt");
+    const std::string dataset = element(0x00080020, "DA", "20240102", false) +
+                                element(0x00100010, "PN", "Doe^Jane", false) +
+                                element(0x00102180, "SH", "Welder", false);
+    const std::string out = deidentify(deid, part10(dataset, kImplicitLittleEndian));
+    const auto parsed = elements(std::string_view(out).substr(132), false);
+
+    EXPECT_TRUE(find(parsed, 0x00080020)->empty());
+    EXPECT_EQ(trimmed(*find(parsed, 0x00100010)), "ANONYMOUS");
+    EXPECT_EQ(find(parsed, 0x00102180), nullptr);
+}
+
+TEST(DicomDeidentifier, DropsUndefinedLengthSequencesWhole) {
+    const DicomDeidentifier deid(basic(), "salt");
+    const std::string undefined = tagBytes(0x00101002) + "SQ" + std::string(2, '\0') + le32(0xFFFFFFFF) +
+                                  tagBytes(0xFFFEE000) + le32(0xFFFFFFFF) +
+                                  element(0x00100020, "LO", "OTHER-7") +
+                                  tagBytes(0xFFFEE00D) + le32(0) +
+                                  tagBytes(0xFFFEE0DD) + le32(0);
+    const std::string out = deidentify(deid, part10(element(0x00080060, "CS", "MR") + undefined));
+    const auto parsed = elements(std::string_view(out).substr(132));
+
+    EXPECT_EQ(find(parsed, 0x00101002), nullptr);
+    EXPECT_EQ(out.find("OTHER-7"), std::string::npos);
+}
+
+TEST(DicomDeidentifier, RejectsMalformedAndUnsupportedFiles) {
+    const DicomDeidentifier deid(basic(), "salt");
+    EXPECT_THROW(deid.plan("not a dicom file"), std::invalid_argument);
+    EXPECT_THROW(deid.plan(part10(element(0x00100010, "PN", "Doe"), kExplicitBigEndian)),
+                 std::invalid_argument);
+
+    // Only sequences and encapsulated pixel data may have undefined length
+    const std::string undefined = tagBytes(0x00204000) + "UT" + std::string(2, '\0') + le32(0xFFFFFFFF) +
+                                  "comment " + tagBytes(0xFFFEE0DD) + le32(0);
+    EXPECT_THROW(deid.plan(part10(undefined)), std::invalid_argument);
+
+    // An element that runs past the end of the file
+    std::string truncated = part10(element(0x00100010, "PN", "Doe^Jane"));
+    truncated.resize(truncated.size() - 3);
+    EXPECT_THROW(deid.plan(truncated), std::invalid_argument);
+}
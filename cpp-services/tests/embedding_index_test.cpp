@@ -0,0 +1,197 @@
+/**
+ * Embedding Index Tests
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "embedding_index.h"
+#include "test_files.h"
+
+namespace {
+
+constexpr size_t kDim = 32;
+constexpr std::streamoff kDirtyBootOffset = 48;     // FileHeader::dirty_boot
+
+std::vector<std::vector<float>> randomUnitVectors(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> value;
+    std::vector<std::vector<float>> vectors(count, std::vector<float>(kDim));
+    for (auto& v : vectors) {
+        for (auto& x : v) {
+            x = value(rng);
+        }
+        normalizeEmbedding(v);
+    }
+    return vectors;
+}
+
+ContentHash hashOf(size_t i) {
+    return contentHash("image-" + std::to_string(i));
+}
+
+std::vector<ContentHash> bruteForce(const std::vector<std::vector<float>>& vectors,
+                                    const std::vector<float>& query, size_t k) {
+    std::vector<std::pair<float, size_t>> scored;
+    for (size_t i = 0; i < vectors.size(); ++i) {
+        float dot = 0.0f;
+        for (size_t j = 0; j < kDim; ++j) {
+            dot += vectors[i][j] * query[j];
+        }
+        scored.emplace_back(dot, i);
+    }
+    std::partial_sort(scored.begin(), scored.begin() + k, scored.end(), std::greater<>());
+    std::vector<ContentHash> out;
+    for (size_t i = 0; i < k; ++i) {
+        out.push_back(hashOf(scored[i].second));
+    }
+    return out;
+}
+
+// Inserts in a child that exits without closing the index, as a crashed
+// service would
+void insertAndCrash(const std::string& path, const std::vector<std::vector<float>>& vectors) {
+    const pid_t child = ::fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        auto* index = new EmbeddingIndex(path, kDim, EmbeddingIndexConfig{});
+        for (size_t i = 0; i < vectors.size(); ++i) {
+            index->insert(hashOf(i), vectors[i].data());
+        }
+        ::_exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(::waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+} // namespace
+
+TEST(EmbeddingIndex, EmptyIndexFindsNothing) {
+    ScratchDir dir;
+    EmbeddingIndex index(dir.file("index"), kDim, EmbeddingIndexConfig{});
+    const auto query = randomUnitVectors(1, 1)[0];
+    EXPECT_EQ(index.size(), 0u);
+    EXPECT_TRUE(index.search(query.data(), 5).empty());
+}
+
+TEST(EmbeddingIndex, InsertIsIdempotentPerHash) {
+    ScratchDir dir;
+    EmbeddingIndex index(dir.file("index"), kDim, EmbeddingIndexConfig{});
+    const auto vectors = randomUnitVectors(2, 2);
+    EXPECT_TRUE(index.insert(hashOf(0), vectors[0].data()));
+    EXPECT_FALSE(index.insert(hashOf(0), vectors[1].data()));
+    EXPECT_TRUE(index.contains(hashOf(0)));
+    EXPECT_FALSE(index.contains(hashOf(1)));
+    EXPECT_EQ(index.size(), 1u);
+}
+
+TEST(EmbeddingIndex, AnIndexedVectorIsItsOwnNearestNeighbour) {
+    ScratchDir dir;
+    EmbeddingIndex index(dir.file("index"), kDim, EmbeddingIndexConfig{});
+    const auto vectors = randomUnitVectors(500, 3);
+    for (size_t i = 0; i < vectors.size(); ++i) {
+        index.insert(hashOf(i), vectors[i].data());
+    }
+    for (size_t i = 0; i < vectors.size(); i += 25) {
+        const auto matches = index.search(vectors[i].data(), 1);
+        ASSERT_EQ(matches.size(), 1u);
+        EXPECT_EQ(matches[0].hash, hashOf(i));
+        EXPECT_NEAR(matches[0].similarity, 1.0f, 1e-5f);
+    }
+}
+
+TEST(EmbeddingIndex, RecallAgainstExactSearch) {
+    ScratchDir dir;
+    EmbeddingIndex index(dir.file("index"), kDim, EmbeddingIndexConfig{});
+    const auto vectors = randomUnitVectors(3000, 4);
+    for (size_t i = 0; i < vectors.size(); ++i) {
+        index.insert(hashOf(i), vectors[i].data());
+    }
+    const auto queries = randomUnitVectors(50, 5);
+    const size_t k = 10;
+    size_t found = 0;
+    for (const auto& query : queries) {
+        const auto exact = bruteForce(vectors, query, k);
+        const auto matches = index.search(query.data(), k, 128);
+        ASSERT_EQ(matches.size(), k);
+        for (size_t i = 1; i < matches.size(); ++i) {
+            EXPECT_GE(matches[i - 1].similarity, matches[i].similarity);
+        }
+        for (const auto& match : matches) {
+            found += std::count(exact.begin(), exact.end(), match.hash);
+        }
+    }
+    EXPECT_GE(static_cast<double>(found) / (queries.size() * k), 0.95);
+}
+
+TEST(EmbeddingIndex, ReopenServesTheSameGraph) {
+    ScratchDir dir;
+    const std::string path = dir.file("index");
+    const auto vectors = randomUnitVectors(300, 6);
+    std::vector<IndexMatch> before;
+    {
+        EmbeddingIndex index(path, kDim, EmbeddingIndexConfig{});
+        for (size_t i = 0; i < vectors.size(); ++i) {
+            index.insert(hashOf(i), vectors[i].data());
+        }
+        before = index.search(vectors[7].data(), 5);
+    }
+    EmbeddingIndex index(path, kDim, EmbeddingIndexConfig{});
+    EXPECT_EQ(index.size(), vectors.size());
+    EXPECT_TRUE(index.contains(hashOf(299)));
+    const auto after = index.search(vectors[7].data(), 5);
+    ASSERT_EQ(after.size(), before.size());
+    for (size_t i = 0; i < after.size(); ++i) {
+        EXPECT_EQ(after[i].hash, before[i].hash);
+    }
+}
+
+TEST(EmbeddingIndex, KeepsInsertsOfAProcessThatCrashedThisBoot) {
+    ScratchDir dir;
+    const std::string path = dir.file("index");
+    const auto vectors = randomUnitVectors(50, 7);
+    insertAndCrash(path, vectors);
+    EmbeddingIndex index(path, kDim, EmbeddingIndexConfig{});
+    EXPECT_EQ(index.size(), vectors.size());
+    EXPECT_EQ(index.search(vectors[3].data(), 1).front().hash, hashOf(3));
+}
+
+TEST(EmbeddingIndex, IsRebuiltWhenLeftOpenByAnEarlierBoot) {
+    ScratchDir dir;
+    const std::string path = dir.file("index");
+    const auto vectors = randomUnitVectors(50, 8);
+    insertAndCrash(path, vectors);
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(kDirtyBootOffset);
+        file.write("an-earlier-boot", 16);
+    }
+    {
+        EmbeddingIndex index(path, kDim, EmbeddingIndexConfig{});
+        EXPECT_EQ(index.size(), 0u);
+        EXPECT_TRUE(index.insert(hashOf(0), vectors[0].data()));
+    }
+    // Closed cleanly this time
+    EmbeddingIndex index(path, kDim, EmbeddingIndexConfig{});
+    EXPECT_EQ(index.size(), 1u);
+}
+
+TEST(EmbeddingIndex, RejectsAnotherDimension) {
+    ScratchDir dir;
+    const std::string path = dir.file("index");
+    {
+        EmbeddingIndex index(path, kDim, EmbeddingIndexConfig{});
+    }
+    EXPECT_THROW(EmbeddingIndex(path, kDim + 1, EmbeddingIndexConfig{}), std::runtime_error);
+}
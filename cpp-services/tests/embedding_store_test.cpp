@@ -0,0 +1,234 @@
+/**
+ * Embedding Store Tests
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "embedding_store.h"
+#include "test_files.h"
+
+namespace {
+
+constexpr size_t kDim = 8;
+const std::string kSalt = "test salt";
+
+std::vector<float> axis(size_t i, float scale = 1.0f) {
+    std::vector<float> v(kDim, 0.0f);
+    v[i % kDim] = scale;
+    return v;
+}
+
+EmbeddingKey keyOf(const std::string& image, uint64_t hints = 0) {
+    return EmbeddingKey{contentHash(image), hints};
+}
+
+// Links get millisecond timestamps; keep their order unambiguous
+void nextMillisecond() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(3));
+}
+
+} // namespace
+
+TEST(EmbeddingStore, ContentHashRoundTripsThroughHex) {
+    const ContentHash hash = contentHash("image bytes");
+    EXPECT_EQ(hash.hex().size(), 32u);
+    EXPECT_EQ(ContentHash::fromHex(hash.hex()), hash);
+    EXPECT_FALSE(contentHash("image bytes!") == hash);
+    EXPECT_THROW(ContentHash::fromHex("abc"), std::invalid_argument);
+    EXPECT_THROW(ContentHash::fromHex(std::string(32, 'g')), std::invalid_argument);
+}
+
+TEST(EmbeddingStore, PatientKeysDependOnTheSalt) {
+    ScratchDir dir;
+    EmbeddingStore store(dir.file("store"), kDim, kSalt);
+    EmbeddingStore other(dir.file("other"), kDim, "another salt");
+    EXPECT_EQ(store.patientKey("PAT-1"), store.patientKey("PAT-1"));
+    EXPECT_NE(store.patientKey("PAT-1"), store.patientKey("PAT-2"));
+    EXPECT_NE(store.patientKey("PAT-1"), other.patientKey("PAT-1"));
+    // Not the unkeyed content hash the links were made of before
+    EXPECT_NE(store.patientKey("PAT-1"), contentHash("PAT-1").low);
+    EXPECT_THROW(EmbeddingStore(dir.file("unsalted"), kDim, ""), std::runtime_error);
+}
+
+TEST(EmbeddingStore, InsertNormalizesAndFindsByKey) {
+    ScratchDir dir;
+    EmbeddingStore store(dir.file("store"), kDim, kSalt);
+    auto vector = axis(2, 5.0f);
+    EXPECT_TRUE(store.insert(keyOf("a"), vector));
+    EXPECT_FLOAT_EQ(vector[2], 1.0f);
+
+    std::vector<float> found;
+    ASSERT_TRUE(store.find(keyOf("a"), found));
+    EXPECT_EQ(found, axis(2));
+    EXPECT_FALSE(store.find(keyOf("a", 7), found));
+    EXPECT_FALSE(store.find(keyOf("b"), found));
+
+    auto again = axis(3);
+    EXPECT_FALSE(store.insert(keyOf("a"), again));
+    EXPECT_EQ(store.size(), 1u);
+}
+
+TEST(EmbeddingStore, SameImageUnderOtherHintsIsAnotherEmbedding) {
+    ScratchDir dir;
+    EmbeddingStore store(dir.file("store"), kDim, kSalt);
+    auto plain = axis(0);
+    auto windowed = axis(1);
+    EXPECT_TRUE(store.insert(keyOf("a"), plain));
+    EXPECT_TRUE(store.insert(keyOf("a", 42), windowed));
+    EXPECT_EQ(store.size(), 2u);
+    // Only embeddings without hints are offered to the index
+    EXPECT_EQ(store.hashes(), std::vector<ContentHash>{contentHash("a")});
+}
+
+TEST(EmbeddingStore, LinkingNeedsAStoredEmbedding) {
+    ScratchDir dir;
+    EmbeddingStore store(dir.file("store"), kDim, kSalt);
+    EXPECT_THROW(store.link(1, keyOf("missing")), std::invalid_argument);
+    auto vector = axis(0);
+    store.insert(keyOf("a"), vector);
+    EXPECT_TRUE(store.link(1, keyOf("a")));
+    EXPECT_FALSE(store.link(1, keyOf("a")));
+    EXPECT_TRUE(store.link(2, keyOf("a")));
+}
+
+TEST(EmbeddingStore, CompareReturnsNewestFirstOncePerImage) {
+    ScratchDir dir;
+    EmbeddingStore store(dir.file("store"), kDim, kSalt);
+    for (const char* image : {"old", "new", "query"}) {
+        auto vector = axis(image[0]);
+        store.insert(keyOf(image), vector);
+    }
+    auto windowed = axis(1);
+    store.insert(keyOf("old", 9), windowed);
+
+    store.link(1, keyOf("old"));
+    nextMillisecond();
+    store.link(1, keyOf("new"));
+    nextMillisecond();
+    store.link(1, keyOf("old", 9));    // same image again, newest link
+    store.link(1, keyOf("query"));
+    store.link(2, keyOf("new"));
+
+    const auto query = axis('q');
+    auto results = store.compare(1, query.data(), {}, contentHash("query"));
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].hash, contentHash("old"));
+    EXPECT_EQ(results[1].hash, contentHash("new"));
+    EXPECT_GE(results[0].stored_at_ms, results[1].stored_at_ms);
+
+    results = store.compare(1, query.data(), {contentHash("new")}, ContentHash{});
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].hash, contentHash("new"));
+
+    EXPECT_TRUE(store.compare(3, query.data(), {}, ContentHash{}).empty());
+}
+
+TEST(EmbeddingStore, SimilarityIsTheCosine) {
+    ScratchDir dir;
+    EmbeddingStore store(dir.file("store"), kDim, kSalt);
+    std::vector<float> prior = {1, 1, 0, 0, 0, 0, 0, 0};
+    store.insert(keyOf("prior"), prior);
+    store.link(1, keyOf("prior"));
+    const auto query = axis(0);
+    const auto results = store.compare(1, query.data(), {}, ContentHash{});
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_NEAR(results[0].similarity, 1.0 / std::sqrt(2.0), 1e-6);
+}
+
+TEST(EmbeddingStore, ReopenKeepsVectorsAndLinks) {
+    ScratchDir dir;
+    const std::string path = dir.file("store");
+    {
+        EmbeddingStore store(path, kDim, kSalt);
+        auto vector = axis(4);
+        store.insert(keyOf("a"), vector);
+        store.link(1, keyOf("a"));
+    }
+    EmbeddingStore store(path, kDim, kSalt);
+    EXPECT_EQ(store.size(), 1u);
+    std::vector<float> found;
+    ASSERT_TRUE(store.find(keyOf("a"), found));
+    EXPECT_EQ(found, axis(4));
+    const auto query = axis(4);
+    ASSERT_EQ(store.compare(1, query.data(), {}, ContentHash{}).size(), 1u);
+}
+
+TEST(EmbeddingStore, TornTailRecordsAreDropped) {
+    ScratchDir dir;
+    const std::string path = dir.file("store");
+    {
+        EmbeddingStore store(path, kDim, kSalt);
+        auto vector = axis(1);
+        store.insert(keyOf("a"), vector);
+        store.link(1, keyOf("a"));
+    }
+    for (const std::string& file : {path, path + ".patients"}) {
+        std::ofstream(file, std::ios::binary | std::ios::app).write("partial", 7);
+    }
+    {
+        EmbeddingStore store(path, kDim, kSalt);
+        EXPECT_EQ(store.size(), 1u);
+        auto vector = axis(2);
+        EXPECT_TRUE(store.insert(keyOf("b"), vector));
+        EXPECT_TRUE(store.link(1, keyOf("b")));
+    }
+    EmbeddingStore store(path, kDim, kSalt);
+    EXPECT_EQ(store.size(), 2u);
+    const auto query = axis(2);
+    EXPECT_EQ(store.compare(1, query.data(), {}, ContentHash{}).size(), 2u);
+}
+
+TEST(EmbeddingStore, RejectsLinksKeyedUnderAnotherSalt) {
+    ScratchDir dir;
+    const std::string path = dir.file("store");
+    {
+        EmbeddingStore store(path, kDim, kSalt);
+        auto vector = axis(1);
+        store.insert(keyOf("a"), vector);
+        store.link(store.patientKey("PAT-1"), keyOf("a"));
+    }
+    EXPECT_THROW(EmbeddingStore(path, kDim, "another salt"), std::runtime_error);
+    EmbeddingStore store(path, kDim, kSalt);
+    const auto query = axis(1);
+    EXPECT_EQ(store.compare(store.patientKey("PAT-1"), query.data(), {}, ContentHash{}).size(), 1u);
+}
+
+TEST(EmbeddingStore, UnsaltedLinksAreDropped) {
+    ScratchDir dir;
+    const std::string path = dir.file("store");
+    {
+        EmbeddingStore store(path, kDim, kSalt);
+        auto vector = axis(1);
+        store.insert(keyOf("a"), vector);
+        store.link(contentHash("PAT-1").low, keyOf("a"));
+    }
+    // Mark the link file as the previous, unsalted format
+    std::fstream(path + ".patients", std::ios::binary | std::ios::in | std::ios::out).write("IMGPAT01", 8);
+    {
+        EmbeddingStore store(path, kDim, kSalt);
+        EXPECT_EQ(store.size(), 1u);
+        const auto query = axis(1);
+        EXPECT_TRUE(store.compare(contentHash("PAT-1").low, query.data(), {}, ContentHash{}).empty());
+        EXPECT_TRUE(store.link(store.patientKey("PAT-1"), keyOf("a")));
+    }
+    EmbeddingStore store(path, kDim, kSalt);
+    const auto query = axis(1);
+    EXPECT_EQ(store.compare(store.patientKey("PAT-1"), query.data(), {}, ContentHash{}).size(), 1u);
+}
+
+TEST(EmbeddingStore, RejectsAnotherDimension) {
+    ScratchDir dir;
+    const std::string path = dir.file("store");
+    {
+        EmbeddingStore store(path, kDim, kSalt);
+    }
+    EXPECT_THROW(EmbeddingStore(path, kDim * 2, kSalt), std::runtime_error);
+}
@@ -0,0 +1,248 @@
+/**
+ * Fair Scheduler Tests
+ * Requests that must queue are issued from their own threads; each test
+ * waits for the scheduler's stats to show them queued before going on, so
+ * the order requests enter their queues is fixed.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fair_scheduler.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+std::chrono::steady_clock::time_point in(std::chrono::milliseconds delay) {
+    return std::chrono::steady_clock::now() + delay;
+}
+
+FairSchedulerConfig configWith(int max_concurrent) {
+    FairSchedulerConfig config;
+    config.max_concurrent = max_concurrent;
+    return config;
+}
+
+int queued(const FairScheduler& scheduler, const std::string& caller) {
+    for (const auto& stats : scheduler.stats()) {
+        if (stats.caller == caller) {
+            return stats.queued;
+        }
+    }
+    return 0;
+}
+
+void waitUntilQueued(const FairScheduler& scheduler, const std::string& caller, int count) {
+    const auto deadline = in(2000ms);
+    while (queued(scheduler, caller) < count) {
+        ASSERT_LT(std::chrono::steady_clock::now(), deadline) << caller << " never queued";
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+// Admits queued requests one at a time and records who got each slot
+class AdmissionLog {
+public:
+    std::thread request(FairScheduler& scheduler, const std::string& caller, RequestPriority priority, int cost) {
+        return std::thread([this, &scheduler, caller, priority, cost] {
+            auto ticket = scheduler.acquire(caller, priority, cost, in(5000ms), nullptr);
+            if (ticket) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                order_.push_back(caller);
+            }
+        });
+    }
+
+    std::vector<std::string> order() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return order_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::string> order_;
+};
+
+} // namespace
+
+TEST(FairScheduler, ParsesPriorities) {
+    EXPECT_EQ(parseRequestPriority("urgent"), RequestPriority::Urgent);
+    EXPECT_EQ(parseRequestPriority("stat"), RequestPriority::Urgent);
+    EXPECT_EQ(parseRequestPriority("routine"), RequestPriority::Routine);
+    EXPECT_EQ(parseRequestPriority(""), RequestPriority::Normal);
+    EXPECT_EQ(parseRequestPriority("whatever"), RequestPriority::Normal);
+}
+
+TEST(FairScheduler, AdmitsImmediatelyWithFreeSlots) {
+    FairScheduler scheduler(configWith(4));
+    auto ticket = scheduler.acquire("a", RequestPriority::Normal, 1, in(100ms), nullptr);
+    EXPECT_EQ(ticket.status(), FairScheduler::AdmitStatus::Admitted);
+    EXPECT_LT(ticket.queueTime(), std::chrono::microseconds(100000));
+}
+
+TEST(FairScheduler, CallerLimitLeavesASlotForOthers) {
+    FairScheduler scheduler(configWith(3));
+    auto first = scheduler.acquire("bulk", RequestPriority::Normal, 1, in(100ms), nullptr);
+    auto second = scheduler.acquire("bulk", RequestPriority::Normal, 1, in(100ms), nullptr);
+    ASSERT_TRUE(first && second);
+
+    // The default limit is max_concurrent - 1
+    auto third = scheduler.acquire("bulk", RequestPriority::Normal, 1, in(50ms), nullptr);
+    EXPECT_EQ(third.status(), FairScheduler::AdmitStatus::TimedOut);
+    auto other = scheduler.acquire("interactive", RequestPriority::Normal, 1, in(100ms), nullptr);
+    EXPECT_EQ(other.status(), FairScheduler::AdmitStatus::Admitted);
+}
+
+TEST(FairScheduler, HighCostCallerIsAdmittedNextToACappedCaller) {
+    FairSchedulerConfig config = configWith(4);
+    config.quantum = 4;
+    FairScheduler scheduler(config);
+
+    std::vector<FairScheduler::Ticket> held;
+    for (int i = 0; i < 3; ++i) {
+        held.push_back(scheduler.acquire("capped", RequestPriority::Normal, 1, in(100ms), nullptr));
+        ASSERT_TRUE(held.back());
+    }
+    // The capped caller keeps a request waiting in the round
+    std::atomic<bool> stop{false};
+    std::thread waiting([&] {
+        scheduler.acquire("capped", RequestPriority::Normal, 1, in(5000ms), [&] { return stop.load(); });
+    });
+    waitUntilQueued(scheduler, "capped", 1);
+
+    // 101 cost units need 26 quanta of credit; one slot is free
+    auto large = scheduler.acquire("large", RequestPriority::Normal, 101, in(1000ms), nullptr);
+    EXPECT_EQ(large.status(), FairScheduler::AdmitStatus::Admitted);
+
+    stop = true;
+    waiting.join();
+}
+
+TEST(FairScheduler, UrgentRequestsGoFirst) {
+    FairScheduler scheduler(configWith(1));
+    AdmissionLog log;
+    auto blocker = scheduler.acquire("blocker", RequestPriority::Normal, 1, in(100ms), nullptr);
+    ASSERT_TRUE(blocker);
+
+    std::thread routine = log.request(scheduler, "routine", RequestPriority::Routine, 1);
+    waitUntilQueued(scheduler, "routine", 1);
+    std::thread normal = log.request(scheduler, "normal", RequestPriority::Normal, 1);
+    waitUntilQueued(scheduler, "normal", 1);
+    std::thread urgent = log.request(scheduler, "urgent", RequestPriority::Urgent, 1);
+    waitUntilQueued(scheduler, "urgent", 1);
+
+    blocker = FairScheduler::Ticket();
+    routine.join();
+    normal.join();
+    urgent.join();
+    EXPECT_EQ(log.order(), (std::vector<std::string>{"urgent", "normal", "routine"}));
+}
+
+TEST(FairScheduler, RoundRobinAlternatesBetweenCallers) {
+    FairSchedulerConfig config = configWith(1);
+    config.caller_limits = {{"a", 1}, {"b", 1}};
+    FairScheduler scheduler(config);
+    AdmissionLog log;
+    auto blocker = scheduler.acquire("blocker", RequestPriority::Normal, 1, in(100ms), nullptr);
+    ASSERT_TRUE(blocker);
+
+    // "a" queues all of its backlog before "b" shows up
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i) {
+        threads.push_back(log.request(scheduler, "a", RequestPriority::Normal, 4));
+        waitUntilQueued(scheduler, "a", i + 1);
+    }
+    for (int i = 0; i < 3; ++i) {
+        threads.push_back(log.request(scheduler, "b", RequestPriority::Normal, 4));
+        waitUntilQueued(scheduler, "b", i + 1);
+    }
+
+    blocker = FairScheduler::Ticket();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(log.order(), (std::vector<std::string>{"a", "b", "a", "b", "a", "b"}));
+}
+
+TEST(FairScheduler, CostWeightsTheShareOfSlots) {
+    FairSchedulerConfig config = configWith(1);
+    config.caller_limits = {{"heavy", 1}, {"light", 1}};
+    FairScheduler scheduler(config);
+    AdmissionLog log;
+    auto blocker = scheduler.acquire("blocker", RequestPriority::Normal, 1, in(100ms), nullptr);
+    ASSERT_TRUE(blocker);
+
+    std::vector<std::thread> threads;
+    threads.push_back(log.request(scheduler, "heavy", RequestPriority::Normal, 8));
+    waitUntilQueued(scheduler, "heavy", 1);
+    for (int i = 0; i < 2; ++i) {
+        threads.push_back(log.request(scheduler, "light", RequestPriority::Normal, 4));
+        waitUntilQueued(scheduler, "light", i + 1);
+    }
+
+    // With a quantum of 4, the cost-8 request needs two rounds of credit
+    // while each cost-4 request needs one
+    blocker = FairScheduler::Ticket();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(log.order(), (std::vector<std::string>{"light", "heavy", "light"}));
+}
+
+TEST(FairScheduler, RejectsBeyondTheQueueLimit) {
+    FairSchedulerConfig config = configWith(1);
+    config.max_queued_per_caller = 1;
+    FairScheduler scheduler(config);
+    auto blocker = scheduler.acquire("blocker", RequestPriority::Normal, 1, in(100ms), nullptr);
+    ASSERT_TRUE(blocker);
+
+    std::atomic<bool> stop{false};
+    std::thread waiting([&] {
+        scheduler.acquire("a", RequestPriority::Normal, 1, in(5000ms), [&] { return stop.load(); });
+    });
+    waitUntilQueued(scheduler, "a", 1);
+    auto rejected = scheduler.acquire("a", RequestPriority::Normal, 1, in(5000ms), nullptr);
+    EXPECT_EQ(rejected.status(), FairScheduler::AdmitStatus::QueueFull);
+
+    stop = true;
+    waiting.join();
+}
+
+TEST(FairScheduler, CancelledWaitersLeaveTheQueue) {
+    FairScheduler scheduler(configWith(1));
+    auto blocker = scheduler.acquire("blocker", RequestPriority::Normal, 1, in(100ms), nullptr);
+    ASSERT_TRUE(blocker);
+    auto cancelled = scheduler.acquire("a", RequestPriority::Normal, 1, in(5000ms), [] { return true; });
+    EXPECT_EQ(cancelled.status(), FairScheduler::AdmitStatus::Cancelled);
+    EXPECT_EQ(queued(scheduler, "a"), 0);
+}
+
+TEST(FairScheduler, IdleCallersAreForgotten) {
+    FairScheduler scheduler(configWith(2));
+    {
+        auto ticket = scheduler.acquire("a", RequestPriority::Normal, 1, in(100ms), nullptr);
+        ASSERT_TRUE(ticket);
+        EXPECT_EQ(scheduler.stats().size(), 1u);
+    }
+    EXPECT_TRUE(scheduler.stats().empty());
+}
+
+TEST(FairScheduler, RaisingTheSlotCountAdmitsWaiters) {
+    FairScheduler scheduler(configWith(1));
+    auto blocker = scheduler.acquire("blocker", RequestPriority::Normal, 1, in(100ms), nullptr);
+    ASSERT_TRUE(blocker);
+    AdmissionLog log;
+    std::thread waiting = log.request(scheduler, "a", RequestPriority::Normal, 1);
+    waitUntilQueued(scheduler, "a", 1);
+    scheduler.setMaxConcurrent(2);
+    waiting.join();
+    EXPECT_EQ(log.order(), std::vector<std::string>{"a"});
+}
@@ -0,0 +1,200 @@
+/**
+ * Image Kernels Tests
+ * Run once per instruction set (MEDICAL_IMAGING_CPU_ISA, see CMakeLists.txt),
+ * so every dispatched variant is checked against the same scalar references.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "image_kernels.h"
+#include "parallel.h"
+
+namespace {
+
+std::vector<float> randomPlane(int width, int height, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> value(0.0f, 1.0f);
+    std::vector<float> plane(static_cast<size_t>(width) * height);
+    for (auto& v : plane) {
+        v = value(rng);
+    }
+    return plane;
+}
+
+// Reads `src` in `orientation` into a plane of the output layout, as the
+// bit definitions in image_kernels.h describe
+std::vector<float> reoriented(const std::vector<float>& src, int width, int height,
+                              ImageOrientation orientation, int& out_width, int& out_height) {
+    const auto bits = static_cast<uint8_t>(orientation);
+    const bool swap = bits & 4;
+    out_width = swap ? height : width;
+    out_height = swap ? width : height;
+    std::vector<float> out(src.size());
+    for (int y = 0; y < out_height; ++y) {
+        for (int x = 0; x < out_width; ++x) {
+            const int xx = (bits & 1) ? out_width - 1 - x : x;
+            const int yy = (bits & 2) ? out_height - 1 - y : y;
+            const int sx = swap ? yy : xx;
+            const int sy = swap ? xx : yy;
+            out[static_cast<size_t>(y) * out_width + x] = src[static_cast<size_t>(sy) * width + sx];
+        }
+    }
+    return out;
+}
+
+void expectNear(const std::vector<float>& actual, const std::vector<float>& expected, float tolerance) {
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        ASSERT_NEAR(actual[i], expected[i], tolerance) << "at " << i;
+    }
+}
+
+class ImageKernels : public ::testing::Test {
+protected:
+    static void SetUpTestSuite() { parallel::configure(); }
+};
+
+} // namespace
+
+TEST_F(ImageKernels, ResizeToTheSameSizeCopies) {
+    const auto src = randomPlane(37, 23, 1);
+    std::vector<float> dst(src.size());
+    kernels::resizeBilinear(src.data(), 37, 23, dst.data(), 37, 23);
+    expectNear(dst, src, 1e-6f);
+}
+
+TEST_F(ImageKernels, ResizeOfAConstantPlaneIsConstant) {
+    const std::vector<float> src(64 * 48, 0.25f);
+    std::vector<float> dst(29 * 17);
+    kernels::resizeBilinear(src.data(), 64, 48, dst.data(), 29, 17);
+    expectNear(dst, std::vector<float>(dst.size(), 0.25f), 1e-6f);
+}
+
+TEST_F(ImageKernels, OrientedReadMatchesReorientingFirst) {
+    const int width = 45;
+    const int height = 31;
+    const auto src = randomPlane(width, height, 2);
+    for (int bits = 0; bits < 8; ++bits) {
+        SCOPED_TRACE("orientation " + std::to_string(bits));
+        const auto orientation = static_cast<ImageOrientation>(bits);
+        int out_width = 0;
+        int out_height = 0;
+        const auto expected_full = reoriented(src, width, height, orientation, out_width, out_height);
+
+        // Pure reorientation, then a downscale of the reoriented plane
+        std::vector<float> full(src.size());
+        kernels::resizeBilinear(src.data(), width, height, full.data(), out_width, out_height, orientation);
+        expectNear(full, expected_full, 1e-6f);
+
+        const int dst_width = out_width / 2 + 3;
+        const int dst_height = out_height / 3 + 1;
+        std::vector<float> expected(static_cast<size_t>(dst_width) * dst_height);
+        kernels::resizeBilinear(expected_full.data(), out_width, out_height, expected.data(), dst_width, dst_height);
+        std::vector<float> actual(expected.size());
+        kernels::resizeBilinear(src.data(), width, height, actual.data(), dst_width, dst_height, orientation);
+        expectNear(actual, expected, 1e-5f);
+    }
+}
+
+TEST_F(ImageKernels, FusedResampleMatchesSeparatePasses) {
+    const int width = 301;
+    const int height = 257;
+    std::mt19937 rng(3);
+    std::vector<uint16_t> pixels(static_cast<size_t>(width) * height);
+    for (auto& p : pixels) {
+        p = static_cast<uint16_t>(rng() % 4096);
+    }
+    const WindowLevelParams window{40.0, 400.0, 1.0, -1024.0};
+    const float mean = 0.485f;
+    const float stddev = 0.229f;
+
+    std::vector<float> windowed(pixels.size());
+    kernels::windowLevel(pixels.data(), windowed.data(), pixels.size(), window);
+
+    const PixelPlane plane{pixels.data(), PixelDepth::U16, width, height, static_cast<size_t>(width)};
+    TensorMapping mapping;
+    mapping.window = &window;
+    mapping.mean = mean;
+    mapping.stddev = stddev;
+
+    for (int bits : {0, 3, 5}) {
+        SCOPED_TRACE("orientation " + std::to_string(bits));
+        const auto orientation = static_cast<ImageOrientation>(bits);
+        const int dst_width = 96;
+        const int dst_height = 80;
+        std::vector<float> resized(static_cast<size_t>(dst_width) * dst_height);
+        kernels::resizeBilinear(windowed.data(), width, height, resized.data(), dst_width, dst_height, orientation);
+        std::vector<float> expected(resized.size());
+        kernels::normalize(resized.data(), expected.data(), expected.size(), mean, stddev);
+
+        std::vector<float> actual(resized.size());
+        kernels::resampleToTensor(plane, mapping, actual.data(), dst_width, dst_height, orientation);
+        expectNear(actual, expected, 1e-5f);
+    }
+}
+
+TEST_F(ImageKernels, ResampleWithoutWindowUsesTheFullDepthRange) {
+    const std::vector<uint8_t> pixels = {0, 255, 51, 102};
+    const PixelPlane plane{pixels.data(), PixelDepth::U8, 2, 2, 2};
+    std::vector<float> out(4);
+    kernels::resampleToTensor(plane, TensorMapping{}, out.data(), 2, 2);
+    expectNear(out, {0.0f, 1.0f, 0.2f, 0.4f}, 1e-6f);
+}
+
+TEST_F(ImageKernels, WindowLevelClampsOutsideTheWindow) {
+    const std::vector<uint16_t> pixels = {0, 1024, 1064, 1264, 4000};
+    const WindowLevelParams window{40.0, 400.0, 1.0, -1024.0};
+    std::vector<uint8_t> out(pixels.size());
+    kernels::windowLevel(pixels.data(), out.data(), pixels.size(), window);
+    EXPECT_EQ(out[0], 0);
+    EXPECT_EQ(out[4], 255);
+    EXPECT_LT(out[1], out[2]);
+    EXPECT_LT(out[2], out[3]);
+}
+
+TEST_F(ImageKernels, NonMaxSuppressionKeepsTheBestOfEachCluster) {
+    const std::vector<DetectionBox> boxes = {
+        {0, 0, 10, 10, 0.6f},
+        {1, 1, 11, 11, 0.9f},     // overlaps the first, higher score
+        {50, 50, 60, 60, 0.7f},
+        {100, 100, 101, 101, 0.1f},
+    };
+    EXPECT_EQ(kernels::nonMaxSuppression(boxes, 0.5f), (std::vector<int>{1, 2, 3}));
+}
+
+TEST_F(ImageKernels, DotProductsMatchScalarSums) {
+    const size_t dim = 77;
+    const auto query = randomPlane(static_cast<int>(dim), 1, 4);
+    const auto data = randomPlane(static_cast<int>(dim), 9, 5);
+    std::vector<const float*> rows;
+    for (size_t i = 0; i < 9; ++i) {
+        rows.push_back(data.data() + i * dim);
+    }
+    std::vector<float> out(rows.size());
+    kernels::dotProducts(query.data(), rows.data(), rows.size(), dim, out.data());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        double expected = 0.0;
+        for (size_t j = 0; j < dim; ++j) {
+            expected += static_cast<double>(query[j]) * rows[i][j];
+        }
+        EXPECT_NEAR(out[i], expected, 1e-4);
+    }
+}
+
+TEST_F(ImageKernels, StatisticsOfAUniformPlane) {
+    const int width = 33;
+    const int height = 21;
+    const std::vector<uint16_t> pixels(static_cast<size_t>(width) * height, 0x0A00);
+    const ImageStatistics stats = kernels::imageStatistics(pixels.data(), width, height, width, 4);
+    EXPECT_EQ(stats.pixels, static_cast<uint64_t>(width) * height);
+    EXPECT_EQ(stats.histogram[0xA0], stats.pixels);
+    EXPECT_EQ(stats.interior, static_cast<uint64_t>(width - 2) * (height - 2));
+    EXPECT_EQ(stats.laplacian_sum, 0.0);
+    EXPECT_EQ(stats.laplacian_sq_sum, 0.0);
+    EXPECT_EQ(stats.noise_abs_sum, 0.0);
+}
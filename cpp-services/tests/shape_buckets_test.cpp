@@ -0,0 +1,61 @@
+/**
+ * Input Shape Buckets Tests
+ */
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+#include "shape_buckets.h"
+
+TEST(ShapeBuckets, LandscapeKeepsAspectAndPadsShortSide) {
+    const ShapeBuckets buckets(512, 32);
+    const ShapeBucket bucket = buckets.bucketFor(3000, 2000);
+    EXPECT_EQ(bucket.content, (InputShape{512, 341}));
+    EXPECT_EQ(bucket.input, (InputShape{512, 352}));
+}
+
+TEST(ShapeBuckets, PortraitMirrorsLandscape) {
+    const ShapeBuckets buckets(512, 32);
+    const ShapeBucket bucket = buckets.bucketFor(2000, 3000);
+    EXPECT_EQ(bucket.content, (InputShape{341, 512}));
+    EXPECT_EQ(bucket.input, (InputShape{352, 512}));
+}
+
+TEST(ShapeBuckets, SquareAndInvalidSizesUseTheFullSquare) {
+    const ShapeBuckets buckets(512, 32);
+    EXPECT_EQ(buckets.bucketFor(100, 100).input, (InputShape{512, 512}));
+    EXPECT_EQ(buckets.bucketFor(0, 100).input, (InputShape{512, 512}));
+    EXPECT_EQ(buckets.bucketFor(100, -1).content, (InputShape{512, 512}));
+}
+
+TEST(ShapeBuckets, LongSideIsRoundedUpToAWholeStep) {
+    const ShapeBuckets buckets(500, 32);
+    EXPECT_EQ(buckets.longSide(), 512);
+    EXPECT_EQ(ShapeBuckets(64, 1000).step(), 64);
+}
+
+TEST(ShapeBuckets, ExtremeAspectKeepsAtLeastOneRow) {
+    const ShapeBuckets buckets(512, 32);
+    const ShapeBucket bucket = buckets.bucketFor(100000, 1);
+    EXPECT_EQ(bucket.content, (InputShape{512, 1}));
+    EXPECT_EQ(bucket.input, (InputShape{512, 32}));
+}
+
+TEST(ShapeBuckets, ShapesStayWithinTheBucketBound) {
+    const ShapeBuckets buckets(384, 32);
+    std::set<InputShape> shapes;
+    for (int width = 1; width <= 1200; width += 7) {
+        for (int height = 1; height <= 1200; height += 11) {
+            const ShapeBucket bucket = buckets.bucketFor(width, height);
+            shapes.insert(bucket.input);
+            ASSERT_EQ(bucket.input.width % buckets.step(), 0);
+            ASSERT_EQ(bucket.input.height % buckets.step(), 0);
+            ASSERT_LE(bucket.content.width, bucket.input.width);
+            ASSERT_LE(bucket.content.height, bucket.input.height);
+            ASSERT_LT(bucket.input.width - bucket.content.width, buckets.step());
+            ASSERT_LT(bucket.input.height - bucket.content.height, buckets.step());
+        }
+    }
+    EXPECT_LE(shapes.size(), buckets.maxBuckets());
+}
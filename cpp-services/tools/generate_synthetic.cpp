@@ -0,0 +1,184 @@
+/**
+ * Synthetic Data Generator
+ * Writes a reproducible benchmark corpus:
+ *   xray/  chest projections as 8- and 16-bit PNG and TIFF
+ *   us/    multi-frame ultrasound DICOM, one file per transfer syntax
+ *   ct/    a CT series per transfer syntax (JPEG baseline excepted, as CT
+ *          pixels are 12-bit)
+ *
+ * Usage: imaging_synthetic_generator --out DIR [--seed N] [--kind all|xray|us|ct]
+ *            [--syntax all|NAME] [--size N] [--slices N] [--frames N]
+ *            [--xray-size WxH] [--signed]
+ */
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "synthetic_dicom.h"
+#include "synthetic_images.h"
+
+namespace {
+
+struct Options {
+    std::string out;
+    uint64_t seed = 1;
+    std::string kind = "all";
+    std::string syntax = "all";
+    int ct_size = 512;
+    int slices = 64;
+    int frames = 48;
+    int xray_width = 2048;
+    int xray_height = 2500;
+    bool signed_pixels = false;
+};
+
+void usage() {
+    std::cerr << "usage: imaging_synthetic_generator --out DIR [--seed N] [--kind all|xray|us|ct]\n"
+                 "           [--syntax all|implicit-le|explicit-le|explicit-be|deflate|rle|jpeg-baseline]\n"
+                 "           [--size N] [--slices N] [--frames N] [--xray-size WxH] [--signed]"
+              << std::endl;
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--out" && has_value) {
+            options.out = argv[++i];
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--kind" && has_value) {
+            options.kind = argv[++i];
+        } else if (arg == "--syntax" && has_value) {
+            options.syntax = argv[++i];
+        } else if (arg == "--size" && has_value) {
+            options.ct_size = std::atoi(argv[++i]);
+        } else if (arg == "--slices" && has_value) {
+            options.slices = std::atoi(argv[++i]);
+        } else if (arg == "--frames" && has_value) {
+            options.frames = std::atoi(argv[++i]);
+        } else if (arg == "--xray-size" && has_value) {
+            const std::string size = argv[++i];
+            const size_t x = size.find('x');
+            if (x == std::string::npos) {
+                return false;
+            }
+            options.xray_width = std::atoi(size.substr(0, x).c_str());
+            options.xray_height = std::atoi(size.substr(x + 1).c_str());
+        } else if (arg == "--signed") {
+            options.signed_pixels = true;
+        } else {
+            return false;
+        }
+    }
+    return !options.out.empty() && options.ct_size > 0 && options.ct_size <= 65535 &&
+           options.slices > 0 && options.frames > 0 && options.xray_width > 0 && options.xray_height > 0;
+}
+
+std::vector<synthetic::TransferSyntax> selectedSyntaxes(const std::string& name) {
+    if (name == "all") {
+        return synthetic::allTransferSyntaxes();
+    }
+    synthetic::TransferSyntax syntax;
+    if (!synthetic::parseTransferSyntax(name, syntax)) {
+        throw std::invalid_argument("unknown transfer syntax: " + name);
+    }
+    return {syntax};
+}
+
+void writeImage(const std::filesystem::path& path, const cv::Mat& image) {
+    if (!cv::imwrite(path.string(), image)) {
+        throw std::runtime_error("cannot write " + path.string());
+    }
+    std::cout << "  " << path.string() << std::endl;
+}
+
+void generateXray(const Options& options) {
+    const auto dir = std::filesystem::path(options.out) / "xray";
+    std::filesystem::create_directories(dir);
+
+    std::vector<uint16_t> pixels = synthetic::xrayImage(options.seed, options.xray_width, options.xray_height);
+    cv::Mat image16(options.xray_height, options.xray_width, CV_16UC1, pixels.data());
+    cv::Mat image8;
+    image16.convertTo(image8, CV_8U, 1.0 / 257.0);
+
+    const std::string stem = "xray_" + std::to_string(options.seed);
+    writeImage(dir / (stem + "_8bit.png"), image8);
+    writeImage(dir / (stem + "_16bit.png"), image16);
+    writeImage(dir / (stem + "_8bit.tiff"), image8);
+    writeImage(dir / (stem + "_16bit.tiff"), image16);
+}
+
+void generateUltrasound(const Options& options) {
+    const auto dir = std::filesystem::path(options.out) / "us";
+    std::filesystem::create_directories(dir);
+
+    synthetic::UltrasoundOptions us;
+    us.seed = options.seed;
+    us.frames = options.frames;
+    for (auto syntax : selectedSyntaxes(options.syntax)) {
+        us.syntax = syntax;
+        const auto path = dir / ("us_" + std::to_string(options.seed) + "_" +
+                                 synthetic::transferSyntaxName(syntax) + ".dcm");
+        synthetic::writeUltrasound(path.string(), us);
+        std::cout << "  " << path.string() << " (" << us.frames << " frames)" << std::endl;
+    }
+}
+
+void generateCt(const Options& options) {
+    synthetic::CtSeriesOptions ct;
+    ct.seed = options.seed;
+    ct.size = options.ct_size;
+    ct.slices = options.slices;
+    ct.signed_pixels = options.signed_pixels;
+    for (auto syntax : selectedSyntaxes(options.syntax)) {
+        if (syntax == synthetic::TransferSyntax::JPEGBaseline) {
+            continue;
+        }
+        ct.syntax = syntax;
+        const auto dir = std::filesystem::path(options.out) / "ct" / synthetic::transferSyntaxName(syntax);
+        std::filesystem::create_directories(dir);
+        synthetic::writeCtSeries(dir.string(), ct);
+        std::cout << "  " << dir.string() << " (" << ct.slices << " slices, "
+                  << ct.size << "x" << ct.size << ")" << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    try {
+        const bool all = options.kind == "all";
+        if (!all && options.kind != "xray" && options.kind != "us" && options.kind != "ct") {
+            usage();
+            return 2;
+        }
+        std::cout << "Generating synthetic data with seed " << options.seed << " into " << options.out << std::endl;
+        if (all || options.kind == "xray") {
+            generateXray(options);
+        }
+        if (all || options.kind == "us") {
+            generateUltrasound(options);
+        }
+        if (all || options.kind == "ct") {
+            generateCt(options);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "generation failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
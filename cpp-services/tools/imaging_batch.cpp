@@ -0,0 +1,382 @@
+/**
+ * Imaging Batch Tool
+ * Runs image files through the imaging core in process, without the gRPC
+ * server: one JSON line per file on stdout, a summary on stderr. DICOM files
+ * (.dcm or a DICM preamble) go through DICOM processing, everything else
+ * through image analysis.
+ *
+ * Files are read by the FileReader (io_uring where available) with many
+ * reads in flight, and each one is handed to a worker as soon as it is in
+ * memory, so reading and processing overlap. Output is in completion order.
+ *
+ * With --deidentify DIR, DICOM files are de-identified with the basic
+ * profile instead (no models are loaded) and written to DIR, named by their
+ * new SOP Instance UID since original file names often carry identifiers.
+ * Replacement UIDs are keyed by IMAGING_DEID_SALT. --redact-text fills
+ * burned-in text in processed DICOM images (needs IMAGING_PHI_MODEL).
+ *
+ * Usage: imaging_batch [--type xray|ct|mri|ultrasound] [--workers N]
+ *                      [--priority P] [--patient ID] [--stage-metrics]
+ *                      [--io-backend auto|io_uring|threads] [--io-depth N]
+ *                      [--deidentify DIR] [--redact-text] PATH...
+ * Directories are walked recursively.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dicom_deidentifier.h"
+#include "file_reader.h"
+#include "imaging_core.h"
+#include "pipeline_stage.h"
+
+namespace {
+
+struct Options {
+    std::string image_type = "xray";
+    std::string priority = "routine";
+    std::string patient_id = "BATCH";
+    int workers = 1;
+    bool stage_metrics = false;
+    std::string io_backend;
+    int io_depth = 0;
+    std::string deidentify_dir;
+    bool redact_text = false;
+    std::vector<std::string> paths;
+};
+
+void usage() {
+    std::cerr << "usage: imaging_batch [--type xray|ct|mri|ultrasound] [--workers N] [--priority P]\n"
+                 "                     [--patient ID] [--stage-metrics]\n"
+                 "                     [--io-backend auto|io_uring|threads] [--io-depth N]\n"
+                 "                     [--deidentify DIR] [--redact-text] PATH..." << std::endl;
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--type" && has_value) {
+            options.image_type = argv[++i];
+        } else if (arg == "--workers" && has_value) {
+            options.workers = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--priority" && has_value) {
+            options.priority = argv[++i];
+        } else if (arg == "--patient" && has_value) {
+            options.patient_id = argv[++i];
+        } else if (arg == "--io-backend" && has_value) {
+            options.io_backend = argv[++i];
+        } else if (arg == "--io-depth" && has_value) {
+            options.io_depth = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--deidentify" && has_value) {
+            options.deidentify_dir = argv[++i];
+        } else if (arg == "--redact-text") {
+            options.redact_text = true;
+        } else if (arg == "--stage-metrics") {
+            options.stage_metrics = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+    return !options.paths.empty();
+}
+
+std::vector<std::string> collectFiles(const std::vector<std::string>& paths) {
+    std::vector<std::string> files;
+    for (const auto& path : paths) {
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+                if (entry.is_regular_file()) {
+                    files.push_back(entry.path().string());
+                }
+            }
+        } else {
+            files.push_back(path);
+        }
+    }
+    // Stable order, so runs over the same corpus are comparable
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Files handed from the reader to the workers; bounded so reading stays
+// only a little ahead of processing
+class FileQueue {
+public:
+    explicit FileQueue(size_t capacity) : capacity_(capacity) {}
+
+    void push(std::unique_ptr<FileData> file) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return files_.size() < capacity_; });
+        files_.push_back(std::move(file));
+        not_empty_.notify_one();
+    }
+
+    // Null once the queue is closed and drained
+    std::unique_ptr<FileData> pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return !files_.empty() || closed_; });
+        if (files_.empty()) {
+            return nullptr;
+        }
+        auto file = std::move(files_.front());
+        files_.pop_front();
+        not_full_.notify_one();
+        return file;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    bool closed_ = false;
+    std::deque<std::unique_ptr<FileData>> files_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+bool isDicom(const std::string& path, std::string_view data) {
+    return std::filesystem::path(path).extension() == ".dcm" ||
+           (data.size() > 132 && data.compare(128, 4, "DICM") == 0);
+}
+
+std::string jsonEscape(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    out += buffer;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+std::string stageJson(const StageRecorder& recorder) {
+    std::ostringstream out;
+    out << "{";
+    bool first = true;
+    for (const auto& stage : recorder.stages()) {
+        out << (first ? "" : ",") << "\"" << pipelineStageName(stage.stage) << "\":" << stage.wall_time_ms;
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+// Writes the de-identified copy of one file; returns the JSON fields
+std::string deidentifyFile(const DicomDeidentifier& deidentifier, const Options& options, std::string_view data) {
+    StageScope stage(PipelineStage::Deidentify);
+    DeidentificationPlan plan = deidentifier.plan(data);
+    if (plan.sop_instance_uid.empty()) {
+        throw std::invalid_argument("no SOP Instance UID to name the output after");
+    }
+    const std::string output = (std::filesystem::path(options.deidentify_dir) / (plan.sop_instance_uid + ".dcm")).string();
+    int fd = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("cannot create " + output + ": " + std::strerror(errno));
+    }
+    try {
+        DicomDeidentifier::write(fd, data, plan);
+    } catch (...) {
+        ::close(fd);
+        ::unlink(output.c_str());
+        throw;
+    }
+    if (::close(fd) != 0) {
+        throw std::runtime_error("cannot write " + output + ": " + std::strerror(errno));
+    }
+    std::ostringstream fields;
+    fields << ",\"ok\":true,\"kind\":\"deidentified\",\"output\":\"" << jsonEscape(output)
+           << "\",\"elements_changed\":" << plan.elements_changed << ",\"bytes\":" << plan.output_bytes;
+    return fields.str();
+}
+
+// One file through the core, or the de-identifier when one is given;
+// returns the JSON line
+std::string processFile(ImagingCore* core, const DicomDeidentifier* deidentifier, const Options& options,
+                        const FileData& file, double& elapsed_ms) {
+    const std::string& path = file.path();
+    std::ostringstream line;
+    line << "{\"file\":\"" << jsonEscape(path) << "\"";
+
+    StageRecorder recorder;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        if (file.error() != 0) {
+            throw std::runtime_error(std::string("cannot read: ") + std::strerror(file.error()));
+        }
+        const std::string_view data = file.data();
+        if (deidentifier) {
+            if (!isDicom(path, data)) {
+                throw std::invalid_argument("not a DICOM file");
+            }
+            line << deidentifyFile(*deidentifier, options, data);
+        } else if (isDicom(path, data)) {
+            ProcessDicomRequest request;
+            request.patient_id = options.patient_id;
+            request.dicom_data = data;
+            request.redact_burned_in_text = options.redact_text;
+            DicomProcessingResult result = core->processDicom(request);
+            line << ",\"ok\":true,\"kind\":\"dicom\",\"images\":" << result.processed_images.size()
+                 << ",\"metadata_fields\":" << result.metadata.size();
+        } else {
+            AnalyzeImageRequest request;
+            request.patient_id = options.patient_id;
+            request.image_type = options.image_type;
+            request.image_data = data;
+            request.priority = options.priority;
+            ImageAnalysisResult result = core->analyzeImage(request);
+            line << ",\"ok\":true,\"kind\":\"image\",\"analysis_id\":\"" << jsonEscape(result.analysis_id)
+                 << "\",\"confidence\":" << result.confidence_score
+                 << ",\"urgency\":\"" << jsonEscape(result.urgency_level)
+                 << "\",\"findings\":" << result.findings.size()
+                 << ",\"model\":\"" << jsonEscape(result.model_used) << "\"";
+            if (result.quality.assessed) {
+                line << ",\"usable\":" << (result.quality.usable ? "true" : "false")
+                     << ",\"sharpness\":" << result.quality.sharpness
+                     << ",\"noise\":" << result.quality.noise_sigma;
+            }
+        }
+    } catch (const std::exception& e) {
+        line << ",\"ok\":false,\"error\":\"" << jsonEscape(e.what()) << "\"";
+    }
+    elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    line << ",\"ms\":" << elapsed_ms;
+    if (options.stage_metrics) {
+        line << ",\"stages\":" << stageJson(recorder);
+    }
+    line << "}";
+    return line.str();
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    try {
+        // De-identification needs no models, so the core is not loaded for it
+        std::unique_ptr<ImagingCore> core;
+        std::unique_ptr<DicomDeidentifier> deidentifier;
+        const std::string salt = options.deidentify_dir.empty() ? std::string()
+                                                                : DicomDeidentifier::saltFromEnvironment();
+        if (options.deidentify_dir.empty()) {
+            ImagingCore::initializeProcess();
+            core = std::make_unique<ImagingCore>();
+        } else {
+            std::filesystem::create_directories(options.deidentify_dir);
+            deidentifier = std::make_unique<DicomDeidentifier>(*DeidentificationProfile::byName("basic"), salt);
+        }
+
+        FileReaderConfig io = FileReaderConfig::fromEnvironment();
+        if (!options.io_backend.empty()) {
+            io.backend = options.io_backend;
+        }
+        if (options.io_depth > 0) {
+            io.queue_depth = options.io_depth;
+        }
+        FileReader reader(io);
+
+        const std::vector<std::string> files = collectFiles(options.paths);
+        FileQueue queue(static_cast<size_t>(options.workers) * 2);
+        std::atomic<int> failures{0};
+        std::atomic<uint64_t> bytes_read{0};
+        std::mutex output_mutex;
+        std::vector<double> latencies;
+
+        auto start = std::chrono::steady_clock::now();
+        auto worker = [&] {
+            while (auto file = queue.pop()) {
+                double ms = 0.0;
+                bytes_read += file->data().size();
+                std::string line = processFile(core.get(), deidentifier.get(), options, *file, ms);
+                file.reset();    // back to the reader's buffer pool before printing
+                if (line.find("\"ok\":false") != std::string::npos) {
+                    failures++;
+                }
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cout << line << "\n";
+                latencies.push_back(ms);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < options.workers; ++i) {
+            threads.emplace_back(worker);
+        }
+        try {
+            reader.readAll(files, [&](std::unique_ptr<FileData> file) { queue.push(std::move(file)); });
+        } catch (...) {
+            queue.close();
+            for (auto& t : threads) {
+                t.join();
+            }
+            throw;
+        }
+        queue.close();
+        for (auto& t : threads) {
+            t.join();
+        }
+        std::cout.flush();
+        const double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cerr << files.size() << " files, " << failures.load() << " failed, "
+                  << (elapsed_s > 0 ? files.size() / elapsed_s : 0.0) << " files/s ("
+                  << (elapsed_s > 0 ? bytes_read.load() / elapsed_s / (1 << 20) : 0.0) << " MB/s) with "
+                  << options.workers << " workers, " << reader.backendName() << " reads; p50 "
+                  << percentile(latencies, 0.5)
+                  << " ms, p99 " << percentile(latencies, 0.99) << " ms" << std::endl;
+        return failures.load() > 0 ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << "batch failed: " << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,452 @@
+/**
+ * Load Generator
+ * Drives the gRPC service with synthetic payloads (synthetic_images.h) and
+ * reports throughput and latency percentiles. In closed-loop mode each
+ * worker sends back to back; with --rate, requests follow a fixed schedule
+ * and latency is measured from the scheduled send time, so a stalled server
+ * is not hidden by the generator slowing down with it.
+ *
+ * With --transport shm each worker writes its payload into a sealed memfd,
+ * registers it once with the server's shared memory registry (--shm-socket,
+ * default IMAGING_SHM_SOCKET) and sends only a reference; the server needs
+ * IMAGING_SHM_TRANSPORT=1 and must run on the same host. DICOM results come
+ * back through the same memfd.
+ *
+ * --compare runs the same load against a second target, e.g. the service's
+ * unix socket against TCP loopback, and prints both side by side. CPU time is
+ * reported per request for the generator and, with --server-pid, for the
+ * service (from /proc, so the service must run on this host).
+ *
+ * Usage: imaging_load_generator [--target HOST:PORT|unix:PATH] [--compare TARGET]
+ *            [--server-pid PID] [--rpc analyze|dicom] [--transport inline|shm]
+ *            [--shm-socket PATH] [--concurrency N] [--rate RPS] [--duration SECONDS] [--seed N]
+ *            [--size N] [--payloads N] [--callers N] [--priority P]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <grpcpp/grpcpp.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "medical_imaging.grpc.pb.h"
+#include "shared_memory.h"
+#include "synthetic_dicom.h"
+#include "synthetic_images.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string target = "localhost:50051";
+    std::string compare;        // second target run with the same load
+    int server_pid = 0;
+    std::string rpc = "analyze";
+    std::string transport = "inline";
+    std::string shm_socket = SharedMemoryRegistry::pathFromEnvironment();
+    int concurrency = 8;
+    double rate = 0.0;          // requests per second; 0 = closed loop
+    int duration_s = 30;
+    uint64_t seed = 1;
+    int size = 512;
+    int payloads = 16;
+    int callers = 1;
+    std::string priority = "normal";
+};
+
+void usage() {
+    std::cerr << "usage: imaging_load_generator [--target HOST:PORT|unix:PATH] [--compare TARGET]\n"
+                 "           [--server-pid PID] [--rpc analyze|dicom] [--transport inline|shm]\n"
+                 "           [--shm-socket PATH] [--concurrency N] [--rate RPS] [--duration SECONDS] [--seed N]\n"
+                 "           [--size N] [--payloads N] [--callers N] [--priority P]" << std::endl;
+}
+
+bool parseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--target") {
+            options.target = value;
+        } else if (arg == "--compare") {
+            options.compare = value;
+        } else if (arg == "--server-pid") {
+            options.server_pid = std::atoi(value);
+        } else if (arg == "--rpc") {
+            options.rpc = value;
+        } else if (arg == "--transport") {
+            options.transport = value;
+        } else if (arg == "--shm-socket") {
+            options.shm_socket = value;
+        } else if (arg == "--concurrency") {
+            options.concurrency = std::atoi(value);
+        } else if (arg == "--rate") {
+            options.rate = std::atof(value);
+        } else if (arg == "--duration") {
+            options.duration_s = std::atoi(value);
+        } else if (arg == "--seed") {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--size") {
+            options.size = std::atoi(value);
+        } else if (arg == "--payloads") {
+            options.payloads = std::atoi(value);
+        } else if (arg == "--callers") {
+            options.callers = std::atoi(value);
+        } else if (arg == "--priority") {
+            options.priority = value;
+        } else {
+            return false;
+        }
+    }
+    return (options.rpc == "analyze" || options.rpc == "dicom") &&
+           (options.transport == "inline" || options.transport == "shm") && options.concurrency > 0 &&
+           options.rate >= 0.0 && options.duration_s > 0 && options.size > 0 &&
+           options.payloads > 0 && options.callers > 0;
+}
+
+// Distinct inputs, so server-side caches see realistic variety
+std::vector<std::string> buildPayloads(const Options& options) {
+    std::vector<std::string> payloads;
+    for (int i = 0; i < options.payloads; ++i) {
+        if (options.rpc == "dicom") {
+            synthetic::CtSeriesOptions ct;
+            ct.seed = options.seed;
+            ct.size = options.size;
+            ct.slices = options.payloads;
+            payloads.push_back(synthetic::ctSliceDicom(ct, i));
+            continue;
+        }
+        const int width = options.size;
+        const int height = options.size * 5 / 4;
+        std::vector<uint16_t> pixels = synthetic::xrayImage(options.seed + i, width, height);
+        cv::Mat image16(height, width, CV_16UC1, pixels.data());
+        cv::Mat image8;
+        image16.convertTo(image8, CV_8U, 1.0 / 257.0);
+        std::vector<uchar> png;
+        if (!cv::imencode(".png", image8, png)) {
+            throw std::runtime_error("PNG encoding failed");
+        }
+        payloads.emplace_back(png.begin(), png.end());
+    }
+    return payloads;
+}
+
+// One worker's memfd: the payload at offset 0, the result area after it.
+// Sealed against shrinking, as the server requires, and against growing
+class SharedPayloadBuffer {
+public:
+    SharedPayloadBuffer(const std::string& registry, size_t payload_capacity, size_t result_capacity) {
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        result_offset_ = (payload_capacity + page - 1) / page * page;
+        result_capacity_ = result_capacity;
+        size_ = result_offset_ + result_capacity_;
+
+        fd_ = ::memfd_create("imaging-loadgen", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd_ < 0 || ::ftruncate(fd_, static_cast<off_t>(size_)) != 0 ||
+            ::fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+            throw std::runtime_error(std::string("memfd setup failed: ") + std::strerror(errno));
+        }
+        void* base = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error(std::string("memfd mapping failed: ") + std::strerror(errno));
+        }
+        data_ = static_cast<char*>(base);
+        // The reference stays valid while the registry connection is open
+        segment_ = registerSharedMemory(registry, fd_, connection_);
+    }
+
+    ~SharedPayloadBuffer() {
+        ::munmap(data_, size_);
+        ::close(fd_);
+        if (connection_ >= 0) {
+            ::close(connection_);
+        }
+    }
+
+    SharedPayloadBuffer(const SharedPayloadBuffer&) = delete;
+    SharedPayloadBuffer& operator=(const SharedPayloadBuffer&) = delete;
+
+    // Writes the payload, as a co-located caller would instead of serializing it
+    void fill(const std::string& payload, medical_imaging::SharedMemoryRef* ref) {
+        std::memcpy(data_, payload.data(), payload.size());
+        ref->set_segment(segment_);
+        ref->set_offset(0);
+        ref->set_length(payload.size());
+        ref->set_result_offset(result_offset_);
+        ref->set_result_capacity(result_capacity_);
+    }
+
+private:
+    int fd_ = -1;
+    int connection_ = -1;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t result_offset_ = 0;
+    size_t result_capacity_ = 0;
+    std::string segment_;
+};
+
+struct WorkerResult {
+    std::vector<double> latencies_ms;
+    std::map<int, int> status_counts;
+};
+
+grpc::Status sendOne(medical_imaging::MedicalImagingService::Stub& stub, const Options& options,
+                     const std::string& payload, const std::string& caller, SharedPayloadBuffer* shared) {
+    grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(60));
+    context.AddMetadata("x-caller-id", caller);
+
+    if (options.rpc == "dicom") {
+        medical_imaging::DicomProcessingRequest request;
+        medical_imaging::DicomProcessingResponse response;
+        request.set_patient_id("LOADGEN");
+        if (shared) {
+            shared->fill(payload, request.mutable_dicom_ref());
+        } else {
+            request.set_dicom_data(payload);
+        }
+        return stub.ProcessDicom(&context, request, &response);
+    }
+    medical_imaging::ImageAnalysisRequest request;
+    medical_imaging::ImageAnalysisResponse response;
+    request.set_patient_id("LOADGEN");
+    request.set_image_type("xray");
+    if (shared) {
+        shared->fill(payload, request.mutable_image_ref());
+    } else {
+        request.set_image_data(payload);
+    }
+    request.set_priority(options.priority);
+    return stub.AnalyzeImage(&context, request, &response);
+}
+
+void runWorker(int index, const Options& options, const std::string& target,
+               const std::vector<std::string>& payloads,
+               Clock::time_point start, Clock::time_point end, WorkerResult& result) {
+    grpc::ChannelArguments args;
+    // Unlimited here; each server listener enforces its own limit
+    args.SetMaxSendMessageSize(-1);
+    args.SetMaxReceiveMessageSize(-1);
+    // One connection per worker instead of multiplexing everything on one
+    args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+    auto channel = grpc::CreateCustomChannel(target, grpc::InsecureChannelCredentials(), args);
+    auto stub = medical_imaging::MedicalImagingService::NewStub(channel);
+
+    const std::string caller = "loadgen-" + std::to_string(index % options.callers);
+    std::unique_ptr<SharedPayloadBuffer> shared;
+    if (options.transport == "shm") {
+        size_t largest = 0;
+        for (const auto& payload : payloads) {
+            largest = std::max(largest, payload.size());
+        }
+        // Processed DICOM images are re-encoded slices, well under this
+        shared = std::make_unique<SharedPayloadBuffer>(options.shm_socket, largest, options.rpc == "dicom" ? 4 * largest : 0);
+    }
+    // Open loop: each worker owns every concurrency-th slot of the schedule
+    const auto interval = options.rate > 0.0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.concurrency / options.rate))
+        : Clock::duration::zero();
+    auto scheduled = start + interval * index / options.concurrency;
+
+    for (size_t n = index; ; n += options.concurrency) {
+        if (options.rate > 0.0) {
+            if (scheduled >= end) {
+                break;
+            }
+            std::this_thread::sleep_until(scheduled);
+        } else {
+            scheduled = Clock::now();
+            if (scheduled >= end) {
+                break;
+            }
+        }
+
+        grpc::Status status = sendOne(*stub, options, payloads[n % payloads.size()], caller, shared.get());
+        result.latencies_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - scheduled).count());
+        result.status_counts[status.error_code()]++;
+        scheduled += interval;
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5)];
+}
+
+double processCpuSeconds() {
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// utime + stime of another process, or -1 when it cannot be read
+double serverCpuSeconds(int pid) {
+    if (pid <= 0) {
+        return -1.0;
+    }
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if (!std::getline(stat, line)) {
+        return -1.0;
+    }
+    // Fields after the parenthesised command name, which may contain spaces
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    double utime = 0.0, stime = 0.0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+        if (i == 14) {
+            utime = std::stod(field);
+        } else if (i == 15) {
+            stime = std::stod(field);
+        }
+    }
+    return (utime + stime) / static_cast<double>(::sysconf(_SC_CLK_TCK));
+}
+
+struct LoadReport {
+    std::string target;
+    double elapsed_s = 0.0;
+    std::vector<double> latencies_ms;    // sorted
+    std::map<int, int> statuses;
+    double client_cpu_s = 0.0;
+    double server_cpu_s = -1.0;
+
+    double cpuMsPerRequest(double cpu_s) const {
+        return latencies_ms.empty() || cpu_s < 0.0 ? 0.0 : cpu_s * 1000.0 / latencies_ms.size();
+    }
+};
+
+LoadReport runLoad(const Options& options, const std::string& target,
+                   const std::vector<std::string>& payloads) {
+    std::cout << "Sending to " << target << " (" << options.transport << ") for "
+              << options.duration_s << "s with "
+              << options.concurrency << " workers, "
+              << (options.rate > 0.0 ? std::to_string(options.rate) + " req/s target" : std::string("closed loop"))
+              << std::endl;
+
+    std::vector<WorkerResult> results(options.concurrency);
+    std::vector<std::thread> threads;
+    const double client_cpu_start = processCpuSeconds();
+    const double server_cpu_start = serverCpuSeconds(options.server_pid);
+    const auto start = Clock::now() + std::chrono::milliseconds(100);
+    const auto end = start + std::chrono::seconds(options.duration_s);
+    for (int i = 0; i < options.concurrency; ++i) {
+        threads.emplace_back(runWorker, i, std::cref(options), std::cref(target), std::cref(payloads),
+                             start, end, std::ref(results[i]));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    LoadReport report;
+    report.target = target;
+    report.elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+    report.client_cpu_s = processCpuSeconds() - client_cpu_start;
+    const double server_cpu_end = serverCpuSeconds(options.server_pid);
+    if (server_cpu_start >= 0.0 && server_cpu_end >= 0.0) {
+        report.server_cpu_s = server_cpu_end - server_cpu_start;
+    }
+    for (const auto& r : results) {
+        report.latencies_ms.insert(report.latencies_ms.end(), r.latencies_ms.begin(), r.latencies_ms.end());
+        for (const auto& [code, count] : r.status_counts) {
+            report.statuses[code] += count;
+        }
+    }
+    std::sort(report.latencies_ms.begin(), report.latencies_ms.end());
+    return report;
+}
+
+void printReport(const LoadReport& report) {
+    const auto& latencies = report.latencies_ms;
+    std::cout << std::fixed << std::setprecision(2)
+              << "requests: " << latencies.size() << " (" << latencies.size() / report.elapsed_s << " req/s)\n"
+              << "latency ms: p50 " << percentile(latencies, 0.50) << "  p90 " << percentile(latencies, 0.90)
+              << "  p99 " << percentile(latencies, 0.99) << "  p99.9 " << percentile(latencies, 0.999)
+              << "  max " << (latencies.empty() ? 0.0 : latencies.back()) << "\n"
+              << "cpu ms/request: client " << report.cpuMsPerRequest(report.client_cpu_s);
+    if (report.server_cpu_s >= 0.0) {
+        std::cout << "  server " << report.cpuMsPerRequest(report.server_cpu_s);
+    }
+    std::cout << "\nstatus:";
+    for (const auto& [code, count] : report.statuses) {
+        std::cout << " " << (code == grpc::StatusCode::OK ? std::string("OK") : "code " + std::to_string(code))
+                  << "=" << count;
+    }
+    std::cout << std::endl;
+}
+
+// Second run relative to the first, in percent
+void printComparison(const LoadReport& base, const LoadReport& other) {
+    auto delta = [](double from, double to) { return from > 0.0 ? (to - from) * 100.0 / from : 0.0; };
+    std::cout << std::fixed << std::setprecision(1) << std::showpos
+              << other.target << " vs " << base.target << ": p50 "
+              << delta(percentile(base.latencies_ms, 0.50), percentile(other.latencies_ms, 0.50)) << "%  p99 "
+              << delta(percentile(base.latencies_ms, 0.99), percentile(other.latencies_ms, 0.99)) << "%  client cpu "
+              << delta(base.cpuMsPerRequest(base.client_cpu_s), other.cpuMsPerRequest(other.client_cpu_s)) << "%";
+    if (base.server_cpu_s >= 0.0 && other.server_cpu_s >= 0.0) {
+        std::cout << "  server cpu "
+                  << delta(base.cpuMsPerRequest(base.server_cpu_s), other.cpuMsPerRequest(other.server_cpu_s)) << "%";
+    }
+    std::cout << std::noshowpos << std::endl;
+}
+
+bool allOk(const LoadReport& report) {
+    return report.statuses.size() == 1 && report.statuses.count(grpc::StatusCode::OK);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        usage();
+        return 2;
+    }
+
+    try {
+        std::cout << "Building " << options.payloads << " synthetic " << options.rpc << " payloads..." << std::endl;
+        const std::vector<std::string> payloads = buildPayloads(options);
+
+        LoadReport report = runLoad(options, options.target, payloads);
+        printReport(report);
+        if (options.compare.empty()) {
+            return allOk(report) ? 0 : 1;
+        }
+
+        LoadReport compared = runLoad(options, options.compare, payloads);
+        printReport(compared);
+        printComparison(report, compared);
+        return allOk(report) && allOk(compared) ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "load generation failed: " << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,518 @@
+/**
+ * Synthetic DICOM Implementation
+ * A minimal Part 10 encoder: elements are kept as little-endian value bytes
+ * and byte-swapped on output for big-endian syntaxes according to their VR.
+ */
+
+#include "synthetic_dicom.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <zlib.h>
+
+#include "synthetic_images.h"
+
+namespace synthetic {
+
+namespace {
+
+constexpr const char* kCtImageStorage = "1.2.840.10008.5.1.4.1.1.2";
+constexpr const char* kUltrasoundMultiFrameStorage = "1.2.840.10008.5.1.4.1.1.3.1";
+constexpr const char* kImplementationClassUid = "2.25.302400775151386403375217745712449151488";
+constexpr const char* kImplementationVersion = "MEDIMG_SYNTH_1";
+
+// Fixed study date so files do not change from run to run
+constexpr const char* kStudyDate = "20240115";
+constexpr const char* kStudyTime = "093000";
+
+// Salts keeping the UIDs of different objects in a study apart
+enum UidKind : uint64_t { StudyUid = 1, SeriesUid, FrameOfReferenceUid, InstanceUid };
+
+uint32_t tagOf(uint16_t group, uint16_t element) {
+    return (static_cast<uint32_t>(group) << 16) | element;
+}
+
+struct Element {
+    std::string vr;
+    std::string value;                      // little-endian bytes, unpadded
+    std::vector<std::string> fragments;     // encapsulated pixel data
+    bool encapsulated = false;
+};
+
+// Size of the words to swap for big-endian output
+int wordSize(const std::string& vr) {
+    if (vr == "US" || vr == "SS" || vr == "OW" || vr == "AT") return 2;
+    if (vr == "UL" || vr == "SL" || vr == "FL" || vr == "OF" || vr == "OL") return 4;
+    if (vr == "FD" || vr == "OD") return 8;
+    return 1;
+}
+
+bool longLength(const std::string& vr) {
+    return vr == "OB" || vr == "OD" || vr == "OF" || vr == "OL" || vr == "OW" ||
+           vr == "SQ" || vr == "UC" || vr == "UN" || vr == "UR" || vr == "UT";
+}
+
+class Dataset {
+public:
+    void text(uint16_t group, uint16_t element, const char* vr, const std::string& value) {
+        elements_[tagOf(group, element)] = {vr, value, {}, false};
+    }
+
+    void us(uint16_t group, uint16_t element, uint16_t value) {
+        binary(group, element, "US", &value, sizeof(value));
+    }
+
+    void ul(uint16_t group, uint16_t element, uint32_t value) {
+        binary(group, element, "UL", &value, sizeof(value));
+    }
+
+    void at(uint16_t group, uint16_t element, uint16_t target_group, uint16_t target_element) {
+        const uint16_t words[2] = {target_group, target_element};
+        binary(group, element, "AT", words, sizeof(words));
+    }
+
+    void binary(uint16_t group, uint16_t element, const char* vr, const void* data, size_t size) {
+        elements_[tagOf(group, element)] = {vr, std::string(static_cast<const char*>(data), size), {}, false};
+    }
+
+    void encapsulated(uint16_t group, uint16_t element, std::vector<std::string> fragments) {
+        elements_[tagOf(group, element)] = {"OB", std::string(), std::move(fragments), true};
+    }
+
+    std::string encode(bool explicit_vr, bool big_endian) const {
+        std::string out;
+        for (const auto& entry : elements_) {
+            write(out, entry.first, entry.second, explicit_vr, big_endian);
+        }
+        return out;
+    }
+
+private:
+    static void put16(std::string& out, uint16_t v, bool big_endian) {
+        if (big_endian) {
+            out += static_cast<char>(v >> 8);
+            out += static_cast<char>(v & 0xff);
+        } else {
+            out += static_cast<char>(v & 0xff);
+            out += static_cast<char>(v >> 8);
+        }
+    }
+
+    static void put32(std::string& out, uint32_t v, bool big_endian) {
+        put16(out, static_cast<uint16_t>(big_endian ? v >> 16 : v & 0xffff), big_endian);
+        put16(out, static_cast<uint16_t>(big_endian ? v & 0xffff : v >> 16), big_endian);
+    }
+
+    static void header(std::string& out, uint32_t tag, const std::string& vr, uint32_t length,
+                       bool explicit_vr, bool big_endian) {
+        put16(out, static_cast<uint16_t>(tag >> 16), big_endian);
+        put16(out, static_cast<uint16_t>(tag & 0xffff), big_endian);
+        if (!explicit_vr) {
+            put32(out, length, big_endian);
+        } else if (longLength(vr)) {
+            out += vr;
+            out.append(2, '\0');
+            put32(out, length, big_endian);
+        } else {
+            out += vr;
+            put16(out, static_cast<uint16_t>(length), big_endian);
+        }
+    }
+
+    static void write(std::string& out, uint32_t tag, const Element& e, bool explicit_vr, bool big_endian) {
+        if (e.encapsulated) {
+            // Items and the delimiter are always little endian (PS3.5 A.4)
+            header(out, tag, e.vr, 0xffffffff, explicit_vr, false);
+            std::string offsets;
+            uint32_t offset = 0;
+            for (const auto& fragment : e.fragments) {
+                put32(offsets, offset, false);
+                offset += 8 + static_cast<uint32_t>(fragment.size() + (fragment.size() & 1));
+            }
+            item(out, 0xe000, offsets);
+            for (const auto& fragment : e.fragments) {
+                item(out, 0xe000, fragment);
+            }
+            item(out, 0xe0dd, std::string());
+            return;
+        }
+
+        std::string value = e.value;
+        if (value.size() & 1) {
+            // UIDs pad with NUL, other strings with a space, binary with zero
+            value += (e.vr == "UI" || e.vr == "OB") ? '\0' : ' ';
+        }
+        const int word = wordSize(e.vr);
+        if (big_endian && word > 1) {
+            for (size_t i = 0; i + word <= value.size(); i += word) {
+                for (int j = 0; j < word / 2; ++j) {
+                    std::swap(value[i + j], value[i + word - 1 - j]);
+                }
+            }
+        }
+        header(out, tag, e.vr, static_cast<uint32_t>(value.size()), explicit_vr, big_endian);
+        out += value;
+    }
+
+    static void item(std::string& out, uint16_t element, const std::string& data) {
+        put16(out, 0xfffe, false);
+        put16(out, element, false);
+        put32(out, static_cast<uint32_t>(data.size() + (data.size() & 1)), false);
+        out += data;
+        if (data.size() & 1) {
+            out += '\0';
+        }
+    }
+
+    std::map<uint32_t, Element> elements_;
+};
+
+std::string deflateRaw(const std::string& data) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // Negative window bits: raw deflate without zlib header, as PS3.5 A.5 requires
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    const int status = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END) {
+        throw std::runtime_error("deflate failed");
+    }
+    return out;
+}
+
+// PackBits over one row of one byte plane
+void packBits(const uint8_t* data, size_t count, std::string& out) {
+    size_t i = 0;
+    while (i < count) {
+        size_t run = 1;
+        while (i + run < count && run < 128 && data[i + run] == data[i]) {
+            ++run;
+        }
+        if (run >= 2) {
+            out += static_cast<char>(static_cast<int8_t>(1 - static_cast<int>(run)));
+            out += static_cast<char>(data[i]);
+            i += run;
+            continue;
+        }
+        size_t literal = 1;
+        while (i + literal < count && literal < 128 &&
+               !(i + literal + 1 < count && data[i + literal] == data[i + literal + 1])) {
+            ++literal;
+        }
+        out += static_cast<char>(literal - 1);
+        out.append(reinterpret_cast<const char*>(data + i), literal);
+        i += literal;
+    }
+}
+
+// One RLE Lossless frame (PS3.5 G): a segment per byte plane, most
+// significant first, each row packed separately
+std::string rleFrame(const uint8_t* pixels, int width, int height, int bytes_per_sample) {
+    std::vector<std::string> segments(bytes_per_sample);
+    std::vector<uint8_t> plane(width);
+    for (int s = 0; s < bytes_per_sample; ++s) {
+        const int byte = bytes_per_sample - 1 - s;  // little-endian input
+        for (int row = 0; row < height; ++row) {
+            const uint8_t* src = pixels + static_cast<size_t>(row) * width * bytes_per_sample;
+            for (int col = 0; col < width; ++col) {
+                plane[col] = src[col * bytes_per_sample + byte];
+            }
+            packBits(plane.data(), plane.size(), segments[s]);
+        }
+        if (segments[s].size() & 1) {
+            segments[s] += '\0';
+        }
+    }
+
+    uint32_t header[16] = {static_cast<uint32_t>(bytes_per_sample)};
+    uint32_t offset = sizeof(header);
+    for (int s = 0; s < bytes_per_sample; ++s) {
+        header[1 + s] = offset;
+        offset += static_cast<uint32_t>(segments[s].size());
+    }
+    std::string frame(reinterpret_cast<const char*>(header), sizeof(header));
+    for (const auto& segment : segments) {
+        frame += segment;
+    }
+    return frame;
+}
+
+std::string jpegFrame(const uint8_t* pixels, int width, int height) {
+    cv::Mat image(height, width, CV_8UC1, const_cast<uint8_t*>(pixels));
+    std::vector<uchar> encoded;
+    if (!cv::imencode(".jpg", image, encoded, {cv::IMWRITE_JPEG_QUALITY, 92})) {
+        throw std::runtime_error("JPEG encoding failed");
+    }
+    return std::string(encoded.begin(), encoded.end());
+}
+
+// Pixel Data for `frames` frames stored back to back
+void setPixelData(Dataset& dataset, TransferSyntax syntax, const uint8_t* pixels,
+                  int width, int height, int frames, int bytes_per_sample) {
+    const size_t frame_bytes = static_cast<size_t>(width) * height * bytes_per_sample;
+    switch (syntax) {
+        case TransferSyntax::RLELossless:
+        case TransferSyntax::JPEGBaseline: {
+            if (syntax == TransferSyntax::JPEGBaseline && bytes_per_sample != 1) {
+                throw std::invalid_argument("JPEG baseline carries 8-bit pixels only");
+            }
+            std::vector<std::string> fragments;
+            for (int f = 0; f < frames; ++f) {
+                const uint8_t* frame = pixels + frame_bytes * f;
+                fragments.push_back(syntax == TransferSyntax::RLELossless
+                                        ? rleFrame(frame, width, height, bytes_per_sample)
+                                        : jpegFrame(frame, width, height));
+            }
+            dataset.encapsulated(0x7fe0, 0x0010, std::move(fragments));
+            break;
+        }
+        default:
+            dataset.binary(0x7fe0, 0x0010, bytes_per_sample == 2 ? "OW" : "OB",
+                           pixels, frame_bytes * frames);
+            break;
+    }
+}
+
+std::string part10(const Dataset& dataset, const char* sop_class, const std::string& sop_instance,
+                   TransferSyntax syntax) {
+    Dataset meta;
+    const uint8_t version[2] = {0x00, 0x01};
+    meta.binary(0x0002, 0x0001, "OB", version, sizeof(version));
+    meta.text(0x0002, 0x0002, "UI", sop_class);
+    meta.text(0x0002, 0x0003, "UI", sop_instance);
+    meta.text(0x0002, 0x0010, "UI", transferSyntaxUid(syntax));
+    meta.text(0x0002, 0x0012, "UI", kImplementationClassUid);
+    meta.text(0x0002, 0x0013, "SH", kImplementationVersion);
+    const std::string meta_body = meta.encode(true, false);
+
+    Dataset group_length;
+    group_length.ul(0x0002, 0x0000, static_cast<uint32_t>(meta_body.size()));
+
+    std::string body;
+    switch (syntax) {
+        case TransferSyntax::ImplicitVRLittleEndian:
+            body = dataset.encode(false, false);
+            break;
+        case TransferSyntax::ExplicitVRBigEndian:
+            body = dataset.encode(true, true);
+            break;
+        case TransferSyntax::DeflatedExplicitVRLittleEndian:
+            body = deflateRaw(dataset.encode(true, false));
+            break;
+        default:
+            body = dataset.encode(true, false);
+            break;
+    }
+
+    std::string file(128, '\0');
+    file += "DICM";
+    file += group_length.encode(true, false);
+    file += meta_body;
+    file += body;
+    return file;
+}
+
+std::string decimal(double value) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+    return buffer;
+}
+
+void addPatientAndStudy(Dataset& ds, uint64_t seed, const char* description) {
+    char id[32];
+    std::snprintf(id, sizeof(id), "SYN%010llu", static_cast<unsigned long long>(seed % 10000000000ull));
+
+    ds.text(0x0008, 0x0005, "CS", "ISO_IR 100");
+    ds.text(0x0008, 0x0020, "DA", kStudyDate);
+    ds.text(0x0008, 0x0030, "TM", kStudyTime);
+    ds.text(0x0008, 0x0050, "SH", std::string("A") + (id + 3));
+    ds.text(0x0008, 0x0070, "LO", "SYNTHETIC");
+    ds.text(0x0008, 0x0090, "PN", "");
+    ds.text(0x0008, 0x1030, "LO", description);
+    ds.text(0x0010, 0x0010, "PN", std::string("SYNTHETIC^PATIENT^") + (id + 3));
+    ds.text(0x0010, 0x0020, "LO", id);
+    ds.text(0x0010, 0x0030, "DA", "19700101");
+    ds.text(0x0010, 0x0040, "CS", "O");
+    ds.text(0x0020, 0x000d, "UI", makeUid(seed, StudyUid));
+    ds.text(0x0020, 0x0010, "SH", "1");
+}
+
+} // namespace
+
+const char* transferSyntaxUid(TransferSyntax syntax) {
+    switch (syntax) {
+        case TransferSyntax::ImplicitVRLittleEndian:         return "1.2.840.10008.1.2";
+        case TransferSyntax::ExplicitVRLittleEndian:         return "1.2.840.10008.1.2.1";
+        case TransferSyntax::ExplicitVRBigEndian:            return "1.2.840.10008.1.2.2";
+        case TransferSyntax::DeflatedExplicitVRLittleEndian: return "1.2.840.10008.1.2.1.99";
+        case TransferSyntax::RLELossless:                    return "1.2.840.10008.1.2.5";
+        case TransferSyntax::JPEGBaseline:                   return "1.2.840.10008.1.2.4.50";
+    }
+    return "";
+}
+
+const char* transferSyntaxName(TransferSyntax syntax) {
+    switch (syntax) {
+        case TransferSyntax::ImplicitVRLittleEndian:         return "implicit-le";
+        case TransferSyntax::ExplicitVRLittleEndian:         return "explicit-le";
+        case TransferSyntax::ExplicitVRBigEndian:            return "explicit-be";
+        case TransferSyntax::DeflatedExplicitVRLittleEndian: return "deflate";
+        case TransferSyntax::RLELossless:                    return "rle";
+        case TransferSyntax::JPEGBaseline:                   return "jpeg-baseline";
+    }
+    return "";
+}
+
+bool parseTransferSyntax(const std::string& name, TransferSyntax& syntax) {
+    for (TransferSyntax candidate : allTransferSyntaxes()) {
+        if (name == transferSyntaxName(candidate) || name == transferSyntaxUid(candidate)) {
+            syntax = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<TransferSyntax> allTransferSyntaxes() {
+    return {TransferSyntax::ImplicitVRLittleEndian, TransferSyntax::ExplicitVRLittleEndian,
+            TransferSyntax::ExplicitVRBigEndian, TransferSyntax::DeflatedExplicitVRLittleEndian,
+            TransferSyntax::RLELossless, TransferSyntax::JPEGBaseline};
+}
+
+std::string makeUid(uint64_t seed, uint64_t index) {
+    return "2.25." + std::to_string(Rng::derive(seed ^ 0x5D1C0Bull, index).next());
+}
+
+std::string ctSliceDicom(const CtSeriesOptions& options, int slice) {
+    if (options.syntax == TransferSyntax::JPEGBaseline) {
+        throw std::invalid_argument("JPEG baseline carries 8-bit pixels only");
+    }
+    const int size = options.size;
+    std::vector<int16_t> hu = ctSlice(options.seed, size, slice, options.slices);
+    if (!options.signed_pixels) {
+        for (auto& v : hu) {
+            v = static_cast<int16_t>(v + 1024);  // 0..4095, read back as uint16
+        }
+    }
+
+    // Series centered on the table, first slice at the feet
+    const double fov = size * options.pixel_spacing_mm;
+    const double z = (slice - (options.slices - 1) / 2.0) * options.slice_thickness_mm;
+    const std::string sop_instance = makeUid(options.seed, (uint64_t(InstanceUid) << 32) | uint32_t(slice));
+    const std::string spacing = decimal(options.pixel_spacing_mm);
+
+    Dataset ds;
+    addPatientAndStudy(ds, options.seed, "CT CHEST SYNTHETIC");
+    ds.text(0x0008, 0x0008, "CS", "ORIGINAL\\PRIMARY\\AXIAL");
+    ds.text(0x0008, 0x0016, "UI", kCtImageStorage);
+    ds.text(0x0008, 0x0018, "UI", sop_instance);
+    ds.text(0x0008, 0x0060, "CS", "CT");
+    ds.text(0x0008, 0x103e, "LO", "AXIAL " + decimal(options.slice_thickness_mm) + "MM");
+    ds.text(0x0008, 0x1090, "LO", "PHANTOM-CT");
+    ds.text(0x0018, 0x0050, "DS", decimal(options.slice_thickness_mm));
+    ds.text(0x0018, 0x0060, "DS", "120");
+    ds.text(0x0018, 0x1151, "IS", "200");
+    ds.text(0x0018, 0x1210, "SH", "STANDARD");
+    ds.text(0x0018, 0x5100, "CS", "HFS");
+    ds.text(0x0020, 0x000e, "UI", makeUid(options.seed, SeriesUid));
+    ds.text(0x0020, 0x0011, "IS", "2");
+    ds.text(0x0020, 0x0013, "IS", std::to_string(slice + 1));
+    ds.text(0x0020, 0x0032, "DS", decimal(-fov / 2) + "\\" + decimal(-fov / 2) + "\\" + decimal(z));
+    ds.text(0x0020, 0x0037, "DS", "1\\0\\0\\0\\1\\0");
+    ds.text(0x0020, 0x0052, "UI", makeUid(options.seed, FrameOfReferenceUid));
+    ds.text(0x0020, 0x1041, "DS", decimal(z));
+    ds.us(0x0028, 0x0002, 1);
+    ds.text(0x0028, 0x0004, "CS", "MONOCHROME2");
+    ds.us(0x0028, 0x0010, static_cast<uint16_t>(size));
+    ds.us(0x0028, 0x0011, static_cast<uint16_t>(size));
+    ds.text(0x0028, 0x0030, "DS", spacing + "\\" + spacing);
+    ds.us(0x0028, 0x0100, 16);
+    ds.us(0x0028, 0x0101, options.signed_pixels ? 16 : 12);
+    ds.us(0x0028, 0x0102, options.signed_pixels ? 15 : 11);
+    ds.us(0x0028, 0x0103, options.signed_pixels ? 1 : 0);
+    ds.text(0x0028, 0x1050, "DS", "40");
+    ds.text(0x0028, 0x1051, "DS", "400");
+    ds.text(0x0028, 0x1052, "DS", options.signed_pixels ? "0" : "-1024");
+    ds.text(0x0028, 0x1053, "DS", "1");
+    ds.text(0x0028, 0x1054, "LO", "HU");
+    setPixelData(ds, options.syntax, reinterpret_cast<const uint8_t*>(hu.data()), size, size, 1, 2);
+
+    return part10(ds, kCtImageStorage, sop_instance, options.syntax);
+}
+
+std::string ultrasoundDicom(const UltrasoundOptions& options) {
+    std::vector<uint8_t> pixels = ultrasoundFrames(options.seed, options.width, options.height, options.frames);
+    const std::string sop_instance = makeUid(options.seed, uint64_t(InstanceUid) << 32);
+
+    Dataset ds;
+    addPatientAndStudy(ds, options.seed, "US ABDOMEN SYNTHETIC");
+    ds.text(0x0008, 0x0008, "CS", "ORIGINAL\\PRIMARY\\ABDOMINAL");
+    ds.text(0x0008, 0x0016, "UI", kUltrasoundMultiFrameStorage);
+    ds.text(0x0008, 0x0018, "UI", sop_instance);
+    ds.text(0x0008, 0x0060, "CS", "US");
+    ds.text(0x0008, 0x103e, "LO", "B-MODE CINE");
+    ds.text(0x0008, 0x1090, "LO", "PHANTOM-US");
+    ds.text(0x0018, 0x0040, "IS", std::to_string(options.frame_rate));
+    ds.text(0x0018, 0x1063, "DS", decimal(1000.0 / options.frame_rate));
+    ds.text(0x0018, 0x5010, "LO", "C5-1");
+    ds.text(0x0020, 0x000e, "UI", makeUid(options.seed, SeriesUid));
+    ds.text(0x0020, 0x0011, "IS", "1");
+    ds.text(0x0020, 0x0013, "IS", "1");
+    ds.us(0x0028, 0x0002, 1);
+    ds.text(0x0028, 0x0004, "CS", "MONOCHROME2");
+    ds.text(0x0028, 0x0008, "IS", std::to_string(options.frames));
+    ds.at(0x0028, 0x0009, 0x0018, 0x1063);  // frame increment pointer -> Frame Time
+    ds.us(0x0028, 0x0010, static_cast<uint16_t>(options.height));
+    ds.us(0x0028, 0x0011, static_cast<uint16_t>(options.width));
+    ds.us(0x0028, 0x0100, 8);
+    ds.us(0x0028, 0x0101, 8);
+    ds.us(0x0028, 0x0102, 7);
+    ds.us(0x0028, 0x0103, 0);
+    if (options.syntax == TransferSyntax::JPEGBaseline) {
+        ds.text(0x0028, 0x2110, "CS", "01");  // lossy image compression
+    }
+    setPixelData(ds, options.syntax, pixels.data(), options.width, options.height, options.frames, 1);
+
+    return part10(ds, kUltrasoundMultiFrameStorage, sop_instance, options.syntax);
+}
+
+std::vector<std::string> writeCtSeries(const std::string& directory, const CtSeriesOptions& options) {
+    std::vector<std::string> paths;
+    for (int slice = 0; slice < options.slices; ++slice) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/CT%06d.dcm", slice + 1);
+        const std::string path = directory + name;
+        const std::string data = ctSliceDicom(options, slice);
+        std::ofstream out(path, std::ios::binary);
+        if (!out.write(data.data(), static_cast<std::streamsize>(data.size()))) {
+            throw std::runtime_error("cannot write " + path);
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+void writeUltrasound(const std::string& path, const UltrasoundOptions& options) {
+    const std::string data = ultrasoundDicom(options);
+    std::ofstream out(path, std::ios::binary);
+    if (!out.write(data.data(), static_cast<std::streamsize>(data.size()))) {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+} // namespace synthetic
@@ -0,0 +1,70 @@
+/**
+ * Synthetic DICOM
+ * Part 10 files wrapping the synthetic phantoms with the headers a modality
+ * would write: a CT series (one file per slice, consistent study, series and
+ * frame-of-reference UIDs and patient geometry) and a multi-frame ultrasound
+ * cine loop. Every transfer syntax the service has to decode can be emitted,
+ * and all UIDs derive from the seed, so output is byte-for-byte reproducible
+ * given the same zlib and libjpeg.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace synthetic {
+
+enum class TransferSyntax {
+    ImplicitVRLittleEndian,
+    ExplicitVRLittleEndian,
+    ExplicitVRBigEndian,            // retired, still found in archives
+    DeflatedExplicitVRLittleEndian,
+    RLELossless,
+    JPEGBaseline,                   // 8-bit only
+};
+
+const char* transferSyntaxUid(TransferSyntax syntax);
+// Short name used on the command line and in file names: implicit-le,
+// explicit-le, explicit-be, deflate, rle, jpeg-baseline
+const char* transferSyntaxName(TransferSyntax syntax);
+bool parseTransferSyntax(const std::string& name, TransferSyntax& syntax);
+std::vector<TransferSyntax> allTransferSyntaxes();
+
+// UID under the 2.25 (integer) root, unique per seed and index
+std::string makeUid(uint64_t seed, uint64_t index);
+
+struct CtSeriesOptions {
+    uint64_t seed = 1;
+    int size = 512;                    // rows = columns
+    int slices = 64;
+    double pixel_spacing_mm = 0.7;
+    double slice_thickness_mm = 1.25;
+    // Stored as signed Hounsfield units instead of 12-bit unsigned with a
+    // -1024 rescale intercept
+    bool signed_pixels = false;
+    TransferSyntax syntax = TransferSyntax::ExplicitVRLittleEndian;
+};
+
+struct UltrasoundOptions {
+    uint64_t seed = 1;
+    int width = 640;
+    int height = 480;
+    int frames = 48;
+    int frame_rate = 30;
+    TransferSyntax syntax = TransferSyntax::JPEGBaseline;
+};
+
+// Encoded Part 10 file of one slice (0-based), e.g. for a load generator that
+// sends files without touching disk. Throws std::invalid_argument for a
+// transfer syntax that cannot carry the pixels.
+std::string ctSliceDicom(const CtSeriesOptions& options, int slice);
+std::string ultrasoundDicom(const UltrasoundOptions& options);
+
+// Writes CT000001.dcm, CT000002.dcm, ... into `directory` (which must exist)
+// and returns the paths
+std::vector<std::string> writeCtSeries(const std::string& directory, const CtSeriesOptions& options);
+void writeUltrasound(const std::string& path, const UltrasoundOptions& options);
+
+} // namespace synthetic
@@ -0,0 +1,240 @@
+/**
+ * Synthetic Images Implementation
+ * Anatomy is described in coordinates normalized to the image size, so every
+ * resolution shows the same phantom.
+ */
+
+#include "synthetic_images.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace synthetic {
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+double clamp01(double v) {
+    return std::min(1.0, std::max(0.0, v));
+}
+
+// 1 well inside the ellipse, 0 outside, with a soft rim of relative width `edge`
+double ellipse(double x, double y, double cx, double cy, double rx, double ry, double edge = 0.08) {
+    const double dx = (x - cx) / rx;
+    const double dy = (y - cy) / ry;
+    return clamp01((1.0 - (dx * dx + dy * dy)) / edge);
+}
+
+} // namespace
+
+uint64_t Rng::next() {
+    uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+double Rng::uniform() {
+    return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double Rng::gaussian() {
+    if (has_spare_) {
+        has_spare_ = false;
+        return spare_;
+    }
+    double u1 = uniform();
+    while (u1 <= 0.0) {
+        u1 = uniform();
+    }
+    const double u2 = uniform();
+    const double r = std::sqrt(-2.0 * std::log(u1));
+    spare_ = r * std::sin(2.0 * kPi * u2);
+    has_spare_ = true;
+    return r * std::cos(2.0 * kPi * u2);
+}
+
+Rng Rng::derive(uint64_t seed, uint64_t index) {
+    Rng mixer(seed ^ (index * 0xD1B54A32D192ED03ull));
+    return Rng(mixer.next());
+}
+
+std::vector<uint16_t> xrayImage(uint64_t seed, int width, int height) {
+    Rng shape = Rng::derive(seed, 0);
+    const double lung_shift = (shape.uniform() - 0.5) * 0.04;
+    const double lung_height = 0.28 + shape.uniform() * 0.05;
+    const double heart_size = 0.11 + shape.uniform() * 0.03;
+    const double rib_phase = shape.uniform() * 0.02;
+
+    Rng noise = Rng::derive(seed, 1);
+    std::vector<uint16_t> pixels(static_cast<size_t>(width) * height);
+    for (int row = 0; row < height; ++row) {
+        const double v = (row + 0.5) / height;
+        for (int col = 0; col < width; ++col) {
+            const double u = (col + 0.5) / width;
+
+            // Attenuation: 0 is direct exposure (dark), 1 no exposure (bright)
+            double a = 0.06;
+            const double body = ellipse(u, v, 0.5, 0.58, 0.46, 0.6, 0.05);
+            a += 0.42 * body;
+
+            const double lungs = std::max(ellipse(u, v, 0.31 + lung_shift, 0.45, 0.15, lung_height),
+                                          ellipse(u, v, 0.69 + lung_shift, 0.45, 0.15, lung_height));
+            a -= 0.24 * lungs;
+
+            // Ribs arc downward from the spine; visible over the lung fields
+            const double lateral = std::fabs(u - 0.5);
+            if (lateral > 0.04 && lateral < 0.42) {
+                for (int k = 0; k < 10; ++k) {
+                    const double center = 0.17 + rib_phase + 0.062 * k + 0.45 * lateral * lateral;
+                    const double d = std::fabs(v - center) / 0.011;
+                    if (d < 1.0) {
+                        a += 0.12 * (1.0 - d * d) * body;
+                    }
+                }
+            }
+
+            a += 0.16 * ellipse(u, v, 0.54, 0.6, heart_size, heart_size * 1.5);
+            a += 0.22 * clamp01((0.04 - lateral) / 0.01) * body;
+
+            // Collimator shadow
+            if (u < 0.025 || u > 0.975 || v < 0.02 || v > 0.98) {
+                a = 0.97;
+            }
+
+            // Quantum noise grows with the detected signal
+            a += noise.gaussian() * 0.012 * std::sqrt(1.05 - std::min(1.0, a));
+            pixels[static_cast<size_t>(row) * width + col] =
+                static_cast<uint16_t>(std::lround(clamp01(a) * 65535.0));
+        }
+    }
+    return pixels;
+}
+
+std::vector<uint8_t> ultrasoundFrames(uint64_t seed, int width, int height, int frames) {
+    Rng shape = Rng::derive(seed, 0);
+    const double vessel_depth = 0.5 + (shape.uniform() - 0.5) * 0.15;
+    const double vessel_angle = (shape.uniform() - 0.5) * 0.3;
+    const double layer_depth = 0.22 + shape.uniform() * 0.06;
+
+    const size_t frame_pixels = static_cast<size_t>(width) * height;
+
+    // Speckle is mostly stationary between frames, as tissue barely moves
+    std::vector<float> fixed_speckle(frame_pixels);
+    Rng fixed = Rng::derive(seed, 1);
+    for (auto& s : fixed_speckle) {
+        const double re = fixed.gaussian();
+        const double im = fixed.gaussian();
+        s = static_cast<float>(std::sqrt(re * re + im * im) / 1.2533);  // Rayleigh, mean 1
+    }
+
+    const double apex_x = width / 2.0;
+    const double apex_y = -0.05 * height;
+    const double half_angle = 35.0 * kPi / 180.0;
+    const double r_min = 0.08 * height;
+    const double r_max = 1.0 * height;
+
+    std::vector<uint8_t> pixels(frame_pixels * frames, 0);
+    for (int f = 0; f < frames; ++f) {
+        Rng noise = Rng::derive(seed, 2 + static_cast<uint64_t>(f));
+        const double pulse = 1.0 + 0.18 * std::sin(2.0 * kPi * f / 24.0);  // ~24 frames per cycle
+        const double vessel_radius = 0.06 * pulse;
+        uint8_t* frame = pixels.data() + frame_pixels * f;
+
+        for (int row = 0; row < height; ++row) {
+            for (int col = 0; col < width; ++col) {
+                const size_t i = static_cast<size_t>(row) * width + col;
+                const double dx = col - apex_x;
+                const double dy = row - apex_y;
+                const double r = std::sqrt(dx * dx + dy * dy);
+                const double theta = std::atan2(dx, dy);
+                if (r < r_min || r > r_max || std::fabs(theta) > half_angle) {
+                    continue;
+                }
+                const double depth = (r - r_min) / (r_max - r_min);
+
+                double echo = 0.35;
+                echo += 0.9 * std::exp(-std::pow((depth - 0.02) / 0.015, 2));           // skin
+                echo += 0.5 * std::exp(-std::pow((depth - layer_depth) / 0.012, 2));    // fascia
+                echo += depth > layer_depth ? 0.15 : 0.0;                               // parenchyma
+
+                const double vx = (theta - vessel_angle) * 0.9;
+                const double vy = depth - vessel_depth;
+                const double in_vessel = clamp01((1.0 - std::sqrt(vx * vx + vy * vy) / vessel_radius) / 0.1);
+                echo *= 1.0 - 0.95 * in_vessel;
+                echo += 0.6 * clamp01(1.0 - std::fabs(std::sqrt(vx * vx + vy * vy) - vessel_radius) / 0.006);  // wall
+
+                const double re = noise.gaussian();
+                const double im = noise.gaussian();
+                const double speckle = 0.8 * fixed_speckle[i] + 0.2 * std::sqrt(re * re + im * im) / 1.2533;
+
+                // Attenuation partly compensated by time-gain control, then log compression
+                const double intensity = echo * speckle * std::exp(-0.6 * depth);
+                const double display = std::log1p(20.0 * intensity) / std::log1p(20.0);
+                frame[i] = static_cast<uint8_t>(std::lround(clamp01(display) * 255.0));
+            }
+        }
+    }
+    return pixels;
+}
+
+std::vector<int16_t> ctSlice(uint64_t seed, int size, int slice, int slices) {
+    Rng shape = Rng::derive(seed, 0);
+    const double offset_x = (shape.uniform() - 0.5) * 0.03;
+    const double offset_y = (shape.uniform() - 0.5) * 0.03;
+    const double body_width = 0.40 + shape.uniform() * 0.04;
+    const double heart_x = 0.54 + (shape.uniform() - 0.5) * 0.03;
+
+    // z runs feet to head; lungs and heart peak mid-volume
+    const double z = slices > 1 ? static_cast<double>(slice) / (slices - 1) : 0.5;
+    const double thorax = std::sin(kPi * (0.15 + 0.7 * z));
+    const double body_rx = body_width * (0.97 + 0.06 * thorax);
+    const double body_ry = 0.29 * (0.97 + 0.06 * thorax);
+    const double cx = 0.5 + offset_x;
+    const double cy = 0.5 + offset_y;
+
+    Rng noise = Rng::derive(seed, 1 + static_cast<uint64_t>(slice));
+    std::vector<int16_t> pixels(static_cast<size_t>(size) * size);
+    for (int row = 0; row < size; ++row) {
+        const double y = (row + 0.5) / size;
+        for (int col = 0; col < size; ++col) {
+            const double x = (col + 0.5) / size;
+
+            double hu = -1000.0;
+            if (y > 0.86 && y < 0.885 && x > 0.1 && x < 0.9) {
+                hu = 150.0;  // table
+            }
+
+            const double body = ellipse(x, y, cx, cy, body_rx, body_ry, 0.02);
+            if (body > 0.0) {
+                const double inner = ellipse(x, y, cx, cy, body_rx * 0.92, body_ry * 0.9, 0.04);
+                const double tissue = -100.0 + 140.0 * inner;  // subcutaneous fat, then soft tissue
+                hu = hu + (tissue - hu) * body;
+
+                const double lung_ry = 0.17 * thorax;
+                const double lungs = std::max(ellipse(x, y, cx - 0.17, cy - 0.02, 0.12 * thorax + 0.01, lung_ry + 0.01),
+                                              ellipse(x, y, cx + 0.17, cy - 0.02, 0.12 * thorax + 0.01, lung_ry + 0.01));
+                hu += (-860.0 - hu) * lungs;
+
+                const double heart = ellipse(x, y, heart_x + offset_x, cy + 0.01, 0.1 * thorax, 0.085 * thorax);
+                hu += (45.0 - hu) * heart;
+
+                const double aorta = ellipse(x, y, cx - 0.03, cy + 0.1, 0.024, 0.024, 0.2);
+                hu += (160.0 - hu) * aorta;
+
+                const double vertebra = ellipse(x, y, cx, cy + 0.18, 0.045, 0.04, 0.3);
+                const double marrow = ellipse(x, y, cx, cy + 0.18, 0.032, 0.028, 0.3);
+                hu += (1100.0 - hu) * vertebra;
+                hu += (280.0 - hu) * marrow;
+            }
+
+            hu += noise.gaussian() * (hu > -900.0 ? 12.0 : 4.0);
+            pixels[static_cast<size_t>(row) * size + col] =
+                static_cast<int16_t>(std::lround(std::min(3071.0, std::max(-1024.0, hu))));
+        }
+    }
+    return pixels;
+}
+
+} // namespace synthetic
@@ -0,0 +1,56 @@
+/**
+ * Synthetic Images
+ * Deterministic phantoms standing in for patient data in benchmarks and load
+ * tests: chest X-ray projections, ultrasound cine loops and CT volumes. The
+ * same seed always yields the same pixels; the generator uses its own PRNG
+ * and distributions instead of <random>'s, whose output differs between
+ * standard libraries.
+ *
+ * Pixel generation has no dependencies; file encoding lives in
+ * synthetic_dicom.h and the generator tool.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace synthetic {
+
+// SplitMix64: small, fast and fully specified, so streams are portable
+class Rng {
+public:
+    explicit Rng(uint64_t seed) : state_(seed) {}
+
+    uint64_t next();
+    // Uniform in [0, 1)
+    double uniform();
+    // Standard normal (Box-Muller)
+    double gaussian();
+
+    // Independent stream for sub-object `index` (a slice, a frame, ...), so
+    // generating one part never depends on how many others were generated
+    static Rng derive(uint64_t seed, uint64_t index);
+
+private:
+    uint64_t state_;
+    bool has_spare_ = false;
+    double spare_ = 0.0;
+};
+
+// Postero-anterior chest projection: lung fields, mediastinum, ribs, a
+// collimation border and quantum noise. Full 16-bit range; shift right by 8
+// for the 8-bit variant.
+std::vector<uint16_t> xrayImage(uint64_t seed, int width, int height);
+
+// B-mode ultrasound cine loop: a sector scan of speckle over tissue layers,
+// with a vessel that pulses from frame to frame. Frames are stored back to
+// back, 8-bit, zero outside the sector.
+std::vector<uint8_t> ultrasoundFrames(uint64_t seed, int width, int height, int frames);
+
+// One axial CT slice in Hounsfield units: body outline, lungs, heart,
+// vertebra and table, varying smoothly with `slice` over the volume of
+// `slices`, plus acquisition noise. Values are clamped to [-1024, 3071].
+std::vector<int16_t> ctSlice(uint64_t seed, int size, int slice, int slices);
+
+} // namespace synthetic